@@ -22,7 +22,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include <iostream>
 #include <map>
+#include <csignal>
+#include <pthread.h>
 #include <rte_ether.h>
+#include "ddTuning.h"
+#include "ddConfig.h"
 
 
 
@@ -32,22 +36,52 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 //Size of the data buffer in each mbuf
 #define MBUF_DATA_SZ            (MAX_PACKET_SZ + RTE_PKTMBUF_HEADROOM)
 
+// Frames up to this size are copied into mbufs of the small size class
+// after RX, with tail room for the crypto padding and digest
+#define SMALL_PACKET_SZ         256
+#define MBUF_SMALL_DATA_SZ      (SMALL_PACKET_SZ + 64 + RTE_PKTMBUF_HEADROOM)
+
 // Number of mbufs in mempool that is created
 #define NB_MBUF                 (8192 * 16)
 
-// How many packets to attempt to read from NIC in one go
+// How many packets to attempt to read from NIC in one go (default, see ddTuning)
 #define PKT_BURST_SZ            32
 
-// How many objects (mbufs) to keep in per-lcore mempool cache
+// How many objects (mbufs) to keep in per-lcore mempool cache (default)
 #define MEMPOOL_CACHE_SZ        256
 
-#define MAX_PKT_BURST           32
-#define BURST_TX_DRAIN_US       100 // TX drain every ~100us
+// Upper bound of the runtime burst sizes
+#define MAX_PKT_BURST           64
+#define BURST_TX_DRAIN_US       100 // TX drain every ~100us (default)
 #define MEMPOOL_CACHE_SIZE      256
 
 #define DATADIODE_TUNNEL_ETHTYPE    (0x4004)
+#define DATADIODE_COMP_ETHTYPE      (0x4005)  // payload behind compression header
+#define DATADIODE_FILE_ETHTYPE      (0x4006)  // file transfer segment
+#define DATADIODE_HEARTBEAT_ETHTYPE (0x4007)  // link health heartbeat
+#define DATADIODE_QUALIFY_ETHTYPE   (0x4008)  // link qualification test frame
+#define DATADIODE_HC_REFRESH_ETHTYPE (0x4009) // header compression context refresh
+#define DATADIODE_HC_ETHTYPE        (0x400A)  // inner frame with compressed headers
+
+// Diode instances in one process, see ddInstance
+#define DD_MAX_INSTANCES            8
 
 class ddPort;
+class ddCrypto;
+class ddCompress;
+class ddCapture;
+class ddSpill;
+class ddFileTx;
+class ddFileRx;
+class ddTopTalkers;
+class ddHeartbeat;
+class ddQualify;
+class ddHandoff;
+class ddTrace;
+class ddHdrComp;
+class ddEventDev;
+class ddStatsExport;
+class ddInstance;
 typedef std::map<int, ddPort*> ddPortMap;
 
 class dataDiodeApp
@@ -69,6 +103,20 @@ public:
         uint32_t rxPortList[MAX_RX_QUEUE_PER_LCORE];
     } __rte_cache_aligned;
 
+// Bursts of 0, 1, 2-3, 4-7, 8-15, 16-31, 32-63 and 64 or more packets
+#define BURST_HIST_SZ 8
+
+    // Cycle accounting of a forwarding lcore, written by that lcore only
+    struct lcoreCycles {
+        uint64_t rx;            // polls that returned packets
+        uint64_t tx;            // TX drain
+        uint64_t stats;         // printing statistics
+        uint64_t idle;          // polls that returned nothing
+        uint64_t pkts;
+        uint64_t burstHist[BURST_HIST_SZ];
+        volatile bool inStats;  // not expected to advance the heartbeat
+    } __rte_cache_aligned;
+
 private:
     dataDiodeApp();
     dataDiodeApp(const dataDiodeApp &obj);
@@ -76,33 +124,119 @@ private:
     // signal handler for app
     static void sigHandler(int sigNumber)
     {
+        if (SIGHUP == sigNumber) {
+            _reloadRequested = true;
+            return;
+        }
         std::cout << "Caught interrupt: " << sigNumber << " Quitting..." << std::endl;
         _forceQuit = true;
     }
 
+    // Quiescent state of a forwarding lcore, cnt advances after every
+    // iteration of the main loop in which no config snapshot is held
+    struct lcoreQs_ {
+        volatile uint64_t cnt;
+        volatile bool online;
+    } __rte_cache_aligned;
+
     static dataDiodeApp *_appPtr;
     volatile static bool _forceQuit;
+    volatile static bool _reloadRequested;
 
+    // the diode of the command line, unless instances.conf is used
     volatile PortMode _corePortMode;
 #ifndef _DD_TESTMODE_
-    ddPort *_corePort;
     int _corePortId;
-    struct ether_addr _peerCorePortEthAddr;
 #else
-    ddPort *_corePort[2];
     int _corePortId[2];
-    struct ether_addr _peerCorePortEthAddr[2];
 #endif
-
-    ddPort *_accessPort;
     uint64_t _userPortMask;
-    ddPortMap _pMap;
-    struct rte_mempool *_pktMbufPool;
     uint32_t _nbMbufs;
+
+    bool _instancesConf;
+    ddInstance *_instances[DD_MAX_INSTANCES];
+    uint32_t _nInstances;
+    ddInstance *_portInstance[RTE_MAX_ETHPORTS];
+    ddPortMap _pMap;
+    struct rte_mempool *_smallMbufPool;
+    uint32_t _nbSmallMbufs;
     struct lcoreQueueConf _lcoreQueueConf[RTE_MAX_LCORE];
-    uint16_t _sId;
-    uint16_t _peerSId;
     uint64_t _timerPeriod;
+    uint32_t _rxQueuePerLcore;
+    bool showEthStats;
+    ddCrypto *_crypto;
+    ddCompress *_compress;
+    ddCapture *_capture;
+    ddSpill *_spill;
+    uint64_t _spillLastTsc;
+    uint64_t _spillLastSpilled;
+    uint64_t _spillLastDrained;
+    ddFileTx *_fileTx;
+    ddFileRx *_fileRx;
+    ddTopTalkers *_topTalkers;
+    ddHeartbeat *_heartbeat;
+    ddQualify *_qualify;
+    ddHandoff *_handoff;
+    ddTrace *_trace;
+    ddHdrComp *_hdrComp;
+    uint8_t _shedPct[DD_SHED_CLASSES];          // RX ring fill shedding a class
+    bool _takeover;
+    ddEventDev *_eventDev;
+    ddStatsExport *_statsExport;
+    ddTuning _tuning;
+    const char *_tuningFile;
+    bool _autotune;
+    struct lcoreQs_ _lcoreQs[RTE_MAX_LCORE];
+    pthread_t _configThread;
+    pthread_t _linkThread;
+    volatile uint32_t _configGeneration;
+    uint64_t _configReloads;
+    uint64_t _configReloadErrors;
+    struct lcoreCycles _lcoreCycles[RTE_MAX_LCORE];
+    struct lcoreCycles _lcoreCyclesLast[RTE_MAX_LCORE];
+    pthread_t _watchdogThread;
+    uint32_t _watchdogMs;
+    uint64_t _lcoreStalls[RTE_MAX_LCORE];
+    bool _scale;
+    pthread_t _scaleThread;
+    // lcore polling each port, changed by that lcore only
+    volatile int _portOwner[RTE_MAX_ETHPORTS];
+    // lcore a port is to be handed over to, -1 if none is pending
+    volatile int _portHandover[RTE_MAX_ETHPORTS];
+    volatile bool _lcoreParked[RTE_MAX_LCORE];
+    uint64_t _lcoreParks[RTE_MAX_LCORE];
+    uint64_t _portMoves;
+
+    // ports are configured and started in parallel, links awaited jointly
+    static void* portInitMain(void *arg);
+    void startPorts();
+    // link state changes are followed on a control thread
+    static void* linkMain(void *arg);
+    void linkLoop();
+
+    // config reload runs on a control thread
+    static void* configMain(void *arg);
+    void configLoop();
+    void reloadConfig();
+    // wait until every forwarding lcore passed a quiescent state, false
+    // if the wait was cut short by quitting
+    bool synchronize();
+
+    // watchdog checks the heartbeat (quiescent state counter) of the
+    // forwarding lcores on a control thread
+    static void* watchdogMain(void *arg);
+    void watchdogLoop();
+
+    // scaler moves ports between lcores by their measured load
+    static void* scaleMain(void *arg);
+    void scaleLoop();
+    // hand over ports the scaler moved away, park if none is left
+    void handoverPorts(uint32_t lcoreId);
+    uint32_t ownedPorts(uint32_t lcoreId) const;
+    // an lcore is done with the main loop, the last one hands the ports off
+    void leaveLoop();
+    // the access ports forwarding to the core port are polled by one lcore
+    bool accessPortsOnOneLcore() const;
 
 protected:
 
@@ -117,14 +251,6 @@ public:
     // member function to cleanup the application before exiting
     void cleanup();
 
-#ifndef _DD_TESTMODE_
-    // member function to configure parameters
-    void configure(struct ether_addr* peerMac, uint16_t peerSId, uint16_t sId);
-#else
-    // member function to configure parameters
-    void configure(struct ether_addr* peerMac, struct ether_addr* peerMac1, uint16_t peerSId, uint16_t sId);
-#endif
-
     static dataDiodeApp& instance()
     {
         if (NULL == _appPtr) {
@@ -136,28 +262,121 @@ public:
     // Print out statistics on packets dropped
     void printStats();
 
+    // Print out statistics reported by the ethernet devices
+    void printEthStats();
+
+    // Print out statistics of the payload crypto stage
+    void printCryptoStats();
+
+    // Print out statistics of the payload compression stage
+    void printCompressStats();
+
+    // Print out statistics of the capture tap
+    void printCaptureStats();
+
+    // Print out occupancy and rates of the spill queue
+    void printSpillStats();
+
+    // Print out statistics of the file transfer
+    void printFileStats();
+
+    // Print out the heavy hitters of the access ports
+    void printTopTalkers();
+
+    // Print out busy time, cycles per packet and burst sizes per lcore
+    void printLcoreStats();
+
+    // Print out the counters of the authorized senders
+    void printSenderStats();
+
+    // Print out core link heartbeats and link changes
+    void printHeartbeatStats();
+
+    // Print out the progress and results of the link qualification
+    void printQualifyStats();
+
+    // Print out the frames sent and rebuilt by the header compression
+    void printHdrCompStats();
+
+    // Print out the frames shed by class next to the NIC misses
+    void printShedStats();
+
+    // Print out the traffic and mbufs of each diode instance
+    void printInstanceStats();
+
+    // Print out the occupancy and memory of the mbuf size classes
+    void printMempoolStats();
+
+    // Print out per lcore work and RX to TX latency of the event mode
+    void printEventStats();
+
     // Display usage
     void usage(const char *prgName);
 
     // accessors
     bool forceQuit() { return _forceQuit; }
-    struct rte_mempool* pktMbufPool() { return _pktMbufPool; }
+    void quit() { _forceQuit = true; }
+    // Diode instances, the accessors below that do not take a port are
+    // those of the first one. The optional stages serve a single diode.
+    uint32_t nInstances() const { return _nInstances; }
+    ddInstance* diode(uint32_t i) const { return _instances[i]; }
+    // NULL if no instance owns the port
+    ddInstance* portInstance(uint16_t portId) const
+    {
+        return portId < RTE_MAX_ETHPORTS ? _portInstance[portId] : NULL;
+    }
+    struct rte_mempool* pktMbufPool() const;
+    // NULL unless the small size class is enabled
+    struct rte_mempool* smallMbufPool() { return _smallMbufPool; }
+    // hugepage memory held by the objects of a mempool
+    static uint64_t mempoolBytes(const struct rte_mempool *pool);
 #ifndef _DD_TESTMODE_
-    ddPort* corePort() const { return _corePort; }
+    ddPort* corePort() const;
     const struct ether_addr* corePortEthAddr() const;
-    const struct ether_addr* peerCorePortEthAddr() { return &_peerCorePortEthAddr; }
 #else
-    ddPort* corePort(PortMode mode = PORTMODE_TX) const { return mode == PORTMODE_RX? _corePort[0] : _corePort[1]; }
+    ddPort* corePort(PortMode mode = PORTMODE_TX) const;
     const struct ether_addr* corePortEthAddr(uint16_t portId) const;
-    const struct ether_addr* peerCorePortEthAddr(uint16_t idx) { return &_peerCorePortEthAddr[idx]; }
 #endif
-    ddPort* accessPort() const { return _accessPort; }
+    // Current config snapshot. Valid until the calling lcore returns to
+    // the main loop, read it once per burst.
+    const ddConfig* config() const;
+    // safe to call from threads that are not forwarding lcores
+    uint32_t configGeneration() const { return _configGeneration; }
+    uint64_t configReloads() const { return _configReloads; }
+    uint64_t configReloadErrors() const { return _configReloadErrors; }
+    ddPort* accessPort() const;
+    // access port portId of any instance, NULL if it is not one
+    ddPort* egressPort(uint16_t portId) const;
+    struct ddSenderStats_* senderStats(uint16_t slot);
+    const ddPortMap& portMap() const { return _pMap; }
+    const ddTuning& tuning() const { return _tuning; }
+    const struct lcoreCycles* lcoreCycles(uint32_t lcoreId) const { return &_lcoreCycles[lcoreId]; }
+    uint64_t lcoreStalls(uint32_t lcoreId) const { return _lcoreStalls[lcoreId]; }
+    bool scale() const { return _scale; }
+    int portOwner(uint16_t portId) const { return _portOwner[portId]; }
+    bool lcoreParked(uint32_t lcoreId) const { return _lcoreParked[lcoreId]; }
+    uint64_t lcoreParks(uint32_t lcoreId) const { return _lcoreParks[lcoreId]; }
+    uint64_t portMoves() const { return _portMoves; }
+    // only while no forwarding lcore is running (autotune)
+    void setTuning(const ddTuning &tuning) { _tuning = tuning; }
+    ddCrypto* crypto() const { return _crypto; }
+    ddCompress* compress() const { return _compress; }
+    ddCapture* capture() const { return _capture; }
+    ddSpill* spill() const { return _spill; }
+    ddFileTx* fileTx() const { return _fileTx; }
+    ddFileRx* fileRx() const { return _fileRx; }
+    ddTopTalkers* topTalkers() const { return _topTalkers; }
+    ddHeartbeat* heartbeat() const { return _heartbeat; }
+    ddQualify* qualify() const { return _qualify; }
+    ddHandoff* handoff() const { return _handoff; }
+    // NULL when the flight recorder is off
+    ddTrace* trace() const { return _trace; }
+    ddHdrComp* hdrComp() const { return _hdrComp; }
+    ddEventDev* eventDev() const { return _eventDev; }
 #ifndef _DD_TESTMODE_
     const uint16_t corePortId() const { return _corePortId; }
 #endif
-    const PortMode corePortMode() const { return _corePortMode; }
-    const uint16_t sId() const { return _sId; }
-    const uint16_t peerSId() const { return _peerSId; }
+    const PortMode corePortMode() const;
 };
 
 
@@ -0,0 +1,82 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDAUTOTUNE_H__
+#define __DDAUTOTUNE_H__
+
+#include <map>
+#include <string>
+#include <rte_mbuf.h>
+#include "ddTuning.h"
+
+
+// Duration of a single trial
+#define DD_TUNE_TRIAL_MS            2000
+
+// Passes over all parameters, each pass sweeps one parameter at a time
+#define DD_TUNE_ROUNDS              2
+
+// Size of the synthetic inner frames, without FCS
+#define DD_TUNE_FRAME_LEN           60
+
+// Synthetic frames per pool, one pool per mempool cache size
+#define DD_TUNE_NB_MBUF             8191
+
+// A result within this fraction of the best throughput is a tie,
+// decided by the lower latency
+#define DD_TUNE_TIE                 0.01
+
+class ddPort;
+
+// Sweeps the ddTuning parameters with synthetic frames fed to the
+// forwarding path of the configured role: frames enter processBurst() of
+// the ingress port and leave on the egress port NIC. The best
+// configuration is written to the tuning file for the next start.
+class ddAutotune
+{
+private:
+    struct result_ {
+        double    mpps;         // frames handed to the egress NIC
+        double    dropRate;     // generated frames that did not make it
+        double    latencyUs;    // average residency in the egress TX buffer
+    };
+
+    std::string _tuningFile;
+    ddPort *_ingress;
+    ddPort *_egress;
+    uint8_t _frame[128];
+    uint16_t _frameLen;
+    std::map<uint32_t, struct rte_mempool *> _pools;
+
+    void buildFrame();
+    struct rte_mempool* pool(uint32_t cacheSz);
+    void apply(const ddTuning &tuning, const ddTuning &current);
+    struct result_ trial(const ddTuning &tuning);
+    bool better(const struct result_ &res, const struct result_ &best) const;
+
+public:
+    ddAutotune(const char *tuningFile);
+    virtual ~ddAutotune() {}
+
+    // run the sweep on the calling lcore and save the best tuning
+    void run();
+};
+
+
+#endif // __DDAUTOTUNE_H__
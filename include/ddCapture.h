@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDCAPTURE_H__
+#define __DDCAPTURE_H__
+
+#include <string>
+#include <pthread.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_lcore.h>
+
+
+// Number of captured frames that can wait for the writer thread
+#define DD_CAPTURE_RING_SZ          4096
+
+// Number of mbufs holding copies of captured frames
+#define DD_CAPTURE_NB_MBUF          8191
+#define DD_CAPTURE_POOL_CACHE_SZ    64
+
+// Bytes of each frame stored in the capture
+#define DD_CAPTURE_SNAPLEN          256
+
+// Writer thread collects records in a buffer of this size before writing
+#define DD_CAPTURE_WRITE_BUF_SZ     (4 * 1024 * 1024)
+
+// Capture files are rotated at this size, and only the newest are kept
+#define DD_CAPTURE_FILE_SZ          (64 * 1024 * 1024)
+#define DD_CAPTURE_NB_FILES         8
+
+#define DD_CAPTURE_DIR              "/var/log/dataDiodeApp"
+
+class ddCapture
+{
+public:
+    enum Mode {
+        MODE_REJECTED,      // Frames dropped by validation only
+        MODE_SAMPLE,        // Rejected frames and one in N forwarded frames
+        MODE_ALL,           // Every frame crossing the diode and every reject
+        MODE_INVALID        // Always a last entry
+    };
+
+    enum Reason {
+        REASON_FORWARDED,
+        REASON_BAD_DST_ADDR,
+        REASON_BAD_SRC_ADDR,
+        REASON_BAD_ETH_TYPE,
+        REASON_BAD_SID,
+        REASON_WRONG_DIRECTION,
+        REASON_MAX          // Always a last entry
+    };
+
+private:
+    // Stored in the headroom of the copy, in front of the captured bytes
+    struct meta_ {
+        uint64_t  tsc;
+        uint32_t  origLen;
+        uint16_t  portId;
+        uint16_t  reason;
+    };
+
+    // Updated by the dataplane lcores only, one per lcore
+    struct lcoreStats_ {
+        uint64_t  captured;
+        uint64_t  ringFull;
+        uint64_t  noMbuf;
+        uint64_t  sampleCnt;
+    } __rte_cache_aligned;
+
+    Mode _mode;
+    uint32_t _sampleRate;
+    std::string _dir;
+    struct rte_mempool *_pool;
+    struct rte_ring *_ring;
+    pthread_t _writerThread;
+    volatile bool _stop;
+    struct lcoreStats_ _lcoreStats[RTE_MAX_LCORE];
+
+    // writer thread state
+    int _fd;
+    uint32_t _fileIdx;
+    uint64_t _fileSz;
+    uint8_t *_writeBuf;
+    uint32_t _writeLen;
+    uint64_t _tscBase;
+    uint64_t _nsBase;
+    uint64_t _written;
+    uint64_t _bytesWritten;
+    uint64_t _writeErrors;
+    uint64_t _rotations;
+
+    static void* writerMain(void *arg);
+    void writerLoop();
+    void openFile();
+    void flush();
+    void append(const void *data, uint32_t len);
+    void writeRecord(struct rte_mbuf *pkt);
+
+public:
+    ddCapture(Mode mode, uint32_t sampleRate, const char *dir = DD_CAPTURE_DIR);
+    virtual ~ddCapture() {}
+
+    // parse "rejected", "all" or "sample:N"
+    static bool parseMode(const char *arg, Mode *mode, uint32_t *sampleRate);
+    static const char* reasonName(Reason reason);
+
+    // create pool and ring, start the writer thread
+    void initialize();
+
+    // stop the writer thread and flush what is pending
+    void cleanup();
+
+    // Copy the frame into the capture ring if selected, never blocking.
+    // The frame itself is left untouched.
+    inline void tap(struct rte_mbuf *pkt, uint16_t portId, Reason reason)
+    {
+        if (REASON_FORWARDED == reason && MODE_ALL != _mode) {
+            if (MODE_REJECTED == _mode)
+                return;
+            if (++_lcoreStats[rte_lcore_id()].sampleCnt % _sampleRate)
+                return;
+        }
+        copy(pkt, portId, reason);
+    }
+    void copy(struct rte_mbuf *pkt, uint16_t portId, Reason reason);
+
+    const char* modeName() const;
+    Mode captureMode() const { return _mode; }
+    uint32_t sampleRate() const { return _sampleRate; }
+    uint64_t captured() const;
+    uint64_t dropped() const;   // ring full or out of capture mbufs
+    uint64_t written() const { return _written; }
+    uint64_t bytesWritten() const { return _bytesWritten; }
+    uint64_t writeErrors() const { return _writeErrors; }
+    uint64_t rotations() const { return _rotations; }
+    uint32_t pending() const { return rte_ring_count(_ring); }
+};
+
+
+#endif // __DDCAPTURE_H__
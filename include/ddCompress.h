@@ -0,0 +1,148 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDCOMPRESS_H__
+#define __DDCOMPRESS_H__
+
+#include <string>
+#include <rte_mbuf.h>
+#include <rte_comp.h>
+#include <rte_compressdev.h>
+
+class ddConfig;
+
+
+// Number of compression operations in the op pool (shared by both directions)
+#define DD_COMP_NB_OPS              8192
+
+// How many compression ops to keep in per-lcore op pool cache
+#define DD_COMP_OP_CACHE_SZ         128
+
+// Max frames waiting in a direction, in order, for the compression stage
+#define DD_COMP_NB_SLOTS            4096
+
+// Frames smaller than this are not worth the effort
+#define DD_COMP_MIN_LEN             128
+
+// Name of the in-process compression engine
+#define DD_COMP_ENGINE_LZ4          "lz4"
+
+class ddCompress
+{
+public:
+    enum Direction {
+        DIR_COMPRESS,    // Tx-Only role: before encapsulation
+        DIR_DECOMPRESS,  // Rx-Only role: after validation
+        DIR_MAX          // Always a last entry
+    };
+
+    enum Algo {
+        ALGO_NONE,       // Bypassed, frame did not shrink
+        ALGO_DEFLATE,    // rte_compressdev (compress_isal, compress_zlib, ...)
+        ALGO_LZ4,        // in-process LZ4 fast path
+        ALGO_INVALID     // Always a last entry
+    };
+
+    // Header in front of every frame of a compressed channel, carried
+    // inside tunnel frames with ethertype DATADIODE_COMP_ETHTYPE
+    struct compHdr_ {
+        uint8_t           algo;         // Algo used, ALGO_NONE for bypass
+        uint8_t           reserved;
+        uint16_t          origLen;      // Length of the original inner frame
+    } __attribute__((__packed__));
+
+private:
+    // A frame in flight; frames leave the stage in the order they entered
+    struct slot_ {
+        struct rte_mbuf   *pkt;
+        uint64_t          enqTsc;
+        uint32_t          done;
+    };
+
+    struct stats_ {
+        uint64_t  in;
+        uint64_t  out;
+        uint64_t  processed;            // compressed or decompressed
+        uint64_t  bypassed;             // did not shrink or too small
+        uint64_t  dropped;              // stage full or no buffers
+        uint64_t  errors;
+        uint64_t  bytesIn;
+        uint64_t  bytesOut;
+        uint64_t  latencyCycles;        // sum over all frames leaving stage
+        uint64_t  latencyMax;
+    } __rte_cache_aligned;
+
+    struct stage_ {
+        struct slot_      *slots;
+        uint32_t          head;         // next slot to leave the stage
+        uint32_t          tail;         // next free slot
+        struct stats_     stats;
+    } __rte_cache_aligned;
+
+    std::string _engine;
+    Algo _algo;
+    int _devId;
+    struct rte_mempool *_opPool;
+    struct rte_mempool *_pktPool;
+    void *_privXform[DIR_MAX];
+    struct stage_ _stage[DIR_MAX];
+
+    void initializeDev();
+    struct rte_mbuf* allocDst(struct rte_mbuf *src, uint16_t len);
+    void complete(Direction dir, uint32_t slot, struct rte_mbuf *pkt);
+    void bypass(Direction dir, uint32_t slot, struct rte_mbuf *pkt);
+    void finishOp(Direction dir, struct rte_comp_op *op);
+    void processLz4(Direction dir, uint32_t slot, struct rte_mbuf *pkt);
+
+public:
+    ddCompress(const char *engine);
+    virtual ~ddCompress() {}
+
+    // create the stage, allocating output frames from pktPool
+    void initialize(struct rte_mempool *pktPool);
+
+    // should the inner frame be sent through the compression stage, the
+    // compressed channels are part of the reloadable configuration
+    bool channelEnabled(const ddConfig *config, struct rte_mbuf *pkt) const;
+
+    // Hand a burst to the stage. Ownership of all the packets is taken.
+    // Compress expects inner frames, decompress expects <COMPHDR|DATA>.
+    uint16_t enqueueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts);
+
+    // Collect finished frames in order without waiting. Compressed frames
+    // are returned as <COMPHDR|DATA>, decompressed ones as inner frames.
+    uint16_t dequeueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts);
+
+    const char* engine() const { return _engine.c_str(); }
+    static const char* dirName(Direction dir);
+    uint64_t in(Direction dir) const { return _stage[dir].stats.in; }
+    uint64_t processed(Direction dir) const { return _stage[dir].stats.processed; }
+    uint64_t bypassed(Direction dir) const { return _stage[dir].stats.bypassed; }
+    uint64_t dropped(Direction dir) const { return _stage[dir].stats.dropped; }
+    uint64_t errors(Direction dir) const { return _stage[dir].stats.errors; }
+    uint64_t inFlight(Direction dir) const { return _stage[dir].tail - _stage[dir].head; }
+    // uncompressed over compressed bytes of all frames handled
+    double ratio(Direction dir) const;
+    // average and maximum time spent in the stage in micro seconds
+    double avgLatencyUs(Direction dir) const;
+    double maxLatencyUs(Direction dir) const;
+};
+
+
+#endif // __DDCOMPRESS_H__
@@ -0,0 +1,207 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDCONFIG_H__
+#define __DDCONFIG_H__
+
+#include <rte_ether.h>
+#include <rte_hash.h>
+#include <rte_mbuf.h>
+
+
+// configuration file names are hardcoded for security purposes, they are
+// read from DD_CONFIG_DIR or from the directory of a diode instance in it
+#define DD_CONFIG_DIR               "/etc/dataDiodeApp"
+#define DD_CONFIG_SID_FILE          "sid.conf"
+#define DD_CONFIG_PEER_SID_FILE     "peerSid.conf"
+#define DD_CONFIG_PEER_MAC_FILE     "peerMac.conf"
+#define DD_CONFIG_PEER_MAC1_FILE    "peerMac1.conf"
+#define DD_CONFIG_COMPRESS_FILE     "compress.conf"
+#define DD_CONFIG_SENDERS_FILE      "senders.conf"
+#define DD_CONFIG_REWRITE_FILE      "rewrite.conf"
+#define DD_CONFIG_PRIORITY_FILE     "priority.conf"
+
+// Upper bound of authorized Tx-Only senders. Counters of a sender keep
+// their slot across reloads, a new sender never takes a slot the
+// previous snapshot still uses, hence twice as many slots.
+#define DD_MAX_SENDERS              512
+#define DD_SENDER_SLOTS             (2 * DD_MAX_SENDERS)
+
+// Egress of a sender without a port, the first access port
+#define DD_SENDER_DEFAULT_PORT      0xFFFF
+
+// An authorized Tx-Only sender of the Rx-Only role
+struct ddSender_ {
+    struct ether_addr mac;
+    uint16_t  sId;          // network byte order, as in the tunnel header
+    uint16_t  portId;       // egress access port
+    uint16_t  vlan;         // VLAN tag added to its inner frames, 0 for none
+    uint16_t  slot;         // index of its counters
+    bool      isNew;        // slot was not used by the previous snapshot
+};
+
+// Counters of a sender, updated by the Rx-Only core lcore
+struct ddSenderStats_ {
+    uint64_t  rxPkts;
+    uint64_t  rxBytes;
+    uint64_t  badSId;
+    uint64_t  txPkts;
+} __rte_cache_aligned;
+
+// Upper bound of address rewrite rules of the Rx-Only role
+#define DD_MAX_REWRITES             1024
+
+// Exact match of a rewrite rule, the inner destination address and,
+// unless 0, the UDP destination port. IPv4 addresses use the first 4 bytes.
+struct ddRewriteKey_ {
+    uint8_t   family;       // 4 or 6
+    uint8_t   pad;
+    uint16_t  dstPort;      // network byte order
+    uint8_t   dstAddr[16];
+} __attribute__((__packed__));
+
+// Rewrite of the inner frames matching key on their way to network B
+struct ddRewrite_ {
+    struct ddRewriteKey_ key;
+    struct ether_addr dMac;
+    struct ether_addr sMac;
+    uint8_t   dstAddr[16];
+    uint16_t  dstPort;      // network byte order
+    bool      setDMac;
+    bool      setSMac;      // egress port address otherwise
+    bool      setAddr;
+    bool      setPort;
+};
+
+// Classes an overloaded access port sheds frames by, class 0 is never
+// shed and the highest class goes first
+#define DD_SHED_CLASSES             4
+
+// Sender of a decapsulated frame, kept in mbuf udata64 so that it survives
+// the crypto and compression stages and a config reload in between
+#define DD_SENDER_TAG_VALID         (1ULL << 63)
+
+static inline uint64_t
+ddSenderTag(const struct ddSender_ *sender)
+{
+    return DD_SENDER_TAG_VALID | ((uint64_t)sender->slot << 32) |
+           ((uint64_t)sender->portId << 16) | sender->vlan;
+}
+static inline uint16_t ddSenderTagSlot(uint64_t tag) { return (tag >> 32) & 0xFFFF; }
+static inline uint16_t ddSenderTagPort(uint64_t tag) { return (tag >> 16) & 0xFFFF; }
+static inline uint16_t ddSenderTagVlan(uint64_t tag) { return tag & 0xFFFF; }
+
+// Immutable snapshot of the reloadable configuration. Forwarding lcores
+// read the snapshot published by dataDiodeApp without taking any lock; a
+// reload builds a new snapshot and the old one is freed only after every
+// lcore went through a quiescent state.
+class ddConfig
+{
+private:
+    uint32_t _generation;
+    uint16_t _instance;     // diode instance the snapshot belongs to
+    uint16_t _sId;
+    uint16_t _peerSId;
+    struct ether_addr _peerCorePortEthAddr[2];  // second one in test mode only
+    uint8_t _compChannels[65536 / 8];           // bitmap of inner L4 dst ports
+    bool _compAllChannels;
+    uint8_t _shedClasses[65536 / 4];            // 2 bits per inner L4 dst port
+    uint8_t _shedDefault;                       // of frames other than TCP/UDP
+    struct ddSender_ _senders[DD_MAX_SENDERS];
+    uint32_t _nSenders;
+    bool _sendersFile;
+    struct rte_hash *_senderHash;   // source MAC to index in _senders
+    struct ddRewrite_ _rewrites[DD_MAX_REWRITES];
+    uint32_t _nRewrites;
+    struct rte_hash *_rewriteHash;  // ddRewriteKey_ to index in _rewrites
+
+    ddConfig();
+    ddConfig(const ddConfig &obj);
+
+    static bool readId(const char *path, uint16_t *id);
+    static bool readMac(const char *path, struct ether_addr *mac);
+    void readCompChannels(const char *path);
+    void readShedClasses(const char *path);
+    bool readSenders(const char *path);
+    void assignSlots(const ddConfig *prev);
+    bool createSenderHash();
+    bool sendersDiffer(const ddConfig *other) const;
+    bool readRewrites(const char *path);
+    bool createRewriteHash();
+
+public:
+    ~ddConfig();
+
+    // Build a snapshot of diode instance from the configuration files in
+    // dir, NULL if any of the mandatory files is missing or malformed.
+    // Sender counter slots are inherited from prev. Needs the EAL for the
+    // sender table.
+    static ddConfig* load(const char *dir, uint16_t instance, uint32_t generation,
+                          const ddConfig *prev = NULL);
+
+    // does the snapshot differ from another one in anything but generation
+    bool differs(const ddConfig *other) const;
+
+    uint32_t generation() const { return _generation; }
+    uint16_t sId() const { return _sId; }
+    uint16_t peerSId() const { return _peerSId; }
+    const struct ether_addr* peerCorePortEthAddr(uint16_t idx = 0) const
+    {
+        return &_peerCorePortEthAddr[idx];
+    }
+    // should frames to inner L4 destination port be compressed
+    bool compChannel(uint16_t dstPort) const
+    {
+        return _compAllChannels ||
+               0 != (_compChannels[dstPort / 8] & (1 << (dstPort % 8)));
+    }
+    bool compAllChannels() const { return _compAllChannels; }
+    // inner L4 destination port of a TCP or UDP frame, false for others
+    static bool innerDstPort(const struct rte_mbuf *pkt, uint16_t *dstPort);
+    // class a frame is shed by, from its inner L4 destination port
+    uint8_t shedClass(const struct rte_mbuf *pkt) const
+    {
+        uint16_t dstPort;
+        if (!innerDstPort(pkt, &dstPort))
+            return _shedDefault;
+        return (_shedClasses[dstPort / 4] >> (2 * (dstPort % 4))) & 0x3;
+    }
+
+    // Look up the senders of a burst by source MAC, bit i of hitMask is
+    // set when keys[i] is known and idx[i] is then its index
+    int lookupSenders(const void **keys, uint32_t n, uint64_t *hitMask, void **idx) const
+    {
+        return rte_hash_lookup_bulk_data(_senderHash, keys, n, hitMask, idx);
+    }
+    const struct ddSender_* sender(uint32_t idx) const { return &_senders[idx]; }
+    uint32_t nSenders() const { return _nSenders; }
+    // senders come from senders.conf, not from the peer MAC and SID
+    bool sendersFile() const { return _sendersFile; }
+
+    // Look up the rewrite rules of a burst, as lookupSenders
+    int lookupRewrites(const void **keys, uint32_t n, uint64_t *hitMask, void **idx) const
+    {
+        return rte_hash_lookup_bulk_data(_rewriteHash, keys, n, hitMask, idx);
+    }
+    const struct ddRewrite_* rewrite(uint32_t idx) const { return &_rewrites[idx]; }
+    uint32_t nRewrites() const { return _nRewrites; }
+};
+
+
+#endif // __DDCONFIG_H__
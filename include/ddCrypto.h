@@ -0,0 +1,141 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDCRYPTO_H__
+#define __DDCRYPTO_H__
+
+#include <string>
+#include <rte_mbuf.h>
+#include <rte_crypto.h>
+#include <rte_cryptodev.h>
+
+
+// Number of crypto operations in the op pool (shared by both directions)
+#define DD_CRYPTO_NB_OPS            8192
+
+// Number of descriptors in each cryptodev queue pair
+#define DD_CRYPTO_NB_DESC           2048
+
+// How many crypto ops to keep in per-lcore op pool cache
+#define DD_CRYPTO_OP_CACHE_SZ       128
+
+#define DD_CRYPTO_IV_LEN            16
+#define DD_CRYPTO_CIPHER_KEY_LEN    16
+#define DD_CRYPTO_AUTH_KEY_LEN      32
+#define DD_CRYPTO_DIGEST_LEN        32
+
+// Location of the crypto keys, hardcoded like other configurations
+#define DD_CRYPTO_KEY_FILE          "/etc/dataDiodeApp/crypto.key"
+
+class ddCrypto
+{
+public:
+    enum Direction {
+        DIR_ENCRYPT,     // Tx-Only role: access port -> core port
+        DIR_DECRYPT,     // Rx-Only role: core port -> access port
+        DIR_MAX          // Always a last entry
+    };
+
+    enum Algo {
+        ALGO_NULL,               // crypto_null PMD, no confidentiality
+        ALGO_AES_CBC_HMAC_SHA256,  // crypto_openssl, crypto_armv8, ...
+        ALGO_INVALID             // Always a last entry
+    };
+
+    // Header carried between the tunnel header and the encrypted inner frame
+    // <TUNNELHDR 16B|IV 16B|INNERLEN 2B|CIPHERTEXT|DIGEST>
+    // The IV and inner frame length are authenticated but not encrypted
+    struct cryptoHdr_ {
+        uint8_t           iv[DD_CRYPTO_IV_LEN];
+        uint16_t          innerLen;     // Length of inner frame before padding
+    } __attribute__((__packed__));
+
+private:
+    // Per crypto op private data, placed right after the symmetric op
+    struct opPriv_ {
+        uint8_t           iv[DD_CRYPTO_IV_LEN];
+        uint64_t          enqTsc;       // TSC at enqueue for latency
+    };
+
+    struct stats_ {
+        uint64_t  enqueued;
+        uint64_t  dequeued;
+        uint64_t  enqDropped;           // qp full or no free crypto op
+        uint64_t  authFailed;
+        uint64_t  opFailed;
+        uint64_t  badLen;
+        uint64_t  latencyCycles;        // sum over all dequeued ops
+        uint64_t  latencyMax;
+    } __rte_cache_aligned;
+
+    std::string _devName;
+    int _devId;
+    Algo _algo;
+    uint16_t _blockSz;
+    uint16_t _digestLen;
+    uint8_t _cipherKey[DD_CRYPTO_CIPHER_KEY_LEN];
+    uint8_t _authKey[DD_CRYPTO_AUTH_KEY_LEN];
+    struct rte_mempool *_opPool;
+    struct rte_mempool *_sessPool;
+    struct rte_cryptodev_sym_session *_sess[DIR_MAX];
+    struct stats_ _stats[DIR_MAX];
+    uint64_t _ivSeq;
+
+    void createSession(Direction dir);
+    bool prepareOp(Direction dir, struct rte_crypto_op *op, struct rte_mbuf *pkt);
+
+public:
+    ddCrypto(const char *devName, Algo algo);
+    virtual ~ddCrypto() {}
+
+    static Algo parseAlgo(const char *name);
+    static const char* dirName(Direction dir);
+
+    // read keys from DD_CRYPTO_KEY_FILE, exits the application on failure
+    void loadKeys(const char *path = DD_CRYPTO_KEY_FILE);
+
+    // configure and start the cryptodev, one queue pair per direction
+    void initialize();
+
+    // Hand a burst of tunnel frames to the cryptodev. Ownership of all the
+    // packets is taken; the ones that could not be enqueued are freed.
+    // Encrypt expects <TUNNELHDR|CRYPTOHDR|INNER>, decrypt expects a
+    // validated frame as received on the core port.
+    uint16_t enqueueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts);
+
+    // Collect finished frames without waiting. Encrypted frames are ready
+    // for the core port, decrypted frames are returned as <TUNNELHDR|INNER>.
+    uint16_t dequeueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts);
+
+    const char* devName() const { return _devName.c_str(); }
+    const char* algoName() const;
+    uint16_t hdrLen() const { return sizeof(struct cryptoHdr_); }
+    uint64_t enqueued(Direction dir) const { return _stats[dir].enqueued; }
+    uint64_t dequeued(Direction dir) const { return _stats[dir].dequeued; }
+    uint64_t inFlight(Direction dir) const { return _stats[dir].enqueued - _stats[dir].dequeued; }
+    uint64_t enqDropped(Direction dir) const { return _stats[dir].enqDropped; }
+    uint64_t authFailed(Direction dir) const { return _stats[dir].authFailed; }
+    uint64_t opFailed(Direction dir) const { return _stats[dir].opFailed + _stats[dir].badLen; }
+    // average and maximum enqueue to dequeue latency in micro seconds
+    double avgLatencyUs(Direction dir) const;
+    double maxLatencyUs(Direction dir) const;
+};
+
+
+#endif // __DDCRYPTO_H__
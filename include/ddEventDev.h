@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDEVENTDEV_H__
+#define __DDEVENTDEV_H__
+
+#include <string>
+#include <rte_mbuf.h>
+#include <rte_lcore.h>
+#include <rte_eventdev.h>
+
+class ddPort;
+
+
+// Event queues of the pipeline
+#define DD_EVENT_Q_WORK             0   // validation, encapsulation, decapsulation
+#define DD_EVENT_Q_TX               1   // transmit, flow is the egress port
+#define DD_EVENT_NB_QUEUES          2
+
+// Atomic flows per queue, frames are hashed onto 20 bit flow ids
+#define DD_EVENT_NB_FLOWS           1024
+#define DD_EVENT_FLOW_MASK          0xFFFFF
+
+// Upper bound of events in flight
+#define DD_EVENT_LIMIT              4096
+
+// Scheduled worker mode. Lcores that own a port inject its bursts into
+// an event device as new events; all other lcores are workers. Frames
+// are scheduled atomically by flow onto the workers for the port work,
+// then atomically by egress port for transmission, which keeps the
+// order of every flow and lets one worker at a time use a TX queue.
+class ddEventDev
+{
+public:
+    struct lcoreStats_ {
+        uint64_t  rx;           // injected as new events
+        uint64_t  rxDropped;    // event device full
+        uint64_t  worked;
+        uint64_t  tx;
+        uint64_t  txDropped;
+        uint64_t  latencyTsc;   // RX to TX of the transmitted frames
+        uint64_t  latencyMaxTsc;
+    } __rte_cache_aligned;
+
+private:
+    std::string _devName;
+    uint8_t _devId;
+    uint32_t _serviceId;
+    bool _hasService;
+    int _evPort[RTE_MAX_LCORE];
+    bool _worker[RTE_MAX_LCORE];
+    uint32_t _nWorkers;
+    ddPort *_ports[RTE_MAX_ETHPORTS];
+    // the ports each lcore polls, as assigned by dataDiodeApp
+    ddPort *_rxPorts[RTE_MAX_LCORE][RTE_MAX_ETHPORTS];
+    uint16_t _nRxPorts[RTE_MAX_LCORE];
+    struct lcoreStats_ _stats[RTE_MAX_LCORE];
+
+    static uint32_t flowHash(const struct rte_mbuf *pkt);
+    uint32_t inject(uint32_t lcoreId, ddPort *port);
+    uint32_t work(uint32_t lcoreId);
+    void transmit(struct lcoreStats_ *stats, struct rte_event *ev, uint32_t nEv);
+
+public:
+    ddEventDev(const char *devName);
+    virtual ~ddEventDev() {}
+
+    // configure and start the event device for the lcores and ports
+    void initialize();
+    void cleanup();
+
+    // One iteration of an lcore, returns frames injected or worked on.
+    // The master lcore also runs the scheduler of software devices.
+    uint32_t poll(uint32_t lcoreId);
+
+    const std::string& devName() const { return _devName; }
+    bool worker(uint32_t lcoreId) const { return _worker[lcoreId]; }
+    bool rxLcore(uint32_t lcoreId) const { return _evPort[lcoreId] >= 0 && !_worker[lcoreId]; }
+    uint32_t nWorkers() const { return _nWorkers; }
+    const struct lcoreStats_* stats(uint32_t lcoreId) const { return &_stats[lcoreId]; }
+};
+
+
+#endif // __DDEVENTDEV_H__
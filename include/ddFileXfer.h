@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDFILEXFER_H__
+#define __DDFILEXFER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+
+
+// File bytes carried by a single segment, leaves room for the tunnel
+// and crypto headers in a standard frame
+#define DD_FILE_SEG_SZ              1408
+
+// Default payload rate of the file transfer
+#define DD_FILE_RATE_MBPS           100
+
+// Segments built ahead of the forwarding lcore
+#define DD_FILE_RING_SZ             1024
+#define DD_FILE_NB_MBUF             2047
+#define DD_FILE_POOL_CACHE_SZ       64
+
+// Sent files are moved into this subdirectory of the spool
+#define DD_FILE_SENT_DIR            "sent"
+
+// Incomplete files without a segment for this long are discarded
+#define DD_FILE_RX_TIMEOUT_S        60
+
+// Rx-Only side, larger files are refused before anything is created. So
+// are files the free space of the output directory can not take next to
+// the ones in progress.
+#define DD_FILE_RX_MAX_SZ           (16ULL << 30)
+
+#define DD_FILE_SPOOL_DIR           "/var/spool/dataDiodeApp"
+#define DD_FILE_OUT_DIR             "/var/lib/dataDiodeApp/files"
+
+// Segment header in front of the file bytes of a 0x4006 frame, all fields
+// in network byte order. START and END carry the file name as payload,
+// DATA carries DD_FILE_SEG_SZ bytes of the file at offset.
+struct ddFileHdr_ {
+    uint32_t  fileId;
+    uint8_t   type;
+    uint8_t   reserved;
+    uint16_t  len;          // payload bytes behind the header
+    uint64_t  offset;
+    uint64_t  size;         // size of the whole file
+    uint32_t  crc;          // CRC32-C of the whole file
+    uint32_t  reserved2;
+} __attribute__((__packed__));
+
+// Tx-Only side: a control thread maps the files found in the spool
+// directory and segments them into mbufs; the access port lcore takes
+// them at the configured rate and sends them through the tunnel.
+class ddFileTx
+{
+public:
+    enum SegType {
+        SEG_START = 1,
+        SEG_DATA,
+        SEG_END
+    };
+
+private:
+    std::string _spoolDir;
+    uint32_t _rateMbps;
+    struct rte_mempool *_pool;
+    struct rte_ring *_ring;
+    pthread_t _readerThread;
+    volatile bool _stop;
+    uint32_t _nextFileId;
+
+    // lcore token bucket, in bytes
+    double _bytesPerTsc;
+    double _tokens;
+    double _bucketSz;
+    uint64_t _lastTsc;
+
+    uint64_t _segments;         // handed to the lcore
+    uint64_t _bytes;
+    uint64_t _filesSent;
+    uint64_t _readErrors;
+    uint64_t _noMbuf;
+
+    static void* readerMain(void *arg);
+    void readerLoop();
+    bool sendFile(const char *name);
+    bool queueSegment(uint32_t fileId, uint8_t type, uint64_t offset, uint64_t size,
+                      uint32_t crc, const void *data, uint16_t len);
+
+public:
+    ddFileTx(const char *spoolDir, uint32_t rateMbps = DD_FILE_RATE_MBPS);
+    virtual ~ddFileTx() {}
+
+    // create pool and ring, start the spool reader thread
+    void initialize();
+    void cleanup();
+
+    // Segments allowed by the rate, never more than n. Called by the
+    // lcore that owns the tunnel TX path.
+    uint32_t dequeueBurst(struct rte_mbuf **pkts, uint32_t n);
+
+    const std::string& spoolDir() const { return _spoolDir; }
+    uint32_t rateMbps() const { return _rateMbps; }
+    uint64_t segments() const { return _segments; }
+    uint64_t bytes() const { return _bytes; }
+    uint64_t filesSent() const { return _filesSent; }
+    uint64_t readErrors() const { return _readErrors; }
+    uint32_t pending() const { return rte_ring_count(_ring); }
+};
+
+// Rx-Only side: segments are handed from the core lcore to a control
+// thread which writes them into place in a mapped part file and renames
+// it to its final name once complete and verified.
+class ddFileRx
+{
+private:
+    struct rxFile_ {
+        int       fd;
+        uint8_t   *map;
+        uint64_t  size;
+        uint64_t  received;
+        uint32_t  crc;
+        bool      named;
+        std::string name;
+        std::vector<bool> segs;
+        time_t    lastSeen;
+    };
+
+    std::string _outDir;
+    struct rte_ring *_ring;
+    pthread_t _writerThread;
+    volatile bool _stop;
+    std::map<uint32_t, struct rxFile_ *> _files;
+    // completed files by the time, their late START or END segments are
+    // ignored for DD_FILE_RX_TIMEOUT_S
+    std::map<uint32_t, time_t> _completed;
+
+    uint64_t _segments;         // taken from the lcore
+    uint64_t _dropped;          // ring full
+    uint64_t _badSegments;
+    uint64_t _committed;
+    uint64_t _crcErrors;
+    uint64_t _expired;
+    uint64_t _writeErrors;
+    uint64_t _tooLarge;
+    uint32_t _inProgress;
+
+    static void* writerMain(void *arg);
+    void writerLoop();
+    void handleSegment(struct rte_mbuf *pkt);
+    struct rxFile_* openFile(uint32_t fileId, uint64_t size);
+    void closeFile(uint32_t fileId, struct rxFile_ *file, bool commit);
+    void expire();
+    std::string partPath(uint32_t fileId) const;
+
+public:
+    ddFileRx(const char *outDir);
+    virtual ~ddFileRx() {}
+
+    // create the ring, start the writer thread
+    void initialize();
+    void cleanup();
+
+    // take over a de-capsulated segment, never blocking
+    inline void receive(struct rte_mbuf *pkt)
+    {
+        if (unlikely(0 != rte_ring_sp_enqueue(_ring, pkt))) {
+            rte_pktmbuf_free(pkt);
+            _dropped++;
+            return;
+        }
+        _segments++;
+    }
+
+    const std::string& outDir() const { return _outDir; }
+    uint64_t segments() const { return _segments; }
+    uint64_t dropped() const { return _dropped; }
+    uint64_t badSegments() const { return _badSegments; }
+    uint64_t committed() const { return _committed; }
+    uint64_t crcErrors() const { return _crcErrors; }
+    uint64_t expired() const { return _expired; }
+    uint64_t writeErrors() const { return _writeErrors; }
+    uint64_t tooLarge() const { return _tooLarge; }
+    uint32_t inProgress() const { return _inProgress; }
+};
+
+
+#endif // __DDFILEXFER_H__
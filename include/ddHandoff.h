@@ -0,0 +1,148 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDHANDOFF_H__
+#define __DDHANDOFF_H__
+
+#include <pthread.h>
+#include <rte_config.h>
+#include <rte_branch_prediction.h>
+#include <rte_atomic.h>
+#include <rte_memzone.h>
+
+class ddPort;
+
+
+#define DD_HANDOFF_MZ_NAME          "datadiode_handoff"
+#define DD_HANDOFF_MAGIC            0x44444846  // "DDHF"
+#define DD_HANDOFF_VERSION          1
+
+// a new instance gives up when the running one did not answer by then
+#define DD_HANDOFF_WAIT_MS          5000
+#define DD_HANDOFF_POLL_US          100
+
+// Handoff state in shared memory, written by the instance that polls the
+// ports (owner) and the one that takes them over (taker)
+struct ddHandoffShm_ {
+    uint32_t  magic;
+    uint32_t  version;
+    volatile uint32_t state;
+    volatile uint32_t accepting;    // owner can hand its ports off
+    volatile int32_t ownerPid;
+    volatile int32_t takerPid;
+    volatile uint32_t generation;   // handoffs completed
+    struct port_ {
+        volatile uint32_t released; // generation + 1 once the owner let go
+        uint32_t  rxMode;           // ddPort::RxMode chosen by the first owner
+        uint64_t  releaseTsc;
+        uint64_t  rx;
+        uint64_t  tx;
+        uint64_t  rxDropped;
+        uint64_t  txDropped;
+    } __rte_cache_aligned ports[RTE_MAX_ETHPORTS];
+} __rte_cache_aligned;
+
+// Hitless upgrade. A new instance started as DPDK secondary process with
+// --takeover attaches to the mempool and the running ports of the owner,
+// then asks for them. Every lcore of the owner leaves its loop at a burst
+// boundary, the last one flushes the TX buffers of all ports and lets go
+// of them together. The lcores of the taker are already spinning and poll
+// the ports from the moment all of them are released, so no TX queue is
+// used by both processes.
+class ddHandoff
+{
+public:
+    enum State {
+        STATE_IDLE,
+        STATE_REQUESTED,    // taker is waiting
+        STATE_ACCEPTED      // owner is releasing its ports
+    };
+
+private:
+    const struct rte_memzone *_mz;
+    struct ddHandoffShm_ *_shm;
+    bool _takeover;                 // taker until all ports are taken
+    bool _watching;
+    volatile bool _pending;         // taker, not all ports taken yet
+    volatile bool _handedOff;       // owner, accepted a request
+    uint32_t _generation;
+    uint64_t _requestTsc;
+    rte_atomic32_t _looping;        // lcores in the main loop
+    rte_atomic32_t _taking;         // taker, an lcore is taking the ports
+    volatile bool _taken[RTE_MAX_ETHPORTS];
+    uint64_t _gapTsc[RTE_MAX_ETHPORTS];
+    uint64_t _maxGapTsc;
+    pthread_t _thread;
+
+    bool accept();
+    bool take();
+    static void* watchMain(void *arg);
+    void watchLoop();
+
+public:
+    ddHandoff(bool takeover);
+    virtual ~ddHandoff() {}
+
+    // Owner: publish the handoff state. Taker: attach to the state of the
+    // running instance, exits when there is none.
+    void initialize(bool accepting);
+    void cleanup();
+
+    // owner: record how a port receives, for the taker to attach to it
+    void publish(const ddPort *port);
+    // taker: how the running instance receives on a port
+    uint32_t rxMode(uint16_t portId) const { return _shm->ports[portId].rxMode; }
+
+    // taker: ask for the ports, the lcores have to be launched right after
+    void request();
+
+    // Owner: has a taker asked for the ports, then the lcores stop. The
+    // first lcore to see it accepts for all of them.
+    bool requested()
+    {
+        if (likely(STATE_REQUESTED != _shm->state && !_handedOff))
+            return false;
+        return _takeover ? false : accept();
+    }
+    bool handedOff() const { return _handedOff; }
+    // lcores about to run the main loop, before they are launched
+    void expect(uint32_t lcores) { rte_atomic32_set(&_looping, lcores); }
+    // an lcore left the main loop, true for the last one
+    bool leave() { return 0 != rte_atomic32_dec_and_test(&_looping); }
+    // owner: let go of a port after the TX buffers of all were flushed
+    void release(ddPort *port);
+
+    // taker: may this process poll the port, takes all ports once all
+    // are released
+    bool owns(uint16_t portId)
+    {
+        if (likely(!_pending) || _taken[portId])
+            return true;
+        return take();
+    }
+
+    bool takeover() const { return _takeover; }
+    bool pending() const { return _pending; }
+    uint32_t generation() const { return _shm->generation; }
+    uint64_t gapTsc(uint16_t portId) const { return _gapTsc[portId]; }
+    uint64_t maxGapTsc() const { return _maxGapTsc; }
+};
+
+
+#endif // __DDHANDOFF_H__
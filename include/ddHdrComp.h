@@ -0,0 +1,150 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDHDRCOMP_H__
+#define __DDHDRCOMP_H__
+
+#include <rte_config.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_mbuf.h>
+
+
+// inner Ethernet, IPv4 without options and UDP header
+#define DD_HC_HDR_LEN               (sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + \
+                                     sizeof(struct udp_hdr))
+
+// Tx-Only side, contexts per access port in sets of DD_HC_WAYS. The
+// context id is the access port id and the index of the context.
+#define DD_HC_WAYS                  4
+#define DD_HC_TX_SETS               256
+#define DD_HC_TX_CONTEXTS           (DD_HC_TX_SETS * DD_HC_WAYS)
+
+// Rx-Only side, contexts of all senders
+#define DD_HC_RX_SETS               4096
+
+// a context is refreshed after this many frames (default) or this long
+#define DD_HC_REFRESH_PKTS          64
+#define DD_HC_REFRESH_MS            100
+
+// Header compression of repetitive Ethernet/IPv4/UDP flows in the spirit
+// of ROHC unidirectional mode, without a feedback channel. The Tx-Only
+// side keeps the static header fields of a flow in a context and sends
+// only the context id and the changing fields; every DD_HC_REFRESH_PKTS
+// frames or DD_HC_REFRESH_MS it sends a full frame that (re)establishes
+// the context in-band. Frames of a context the Rx-Only side does not
+// have, e.g. after a lost refresh, are dropped until the next refresh.
+class ddHdrComp
+{
+public:
+    // in front of the full inner frame of a 0x4009 refresh frame
+    struct ctxHdr_ {
+        uint16_t  cid;
+        uint8_t   gen;          // of the context id, changes on reuse
+        uint8_t   epoch;        // of the Tx-Only process, never 0
+    } __attribute__((__packed__));
+
+    // replaces DD_HC_HDR_LEN bytes of the inner frame in a 0x400A frame,
+    // the fields are copied as they are in the inner headers
+    struct compHdr_ {
+        struct ctxHdr_ ctx;
+        uint16_t  ipLen;        // IPv4 total length, the frame may be padded
+        uint16_t  ipId;
+        uint16_t  udpCsum;
+    } __attribute__((__packed__));
+
+    enum Result {
+        RESULT_PLAIN,           // not compressible, goes as it is
+        RESULT_REFRESH,         // full frame behind a ctxHdr_
+        RESULT_COMPRESSED       // behind a compHdr_
+    };
+
+private:
+    struct ctx_ {
+        uint8_t   hdr[DD_HC_HDR_LEN];   // changing fields zeroed
+        uint8_t   gen;
+        uint8_t   epoch;        // Rx-Only side only
+        bool      valid;
+        uint16_t  cid;
+        uint16_t  slot;         // sender, Rx-Only side only
+        uint32_t  sinceRefresh;
+        uint64_t  refreshTsc;
+        uint64_t  lastTsc;
+    } __rte_cache_aligned;
+
+    // Tx-Only side, one table per access port written by the lcore
+    // polling it
+    struct txTable_ {
+        struct ctx_ ctx[DD_HC_TX_CONTEXTS];
+        uint64_t  compressed;
+        uint64_t  refreshes;
+        uint64_t  plain;
+        uint64_t  savedBytes;
+    };
+
+    uint32_t _refreshPkts;
+    uint64_t _refreshTsc;
+    // Tx-Only side, contexts of an earlier process may still be held by
+    // the Rx-Only side under the same id and generation
+    uint8_t _epoch;
+    struct txTable_ *_tx[RTE_MAX_ETHPORTS];
+
+    // Rx-Only side, written by the core lcore
+    struct ctx_ *_rx;
+    uint64_t _decompressed;
+    uint64_t _rxRefreshes;
+    uint64_t _noContext;
+    uint64_t _badFrames;
+
+    // the inner headers as a context key, false if not compressible
+    static bool key(const struct rte_mbuf *pkt, uint8_t *hdr);
+    struct ctx_* rxSet(uint16_t slot, uint16_t cid) const;
+
+public:
+    ddHdrComp(uint32_t refreshPkts = DD_HC_REFRESH_PKTS);
+    virtual ~ddHdrComp() {}
+
+    // tables of the access ports on the Tx-Only side, of the senders on
+    // the Rx-Only side. Test mode is both.
+    void initialize(bool tx, bool rx);
+
+    // Tx-Only side: compress the inner frames received on access port
+    // portId in place, results[j] tells how frame j is to be encapsulated
+    void compress(uint16_t portId, struct rte_mbuf **pkts, uint32_t n, uint8_t *results);
+
+    // Rx-Only side: rebuild the frames pkts[idx[k]] of a burst whose tunnel
+    // header was removed, in order. refresh has bit k set for refresh
+    // frames. Frames that can not be rebuilt are freed and set to NULL.
+    void decompress(struct rte_mbuf **pkts, const uint32_t *idx, uint32_t n,
+                    uint64_t refresh);
+
+    uint32_t refreshPkts() const { return _refreshPkts; }
+    uint64_t txCompressed() const;
+    uint64_t txRefreshes() const;
+    uint64_t txPlain() const;
+    uint64_t txSavedBytes() const;
+    uint64_t rxDecompressed() const { return _decompressed; }
+    uint64_t rxRefreshes() const { return _rxRefreshes; }
+    uint64_t rxNoContext() const { return _noContext; }
+    uint64_t rxBadFrames() const { return _badFrames; }
+};
+
+
+#endif // __DDHDRCOMP_H__
@@ -0,0 +1,121 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDHEARTBEAT_H__
+#define __DDHEARTBEAT_H__
+
+#include <pthread.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include "ddConfig.h"
+
+
+// Default interval between two heartbeats
+#define DD_HEARTBEAT_MS             100
+
+// Intervals without a heartbeat before a sender is reported lost
+#define DD_HEARTBEAT_MISS           3
+
+// Heartbeat payload of a 0x4007 frame, all fields in network byte order.
+// Counters are those of the sending Tx-Only device.
+struct ddHeartbeatHdr_ {
+    uint32_t  seq;
+    uint32_t  intervalMs;
+    uint64_t  tsc;          // TSC of the sender when the frame was built
+    uint64_t  tscHz;
+    uint64_t  uptimeMs;
+    uint64_t  accessRx;     // frames received on its access port
+    uint64_t  tunnelTx;     // frames sent on its core port
+    uint64_t  txDropped;    // frames its core port could not send
+} __attribute__((__packed__));
+
+// In-band link health of the core link. The Tx-Only side stamps a small
+// frame with its TSC every interval; the Rx-Only side consumes them on
+// the core lcore and tracks per sender missing frames and the
+// inter-arrival jitter (RFC 3550), a control thread raises the alarms.
+class ddHeartbeat
+{
+public:
+    // Heartbeat state of one sender, written by the Rx-Only core lcore
+    struct sender_ {
+        volatile uint64_t lastRxTsc;
+        uint64_t  lastRxNs;
+        uint64_t  lastTxNs;
+        uint32_t  lastSeq;
+        uint64_t  received;
+        uint64_t  missing;      // sequence gaps
+        uint64_t  restarts;
+        uint64_t  jitterNs;
+        uint64_t  uptimeMs;
+        uint64_t  accessRx;
+        uint64_t  tunnelTx;
+        uint64_t  txDropped;
+        uint64_t  reportedMissing;  // monitor thread only
+        volatile bool lost;         // monitor thread only
+    } __rte_cache_aligned;
+
+private:
+    uint32_t _intervalMs;
+    uint64_t _intervalTsc;
+    uint64_t _startTsc;
+    uint64_t _nextTsc;
+    uint32_t _seq;
+    struct rte_mempool *_pool;
+    struct sender_ *_senders;       // by sender slot
+    pthread_t _monitorThread;
+    bool _monitor;
+    volatile bool _stop;
+
+    uint64_t _sent;
+    uint64_t _noMbuf;
+    uint64_t _received;
+    uint64_t _badFrames;
+    uint64_t _alarms;
+
+    static void* monitorMain(void *arg);
+    void monitorLoop();
+
+public:
+    ddHeartbeat(uint32_t intervalMs = DD_HEARTBEAT_MS);
+    virtual ~ddHeartbeat() {}
+
+    // Tx-Only side builds heartbeats from pool, the Rx-Only side
+    // (monitor) watches the senders on a control thread
+    void initialize(struct rte_mempool *pool, bool monitor);
+    void cleanup();
+
+    // A heartbeat frame when one is due, NULL otherwise. Called by the
+    // lcore that owns the tunnel TX path.
+    struct rte_mbuf* poll();
+
+    // consume a de-capsulated heartbeat of the sender tagged in udata64
+    void receive(struct rte_mbuf *pkt);
+
+    uint32_t intervalMs() const { return _intervalMs; }
+    bool monitor() const { return _monitor; }
+    const struct sender_* sender(uint16_t slot) const { return &_senders[slot]; }
+    uint64_t sent() const { return _sent; }
+    uint64_t noMbuf() const { return _noMbuf; }
+    uint64_t received() const { return _received; }
+    uint64_t badFrames() const { return _badFrames; }
+    uint64_t alarms() const { return _alarms; }
+};
+
+
+#endif // __DDHEARTBEAT_H__
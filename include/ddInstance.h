@@ -0,0 +1,127 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDINSTANCE_H__
+#define __DDINSTANCE_H__
+
+#include <limits.h>
+#include <rte_config.h>
+#include <rte_ether.h>
+#include <rte_mempool.h>
+#include "dataDiode.h"
+#include "ddConfig.h"
+
+
+// diode instances of the process, each with its configuration in
+// DD_CONFIG_DIR/<name>
+#define DD_CONFIG_INSTANCES_FILE    DD_CONFIG_DIR "/instances.conf"
+#define DD_INSTANCE_NAME_SZ         16
+
+// One data diode: its core port, the access ports behind it, the lcores
+// polling them, the mempool their RX rings fill from, the configuration
+// snapshot and the counters of its senders. Instances of a process share
+// nothing the forwarding lcores write.
+class ddInstance
+{
+private:
+    uint16_t _id;
+    char _name[DD_INSTANCE_NAME_SZ];
+    char _configDir[PATH_MAX];
+    dataDiodeApp::PortMode _corePortMode;
+    uint64_t _portMask;
+    bool _lcores[RTE_MAX_LCORE];
+#ifndef _DD_TESTMODE_
+    int _corePortId;
+    ddPort *_corePort;
+#else
+    int _corePortId[2];
+    ddPort *_corePort[2];
+#endif
+    ddPort *_accessPort;
+    ddPort *_egressPorts[RTE_MAX_ETHPORTS];     // access ports by port id
+    uint32_t _nbMbufs;
+    struct rte_mempool *_pktMbufPool;
+    ddConfig * volatile _config;
+    struct ddSenderStats_ _senderStats[DD_SENDER_SLOTS];
+
+    // lcore list as of the EAL -l option, e.g. 2-3,6
+    bool parseLcores(const char *list);
+
+public:
+    ddInstance(uint16_t id, const char *name, const char *configDir,
+               dataDiodeApp::PortMode corePortMode, uint64_t portMask,
+               int corePortId, uint32_t nbMbufs);
+    virtual ~ddInstance() {}
+
+    // Read the instances of instances.conf, returns how many or 0 if the
+    // file is missing or malformed. Needs the EAL for the lcores.
+    static uint32_t readInstances(const char *path, uint32_t nbMbufs,
+                                  ddInstance **instances);
+
+    // create the mempool, or look up the one of a running instance
+    void createMempool(const char *poolName, int socketId, uint32_t cacheSize, bool lookup);
+    // port portId in the role it has in this instance
+    ddPort* createPort(uint16_t portId);
+
+    // Build the configuration snapshot from the files of the instance,
+    // false if any of the mandatory files is missing or malformed
+    bool loadConfig(uint32_t generation);
+    // Publish a new snapshot of generation if the files changed. Returns
+    // the old one to be freed once no lcore reads it, NULL if nothing
+    // changed or failed is set.
+    ddConfig* reloadConfig(uint32_t generation, bool *failed);
+    // zero the counters of new senders and check their egress ports
+    void prepareSenders(const ddConfig *config);
+
+    uint16_t id() const { return _id; }
+    const char* name() const { return _name; }
+    const char* configDir() const { return _configDir; }
+    dataDiodeApp::PortMode corePortMode() const { return _corePortMode; }
+    bool ownsPort(uint16_t portId) const { return portId < 64 && (_portMask & (1ULL << portId)); }
+    bool ownsLcore(uint32_t lcoreId) const { return _lcores[lcoreId]; }
+    // every enabled lcore, for the instance of the command line
+    void ownAllLcores();
+    // NUMA socket of the core port
+    int socketId() const;
+#ifndef _DD_TESTMODE_
+    ddPort* corePort() const { return _corePort; }
+    const struct ether_addr* corePortEthAddr() const;
+#else
+    ddPort* corePort(dataDiodeApp::PortMode mode = dataDiodeApp::PORTMODE_TX) const
+    {
+        return mode == dataDiodeApp::PORTMODE_RX ? _corePort[0] : _corePort[1];
+    }
+    const struct ether_addr* corePortEthAddr(uint16_t portId) const;
+#endif
+    ddPort* accessPort() const { return _accessPort; }
+    // access port portId, NULL if it is not one of this instance
+    ddPort* egressPort(uint16_t portId) const
+    {
+        return portId < RTE_MAX_ETHPORTS ? _egressPorts[portId] : NULL;
+    }
+    // Current config snapshot. Valid until the calling lcore returns to
+    // the main loop, read it once per burst.
+    const ddConfig* config() const { return _config; }
+    struct ddSenderStats_* senderStats(uint16_t slot) { return &_senderStats[slot]; }
+    struct rte_mempool* pktMbufPool() const { return _pktMbufPool; }
+    uint32_t nbMbufs() const { return _nbMbufs; }
+};
+
+
+#endif // __DDINSTANCE_H__
@@ -21,21 +21,42 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #define __DDPORT_H__
 
 #include <iostream>
+#include <strings.h>
 #include <rte_ether.h>
 #include <rte_ethdev.h>
+#include <rte_flow.h>
+#include "ddTraceDump.h"
+#include "ddConfig.h"
 
 
 // Configurable number of RX/TX ring descriptors
 #define RTE_TEST_RX_DESC_DEFAULT 1024
 #define RTE_TEST_TX_DESC_DEFAULT 1024
 
+// Wrong-direction frames the NIC does not drop are read this often, at
+// most this many bursts at a time
+#define DD_DRAIN_POLL_US            1000
+#define DD_DRAIN_MAX_BURSTS         8
+
 //class ddPort;
+class ddInstance;
 //typedef std::map<int, ddPort*> ddPortMap;
 
 class ddPort
 {
+public:
+    // How frames arriving on a port are received. Ports that only
+    // transmit in their role drop them in hardware where possible.
+    enum RxMode {
+        RXMODE_POLL,        // polled and processed every loop iteration
+        RXMODE_NONE,        // no RX queue at all
+        RXMODE_FLOW_DROP,   // rte_flow rule drops everything
+        RXMODE_DRAIN        // polled rarely and freed in bulk
+    };
+
 private:
     uint16_t _portId;
+    ddInstance *_diode;     // the diode instance the port belongs to
     struct rte_eth_dev_info _devInfo;
     struct rte_eth_rxconf _rxqConf;
     struct rte_eth_txconf _txqConf;
@@ -47,6 +68,9 @@ private:
         uint64_t  tx;
         uint64_t  txDropped;
         uint64_t  rxDropped;
+        uint64_t  txLinkDown;   // part of txDropped, link was down
+        uint64_t  compacted;    // copied into the small size class
+        uint64_t  compactNoMbuf;
     } __rte_cache_aligned;
     struct stats_ _stats;
     struct errStats_ {
@@ -56,6 +80,41 @@ private:
         uint64_t  badSId;
     } __rte_cache_aligned;
     struct errStats_ _errStats;
+    volatile uint64_t _lscEvents;
+    volatile bool _lscPending;
+    bool _lscCapable;
+    volatile bool _linkUp;
+    uint64_t _linkDowns;
+    uint32_t _linkSpeed;
+    RxMode _rxMode;
+    struct rte_flow *_dropFlow;
+    bool _dropFlowCounted;
+    uint64_t _drainTsc;
+    uint64_t _nextDrainTsc;
+    // drops up to the last flight recorder event
+    uint64_t _tracedRxDropped;
+    uint64_t _tracedTxDropped;
+    uint64_t _tracedTxLinkDown;
+    // RX ring fill in descriptors above which a class is shed, 0 never
+    uint16_t _shedDesc[DD_SHED_CLASSES];
+    bool _shedding;
+    bool _shedByCount;      // the PMD can not tell the status of a descriptor
+    uint8_t _shedFrom;      // lowest class shed in the current burst
+    uint64_t _shed[DD_SHED_CLASSES];
+
+    // link state change interrupt, runs on the EAL interrupt thread
+    static int lscCallback(uint16_t portId, enum rte_eth_event_type type,
+                           void *param, void *retParam);
+    // rte_flow rule dropping every frame, with a counter if the NIC has one
+    bool installDropFlow();
+    // read and free frames of a port in RXMODE_DRAIN
+    uint32_t drainRx();
+    // TX buffer with the drop counting error callback
+    void initTxBuffer();
+    // lowest class to shed by the fill of the RX ring after a full burst
+    uint8_t shedLevel();
+    // free the frames of the classes shed, returns the frames kept in order
+    uint32_t shed(struct rte_mbuf **pkts, uint32_t n);
 
 public:
     struct tunnelHdr_ {
@@ -65,69 +124,187 @@ public:
         uint16_t          sId;         // Secure ID
     } __attribute__((__packed__));
 
-    ddPort(uint16_t portId);
+    ddPort(uint16_t portId, ddInstance *diode);
     virtual ~ddPort() {}
     void initialize();
+    // Use the port as configured and started by a running instance of
+    // which this one takes over, receiving by rxMode
+    void attach(uint32_t rxMode);
+    // re-create the TX queue with nbTxd descriptors, port is restarted
+    void setupTxQueue(uint16_t nbTxd);
+    // flush and resize the TX buffer
+    void setTxBurst(uint16_t txBurst);
     rte_eth_dev_info* devInfo() { return &_devInfo; }
     const char* devName() const { return _devInfo.device->name; }
-    void checkLinkStatus();
+    // queues as configured, by this or the running instance
+    uint16_t nbRxQueues() const { return rte_eth_devices[_portId].data->nb_rx_queues; }
+    uint16_t nbTxQueues() const { return rte_eth_devices[_portId].data->nb_tx_queues; }
+    // Read the link state without waiting, returns whether it is up.
+    // A change is logged when log is set.
+    bool checkLinkStatus(bool log = true);
+    // is an LSC interrupt waiting to be looked at, clears it
+    bool takeLscPending()
+    {
+        bool pending = _lscPending;
+        _lscPending = false;
+        return pending;
+    }
+    bool lscCapable() const { return _lscCapable; }
     void start();
     const struct ether_addr *ethAddr() const { return &_ethAddr; }
     uint16_t portId() const { return _portId; }
+    ddInstance* diode() const { return _diode; }
     struct rte_eth_dev_tx_buffer* txBuffer() { return _txBuffer; }
     struct stats_* stats() { return &_stats; }
     uint64_t rxStats() const { return _stats.rx; }
     uint64_t txStats() const { return _stats.tx; }
     uint64_t rxDropStats() const { return _stats.rxDropped; }
     uint64_t txDropStats() const { return _stats.txDropped; }
+    uint64_t txLinkDownStats() const { return _stats.txLinkDown; }
+    uint64_t compactStats() const { return _stats.compacted; }
+    uint64_t compactNoMbufStats() const { return _stats.compactNoMbuf; }
     uint64_t errStatsBadSrcAddr() const { return _errStats.badSrcAddr; }
     uint64_t errStatsBadDstAddr() const { return _errStats.badDstAddr; }
     uint64_t errStatsBadEthType() const { return _errStats.badEthType; }
     uint64_t errStatsBadSIdr() const { return _errStats.badSId; }
+    uint64_t lscEvents() const { return _lscEvents; }
+    bool linkUp() const { return _linkUp; }
+    uint64_t linkDowns() const { return _linkDowns; }
+    uint32_t linkSpeed() const { return _linkSpeed; }
+    RxMode rxMode() const { return _rxMode; }
+    const char* rxModeName() const;
+    // Frames dropped for arriving the wrong way, from the NIC counters.
+    // Queries the device, not for the forwarding path.
+    uint64_t wrongDirDrops();
+    // counters of the instance this one took over from
+    void carryStats(uint64_t rx, uint64_t tx, uint64_t rxDropped, uint64_t txDropped)
+    {
+        _stats.rx += rx;
+        _stats.tx += tx;
+        _stats.rxDropped += rxDropped;
+        _stats.txDropped += txDropped;
+    }
     void incRxStats(uint64_t pkts) { _stats.rx += pkts; }
     void incTxStats(uint64_t pkts) { _stats.tx += pkts; }
     void incRxDropStats(uint64_t pkts) { _stats.rxDropped += pkts; }
     void incTxDropStats(uint64_t pkts) { _stats.txDropped += pkts; }
+    void incTxLinkDownStats(uint64_t pkts) { _stats.txLinkDown += pkts; }
     void incErrStatsBadSrcAddr() {  _errStats.badSrcAddr++; }
     void incErrStatsBadDstAddr() {  _errStats.badDstAddr++; }
     void incErrStatsBadEthType() {  _errStats.badEthType++; }
     void incErrStatsBadSId() {  _errStats.badSId++; }
+    // flight recorder event of this port, if the recorder is on
+    void trace(uint8_t type, uint8_t reason, uint32_t value);
+
+    // Buffer a frame for transmission. Frames toward a down link are
+    // dropped and counted without trying the NIC.
+    void send(struct rte_mbuf *pkt)
+    {
+        if (unlikely(!_linkUp)) {
+            rte_pktmbuf_free(pkt);
+            _stats.txDropped++;
+            _stats.txLinkDown++;
+            return;
+        }
+        _stats.tx += rte_eth_tx_buffer(_portId, 0, _txBuffer, pkt);
+    }
+    // Shed class c once more than pct[c] percent of the RX ring is
+    // filled, 0 never. Frames are shed right after RX.
+    void setShedWatermarks(const uint8_t *pct);
+    bool shedding() const { return _shedding; }
+    uint8_t shedFrom() const { return _shedFrom; }
+    uint64_t shedStats(uint8_t cls) const { return _shed[cls]; }
+
+    // send the buffered frames, or drop them while the link is down
+    void flushTx();
 
-    virtual void handleRx() = 0;
+    // Copy the single segment frames of at most SMALL_PACKET_SZ bytes of
+    // a received burst into mbufs of the small size class. The standard
+    // mbufs go straight back to the pool for the RX ring.
+    void compact(struct rte_mbuf **pkts, uint32_t n);
+    // read a burst from the RX queue and process it, returns packets read
+    uint32_t handleRx();
+    // process a burst as if received on this port, ownership is taken
+    virtual void processBurst(struct rte_mbuf **pkts, uint32_t nRx) = 0;
+    // Process a single frame on an event worker, returns the port to
+    // send *pkt on or NULL when it was consumed
+    virtual ddPort* processEvent(struct rte_mbuf **pkt) = 0;
     virtual void handleTx() = 0;
+    virtual const char* roleName() const = 0;
+    // does the role of the port only transmit
+    virtual bool wrongDirection() const = 0;
 };
 
 class ddCorePort : public ddPort
 {
 public:
-    ddCorePort(uint16_t portId) : ddPort(portId) {}
+    ddCorePort(uint16_t portId, ddInstance *diode) : ddPort(portId, diode) {}
     virtual ~ddCorePort() {}
 };
 
 class ddRxOnlyCorePort : public ddCorePort
 {
+private:
+    uint64_t _rewritten;
+    uint64_t _rewriteMisses;
+    // frames of the current burst failing validation, by ddCapture::Reason
+    uint32_t _burstDrops[DD_TRACE_DROP_WRONG_DIRECTION];
+
+    // flight recorder events for the validation drops of a burst
+    void traceDrops();
+    // check the tunnel header of a frame from a known (or unknown) sender,
+    // tags the frame with its sender or frees it
+    bool validate(struct rte_mbuf *pkt, const ddConfig *config,
+                  const struct ether_addr *dstAddr, bool known, uint32_t senderIdx);
+    // access port of a de-capsulated frame, NULL if it was dropped
+    ddPort* egress(struct rte_mbuf **pkt);
+    // access port of the sender tagged in udata64
+    ddPort* egressPortOf(uint64_t tag) const;
+    // rewrite addresses of de-capsulated frames by the rules of config
+    void rewrite(struct rte_mbuf **pkts, uint32_t n, const ddConfig *config);
+
 public:
-    ddRxOnlyCorePort(uint16_t portId) : ddCorePort(portId) {}
-    virtual void handleRx();
+    ddRxOnlyCorePort(uint16_t portId, ddInstance *diode) :
+        ddCorePort(portId, diode), _rewritten(0), _rewriteMisses(0)
+    {
+        bzero(_burstDrops, sizeof(_burstDrops));
+    }
+    virtual void processBurst(struct rte_mbuf **pkts, uint32_t nRx);
+    virtual ddPort* processEvent(struct rte_mbuf **pkt);
     virtual void handleTx();
+    virtual const char* roleName() const { return "rx-core"; }
+    virtual bool wrongDirection() const { return false; }
+    uint64_t rewritten() const { return _rewritten; }
+    uint64_t rewriteMisses() const { return _rewriteMisses; }
     virtual ~ddRxOnlyCorePort() {}
 };
 
 class ddTxOnlyCorePort : public ddCorePort
 {
 public:
-    ddTxOnlyCorePort(uint16_t portId) : ddCorePort(portId) {}
-    virtual void handleRx();
+    ddTxOnlyCorePort(uint16_t portId, ddInstance *diode) : ddCorePort(portId, diode) {}
+    virtual void processBurst(struct rte_mbuf **pkts, uint32_t nRx);
+    virtual ddPort* processEvent(struct rte_mbuf **pkt);
     virtual void handleTx();
+    virtual const char* roleName() const { return "tx-core"; }
+    virtual bool wrongDirection() const { return true; }
     virtual ~ddTxOnlyCorePort() {}
 };
 
 class ddAccessPort : public ddPort
 {
+private:
+    // prepend tunnel header to the packets, returns encapsulated packets
+    uint32_t encapsulate(struct rte_mbuf **pkts, uint32_t nPkts,
+                         uint16_t etherType, struct rte_mbuf **tunnelPkts);
+
 public:
-    ddAccessPort(uint16_t portId) : ddPort(portId) {}
-    virtual void handleRx();
+    ddAccessPort(uint16_t portId, ddInstance *diode) : ddPort(portId, diode) {}
+    virtual void processBurst(struct rte_mbuf **pkts, uint32_t nRx);
+    virtual ddPort* processEvent(struct rte_mbuf **pkt);
     virtual void handleTx();
+    virtual const char* roleName() const { return "access"; }
+    virtual bool wrongDirection() const;
     virtual ~ddAccessPort() {}
 };
 
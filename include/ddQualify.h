@@ -0,0 +1,157 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDQUALIFY_H__
+#define __DDQUALIFY_H__
+
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+
+
+// Schedule shared by both sides: every frame size at every rate, each
+// step sends for STEP_MS (default) and leaves GAP_MS for the link to
+// drain before the next one. Rates are percent of the core link speed.
+#define DD_QUALIFY_STEP_MS          1000
+#define DD_QUALIFY_GAP_MS           500
+#define DD_QUALIFY_START_MS         3000    // after startup, for links and the peer
+#define DD_QUALIFY_N_SIZES          7
+#define DD_QUALIFY_N_RATES          10
+#define DD_QUALIFY_STEPS            (DD_QUALIFY_N_SIZES * DD_QUALIFY_N_RATES)
+
+// end of step markers sent in the gap, one is enough
+#define DD_QUALIFY_END_COPIES       3
+
+// core link speed assumed when the port does not report one
+#define DD_QUALIFY_DEFAULT_MBPS     10000
+
+#define DD_QUALIFY_TYPE_DATA        0
+#define DD_QUALIFY_TYPE_END         1
+
+// Test frame payload of a 0x4008 frame, all fields in network byte order
+struct ddQualifyHdr_ {
+    uint16_t  step;
+    uint16_t  frameSize;    // on the core link, FCS included
+    uint8_t   ratePct;
+    uint8_t   type;
+    uint16_t  reserved;
+    uint32_t  seq;          // within the step, frames sent for an END frame
+    uint64_t  tsc;          // TSC of the sender when the frame was built
+    uint64_t  tscHz;
+} __attribute__((__packed__));
+
+// RFC 2544 style qualification of the core link and the Rx-Only device
+// without a return path. The Tx-Only side generates test frames along
+// the schedule, the Rx-Only side follows the step numbers in the frames
+// and reports loss, throughput and latency per step.
+class ddQualify
+{
+public:
+    // result of a step, written by the Rx-Only core lcore
+    struct result_ {
+        uint16_t  frameSize;
+        uint8_t   ratePct;
+        bool      started;
+        bool      sentKnown;    // END frame arrived
+        uint64_t  sent;
+        uint64_t  received;
+        uint64_t  reordered;
+        uint32_t  nextSeq;
+        uint64_t  firstRxTsc;
+        uint64_t  lastRxTsc;
+        int64_t   firstDelayNs; // one-way delays relative to this one
+        int64_t   minDelayNs;
+        int64_t   maxDelayNs;
+        int64_t   sumDelayNs;
+        volatile bool done;
+    };
+
+private:
+    uint32_t _stepMs;
+    bool _sender;
+    bool _receiver;
+    struct rte_mempool *_pool;
+    uint64_t _startTsc;
+    uint64_t _stepTsc;
+    uint64_t _slotTsc;
+
+    // Tx-Only side
+    int32_t _step;
+    uint64_t _pps;
+    uint64_t _stepSent;
+    bool _endSent;
+    volatile bool _finished;
+    uint64_t _sent;
+    uint64_t _noMbuf;
+
+    // Rx-Only side
+    struct result_ _results[DD_QUALIFY_STEPS];
+    int32_t _rxStep;
+    volatile uint32_t _nDone;
+    uint64_t _badFrames;
+    uint64_t _late;
+
+    uint32_t build(struct rte_mbuf **pkts, uint32_t n, uint8_t type, uint32_t seq);
+    void finish(uint32_t step);
+    void printResult(uint32_t step) const;
+
+public:
+    static const uint16_t frameSizes[DD_QUALIFY_N_SIZES];
+
+    ddQualify(uint32_t stepMs = DD_QUALIFY_STEP_MS);
+    virtual ~ddQualify() {}
+
+    // Tx-Only side (sender) builds test frames from pool, the Rx-Only
+    // side (receiver) reports the results. Test mode is both.
+    void initialize(struct rte_mempool *pool, bool sender, bool receiver);
+    void cleanup();
+
+    // Test frames due now, at most max. Called by the lcore that owns
+    // the tunnel TX path.
+    uint32_t poll(struct rte_mbuf **pkts, uint32_t max);
+
+    // consume a de-capsulated test frame
+    void receive(struct rte_mbuf *pkt);
+
+    // print the results of the steps completed so far, or of the latest
+    void report(bool all) const;
+
+    // highest rate in percent without loss for frameSizes[size], -1 when
+    // every rate lost frames and -2 before any of them was reported
+    int32_t lossFreeRate(uint32_t size) const;
+
+    static uint16_t stepSize(uint32_t step) { return frameSizes[step / DD_QUALIFY_N_RATES]; }
+    static uint8_t stepRate(uint32_t step) { return 10 * (step % DD_QUALIFY_N_RATES + 1); }
+
+    bool sender() const { return _sender; }
+    bool receiver() const { return _receiver; }
+    uint32_t stepMs() const { return _stepMs; }
+    int32_t txStep() const { return _step; }
+    int32_t rxStep() const { return _rxStep; }
+    bool txFinished() const { return _finished; }
+    uint64_t sent() const { return _sent; }
+    uint64_t noMbuf() const { return _noMbuf; }
+    uint64_t pps() const { return _pps; }
+    uint32_t stepsDone() const { return _nDone; }
+    uint64_t badFrames() const { return _badFrames; }
+    uint64_t late() const { return _late; }
+    const struct result_* result(uint32_t step) const { return &_results[step]; }
+};
+
+
+#endif // __DDQUALIFY_H__
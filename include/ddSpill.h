@@ -0,0 +1,108 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDSPILL_H__
+#define __DDSPILL_H__
+
+#include <string>
+#include <rte_mbuf.h>
+
+
+// Default sizes of the in-memory and the file backed part of the spill
+#define DD_SPILL_MEM_MB             64
+#define DD_SPILL_FILE_MB            0
+
+#define DD_SPILL_FILE               "/var/lib/dataDiodeApp/spill.dat"
+
+// Frames handed to the access port per drain attempt
+#define DD_SPILL_DRAIN_BURST        32
+
+// Spill queue in front of the access port of the Rx-Only role. Frames the
+// access port NIC does not accept are copied into a hugepage byte ring,
+// overflowing into a memory-mapped file, and are sent in their original
+// order once the NIC accepts frames again. Used by a single lcore.
+class ddSpill
+{
+private:
+    // A circular buffer of <len|frame> records, 8 byte aligned
+    struct ring_ {
+        uint8_t   *base;
+        uint64_t  size;
+        uint64_t  head;         // next record to drain
+        uint64_t  tail;         // next free byte
+        uint64_t  frames;
+    };
+
+    struct stats_ {
+        uint64_t  spilled;      // frames put into the spill
+        uint64_t  drained;      // frames sent from the spill
+        uint64_t  dropped;      // spill full
+        uint64_t  fileSpilled;  // frames that overflowed into the file
+        uint64_t  peakBytes;
+    };
+
+    uint64_t _memSz;
+    uint64_t _fileSz;
+    std::string _filePath;
+    int _fd;
+    struct ring_ _mem;
+    struct ring_ _file;
+    struct stats_ _stats;
+
+    static bool put(struct ring_ *ring, const struct rte_mbuf *pkt);
+    static uint32_t peek(const struct ring_ *ring, struct rte_mempool *pool,
+                         struct rte_mbuf **pkts, uint64_t *heads, uint32_t n);
+    uint32_t drainRing(struct ring_ *ring, uint16_t portId, struct rte_mempool *pool);
+
+public:
+    ddSpill(uint64_t memMb, uint64_t fileMb, const char *filePath = DD_SPILL_FILE);
+    virtual ~ddSpill() {}
+
+    // parse "MEM_MB[:FILE_MB]"
+    static bool parseSize(const char *arg, uint64_t *memMb, uint64_t *fileMb);
+
+    // allocate the hugepage ring and map the file
+    void initialize();
+    void cleanup();
+
+    bool empty() const { return 0 == _mem.frames && 0 == _file.frames; }
+
+    // Copy frames into the spill behind what is already queued. The
+    // frames are always freed, those that do not fit are counted dropped.
+    void enqueue(struct rte_mbuf **pkts, uint32_t nPkts);
+
+    // Send queued frames in order as long as the port accepts them,
+    // buffers for them are taken from pool. Returns frames sent.
+    uint32_t drain(uint16_t portId, struct rte_mempool *pool);
+
+    uint64_t memSz() const { return _memSz; }
+    uint64_t fileSz() const { return _fileSz; }
+    uint64_t memBytes() const { return _mem.tail - _mem.head; }
+    uint64_t fileBytes() const { return _file.tail - _file.head; }
+    uint64_t memFrames() const { return _mem.frames; }
+    uint64_t fileFrames() const { return _file.frames; }
+    uint64_t spilled() const { return _stats.spilled; }
+    uint64_t drained() const { return _stats.drained; }
+    uint64_t dropped() const { return _stats.dropped; }
+    uint64_t fileSpilled() const { return _stats.fileSpilled; }
+    uint64_t peakBytes() const { return _stats.peakBytes; }
+};
+
+
+#endif // __DDSPILL_H__
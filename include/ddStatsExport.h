@@ -0,0 +1,69 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDSTATSEXPORT_H__
+#define __DDSTATSEXPORT_H__
+
+#include <pthread.h>
+#include <rte_memzone.h>
+#include "ddStatsShm.h"
+
+
+// How often the shared statistics are refreshed
+#define DD_STATS_INTERVAL_MS        500
+
+// Weight of the newest interval in the EWMA rates
+#define DD_STATS_EWMA_ALPHA         0.2
+
+// Publishes application and device statistics to the DD_STATS_MZ_NAME
+// memzone from a control thread. Forwarding lcores are not involved, they
+// keep updating their own counters only.
+class ddStatsExport
+{
+private:
+    const struct rte_memzone *_mz;
+    struct ddStatsShm_ *_shm;
+    pthread_t _thread;
+    uint64_t _lastNs;
+    uint32_t _nXstats[DD_STATS_MAX_PORTS];
+    bool _laidOut;
+
+    static void* exportMain(void *arg);
+    void exportLoop();
+    // port table and identity of the block, once this process owns the ports
+    void layout();
+    void update();
+    void updatePort(struct ddStatsPort_ *sp, uint64_t dtNs);
+    void updateRate(struct ddStatsRate_ *rate, uint64_t pkts, uint64_t bytes, uint64_t dtNs);
+    void addCounter(const char *name, uint64_t value);
+
+public:
+    ddStatsExport();
+    virtual ~ddStatsExport() {}
+
+    // reserve the memzone and start the export thread, call once
+    // all ports are initialized
+    void initialize();
+
+    // wait for the export thread to finish, after forceQuit
+    void cleanup();
+};
+
+
+#endif // __DDSTATSEXPORT_H__
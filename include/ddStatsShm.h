@@ -0,0 +1,125 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDSTATSSHM_H__
+#define __DDSTATSSHM_H__
+
+// Layout of the statistics published in hugepage shared memory by the
+// data diode application and read by datadiode-stat (secondary process).
+// Bump DD_STATS_VERSION on any change of the layout.
+
+#include <stdint.h>
+#include <string.h>
+#include <rte_atomic.h>
+#include <rte_ethdev.h>
+
+
+#define DD_STATS_MZ_NAME            "datadiode_stats"
+#define DD_STATS_MAGIC              0x44445354  // "DDST"
+#define DD_STATS_VERSION            1
+
+#define DD_STATS_MAX_PORTS          8
+#define DD_STATS_MAX_XSTATS         256
+#define DD_STATS_MAX_COUNTERS       128
+#define DD_STATS_NAME_SZ            64
+
+struct ddStatsRate_ {
+    double    pps;              // EWMA of packets per second
+    double    bps;              // EWMA of bits per second
+    double    ppsPeak;          // highest rate seen over one interval
+    double    bpsPeak;
+};
+
+struct ddStatsXstat_ {
+    char      name[DD_STATS_NAME_SZ];
+    uint64_t  value;
+};
+
+struct ddStatsPort_ {
+    uint16_t  portId;
+    uint16_t  nRxQueues;
+    uint16_t  nTxQueues;
+    char      name[DD_STATS_NAME_SZ];
+    char      role[16];
+
+    // application counters
+    uint64_t  rx;
+    uint64_t  tx;
+    uint64_t  rxDropped;
+    uint64_t  txDropped;
+    uint64_t  badSrcAddr;
+    uint64_t  badDstAddr;
+    uint64_t  badEthType;
+    uint64_t  badSId;
+
+    // device counters, per queue for every configured queue
+    struct rte_eth_stats eth;
+    struct ddStatsRate_ rxRate;
+    struct ddStatsRate_ txRate;
+
+    uint32_t  nXstats;
+    struct ddStatsXstat_ xstats[DD_STATS_MAX_XSTATS];
+};
+
+// Named counters of the optional stages (crypto, compression, capture ...)
+struct ddStatsCounter_ {
+    char      name[DD_STATS_NAME_SZ];
+    uint64_t  value;
+};
+
+struct ddStatsShm_ {
+    uint32_t  magic;
+    uint32_t  version;
+
+    // Sequence lock: odd while the exporter is updating. Readers copy the
+    // block and retry when the sequence is odd or changed meanwhile.
+    volatile uint32_t seq;
+
+    uint32_t  intervalMs;       // update interval
+    uint64_t  updates;          // number of updates since start
+    uint64_t  timestampNs;      // wall clock of the last update
+    uint64_t  startNs;          // wall clock of application start
+    char      mode[16];         // Rx-Only, Tx-Only, test or multi
+
+    uint32_t  nPorts;
+    struct ddStatsPort_ ports[DD_STATS_MAX_PORTS];
+
+    uint32_t  nCounters;
+    struct ddStatsCounter_ counters[DD_STATS_MAX_COUNTERS];
+};
+
+// Take a consistent copy of the shared block, false if it kept changing
+static inline bool
+ddStatsShmRead(const volatile struct ddStatsShm_ *shm, struct ddStatsShm_ *copy)
+{
+    for (int retry = 0; retry < 1000; retry++) {
+        uint32_t seq = shm->seq;
+        if (seq & 1)
+            continue;
+        rte_smp_rmb();
+        memcpy(copy, (const void *)shm, sizeof(*copy));
+        rte_smp_rmb();
+        if (seq == shm->seq)
+            return true;
+    }
+    return false;
+}
+
+
+#endif // __DDSTATSSHM_H__
@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDTOPTALKERS_H__
+#define __DDTOPTALKERS_H__
+
+#include <vector>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+#include <rte_lcore.h>
+
+
+// Count-min sketch dimensions, width has to be a power of 2
+#define DD_TOP_DEPTH                4
+#define DD_TOP_WIDTH                1024
+
+// Heavy hitters tracked per lcore, upper bound of the reported entries
+#define DD_TOP_K                    16
+
+// Default number of reported flows
+#define DD_TOP_N                    10
+
+// Interval used when the periodic statistics are disabled
+#define DD_TOP_INTERVAL_S           10
+
+// Top talkers of the access port ingress. Every lcore keeps its own
+// count-min sketch of packets and bytes per flow, IPv4 5-tuple or source
+// MAC of other frames, plus the flows with the highest estimates. At the
+// end of each interval the lcore publishes its heavy hitters and starts
+// over, memory use is fixed.
+class ddTopTalkers
+{
+public:
+    struct flowKey_ {
+        union {
+            struct {
+                uint32_t  srcIp;
+                uint32_t  dstIp;
+                uint16_t  srcPort;
+                uint16_t  dstPort;
+            } ip;
+            struct ether_addr srcMac;
+        };
+        uint8_t   proto;
+        uint8_t   isIp;
+        uint16_t  pad;
+    } __attribute__((__packed__));
+
+    struct flow_ {
+        struct flowKey_ key;
+        uint32_t  hash;
+        uint64_t  pkts;
+        uint64_t  bytes;
+    };
+
+private:
+    struct topList_ {
+        struct flow_ flows[DD_TOP_K];
+        uint32_t  n;
+        uint32_t  minIdx;
+    };
+
+    // Owned by one lcore, the published lists are read under seq
+    struct lcoreState_ {
+        uint64_t  pkts[DD_TOP_DEPTH][DD_TOP_WIDTH];
+        uint64_t  bytes[DD_TOP_DEPTH][DD_TOP_WIDTH];
+        struct topList_ byPkts;
+        struct topList_ byBytes;
+        uint64_t  rollTsc;
+        volatile uint32_t seq;
+        struct topList_ pubPkts;
+        struct topList_ pubBytes;
+    } __rte_cache_aligned;
+
+    uint32_t _topN;
+    uint32_t _intervalS;
+    uint64_t _intervalTsc;
+    struct lcoreState_ *_lcore[RTE_MAX_LCORE];
+
+    static void flowKey(const struct rte_mbuf *pkt, struct flowKey_ *key);
+    static void updateTop(struct topList_ *top, const struct flowKey_ &key, uint32_t hash,
+                          uint64_t pkts, uint64_t bytes, bool byBytes);
+    void roll(struct lcoreState_ *state, uint64_t now);
+
+public:
+    ddTopTalkers(uint32_t topN = DD_TOP_N, uint32_t intervalS = DD_TOP_INTERVAL_S);
+    virtual ~ddTopTalkers() {}
+
+    // allocate the per lcore sketches
+    void initialize();
+    void cleanup();
+
+    // account a received burst, on the lcore that polls the port
+    void update(struct rte_mbuf **pkts, uint32_t nPkts);
+
+    // heavy hitters of the last completed interval of all lcores
+    void report(std::vector<struct flow_> &byPkts, std::vector<struct flow_> &byBytes) const;
+
+    static void formatKey(const struct flowKey_ &key, char *buf, uint32_t len);
+
+    uint32_t topN() const { return _topN; }
+    uint32_t intervalS() const { return _intervalS; }
+};
+
+
+#endif // __DDTOPTALKERS_H__
@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDTRACE_H__
+#define __DDTRACE_H__
+
+#include <limits.h>
+#include <signal.h>
+#include <rte_config.h>
+#include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_spinlock.h>
+#include "ddTraceDump.h"
+
+
+// Events kept per lcore, 64KB of hugepage memory each
+#define DD_TRACE_EVENTS             4096
+#define DD_TRACE_FILE               "/var/log/dataDiodeApp/trace.bin"
+
+// Flight recorder of the dataplane. Every forwarding lcore writes compact
+// events into a ring of its own, overwriting the oldest, without locks or
+// atomics; the control threads share one ring under a lock. The rings are
+// dumped to a file on SIGUSR1, and on a crash before the default action.
+class ddTrace
+{
+private:
+    struct ring_ {
+        struct ddTraceEvent_ *events;
+        volatile uint64_t head;
+    } __rte_cache_aligned;
+
+    static ddTrace *_tracePtr;
+
+    char _path[PATH_MAX];
+    uint32_t _nEvents;
+    uint32_t _mask;
+    struct ring_ _rings[RTE_MAX_LCORE];
+    struct ring_ _ctrlRing;
+    rte_spinlock_t _ctrlLock;
+    volatile uint64_t _dumps;
+
+    static void sigHandler(int sigNumber, siginfo_t *info, void *ctx);
+    // async-signal-safe
+    bool dump(int sigNumber);
+
+    static void put(struct ring_ *ring, uint32_t mask, uint8_t type,
+                    uint8_t reason, uint16_t portId, uint32_t value)
+    {
+        struct ddTraceEvent_ *ev = &ring->events[ring->head & mask];
+        ev->tsc = rte_rdtsc();
+        ev->type = type;
+        ev->reason = reason;
+        ev->portId = portId;
+        ev->value = value;
+        ring->head++;
+    }
+
+public:
+    // nEvents per lcore is rounded up to a power of 2
+    ddTrace(const char *path, uint32_t nEvents = DD_TRACE_EVENTS);
+    virtual ~ddTrace() {}
+
+    // allocate the rings and take the dump and crash signals
+    void initialize();
+
+    // from any thread, a forwarding lcore does not wait
+    void record(uint8_t type, uint8_t reason, uint16_t portId, uint32_t value)
+    {
+        unsigned lcoreId = rte_lcore_id();
+        if (likely(lcoreId < RTE_MAX_LCORE)) {
+            put(&_rings[lcoreId], _mask, type, reason, portId, value);
+            return;
+        }
+        rte_spinlock_lock(&_ctrlLock);
+        put(&_ctrlRing, _mask, type, reason, portId, value);
+        rte_spinlock_unlock(&_ctrlLock);
+    }
+
+    const char* path() const { return _path; }
+    uint32_t nEvents() const { return _nEvents; }
+    uint64_t dumps() const { return _dumps; }
+};
+
+
+#endif // __DDTRACE_H__
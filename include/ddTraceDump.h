@@ -0,0 +1,123 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDTRACEDUMP_H__
+#define __DDTRACEDUMP_H__
+
+// Layout of the flight recorder dump written by the data diode
+// application and read by datadiode-trace, on any host. Bump
+// DD_TRACE_VERSION on any change of the layout.
+//
+// <file header|ring header|nEvents events|ring header|nEvents events|...>
+// Ring events are dumped as they are in memory, the oldest one is at
+// index head % nEvents once the ring has wrapped.
+
+#include <stdint.h>
+
+
+#define DD_TRACE_MAGIC              0x44445452  // "DDTR"
+#define DD_TRACE_VERSION            1
+
+// ring of the control threads, which have no lcore id
+#define DD_TRACE_CTRL_RING          0xffff
+
+enum ddTraceType {
+    DD_TRACE_RX_BURST = 1,      // value: frames received
+    DD_TRACE_TX_FLUSH,          // value: frames sent
+    DD_TRACE_DROP,              // reason: ddTraceDrop, value: frames
+    DD_TRACE_NO_MBUF,           // reason: ddTracePool, value: mbufs asked for
+    DD_TRACE_CONFIG_SWAP,       // value: new config generation
+    DD_TRACE_LINK,              // value: 1 up, 0 down
+    DD_TRACE_TYPE_MAX
+};
+
+// 1 to 5 are numbered as ddCapture::Reason
+enum ddTraceDrop {
+    DD_TRACE_DROP_BAD_DST_ADDR = 1,
+    DD_TRACE_DROP_BAD_SRC_ADDR,
+    DD_TRACE_DROP_BAD_ETH_TYPE,
+    DD_TRACE_DROP_BAD_SID,
+    DD_TRACE_DROP_WRONG_DIRECTION,
+    DD_TRACE_DROP_TX,               // TX queue full, or no room for a header
+    DD_TRACE_DROP_TX_LINK_DOWN,
+    DD_TRACE_DROP_SHED,             // access port overloaded, by class
+    DD_TRACE_DROP_MAX
+};
+
+enum ddTracePool {
+    DD_TRACE_POOL_SMALL,
+    DD_TRACE_POOL_MAX
+};
+
+struct ddTraceFileHdr_ {
+    uint32_t  magic;
+    uint32_t  version;
+    uint64_t  tscHz;
+    uint64_t  dumpTsc;          // TSC and wall clock when the dump was written
+    uint64_t  dumpNs;
+    uint32_t  nRings;
+    uint32_t  nEvents;          // per ring, a power of 2
+    int32_t   signal;           // that caused the dump
+    int32_t   pid;
+};
+
+struct ddTraceRingHdr_ {
+    uint16_t  lcoreId;          // DD_TRACE_CTRL_RING for the control threads
+    uint16_t  reserved[3];
+    uint64_t  head;             // events ever recorded
+};
+
+struct ddTraceEvent_ {
+    uint64_t  tsc;
+    uint8_t   type;
+    uint8_t   reason;
+    uint16_t  portId;
+    uint32_t  value;
+};
+
+static inline const char *
+ddTraceTypeName(uint8_t type)
+{
+    static const char *names[DD_TRACE_TYPE_MAX] = {
+        "none", "rx", "tx", "drop", "no-mbuf", "config", "link"
+    };
+    return (type < DD_TRACE_TYPE_MAX) ? names[type] : "unknown";
+}
+
+static inline const char *
+ddTraceDropName(uint8_t reason)
+{
+    static const char *names[DD_TRACE_DROP_MAX] = {
+        "none", "bad-dst-addr", "bad-src-addr", "bad-eth-type", "bad-sid",
+        "wrong-direction", "tx", "tx-link-down", "shed"
+    };
+    return (reason < DD_TRACE_DROP_MAX) ? names[reason] : "unknown";
+}
+
+static inline const char *
+ddTracePoolName(uint8_t pool)
+{
+    static const char *names[DD_TRACE_POOL_MAX] = {
+        "small"
+    };
+    return (pool < DD_TRACE_POOL_MAX) ? names[pool] : "unknown";
+}
+
+
+#endif // __DDTRACEDUMP_H__
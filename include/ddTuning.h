@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#ifndef __DDTUNING_H__
+#define __DDTUNING_H__
+
+#include <iostream>
+#include <stdint.h>
+
+
+// Tuning parameters written by the autotune mode and loaded at start
+#define DD_TUNING_FILE              "/etc/dataDiodeApp/tuning.conf"
+
+// Runtime values of the burst, descriptor, mempool cache and drain
+// parameters. Defaults are the compile time values; the burst sizes are
+// bounded by MAX_PKT_BURST which sizes the burst arrays.
+class ddTuning
+{
+public:
+    uint16_t rxBurst;           // packets to read from NIC in one go
+    uint16_t txBurst;           // packets buffered before a TX burst
+    uint16_t nbRxd;             // RX ring descriptors
+    uint16_t nbTxd;             // TX ring descriptors
+    uint32_t mempoolCache;      // per-lcore mempool cache of the mbuf pool
+    uint32_t drainUs;           // TX buffers are drained after this many us
+
+    ddTuning();
+
+    // read "key = value" lines, false if the file can not be read or a
+    // value is out of range, in which case nothing is changed
+    bool load(const char *path = DD_TUNING_FILE);
+    bool save(const char *path = DD_TUNING_FILE) const;
+
+    bool operator==(const ddTuning &other) const;
+    bool operator!=(const ddTuning &other) const { return !(*this == other); }
+};
+
+std::ostream& operator<<(std::ostream &os, const ddTuning &tuning);
+
+
+#endif // __DDTUNING_H__
@@ -17,6 +17,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 
 #include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
 #include <iomanip>
 #include <getopt.h>
 #include <stdarg.h>
@@ -30,12 +33,113 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include <rte_lcore.h>
 #include <rte_malloc.h>
 #include <rte_log.h>
+#include <rte_atomic.h>
 #include <ddPort.h>
+#include "ddCrypto.h"
+#include "ddCompress.h"
+#include "ddCapture.h"
+#include "ddSpill.h"
+#include "ddFileXfer.h"
+#include "ddTopTalkers.h"
+#include "ddHeartbeat.h"
+#include "ddQualify.h"
+#include "ddHandoff.h"
+#include "ddTrace.h"
+#include "ddHdrComp.h"
+#include "ddEventDev.h"
+#include "ddConfig.h"
+#include "ddStatsExport.h"
+#include "ddAutotune.h"
+#include "ddInstance.h"
 #include "dataDiode.h"
 
+// long options
+#define CMD_LINE_OPT_CRYPTO_DEV     "crypto-dev"
+#define CMD_LINE_OPT_CRYPTO_ALGO    "crypto-algo"
+#define CMD_LINE_OPT_COMPRESS       "compress"
+#define CMD_LINE_OPT_CAPTURE        "capture"
+#define CMD_LINE_OPT_CAPTURE_DIR    "capture-dir"
+#define CMD_LINE_OPT_TUNING         "tuning"
+#define CMD_LINE_OPT_AUTOTUNE       "autotune"
+#define CMD_LINE_OPT_SPILL          "spill"
+#define CMD_LINE_OPT_SPILL_FILE     "spill-file"
+#define CMD_LINE_OPT_FILE_TX        "file-tx"
+#define CMD_LINE_OPT_FILE_RATE      "file-rate"
+#define CMD_LINE_OPT_FILE_RX        "file-rx"
+#define CMD_LINE_OPT_TOP_TALKERS    "top-talkers"
+#define CMD_LINE_OPT_WATCHDOG       "watchdog"
+#define CMD_LINE_OPT_HEARTBEAT      "heartbeat"
+#define CMD_LINE_OPT_EVENTDEV       "eventdev"
+#define CMD_LINE_OPT_SCALE          "scale"
+#define CMD_LINE_OPT_QUALIFY        "qualify"
+#define CMD_LINE_OPT_SMALL_MBUFS    "small-mbufs"
+#define CMD_LINE_OPT_TAKEOVER       "takeover"
+#define CMD_LINE_OPT_TRACE_EVENTS   "trace-events"
+#define CMD_LINE_OPT_TRACE_FILE     "trace-file"
+#define CMD_LINE_OPT_HEADER_COMP    "header-comp"
+#define CMD_LINE_OPT_SHED           "shed"
+#define CMD_LINE_OPT_INSTANCES      "instances"
+
+enum {
+    // long options mapped to short options start after the last char
+    CMD_LINE_OPT_MIN_NUM = 256,
+    CMD_LINE_OPT_CRYPTO_DEV_NUM,
+    CMD_LINE_OPT_CRYPTO_ALGO_NUM,
+    CMD_LINE_OPT_COMPRESS_NUM,
+    CMD_LINE_OPT_CAPTURE_NUM,
+    CMD_LINE_OPT_CAPTURE_DIR_NUM,
+    CMD_LINE_OPT_TUNING_NUM,
+    CMD_LINE_OPT_AUTOTUNE_NUM,
+    CMD_LINE_OPT_SPILL_NUM,
+    CMD_LINE_OPT_SPILL_FILE_NUM,
+    CMD_LINE_OPT_FILE_TX_NUM,
+    CMD_LINE_OPT_FILE_RATE_NUM,
+    CMD_LINE_OPT_FILE_RX_NUM,
+    CMD_LINE_OPT_TOP_TALKERS_NUM,
+    CMD_LINE_OPT_WATCHDOG_NUM,
+    CMD_LINE_OPT_HEARTBEAT_NUM,
+    CMD_LINE_OPT_EVENTDEV_NUM,
+    CMD_LINE_OPT_SCALE_NUM,
+    CMD_LINE_OPT_QUALIFY_NUM,
+    CMD_LINE_OPT_SMALL_MBUFS_NUM,
+    CMD_LINE_OPT_TAKEOVER_NUM,
+    CMD_LINE_OPT_TRACE_EVENTS_NUM,
+    CMD_LINE_OPT_TRACE_FILE_NUM,
+    CMD_LINE_OPT_HEADER_COMP_NUM,
+    CMD_LINE_OPT_SHED_NUM,
+    CMD_LINE_OPT_INSTANCES_NUM,
+};
+
+
+// config reload thread wakes up this often to check for SIGHUP
+#define DD_CONFIG_POLL_MS           200
+#define DD_CONFIG_SETTLE_MS         50
+#define DD_CONFIG_QS_POLL_US        10
+
+// watchdog checks the lcore heartbeats this often, and by default reports
+// an lcore whose heartbeat did not advance for DD_WATCHDOG_MS
+#define DD_WATCHDOG_POLL_US         1000
+#define DD_WATCHDOG_MS              10
+
+// links of all ports are awaited together at startup, up to WAIT. The
+// link thread reads ports with a pending LSC interrupt every POLL and
+// all ports every CHECK.
+#define DD_LINK_WAIT_MS             2000
+#define DD_LINK_CHECK_MS            100
+#define DD_LINK_POLL_MS             10
+
+// scaler looks at the lcore busy share (percent) this often. An lcore
+// above HIGH hands a port to another one, an lcore below LOW gives its
+// ports to one that stays below TARGET with them and then parks.
+#define DD_SCALE_INTERVAL_MS        500
+#define DD_SCALE_HIGH_PCT           80
+#define DD_SCALE_LOW_PCT            20
+#define DD_SCALE_TARGET_PCT         60
+#define DD_SCALE_PARK_US            1000
 
 dataDiodeApp *dataDiodeApp::_appPtr = NULL;
 volatile bool dataDiodeApp::_forceQuit = false;
+volatile bool dataDiodeApp::_reloadRequested = false;
 
 static int
 perCoreLoop(__attribute__((unused)) void* args)
@@ -46,51 +150,52 @@ perCoreLoop(__attribute__((unused)) void* args)
 
 dataDiodeApp::dataDiodeApp() :
 #ifndef _DD_TESTMODE_
-        _corePortId(0),_corePort(NULL),
+        _corePortId(0),
 #endif
-        _nbMbufs(4096), _pktMbufPool(NULL),
+        _nbMbufs(4096), _instancesConf(false), _nInstances(0),
+        _smallMbufPool(NULL), _nbSmallMbufs(0),
         _userPortMask(0), _corePortMode(PORTMODE_INVALID),
-        _timerPeriod(2), _accessPort(NULL),
-        _sId(0), _peerSId(0),showEthStats(false),
-        _rxQueuePerLcore(1)
+        _timerPeriod(2),
+        showEthStats(false),
+        _rxQueuePerLcore(1), _crypto(NULL), _compress(NULL), _capture(NULL),
+        _spill(NULL), _spillLastTsc(0), _spillLastSpilled(0), _spillLastDrained(0),
+        _fileTx(NULL), _fileRx(NULL), _topTalkers(NULL), _heartbeat(NULL), _qualify(NULL),
+        _handoff(NULL), _takeover(false), _trace(NULL), _hdrComp(NULL),
+        _eventDev(NULL),
+        _statsExport(NULL), _tuningFile(DD_TUNING_FILE), _autotune(false),
+        _configGeneration(0), _configReloads(0), _configReloadErrors(0),
+        _watchdogMs(DD_WATCHDOG_MS), _scale(false), _portMoves(0)
 {
-    bzero(&_peerCorePortEthAddr, sizeof(_peerCorePortEthAddr));
+    bzero(_lcoreQs, sizeof(_lcoreQs));
+    bzero(_shedPct, sizeof(_shedPct));
+    bzero(_lcoreCycles, sizeof(_lcoreCycles));
+    bzero(_lcoreCyclesLast, sizeof(_lcoreCyclesLast));
+    bzero(_lcoreStalls, sizeof(_lcoreStalls));
+    bzero(_instances, sizeof(_instances));
+    bzero(_portInstance, sizeof(_portInstance));
     bzero(_lcoreQueueConf, sizeof(lcoreQueueConf));
+    bzero((void *)_lcoreParked, sizeof(_lcoreParked));
+    bzero(_lcoreParks, sizeof(_lcoreParks));
+    // lcore polling a port, assigned with the RX queues, until the scaler
+    // moves it
+    for (int i = 0; i < RTE_MAX_ETHPORTS; i++) {
+        _portOwner[i] = i;
+        _portHandover[i] = -1;
+    }
 #ifdef _DD_TESTMODE_
         _corePortId[0] = 0;
         _corePortId[1] = 0;
-        _corePort[0] = NULL;
-        _corePort[1] = NULL;
 
 #endif
 }
 
-#ifndef _DD_TESTMODE_
-void
-dataDiodeApp::configure(struct ether_addr* peerMac, uint16_t peerSId, uint16_t sId)
-{
-    _peerSId = peerSId;
-    _sId = sId;
-    bcopy(peerMac, &_peerCorePortEthAddr, sizeof(struct ether_addr));
-}
-#else
-void
-dataDiodeApp::configure(struct ether_addr* peerMac, struct ether_addr* peerMac1,
-                        uint16_t peerSId, uint16_t sId)
-{
-    _peerSId = peerSId;
-    _sId = sId;
-    bcopy(peerMac, &_peerCorePortEthAddr[0], sizeof(struct ether_addr));
-    bcopy(peerMac1, &_peerCorePortEthAddr[1], sizeof(struct ether_addr));
-}
-#endif
-
 void
 dataDiodeApp::initialize(int argc, char **argv)
 {
     // setup signal handler to start with
     signal(SIGINT, dataDiodeApp::sigHandler);
     signal(SIGTERM, dataDiodeApp::sigHandler);
+    signal(SIGHUP, dataDiodeApp::sigHandler);
 
     // initialize DPDK RTE EAL
     int ret = rte_eal_init(argc, argv);
@@ -108,6 +213,41 @@ dataDiodeApp::initialize(int argc, char **argv)
                  "Incorrect arguments.\nExiting...\n");
     }
 
+    // the command line describes one diode, instances.conf any number of
+    // them with ports, lcores and mempools of their own
+    if (_instancesConf) {
+        _nInstances = ddInstance::readInstances(DD_CONFIG_INSTANCES_FILE, _nbMbufs, _instances);
+        if (0 == _nInstances) {
+            rte_exit(EXIT_FAILURE,
+                     "Unable to read " DD_CONFIG_INSTANCES_FILE ".\nExiting...\n");
+        }
+    } else {
+#ifndef _DD_TESTMODE_
+        _instances[0] = new ddInstance(0, "default", DD_CONFIG_DIR, _corePortMode,
+                                       _userPortMask, _corePortId, _nbMbufs);
+#else
+        _instances[0] = new ddInstance(0, "default", DD_CONFIG_DIR, _corePortMode,
+                                       _userPortMask, _corePortId[0], _nbMbufs);
+#endif
+        _instances[0]->ownAllLcores();
+        _nInstances = 1;
+    }
+
+    // read configuration files, they are re-read on SIGHUP or when changed.
+    // The sender table lives in hugepage memory, hence after the EAL.
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        if (!_instances[i]->loadConfig(0)) {
+            rte_exit(EXIT_FAILURE,
+                     "Unable to read configuration files of %s.\nExiting...\n",
+                     _instances[i]->name());
+        }
+    }
+
+    // the first events are those of the port startup
+    if (NULL != _trace) {
+        _trace->initialize();
+    }
+
     // enumerate ports
     int nPorts = rte_eth_dev_count_avail();
     if (nPorts == 0) {
@@ -115,109 +255,277 @@ dataDiodeApp::initialize(int argc, char **argv)
     }
 
     uint16_t portId;
-    unsigned int rxLcoreId = 0;
-    lcoreQueueConf *qConf = NULL;
+    _userPortMask = 0;
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        RTE_ETH_FOREACH_DEV(portId) {
+            if (_instances[i]->ownsPort(portId)) {
+                _portInstance[portId] = _instances[i];
+                _userPortMask |= 1ULL << portId;
+            }
+        }
+    }
 
-    // Initialize the port/queue configuration of each logical core
-    RTE_ETH_FOREACH_DEV(portId) {
-        // skip the ports that are not enabled
-        if ((_userPortMask & (1 << portId)) == 0)
-            continue;
+    // Initialize the port/queue configuration of each logical core, an
+    // lcore polls the ports of one instance only
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        ddInstance *diode = _instances[i];
+        unsigned int rxLcoreId = 0;
+        lcoreQueueConf *qConf = NULL;
+
+        RTE_ETH_FOREACH_DEV(portId) {
+            // skip the ports that are not enabled
+            if (diode != _portInstance[portId])
+                continue;
+
+            // get the lcore_id for this port
+            while (0 == rte_lcore_is_enabled(rxLcoreId) || !diode->ownsLcore(rxLcoreId) ||
+                    _lcoreQueueConf[rxLcoreId].nRxPort == _rxQueuePerLcore) {
+                rxLcoreId++;
+                if (rxLcoreId >= RTE_MAX_LCORE) {
+                    if (_instancesConf)
+                        rte_exit(EXIT_FAILURE, "Not enough cores for instance %s\n",
+                                 diode->name());
+                    rte_exit(EXIT_FAILURE, "Not enough cores\n");
+                }
+            }
+
+            if (qConf != &_lcoreQueueConf[rxLcoreId]) {
+                // Assigned a new logical core in the loop above
+                qConf = &_lcoreQueueConf[rxLcoreId];
+            }
 
-        // get the lcore_id for this port
-        while (0 == rte_lcore_is_enabled(rxLcoreId) ||
-                _lcoreQueueConf[rxLcoreId].nRxPort == _rxQueuePerLcore) {
-            rxLcoreId++;
-            if (rxLcoreId >= RTE_MAX_LCORE)
-                rte_exit(EXIT_FAILURE, "Not enough cores\n");
+            qConf->rxPortList[qConf->nRxPort] = portId;
+            qConf->nRxPort++;
+            _portOwner[portId] = rxLcoreId;
+            std::cout << "Lcore " << rxLcoreId << ": RX port " << portId
+                      << ": nRxPort " << qConf->nRxPort << std::endl;
         }
+    }
+
 
-        if (qConf != &_lcoreQueueConf[rxLcoreId]) {
-            // Assigned a new logical core in the loop above
-            qConf = &_lcoreQueueConf[rxLcoreId];
+    // create mbuf pool, or use the one of the running instance. The pools
+    // of the instances of instances.conf are on the socket of their core
+    // port.
+    if (_instancesConf) {
+        for (uint32_t i = 0; i < _nInstances; i++) {
+            char poolName[RTE_MEMPOOL_NAMESIZE];
+            snprintf(poolName, sizeof(poolName), "mbuf_pool_%s", _instances[i]->name());
+            _instances[i]->createMempool(poolName, _instances[i]->socketId(),
+                                         _tuning.mempoolCache, false);
         }
+    } else {
+        _instances[0]->createMempool("mbuf_pool", rte_socket_id(), _tuning.mempoolCache,
+                                     _takeover);
+    }
+
+    // small frames are copied into their own size class after RX, the
+    // RX rings keep filling from the standard pool
+    if (_takeover)
+        _smallMbufPool = rte_mempool_lookup("mbuf_pool_small");
+    if (NULL != _smallMbufPool) {
+        _nbSmallMbufs = _smallMbufPool->size;
+        std::cout << "Mempool " << _smallMbufPool->name << ": " << _nbSmallMbufs
+                  << " mbufs of the running instance" << std::endl;
+    } else if (_nbSmallMbufs) {
+        _smallMbufPool = rte_pktmbuf_pool_create("mbuf_pool_small", _nbSmallMbufs,
+                                                 _tuning.mempoolCache,
+                                                 0, MBUF_SMALL_DATA_SZ,
+                                                 rte_socket_id());
+        if (_smallMbufPool == NULL)
+            rte_exit(EXIT_FAILURE, "Could not create the small mbuf pool\n");
+        std::cout << "Mempool " << _smallMbufPool->name << ": " << _nbSmallMbufs
+                  << " mbufs of " << MBUF_SMALL_DATA_SZ << " bytes, "
+                  << mempoolBytes(_smallMbufPool) / 1024 << " KB" << std::endl;
+    }
 
-        qConf->rxPortList[qConf->nRxPort] = portId;
-        qConf->nRxPort++;
-        std::cout << "Lcore " << rxLcoreId << ": RX port " << portId
-                  << ": nRxPort " << qConf->nRxPort << std::endl;
+    // payload crypto stage has to be ready before ports start forwarding
+    if (NULL != _crypto) {
+        _crypto->loadKeys();
+        _crypto->initialize();
     }
 
+    // and so does the payload compression stage
+    if (NULL != _compress) {
+        _compress->initialize(pktMbufPool());
+    }
 
-    // create mbuf pool
-    _pktMbufPool = rte_pktmbuf_pool_create("mbuf_pool", _nbMbufs,
-                                           MEMPOOL_CACHE_SZ,
-                                           0, MBUF_DATA_SZ,
-                                           rte_socket_id());
-    if (_pktMbufPool == NULL) {
-        rte_exit(EXIT_FAILURE,
-                 "Could not initializing memory buffer pool.\nExiting...\n");
-        return;
+    // capture writer runs on a control thread, off the forwarding lcores
+    if (NULL != _capture) {
+        _capture->initialize();
+    }
+
+    // spill queue absorbs access link stalls of the Rx-Only role
+    if (NULL != _spill) {
+        _spill->initialize();
+        _spillLastTsc = rte_rdtsc();
+    }
+
+    // file transfer reads and writes files on control threads
+    if (NULL != _fileTx) {
+        _fileTx->initialize();
+    }
+    if (NULL != _fileRx) {
+        _fileRx->initialize();
+    }
+
+    if (NULL != _topTalkers) {
+        _topTalkers->initialize();
+    }
+
+    // heartbeats are sent by the Tx-Only role and watched by the Rx-Only one
+    if (NULL != _heartbeat) {
+        _heartbeat->initialize(pktMbufPool(), PORTMODE_TX != _corePortMode);
+    }
+
+    // and so are the qualification test frames
+    if (NULL != _qualify) {
+        _qualify->initialize(pktMbufPool(), PORTMODE_RX != _corePortMode,
+                             PORTMODE_TX != _corePortMode);
+    }
+
+    // so does the config reload
+    ret = rte_ctrl_thread_create(&_configThread, "dd-config", NULL,
+                                 dataDiodeApp::configMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start config reload thread: err = %d\n", ret);
+
+    if (_watchdogMs) {
+        ret = rte_ctrl_thread_create(&_watchdogThread, "dd-watchdog", NULL,
+                                     dataDiodeApp::watchdogMain, this);
+        if (ret != 0)
+            rte_exit(EXIT_FAILURE, "Cannot start watchdog thread: err = %d\n", ret);
     }
 
     struct rte_eth_dev_info devInfo;
     RTE_ETH_FOREACH_DEV(portId) {
         // skip ports that are not enabled
-        if ((_userPortMask & (1 << portId)) == 0)
+        if (NULL == _portInstance[portId])
             continue;
 
-        ddPort *pPort;
+        ddPort *pPort = _portInstance[portId]->createPort(portId);
 
-#ifndef _DD_TESTMODE_
-        if (portId == _corePortId) {
-            if (PORTMODE_RX == _corePortMode) {
-                std::cout << "Setting Rx-Only role on Port: "
-                          << portId << std::endl;
-                pPort = new ddRxOnlyCorePort(portId);
-                _corePort = pPort;
-            } else if (PORTMODE_TX == _corePortMode) {
-                std::cout << "Setting Tx-Only role on Port: "
-                          << portId << std::endl;
-                pPort = new ddTxOnlyCorePort(portId);
-                _corePort = pPort;
-            } else {
-                rte_exit(EXIT_FAILURE, "Invalid Port mode %u for port: %u.\nExiting...\n",
-                         _corePortMode, portId);
-            }
-#else
-            std::cerr << "WARNING: Running the Application in test mode" << std::endl;
-            std::cerr << "WARNING: Test mode is not to be run in production network" << std::endl;
-            std::cout << "Setting Rx-Only and Tx-only roles on Port: "
-                      << _corePortId[0] << " and Port: " << _corePortId[1]
-                      << std::endl;
-            if (portId == _corePortId[0]) {
-                    pPort = new ddRxOnlyCorePort(portId);
-                    _corePort[0] = pPort;
-            } else if (portId == _corePortId[1]) {
-                    pPort = new ddTxOnlyCorePort(portId);
-                    _corePort[1] = pPort;
-#endif
-        } else {
-            std::cout << "Setting Access port " << portId << std::endl;
-            pPort = new ddAccessPort(portId);
-            if (NULL == _accessPort) {
-                _accessPort = pPort;
-            }
-        }
         _pMap.insert(std::pair<uint16_t,ddPort*>(portId, pPort));
         std::cout << "Port Id: " << portId << " PortName: "
                   << pPort->devName() << std::endl;
+    }
+
+    // the crypto stage has one queue pair per direction and no locks
+    if (NULL != _crypto && !accessPortsOnOneLcore())
+        rte_exit(EXIT_FAILURE, "Crypto needs all access ports on one lcore\n");
+    // so has the compression stage, its in-order slots are filled and
+    // emptied by one lcore
+    if (NULL != _compress && !accessPortsOnOneLcore())
+        rte_exit(EXIT_FAILURE, "Compression needs all access ports on one lcore\n");
+
+    // the contexts of the Tx-Only side are per access port
+    if (NULL != _hdrComp) {
+        _hdrComp->initialize(PORTMODE_RX != _corePortMode, PORTMODE_TX != _corePortMode);
+    }
+
+    // stateful stages keep frames an instance taking over knows nothing of
+    _handoff->initialize(NULL == _crypto && NULL == _compress && NULL == _spill &&
+                         NULL == _fileTx && NULL == _fileRx && NULL == _eventDev &&
+                         !_autotune && !_scale);
+    startPorts();
+
+    // overloaded access ports shed the low priority classes
+    for (uint16_t portId = 0; portId < RTE_MAX_ETHPORTS; portId++) {
+        ddPort *port = egressPort(portId);
+        if (NULL != port && !port->wrongDirection())
+            port->setShedWatermarks(_shedPct);
+    }
+
+    // link changes are followed from now on
+    ret = rte_ctrl_thread_create(&_linkThread, "dd-link", NULL,
+                                 dataDiodeApp::linkMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start link thread: err = %d\n", ret);
+
+    for (uint32_t i = 0; i < _nInstances; i++)
+        _instances[i]->prepareSenders(_instances[i]->config());
+
+    // scheduled worker mode, the ports have to exist
+    if (NULL != _eventDev) {
+        _eventDev->initialize();
+    }
+
+    // statistics are published to shared memory for datadiode-stat
+    _statsExport = new ddStatsExport();
+    _statsExport->initialize();
 
-        pPort->initialize();
-        pPort->checkLinkStatus();
+    if (_scale) {
+        ret = rte_ctrl_thread_create(&_scaleThread, "dd-scale", NULL,
+                                     dataDiodeApp::scaleMain, this);
+        if (ret != 0)
+            rte_exit(EXIT_FAILURE, "Cannot start scaler thread: err = %d\n", ret);
     }
 
     ret = 0;
     uint32_t lcoreId;
-    // launch per-lcore initialization on every lcore
-    rte_eal_mp_remote_launch(perCoreLoop, NULL, CALL_MASTER);
-    RTE_LCORE_FOREACH_SLAVE(lcoreId) {
-        if (rte_eal_wait_lcore(lcoreId) < 0) {
-            ret = -1;
-            break;
+    if (_autotune) {
+        // forwarding lcores stay idle, the sweep drives the ports itself
+        ddAutotune autotune(_tuningFile);
+        autotune.run();
+        _forceQuit = true;
+    } else {
+        // the lcores have to spin before the running instance lets go
+        _handoff->expect(rte_lcore_count());
+        if (_handoff->takeover())
+            _handoff->request();
+        // launch per-lcore initialization on every lcore
+        rte_eal_mp_remote_launch(perCoreLoop, NULL, CALL_MASTER);
+        RTE_LCORE_FOREACH_SLAVE(lcoreId) {
+            if (rte_eal_wait_lcore(lcoreId) < 0) {
+                ret = -1;
+                break;
+            }
         }
     }
 
+    pthread_join(_configThread, NULL);
+    pthread_join(_linkThread, NULL);
+    if (_watchdogMs)
+        pthread_join(_watchdogThread, NULL);
+    if (_scale)
+        pthread_join(_scaleThread, NULL);
+    _statsExport->cleanup();
+
+    if (NULL != _capture) {
+        _capture->cleanup();
+    }
+
+    if (NULL != _spill) {
+        _spill->cleanup();
+    }
+
+    if (NULL != _fileTx) {
+        _fileTx->cleanup();
+    }
+    if (NULL != _fileRx) {
+        _fileRx->cleanup();
+    }
+
+    if (NULL != _topTalkers) {
+        _topTalkers->cleanup();
+    }
+
+    if (NULL != _heartbeat) {
+        _heartbeat->cleanup();
+    }
+
+    if (NULL != _qualify) {
+        _qualify->cleanup();
+    }
+
+    if (NULL != _eventDev) {
+        _eventDev->cleanup();
+    }
+
+    _handoff->cleanup();
+    if (_handoff->handedOff()) {
+        std::cout << "Ports handed off to the new instance" << std::endl;
+        return;
+    }
     for(ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
         rte_eth_dev_stop(it->second->portId());
         rte_eth_dev_close(it->second->portId());
@@ -232,8 +540,13 @@ dataDiodeApp::mainLoop()
 
     std::cout << "Starting main loop on core: "<< lCoreId << " ..." << std::endl;
 
-    if (qConf->nRxPort == 0) {
+    // in event mode the lcores without a port are the workers, with the
+    // scaler they wait parked for one; the master lcore without a port,
+    // like with instances.conf, still prints the statistics
+    if (qConf->nRxPort == 0 && !_scale && (NULL == _eventDev || !_eventDev->worker(lCoreId)) &&
+        (lCoreId != rte_get_master_lcore() || 0 == _timerPeriod)) {
         std::cout << "lcore " << lCoreId << " has nothing to do" << std::endl;
+        leaveLoop();
         return;
     }
 
@@ -244,10 +557,15 @@ dataDiodeApp::mainLoop()
     }
 
     const uint64_t drainTsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S *
-                BURST_TX_DRAIN_US;
+                _tuning.drainUs;
     volatile uint64_t prevTsc = 0, timerTsc = 0, curTsc, diffTsc;
+    struct lcoreQs_ *qs = &_lcoreQs[lCoreId];
+    struct lcoreCycles *cycles = &_lcoreCycles[lCoreId];
+    qs->online = true;
+    rte_smp_mb();
     while (!_forceQuit) {
         curTsc = rte_rdtsc();
+        uint64_t phaseTsc = curTsc, nowTsc;
 
         // TX burst queue drain
         diffTsc = curTsc - prevTsc;
@@ -255,16 +573,35 @@ dataDiodeApp::mainLoop()
 
             for (ddPortMap::iterator it = _pMap.begin();
                  it != _pMap.end(); ++it) {
-                if (lCoreId == it->second->portId())
+                if (lCoreId == (uint32_t)_portOwner[it->first] &&
+                    _handoff->owns(it->first))
                     it->second->handleTx();
             }
+            nowTsc = rte_rdtsc();
+            cycles->tx += nowTsc - phaseTsc;
+            phaseTsc = nowTsc;
         }
         // Read packet from RX queues
-        for (ddPortMap::iterator it = _pMap.begin();
-             it != _pMap.end(); ++it) {
-            if (lCoreId == it->second->portId())
-                it->second->handleRx();
+        uint32_t nRx = 0;
+        if (NULL != _eventDev) {
+            nRx = _eventDev->poll(lCoreId);
+        } else {
+            for (ddPortMap::iterator it = _pMap.begin();
+                 it != _pMap.end(); ++it) {
+                if (lCoreId == (uint32_t)_portOwner[it->first] &&
+                    _handoff->owns(it->first))
+                    nRx += it->second->handleRx();
+            }
         }
+        // empty polls count as idle time
+        nowTsc = rte_rdtsc();
+        if (nRx)
+            cycles->rx += nowTsc - phaseTsc;
+        else
+            cycles->idle += nowTsc - phaseTsc;
+        cycles->pkts += nRx;
+        cycles->burstHist[nRx ? RTE_MIN(32 - __builtin_clz(nRx), BURST_HIST_SZ - 1) : 0]++;
+
         // do this only on master core and if timer is enabled
         if (lCoreId == rte_get_master_lcore() && _timerPeriod > 0) {
             // advance the timer
@@ -272,12 +609,457 @@ dataDiodeApp::mainLoop()
 
             // if timer has reached its timeout
             if (unlikely(timerTsc >= (_timerPeriod * rte_get_tsc_hz()))) {
+                cycles->inStats = true;
                 printStats();
+                cycles->inStats = false;
+                cycles->stats += rte_rdtsc() - nowTsc;
                 // reset the timer
                 timerTsc = 0;
             }
         }
         prevTsc = curTsc;
+
+        // ports change owner between two bursts
+        if (unlikely(_scale))
+            handoverPorts(lCoreId);
+
+        // a new instance asked for the ports, let go at this burst boundary
+        if (unlikely(_handoff->requested()))
+            _forceQuit = true;
+
+        // no config snapshot is referenced past this point, the counter
+        // doubles as heartbeat for the watchdog
+        rte_smp_mb();
+        qs->cnt++;
+    }
+    qs->online = false;
+    leaveLoop();
+}
+
+bool
+dataDiodeApp::accessPortsOnOneLcore() const
+{
+    int lcoreId = -1;
+    for (ddPortMap::const_iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+        if (NULL == dynamic_cast<const ddAccessPort *>(it->second) || it->second->wrongDirection())
+            continue;
+        if (lcoreId >= 0 && lcoreId != _portOwner[it->first])
+            return false;
+        lcoreId = _portOwner[it->first];
+    }
+    return true;
+}
+
+void
+dataDiodeApp::leaveLoop()
+{
+    // Once the last lcore left, nothing is added to any TX buffer. Frames
+    // already buffered go out before the new instance polls, also those an
+    // access lcore put into the buffer of the core port.
+    if (!_handoff->leave() || !_handoff->handedOff())
+        return;
+    rte_smp_rmb();
+    for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it)
+        it->second->handleTx();
+    for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it)
+        _handoff->release(it->second);
+}
+
+void*
+dataDiodeApp::portInitMain(void *arg)
+{
+    reinterpret_cast<ddPort *>(arg)->initialize();
+    return NULL;
+}
+
+void
+dataDiodeApp::startPorts()
+{
+    pthread_t threads[RTE_MAX_ETHPORTS];
+    uint32_t nThreads = 0;
+
+    // the running instance keeps polling them until they are handed off
+    if (_handoff->takeover()) {
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it)
+            it->second->attach(_handoff->rxMode(it->first));
+        return;
+    }
+
+    // configuring and starting a device takes a while, do all at once
+    for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+        char name[RTE_MAX_THREAD_NAME_LEN];
+        snprintf(name, sizeof(name), "dd-port%u", it->second->portId());
+        int ret = rte_ctrl_thread_create(&threads[nThreads++], name, NULL,
+                                         dataDiodeApp::portInitMain, it->second);
+        if (ret != 0)
+            rte_exit(EXIT_FAILURE, "Cannot start port thread: err = %d\n", ret);
+    }
+    for (uint32_t i = 0; i < nThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    // and so do the links, under one deadline
+    uint64_t deadline = rte_get_timer_cycles() + rte_get_timer_hz() / 1000 * DD_LINK_WAIT_MS;
+    std::cout << "Checking link status";
+    while (!_forceQuit) {
+        bool allUp = true;
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it)
+            allUp = it->second->checkLinkStatus(false) && allUp;
+        if (allUp || rte_get_timer_cycles() > deadline)
+            break;
+        std::cout << "." << std::flush;
+        rte_delay_ms(DD_LINK_CHECK_MS);
+    }
+    std::cout << "done" << std::endl;
+
+    for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+        if (it->second->linkUp())
+            std::cout << "Port " << it->second->portId() << " Link Up. Speed "
+                      << it->second->linkSpeed() << " Mbps" << std::endl;
+        else
+            std::cout << "Port " << it->second->portId() << " Link Down" << std::endl;
+        _handoff->publish(it->second);
+    }
+}
+
+void*
+dataDiodeApp::linkMain(void *arg)
+{
+    reinterpret_cast<dataDiodeApp *>(arg)->linkLoop();
+    return NULL;
+}
+
+void
+dataDiodeApp::linkLoop()
+{
+    const uint32_t checkRounds = DD_LINK_CHECK_MS / DD_LINK_POLL_MS;
+    uint32_t round = 0;
+
+    while (!_forceQuit) {
+        usleep(DD_LINK_POLL_MS * 1000);
+        // ports with an interrupt are read as soon as it fired, all of them
+        // now and then for those without and for a missed interrupt
+        bool checkAll = (0 == ++round % checkRounds);
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+            if (it->second->takeLscPending() || checkAll)
+                it->second->checkLinkStatus();
+        }
+    }
+}
+
+void*
+dataDiodeApp::configMain(void *arg)
+{
+    reinterpret_cast<dataDiodeApp *>(arg)->configLoop();
+    return NULL;
+}
+
+void
+dataDiodeApp::configLoop()
+{
+    // config files replaced by editors or deployment tools show up as
+    // close-after-write or move into the config directory
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        const char *dir = _instances[i]->configDir();
+        if (fd < 0 || inotify_add_watch(fd, dir,
+                                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+            RTE_LOG(WARNING, USER1, "Cannot watch %s, reload on SIGHUP only\n", dir);
+        }
+    }
+
+    while (!_forceQuit) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, DD_CONFIG_POLL_MS) > 0 && (pfd.revents & POLLIN)) {
+            // a write is often followed by more, let the burst settle
+            char events[4096];
+            usleep(DD_CONFIG_SETTLE_MS * 1000);
+            while (read(fd, events, sizeof(events)) > 0)
+                ;
+            _reloadRequested = true;
+        }
+        if (_reloadRequested) {
+            _reloadRequested = false;
+            reloadConfig();
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+void
+dataDiodeApp::reloadConfig()
+{
+    // every instance publishes its own snapshot, readers of the old ones
+    // are waited for once
+    uint32_t generation = _configGeneration + 1;
+    ddConfig *oldConfigs[DD_MAX_INSTANCES];
+    uint32_t nOld = 0;
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        bool failed = false;
+        ddConfig *oldConfig = _instances[i]->reloadConfig(generation, &failed);
+        if (failed)
+            _configReloadErrors++;
+        if (NULL != oldConfig)
+            oldConfigs[nOld++] = oldConfig;
+    }
+    if (0 == nOld)
+        return;
+
+    _configGeneration = generation;
+    if (NULL != _trace)
+        _trace->record(DD_TRACE_CONFIG_SWAP, 0, 0, _configGeneration);
+    _configReloads++;
+    // on shutdown the lcores may still read the old snapshots, they are
+    // left to the process exit
+    if (!synchronize())
+        return;
+    for (uint32_t i = 0; i < nOld; i++)
+        delete oldConfigs[i];
+}
+
+bool
+dataDiodeApp::synchronize()
+{
+    uint64_t seen[RTE_MAX_LCORE];
+
+    rte_smp_mb();
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++)
+        seen[i] = _lcoreQs[i].cnt;
+
+    // an lcore that advanced its counter or left the loop holds no
+    // reference to the old snapshot any more
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++) {
+        while (_lcoreQs[i].online && _lcoreQs[i].cnt == seen[i] && !_forceQuit)
+            usleep(DD_CONFIG_QS_POLL_US);
+    }
+    rte_smp_mb();
+    return !_forceQuit;
+}
+
+void*
+dataDiodeApp::watchdogMain(void *arg)
+{
+    reinterpret_cast<dataDiodeApp *>(arg)->watchdogLoop();
+    return NULL;
+}
+
+void
+dataDiodeApp::watchdogLoop()
+{
+    uint64_t lastCnt[RTE_MAX_LCORE];
+    uint64_t lastBeatTsc[RTE_MAX_LCORE];
+    bool stalled[RTE_MAX_LCORE];
+    const uint64_t stallTsc = rte_get_tsc_hz() / 1000 * _watchdogMs;
+
+    bzero(lastCnt, sizeof(lastCnt));
+    bzero(lastBeatTsc, sizeof(lastBeatTsc));
+    bzero(stalled, sizeof(stalled));
+    while (!_forceQuit) {
+        usleep(DD_WATCHDOG_POLL_US);
+        uint64_t now = rte_rdtsc();
+        uint32_t lcoreId;
+        RTE_LCORE_FOREACH(lcoreId) {
+            const struct lcoreQs_ *qs = &_lcoreQs[lcoreId];
+            uint64_t cnt = qs->cnt;
+
+            // lcores outside the loop or printing statistics are not checked
+            if (cnt != lastCnt[lcoreId] || !qs->online || _lcoreCycles[lcoreId].inStats) {
+                if (stalled[lcoreId]) {
+                    RTE_LOG(WARNING, USER1, "lcore %u resumed after %lu ms\n", lcoreId,
+                            (unsigned long)((now - lastBeatTsc[lcoreId]) * 1000 / rte_get_tsc_hz()));
+                    stalled[lcoreId] = false;
+                }
+                lastCnt[lcoreId] = cnt;
+                lastBeatTsc[lcoreId] = now;
+            } else if (!stalled[lcoreId] && now - lastBeatTsc[lcoreId] > stallTsc) {
+                RTE_LOG(ERR, USER1, "lcore %u stalled, no heartbeat for %u ms\n",
+                        lcoreId, _watchdogMs);
+                stalled[lcoreId] = true;
+                _lcoreStalls[lcoreId]++;
+            }
+        }
+    }
+}
+
+uint32_t
+dataDiodeApp::ownedPorts(uint32_t lcoreId) const
+{
+    // a port being handed over counts for both lcores
+    uint32_t n = 0;
+    for (ddPortMap::const_iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+        uint16_t portId = it->second->portId();
+        if (lcoreId == (uint32_t)_portOwner[portId] ||
+            (int)lcoreId == _portHandover[portId])
+            n++;
+    }
+    return n;
+}
+
+void
+dataDiodeApp::handoverPorts(uint32_t lcoreId)
+{
+    for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+        uint16_t portId = it->second->portId();
+        int target = _portHandover[portId];
+        if (target < 0 || lcoreId != (uint32_t)_portOwner[portId])
+            continue;
+
+        // Only the owner polls a port. Frames it buffered go out before
+        // the new owner sends any, frames not read yet wait in the RX
+        // ring, so nothing is lost or reordered.
+        it->second->handleTx();
+        rte_smp_wmb();
+        _portOwner[portId] = target;
+        _portHandover[portId] = -1;
+        _portMoves++;
+        RTE_LOG(INFO, USER1, "Port %u moved from lcore %u to lcore %d\n",
+                portId, lcoreId, target);
+    }
+
+    // the master lcore prints the statistics and is never parked
+    if (lcoreId == rte_get_master_lcore() || 0 != ownedPorts(lcoreId))
+        return;
+
+    // a parked lcore holds no config snapshot and has no heartbeat
+    struct lcoreQs_ *qs = &_lcoreQs[lcoreId];
+    qs->online = false;
+    _lcoreParked[lcoreId] = true;
+    _lcoreParks[lcoreId]++;
+    rte_smp_mb();
+    RTE_LOG(INFO, USER1, "lcore %u parked\n", lcoreId);
+    // woken by a handover to it, it is polling before the port arrives
+    while (0 == ownedPorts(lcoreId) && !_forceQuit)
+        usleep(DD_SCALE_PARK_US);
+    _lcoreParked[lcoreId] = false;
+    qs->online = true;
+    rte_smp_mb();
+    RTE_LOG(INFO, USER1, "lcore %u resumed\n", lcoreId);
+}
+
+void*
+dataDiodeApp::scaleMain(void *arg)
+{
+    reinterpret_cast<dataDiodeApp *>(arg)->scaleLoop();
+    return NULL;
+}
+
+void
+dataDiodeApp::scaleLoop()
+{
+    struct lcoreCycles last[RTE_MAX_LCORE];
+    uint64_t lastRx[RTE_MAX_ETHPORTS];
+    uint32_t busy[RTE_MAX_LCORE];
+    uint64_t load[RTE_MAX_ETHPORTS];
+    bool deep[RTE_MAX_ETHPORTS];
+    uint32_t lcoreId;
+
+    bzero(last, sizeof(last));
+    bzero(lastRx, sizeof(lastRx));
+    while (!_forceQuit) {
+        usleep(DD_SCALE_INTERVAL_MS * 1000);
+
+        // busy share of every lcore since the last round, parked ones
+        // do not count cycles at all
+        RTE_LCORE_FOREACH(lcoreId) {
+            struct lcoreCycles cur = _lcoreCycles[lcoreId];
+            uint64_t work = (cur.rx - last[lcoreId].rx) + (cur.tx - last[lcoreId].tx);
+            uint64_t total = work + cur.idle - last[lcoreId].idle;
+            busy[lcoreId] = total ? work * 100 / total : 0;
+            last[lcoreId] = cur;
+        }
+
+        // packets per port pick the port to move, a backed up RX ring
+        // means its lcore falls behind whatever the busy share says
+        bool pending = false;
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+            uint16_t portId = it->second->portId();
+            uint64_t rx = it->second->rxStats();
+            load[portId] = rx - lastRx[portId];
+            lastRx[portId] = rx;
+            int depth = rte_eth_rx_queue_count(portId, 0);
+            deep[portId] = depth > _tuning.nbRxd / 2;
+            if (_portHandover[portId] >= 0)
+                pending = true;
+        }
+        // one move at a time, the last one has to be taken over first
+        if (pending)
+            continue;
+
+        // scale up, the busiest overloaded lcore with more than one port
+        int src = -1;
+        RTE_LCORE_FOREACH(lcoreId) {
+            if (_lcoreParked[lcoreId] || ownedPorts(lcoreId) < 2)
+                continue;
+            bool hot = busy[lcoreId] > DD_SCALE_HIGH_PCT;
+            for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+                uint16_t portId = it->second->portId();
+                if (lcoreId == (uint32_t)_portOwner[portId] && deep[portId])
+                    hot = true;
+            }
+            if (hot && (src < 0 || busy[lcoreId] > busy[src]))
+                src = lcoreId;
+        }
+        if (src >= 0) {
+            int portId = -1;
+            for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+                uint16_t p = it->second->portId();
+                if (src == _portOwner[p] && (portId < 0 || load[p] > load[portId]))
+                    portId = p;
+            }
+            // an idle running lcore takes it, else a parked one is woken
+            int dst = -1;
+            RTE_LCORE_FOREACH(lcoreId) {
+                if ((int)lcoreId == src || _lcoreParked[lcoreId] ||
+                    busy[lcoreId] >= DD_SCALE_LOW_PCT)
+                    continue;
+                if (dst < 0 || busy[lcoreId] < busy[dst])
+                    dst = lcoreId;
+            }
+            RTE_LCORE_FOREACH(lcoreId) {
+                if (dst < 0 && _lcoreParked[lcoreId])
+                    dst = lcoreId;
+            }
+            if (dst >= 0) {
+                RTE_LOG(INFO, USER1, "lcore %d busy %u%%, moving port %d to lcore %d\n",
+                        src, busy[src], portId, dst);
+                _portHandover[portId] = dst;
+            }
+            continue;
+        }
+
+        // scale down, a quiet lcore gives a port to the busiest lcore that
+        // stays below target with it, it parks once all are gone
+        RTE_LCORE_FOREACH(lcoreId) {
+            if (lcoreId == rte_get_master_lcore() || _lcoreParked[lcoreId] ||
+                0 == ownedPorts(lcoreId) || busy[lcoreId] >= DD_SCALE_LOW_PCT)
+                continue;
+            int dst = -1;
+            uint32_t dstId;
+            RTE_LCORE_FOREACH(dstId) {
+                if (dstId == lcoreId || _lcoreParked[dstId] ||
+                    busy[dstId] + busy[lcoreId] >= DD_SCALE_TARGET_PCT)
+                    continue;
+                if (dstId != rte_get_master_lcore() && 0 == ownedPorts(dstId))
+                    continue;
+                if (dst < 0 || busy[dstId] > busy[dst])
+                    dst = dstId;
+            }
+            if (dst < 0)
+                continue;
+            for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+                uint16_t portId = it->second->portId();
+                if (lcoreId == (uint32_t)_portOwner[portId]) {
+                    RTE_LOG(INFO, USER1, "lcore %u busy %u%%, moving port %u to lcore %d\n",
+                            lcoreId, busy[lcoreId], portId, dst);
+                    _portHandover[portId] = dst;
+                    break;
+                }
+            }
+            break;
+        }
     }
 }
 
@@ -297,6 +1079,31 @@ dataDiodeApp::usage(const char *prgName)
        "  -s MEMBUF_SIZE: Override membuf size (DEFAULT: 4096)\n"
        "  -t PERIOD: statistics will be refreshed each PERIOD seconds (0 to disable, 2 default, 86400 maximum)\n"
        "  -T: start the program with core Port in TxOnly mode (MUTUALLY EXCLUSIVE with -R)\n"
+       "  --crypto-dev NAME: encrypt tunnel payload using cryptodev NAME (e.g. crypto_openssl)\n"
+       "  --crypto-algo ALGO: payload crypto algorithm aes-cbc-sha256 (DEFAULT) or null\n"
+       "  --compress ENGINE: compress payload using compressdev ENGINE (e.g. compress_isal) or lz4\n"
+       "  --capture MODE: capture frames to pcapng, MODE is rejected, all or sample:N\n"
+       "  --capture-dir DIR: directory for capture files (DEFAULT: " DD_CAPTURE_DIR ")\n"
+       "  --tuning FILE: burst, descriptor, cache and drain parameters (DEFAULT: " DD_TUNING_FILE ")\n"
+       "  --autotune: sweep tuning parameters with synthetic traffic and write the best to the tuning file\n"
+       "  --spill MEM_MB[:FILE_MB]: queue frames the access port does not accept, Rx-Only role (DEFAULT: off)\n"
+       "  --spill-file PATH: file backing the FILE_MB part of the spill queue (DEFAULT: " DD_SPILL_FILE ")\n"
+       "  --file-tx DIR: send files put into spool DIR, Tx-Only role\n"
+       "  --file-rate MBPS: payload rate of the file transfer (DEFAULT: 100)\n"
+       "  --file-rx DIR: write received files into DIR, Rx-Only role\n"
+       "  --top-talkers N: report the N flows with most packets and bytes on the access ports (16 maximum)\n"
+       "  --watchdog MS: report forwarding cores without heartbeat for MS milliseconds (DEFAULT: 10, 0 to disable)\n"
+       "  --heartbeat MS: send (Tx-Only) or expect (Rx-Only) a core link heartbeat every MS milliseconds\n"
+       "  --eventdev NAME: schedule frames onto worker lcores through event device NAME (e.g. event_sw0)\n"
+       "  --scale: move ports between lcores by their load and park idle lcores\n"
+       "  --small-mbufs N: copy frames up to 256 bytes into a pool of N small mbufs after RX\n"
+       "  --qualify MS: run the link qualification (Tx-Only sends, Rx-Only reports), MS milliseconds per step\n"
+       "  --takeover: take the ports over from the running instance, as DPDK secondary process\n"
+       "  --trace-events N: flight recorder events kept per lcore (DEFAULT: 4096, 0 to disable)\n"
+       "  --trace-file PATH: file the flight recorder is dumped to on SIGUSR1 or crash\n"
+       "  --header-comp FRAMES: compress inner Ethernet/IPv4/UDP headers, refreshing each context every FRAMES frames\n"
+       "  --shed PCT[,PCT[,PCT]]: shed classes 3, 2 and 1 of priority.conf above PCT percent RX ring fill (Tx-Only)\n"
+       "  --instances: run the diode instances of " DD_CONFIG_INSTANCES_FILE " instead of -p, -R and -T\n"
 #ifdef _DD_TESTMODE_
        "  -x: start the program in test mode. NOT to be run in production network\n"
 #endif
@@ -323,8 +1130,53 @@ dataDiodeApp::parseArgs(int argc, char **argv)
 #endif
         ;
     const struct option longOptions[] = {
+        {CMD_LINE_OPT_CRYPTO_DEV, 1, 0, CMD_LINE_OPT_CRYPTO_DEV_NUM},
+        {CMD_LINE_OPT_CRYPTO_ALGO, 1, 0, CMD_LINE_OPT_CRYPTO_ALGO_NUM},
+        {CMD_LINE_OPT_COMPRESS, 1, 0, CMD_LINE_OPT_COMPRESS_NUM},
+        {CMD_LINE_OPT_CAPTURE, 1, 0, CMD_LINE_OPT_CAPTURE_NUM},
+        {CMD_LINE_OPT_CAPTURE_DIR, 1, 0, CMD_LINE_OPT_CAPTURE_DIR_NUM},
+        {CMD_LINE_OPT_TUNING, 1, 0, CMD_LINE_OPT_TUNING_NUM},
+        {CMD_LINE_OPT_AUTOTUNE, 0, 0, CMD_LINE_OPT_AUTOTUNE_NUM},
+        {CMD_LINE_OPT_SPILL, 1, 0, CMD_LINE_OPT_SPILL_NUM},
+        {CMD_LINE_OPT_SPILL_FILE, 1, 0, CMD_LINE_OPT_SPILL_FILE_NUM},
+        {CMD_LINE_OPT_FILE_TX, 1, 0, CMD_LINE_OPT_FILE_TX_NUM},
+        {CMD_LINE_OPT_FILE_RATE, 1, 0, CMD_LINE_OPT_FILE_RATE_NUM},
+        {CMD_LINE_OPT_FILE_RX, 1, 0, CMD_LINE_OPT_FILE_RX_NUM},
+        {CMD_LINE_OPT_TOP_TALKERS, 1, 0, CMD_LINE_OPT_TOP_TALKERS_NUM},
+        {CMD_LINE_OPT_WATCHDOG, 1, 0, CMD_LINE_OPT_WATCHDOG_NUM},
+        {CMD_LINE_OPT_HEARTBEAT, 1, 0, CMD_LINE_OPT_HEARTBEAT_NUM},
+        {CMD_LINE_OPT_EVENTDEV, 1, 0, CMD_LINE_OPT_EVENTDEV_NUM},
+        {CMD_LINE_OPT_SCALE, 0, 0, CMD_LINE_OPT_SCALE_NUM},
+        {CMD_LINE_OPT_QUALIFY, 1, 0, CMD_LINE_OPT_QUALIFY_NUM},
+        {CMD_LINE_OPT_SMALL_MBUFS, 1, 0, CMD_LINE_OPT_SMALL_MBUFS_NUM},
+        {CMD_LINE_OPT_TAKEOVER, 0, 0, CMD_LINE_OPT_TAKEOVER_NUM},
+        {CMD_LINE_OPT_TRACE_EVENTS, 1, 0, CMD_LINE_OPT_TRACE_EVENTS_NUM},
+        {CMD_LINE_OPT_TRACE_FILE, 1, 0, CMD_LINE_OPT_TRACE_FILE_NUM},
+        {CMD_LINE_OPT_HEADER_COMP, 1, 0, CMD_LINE_OPT_HEADER_COMP_NUM},
+        {CMD_LINE_OPT_SHED, 1, 0, CMD_LINE_OPT_SHED_NUM},
+        {CMD_LINE_OPT_INSTANCES, 0, 0, CMD_LINE_OPT_INSTANCES_NUM},
         {NULL, 0, 0, 0}
     };
+    const char *cryptoDev = NULL;
+    ddCrypto::Algo cryptoAlgo = ddCrypto::ALGO_AES_CBC_HMAC_SHA256;
+    const char *captureDir = DD_CAPTURE_DIR;
+    ddCapture::Mode captureMode = ddCapture::MODE_INVALID;
+    uint32_t captureSampleRate = 1;
+    const char *spillFile = DD_SPILL_FILE;
+    uint64_t spillMemMb = 0;
+    uint64_t spillFileMb = 0;
+    const char *fileTxDir = NULL;
+    const char *fileRxDir = NULL;
+    uint32_t fileRate = DD_FILE_RATE_MBPS;
+    uint32_t topN = 0;
+    uint32_t heartbeatMs = 0;
+    uint32_t qualifyMs = 0;
+    uint32_t traceEvents = DD_TRACE_EVENTS;
+    const char *traceFile = DD_TRACE_FILE;
+    uint32_t hcRefreshPkts = 0;
+    bool shed = false;
+    bool cmdLineDiode = false;
+    const char *eventDev = NULL;
 
     argvOpt = argv;
 
@@ -356,6 +1208,7 @@ dataDiodeApp::parseArgs(int argc, char **argv)
                 return -1;
             }
             _userPortMask = pm;
+            cmdLineDiode = true;
             break;
         }
         case 's':
@@ -369,6 +1222,7 @@ dataDiodeApp::parseArgs(int argc, char **argv)
             std::cout << "Setting role as Rx Only" << std::endl;
             _corePortMode = PORTMODE_RX;
             _corePortId = 1;
+            cmdLineDiode = true;
             break;
         case 't':
         {
@@ -381,6 +1235,7 @@ dataDiodeApp::parseArgs(int argc, char **argv)
             std::cout << "Setting role as Tx Only" << std::endl;
             _corePortMode = PORTMODE_TX;
             _corePortId = 1;
+            cmdLineDiode = true;
             break;
 #else
         case 'x':
@@ -390,28 +1245,397 @@ dataDiodeApp::parseArgs(int argc, char **argv)
             _corePortMode = PORTMODE_BIDIR;
             break;
 #endif // _DD_TESTMODE_
-        default:
-            std::cerr << "Encountered Invalid Program Argument!\n" << std::endl;
+        case CMD_LINE_OPT_CRYPTO_DEV_NUM:
+            cryptoDev = optarg;
             break;
-        }
-    }
-    return EXIT_SUCCESS;
-}
-
-#ifndef _DD_TESTMODE_
-const struct ether_addr*
-dataDiodeApp::corePortEthAddr() const
-{
-    return _corePort->ethAddr();
-}
-#else
-const struct ether_addr*
-dataDiodeApp::corePortEthAddr(uint16_t portId) const
-{
-    return _corePort[portId]->ethAddr();
-}
-#endif
-
+        case CMD_LINE_OPT_CRYPTO_ALGO_NUM:
+            cryptoAlgo = ddCrypto::parseAlgo(optarg);
+            if (ddCrypto::ALGO_INVALID == cryptoAlgo) {
+                std::cerr << "Invalid crypto algorithm " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        case CMD_LINE_OPT_COMPRESS_NUM:
+            std::cout << "Enabling payload compression using " << optarg << std::endl;
+            _compress = new ddCompress(optarg);
+            break;
+        case CMD_LINE_OPT_CAPTURE_NUM:
+            if (!ddCapture::parseMode(optarg, &captureMode, &captureSampleRate)) {
+                std::cerr << "Invalid capture mode " << optarg << std::endl;
+                return -1;
+            }
+            break;
+        case CMD_LINE_OPT_CAPTURE_DIR_NUM:
+            captureDir = optarg;
+            break;
+        case CMD_LINE_OPT_TUNING_NUM:
+            _tuningFile = optarg;
+            break;
+        case CMD_LINE_OPT_AUTOTUNE_NUM:
+            std::cout << "Running autotune, the diode does not forward traffic" << std::endl;
+            _autotune = true;
+            break;
+        case CMD_LINE_OPT_SPILL_NUM:
+            if (!ddSpill::parseSize(optarg, &spillMemMb, &spillFileMb)) {
+                std::cerr << "Invalid spill size " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        case CMD_LINE_OPT_SPILL_FILE_NUM:
+            spillFile = optarg;
+            break;
+        case CMD_LINE_OPT_FILE_TX_NUM:
+            fileTxDir = optarg;
+            break;
+        case CMD_LINE_OPT_FILE_RATE_NUM:
+        {
+            char *end = NULL;
+            fileRate = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0' || fileRate == 0) {
+                std::cerr << "Invalid file transfer rate " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_FILE_RX_NUM:
+            fileRxDir = optarg;
+            break;
+        case CMD_LINE_OPT_TOP_TALKERS_NUM:
+        {
+            char *end = NULL;
+            topN = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0' || topN == 0 || topN > DD_TOP_K) {
+                std::cerr << "Invalid number of top talkers " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_WATCHDOG_NUM:
+        {
+            char *end = NULL;
+            _watchdogMs = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0') {
+                std::cerr << "Invalid watchdog timeout " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_HEARTBEAT_NUM:
+        {
+            char *end = NULL;
+            heartbeatMs = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0' || heartbeatMs == 0) {
+                std::cerr << "Invalid heartbeat interval " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_EVENTDEV_NUM:
+            eventDev = optarg;
+            break;
+        case CMD_LINE_OPT_SCALE_NUM:
+            _scale = true;
+            break;
+        case CMD_LINE_OPT_TAKEOVER_NUM:
+            _takeover = true;
+            break;
+        case CMD_LINE_OPT_TRACE_EVENTS_NUM:
+        {
+            char *end = NULL;
+            traceEvents = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0') {
+                std::cerr << "Invalid number of trace events " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_TRACE_FILE_NUM:
+            traceFile = optarg;
+            break;
+        case CMD_LINE_OPT_SHED_NUM:
+        {
+            // lowest class first, each watermark above the one before
+            char *p = optarg;
+            uint32_t prev = 0;
+            for (int c = DD_SHED_CLASSES - 1; c > 0 && '\0' != *p; c--) {
+                char *end = NULL;
+                uint32_t pct = strtoul(p, &end, 10);
+                if (end == p || (*end != '\0' && *end != ',') || pct <= prev || pct > 100) {
+                    std::cerr << "Invalid shedding watermarks " << optarg << std::endl;
+                    usage(prgName);
+                    return -1;
+                }
+                _shedPct[c] = pct;
+                prev = pct;
+                p = (',' == *end) ? end + 1 : end;
+            }
+            if ('\0' != *p) {
+                std::cerr << "Invalid shedding watermarks " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            shed = true;
+            break;
+        }
+        case CMD_LINE_OPT_INSTANCES_NUM:
+            _instancesConf = true;
+            break;
+        case CMD_LINE_OPT_HEADER_COMP_NUM:
+        {
+            char *end = NULL;
+            hcRefreshPkts = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0' || hcRefreshPkts == 0) {
+                std::cerr << "Invalid header compression refresh " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_SMALL_MBUFS_NUM:
+        {
+            char *end = NULL;
+            _nbSmallMbufs = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0') {
+                std::cerr << "Invalid number of small mbufs " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        case CMD_LINE_OPT_QUALIFY_NUM:
+        {
+            char *end = NULL;
+            qualifyMs = strtoul(optarg, &end, 10);
+            if (optarg[0] == '\0' || *end != '\0' || qualifyMs == 0) {
+                std::cerr << "Invalid qualification step " << optarg << std::endl;
+                usage(prgName);
+                return -1;
+            }
+            break;
+        }
+        default:
+            std::cerr << "Encountered Invalid Program Argument!\n" << std::endl;
+            break;
+        }
+    }
+
+    // ports of the crypto and compression stages stay on their lcore
+    if ((NULL != cryptoDev || NULL != _compress) && _scale) {
+        std::cerr << "Crypto and compression do not support scaling" << std::endl;
+        usage(prgName);
+        return -1;
+    }
+    if (NULL != cryptoDev) {
+        std::cout << "Enabling payload crypto on " << cryptoDev << std::endl;
+        _crypto = new ddCrypto(cryptoDev, cryptoAlgo);
+    }
+
+    // tuning file is optional, compile time defaults are used without it
+    if (_tuning.load(_tuningFile)) {
+        std::cout << "Tuning from " << _tuningFile << ": " << _tuning << std::endl;
+    }
+
+    if (ddCapture::MODE_INVALID != captureMode) {
+        std::cout << "Enabling capture to " << captureDir << std::endl;
+        _capture = new ddCapture(captureMode, captureSampleRate, captureDir);
+    }
+
+    if (spillMemMb || spillFileMb) {
+        if (PORTMODE_TX == _corePortMode) {
+            std::cerr << "Spill queue is only used in Rx-Only role, ignoring" << std::endl;
+        } else {
+            std::cout << "Enabling spill queue of " << spillMemMb << "MB memory and "
+                      << spillFileMb << "MB file" << std::endl;
+            _spill = new ddSpill(spillMemMb, spillFileMb, spillFile);
+        }
+    }
+
+    if (NULL != fileTxDir) {
+        if (PORTMODE_RX == _corePortMode) {
+            std::cerr << "Files can not be sent in Rx-Only role, ignoring" << std::endl;
+        } else {
+            std::cout << "Enabling file transfer from " << fileTxDir << std::endl;
+            _fileTx = new ddFileTx(fileTxDir, fileRate);
+        }
+    }
+    if (NULL != fileRxDir) {
+        if (PORTMODE_TX == _corePortMode) {
+            std::cerr << "Files can not be received in Tx-Only role, ignoring" << std::endl;
+        } else {
+            std::cout << "Enabling file transfer to " << fileRxDir << std::endl;
+            _fileRx = new ddFileRx(fileRxDir);
+        }
+    }
+
+    // reported with the periodic statistics, over the same interval
+    if (topN) {
+        _topTalkers = new ddTopTalkers(topN, _timerPeriod);
+    }
+
+    if (heartbeatMs) {
+        std::cout << "Enabling core link heartbeat every " << heartbeatMs << " ms" << std::endl;
+        _heartbeat = new ddHeartbeat(heartbeatMs);
+    }
+
+    // on by default, recording costs a few stores per burst
+    if (traceEvents) {
+        _trace = new ddTrace(traceFile, traceEvents);
+    }
+
+    if (qualifyMs) {
+        std::cout << "Enabling link qualification, " << qualifyMs << " ms per step" << std::endl;
+        _qualify = new ddQualify(qualifyMs);
+    }
+
+    if (shed) {
+        if (PORTMODE_RX == _corePortMode) {
+            std::cerr << "Shedding is only done in Tx-Only role, ignoring" << std::endl;
+            bzero(_shedPct, sizeof(_shedPct));
+        } else {
+            std::cout << "Enabling shedding of classes 3/2/1 above " << (uint32_t)_shedPct[3]
+                      << "/" << (uint32_t)_shedPct[2] << "/" << (uint32_t)_shedPct[1]
+                      << "% RX ring fill" << std::endl;
+        }
+    }
+
+    // both ends of the core link have to agree, there is no negotiation
+    if (hcRefreshPkts) {
+        std::cout << "Enabling header compression, refresh every " << hcRefreshPkts
+                  << " frames" << std::endl;
+        _hdrComp = new ddHdrComp(hcRefreshPkts);
+    }
+
+    if (NULL != eventDev) {
+        // workers run the port stages only, the others keep per lcore state
+        if (NULL != _crypto || NULL != _compress || NULL != _capture || NULL != _spill ||
+            NULL != _fileTx || NULL != _fileRx || NULL != _topTalkers ||
+            NULL != _heartbeat || NULL != _qualify || NULL != _hdrComp || shed ||
+            _autotune || _scale) {
+            std::cerr << "Event mode does not support crypto, compression, capture, spill, "
+                      << "file transfer, top talkers, heartbeat, qualification, header "
+                      << "compression, shedding, autotune or scaling" << std::endl;
+            usage(prgName);
+            return -1;
+        }
+        std::cout << "Enabling event mode on " << eventDev << std::endl;
+        _eventDev = new ddEventDev(eventDev);
+    }
+
+    // The optional stages are process wide and serve one diode, the
+    // instances of instances.conf forward, filter, rewrite and shed only
+    if (_instancesConf) {
+#ifdef _DD_TESTMODE_
+        std::cerr << "Instances are not supported in test mode" << std::endl;
+        usage(prgName);
+        return -1;
+#endif
+        if (cmdLineDiode) {
+            std::cerr << "Ports and roles of instances are set in "
+                      << DD_CONFIG_INSTANCES_FILE << ", not with -p, -R or -T" << std::endl;
+            usage(prgName);
+            return -1;
+        }
+        if (NULL != _crypto || NULL != _compress || NULL != _capture || NULL != _spill ||
+            NULL != _fileTx || NULL != _fileRx || NULL != _topTalkers ||
+            NULL != _heartbeat || NULL != _qualify || NULL != _hdrComp ||
+            NULL != _eventDev || _nbSmallMbufs || _takeover || _autotune || _scale) {
+            std::cerr << "Instances do not support crypto, compression, capture, spill, "
+                      << "file transfer, top talkers, heartbeat, qualification, header "
+                      << "compression, event mode, small mbufs, takeover, autotune or "
+                      << "scaling" << std::endl;
+            usage(prgName);
+            return -1;
+        }
+    }
+
+    // the devices, rings and files of the running instance stay its own
+    if (_takeover != (RTE_PROC_SECONDARY == rte_eal_process_type())) {
+        std::cerr << "Taking over requires a secondary process, and a secondary "
+                  << "process takes over" << std::endl;
+        usage(prgName);
+        return -1;
+    }
+    if (_takeover && (NULL != _crypto || NULL != _compress || NULL != _capture ||
+                      NULL != _spill || NULL != _fileTx || NULL != _fileRx ||
+                      NULL != _eventDev || _autotune || _scale)) {
+        std::cerr << "Taking over does not support crypto, compression, capture, spill, "
+                  << "file transfer, event mode, autotune or scaling" << std::endl;
+        usage(prgName);
+        return -1;
+    }
+    _handoff = new ddHandoff(_takeover);
+    return EXIT_SUCCESS;
+}
+
+#ifndef _DD_TESTMODE_
+ddPort*
+dataDiodeApp::corePort() const
+{
+    return _instances[0]->corePort();
+}
+
+const struct ether_addr*
+dataDiodeApp::corePortEthAddr() const
+{
+    return _instances[0]->corePortEthAddr();
+}
+#else
+ddPort*
+dataDiodeApp::corePort(PortMode mode) const
+{
+    return _instances[0]->corePort(mode);
+}
+
+const struct ether_addr*
+dataDiodeApp::corePortEthAddr(uint16_t portId) const
+{
+    return _instances[0]->corePortEthAddr(portId);
+}
+#endif
+
+const dataDiodeApp::PortMode
+dataDiodeApp::corePortMode() const
+{
+    return NULL == _instances[0] ? _corePortMode : _instances[0]->corePortMode();
+}
+
+struct rte_mempool*
+dataDiodeApp::pktMbufPool() const
+{
+    return _instances[0]->pktMbufPool();
+}
+
+const ddConfig*
+dataDiodeApp::config() const
+{
+    return _instances[0]->config();
+}
+
+ddPort*
+dataDiodeApp::accessPort() const
+{
+    return _instances[0]->accessPort();
+}
+
+ddPort*
+dataDiodeApp::egressPort(uint16_t portId) const
+{
+    ddInstance *diode = portInstance(portId);
+    return NULL == diode ? NULL : diode->egressPort(portId);
+}
+
+struct ddSenderStats_*
+dataDiodeApp::senderStats(uint16_t slot)
+{
+    return _instances[0]->senderStats(slot);
+}
+
 void
 dataDiodeApp::printStats()
 {
@@ -429,6 +1653,28 @@ dataDiodeApp::printStats()
     std::cout << clr << topLeft << std::endl;
 
     std::cout << std::endl << "Press CTRL+C to quit the program" << std::endl;
+    std::cout << "Config generation: " << _configGeneration
+              << " Reloads: " << _configReloads
+              << " Failed: " << _configReloadErrors << std::endl;
+    bool senders = false;
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        const ddConfig *config = _instances[i]->config();
+#ifndef _DD_TESTMODE_
+        const ddRxOnlyCorePort *rxCore =
+            dynamic_cast<const ddRxOnlyCorePort *>(_instances[i]->corePort());
+#else
+        const ddRxOnlyCorePort *rxCore =
+            dynamic_cast<const ddRxOnlyCorePort *>(_instances[i]->corePort(PORTMODE_RX));
+#endif
+        if (NULL != rxCore && 0 != config->nRewrites()) {
+            if (_instancesConf)
+                std::cout << _instances[i]->name() << " ";
+            std::cout << "Rewrite rules: " << config->nRewrites()
+                      << " Rewritten: " << rxCore->rewritten()
+                      << " Unmatched: " << rxCore->rewriteMisses() << std::endl;
+        }
+        senders = senders || config->sendersFile();
+    }
     std::cout << "===================== Data Diode IN4004 Traffic Statistics ======================"
               << std::endl
               << "Interface" << " | "
@@ -444,10 +1690,18 @@ dataDiodeApp::printStats()
                   << it->second->portId() << std::setw(colWidth)
                   << std::setw(5 + colWidth) << it->second->rxStats()
                   << std::setw(3 + colWidth) << it->second->txStats()
-                  << std::setw(3 + colWidth) << it->second->rxDropStats()
+                  << std::setw(3 + colWidth) << it->second->rxDropStats() + it->second->wrongDirDrops()
                   << std::setw(1 + colWidth) << it->second->txDropStats()
 		  << std::endl;
         }
+    for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+        std::cout << " Port " << it->second->portId() << " link "
+                  << (it->second->linkUp() ? "up" : "down")
+                  << " Downs: " << it->second->linkDowns()
+                  << " LSC: " << it->second->lscEvents()
+                  << " Tx dropped while down: " << it->second->txLinkDownStats()
+                  << std::endl;
+    }
     std::cout << std::endl
               <<"================================================================================="
               << std::endl;
@@ -475,9 +1729,707 @@ dataDiodeApp::printStats()
     std::cout << std::endl
               <<"================================================================================="
               << std::endl;
+    if (_instancesConf) printInstanceStats();
+    if (NULL != _crypto) printCryptoStats();
+    if (NULL != _compress) printCompressStats();
+    if (NULL != _capture) printCaptureStats();
+    if (NULL != _spill) printSpillStats();
+    if (NULL != _fileTx || NULL != _fileRx) printFileStats();
+    if (NULL != _topTalkers) printTopTalkers();
+    if (senders) printSenderStats();
+    if (NULL != _heartbeat) printHeartbeatStats();
+    if (NULL != _qualify) printQualifyStats();
+    if (NULL != _hdrComp) printHdrCompStats();
+    if (0 != _shedPct[DD_SHED_CLASSES - 1]) printShedStats();
+    if (NULL != _eventDev) printEventStats();
+    printMempoolStats();
+    printLcoreStats();
     if (showEthStats) printEthStats();
 }
 
+void
+dataDiodeApp::printCryptoStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "===================== Data Diode IN4004 Crypto Statistics ======================="
+              << std::endl
+              << "Device: " << _crypto->devName() << " Algorithm: " << _crypto->algoName()
+              << std::endl
+              << "Direction" << " | "
+              << std::setw(colWidth) << "Enqueued" << " | "
+              << std::setw(colWidth) << "Dequeued" << " | "
+              << std::setw(colWidth) << "In Flight" << " | "
+              << std::setw(colWidth) << "Enq Drops" << " | "
+              << std::setw(colWidth) << "Auth Fail" << " | "
+              << std::setw(colWidth) << "Op Fail" << " | "
+              << std::setw(colWidth) << "Avg us" << " | "
+              << std::setw(colWidth) << "Max us" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    for (int dir = 0; dir < ddCrypto::DIR_MAX; dir++) {
+        ddCrypto::Direction d = static_cast<ddCrypto::Direction>(dir);
+        std::cout << " " << std::setw(8) << ddCrypto::dirName(d)
+                  << std::setw(3 + colWidth) << _crypto->enqueued(d)
+                  << std::setw(3 + colWidth) << _crypto->dequeued(d)
+                  << std::setw(3 + colWidth) << _crypto->inFlight(d)
+                  << std::setw(3 + colWidth) << _crypto->enqDropped(d)
+                  << std::setw(3 + colWidth) << _crypto->authFailed(d)
+                  << std::setw(3 + colWidth) << _crypto->opFailed(d)
+                  << std::setw(3 + colWidth) << std::fixed << std::setprecision(2)
+                  << _crypto->avgLatencyUs(d)
+                  << std::setw(3 + colWidth) << _crypto->maxLatencyUs(d)
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printCompressStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "=================== Data Diode IN4004 Compression Statistics ===================="
+              << std::endl
+              << "Engine: " << _compress->engine()
+              << std::endl
+              << "Direction" << " | "
+              << std::setw(colWidth) << "Frames" << " | "
+              << std::setw(colWidth) << "Processed" << " | "
+              << std::setw(colWidth) << "Bypassed" << " | "
+              << std::setw(colWidth) << "Dropped" << " | "
+              << std::setw(colWidth) << "Errors" << " | "
+              << std::setw(colWidth) << "In Flight" << " | "
+              << std::setw(colWidth) << "Ratio" << " | "
+              << std::setw(colWidth) << "Avg us" << " | "
+              << std::setw(colWidth) << "Max us" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    for (int dir = 0; dir < ddCompress::DIR_MAX; dir++) {
+        ddCompress::Direction d = static_cast<ddCompress::Direction>(dir);
+        std::cout << " " << std::setw(8) << ddCompress::dirName(d)
+                  << std::setw(3 + colWidth) << _compress->in(d)
+                  << std::setw(3 + colWidth) << _compress->processed(d)
+                  << std::setw(3 + colWidth) << _compress->bypassed(d)
+                  << std::setw(3 + colWidth) << _compress->dropped(d)
+                  << std::setw(3 + colWidth) << _compress->errors(d)
+                  << std::setw(3 + colWidth) << _compress->inFlight(d)
+                  << std::setw(3 + colWidth) << std::fixed << std::setprecision(2)
+                  << _compress->ratio(d)
+                  << std::setw(3 + colWidth) << _compress->avgLatencyUs(d)
+                  << std::setw(3 + colWidth) << _compress->maxLatencyUs(d)
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printCaptureStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "===================== Data Diode IN4004 Capture Statistics ======================"
+              << std::endl
+              << "Mode: " << _capture->modeName();
+    if (ddCapture::MODE_SAMPLE == _capture->captureMode())
+        std::cout << " 1/" << _capture->sampleRate();
+    std::cout << std::endl
+              << std::setw(colWidth) << "Captured" << " | "
+              << std::setw(colWidth) << "Dropped" << " | "
+              << std::setw(colWidth) << "Pending" << " | "
+              << std::setw(colWidth) << "Written" << " | "
+              << std::setw(colWidth) << "MBytes" << " | "
+              << std::setw(colWidth) << "Rotations" << " | "
+              << std::setw(colWidth) << "Wr Errors" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl
+              << std::setw(colWidth) << _capture->captured()
+              << std::setw(3 + colWidth) << _capture->dropped()
+              << std::setw(3 + colWidth) << _capture->pending()
+              << std::setw(3 + colWidth) << _capture->written()
+              << std::setw(3 + colWidth) << (_capture->bytesWritten() >> 20)
+              << std::setw(3 + colWidth) << _capture->rotations()
+              << std::setw(3 + colWidth) << _capture->writeErrors()
+              << std::endl
+              << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printSpillStats()
+{
+    uint16_t colWidth = 10;
+    uint64_t now = rte_rdtsc();
+    double secs = (double)(now - _spillLastTsc) / rte_get_tsc_hz();
+    uint64_t spilled = _spill->spilled();
+    uint64_t drained = _spill->drained();
+    double spillRate = secs > 0 ? (spilled - _spillLastSpilled) / secs : 0;
+    double drainRate = secs > 0 ? (drained - _spillLastDrained) / secs : 0;
+    _spillLastTsc = now;
+    _spillLastSpilled = spilled;
+    _spillLastDrained = drained;
+
+    std::cout << "====================== Data Diode IN4004 Spill Statistics ======================="
+              << std::endl
+              << "Memory: " << _spill->memFrames() << " frames "
+              << (_spill->memBytes() >> 10) << "/" << (_spill->memSz() >> 10) << " KB"
+              << " File: " << _spill->fileFrames() << " frames "
+              << (_spill->fileBytes() >> 10) << "/" << (_spill->fileSz() >> 10) << " KB"
+              << " Peak: " << (_spill->peakBytes() >> 10) << " KB"
+              << std::endl
+              << std::setw(colWidth) << "Spilled" << " | "
+              << std::setw(colWidth) << "To File" << " | "
+              << std::setw(colWidth) << "Drained" << " | "
+              << std::setw(colWidth) << "Dropped" << " | "
+              << std::setw(colWidth) << "Spill/s" << " | "
+              << std::setw(colWidth) << "Drain/s" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl
+              << std::setw(colWidth) << spilled
+              << std::setw(3 + colWidth) << _spill->fileSpilled()
+              << std::setw(3 + colWidth) << drained
+              << std::setw(3 + colWidth) << _spill->dropped()
+              << std::setw(3 + colWidth) << std::fixed << std::setprecision(0) << spillRate
+              << std::setw(3 + colWidth) << drainRate
+              << std::endl
+              << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printFileStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "=================== Data Diode IN4004 File Transfer Statistics ==================="
+              << std::endl;
+    if (NULL != _fileTx) {
+        std::cout << "Spool: " << _fileTx->spoolDir() << " Rate: " << _fileTx->rateMbps() << " Mbps"
+                  << std::endl
+                  << std::setw(colWidth) << "Files" << " | "
+                  << std::setw(colWidth) << "Segments" << " | "
+                  << std::setw(colWidth) << "MBytes" << " | "
+                  << std::setw(colWidth) << "Pending" << " | "
+                  << std::setw(colWidth) << "Rd Errors" << " |"
+                  << std::endl
+                  << "---------------------------------------------------------------------------------"
+                  << std::endl
+                  << std::setw(colWidth) << _fileTx->filesSent()
+                  << std::setw(3 + colWidth) << _fileTx->segments()
+                  << std::setw(3 + colWidth) << (_fileTx->bytes() >> 20)
+                  << std::setw(3 + colWidth) << _fileTx->pending()
+                  << std::setw(3 + colWidth) << _fileTx->readErrors()
+                  << std::endl;
+    }
+    if (NULL != _fileRx) {
+        std::cout << "Output: " << _fileRx->outDir()
+                  << std::endl
+                  << std::setw(colWidth) << "Segments" << " | "
+                  << std::setw(colWidth) << "Dropped" << " | "
+                  << std::setw(colWidth) << "Bad Segs" << " | "
+                  << std::setw(colWidth) << "Open" << " | "
+                  << std::setw(colWidth) << "Committed" << " | "
+                  << std::setw(colWidth) << "CRC Fail" << " | "
+                  << std::setw(colWidth) << "Expired" << " | "
+                  << std::setw(colWidth) << "Wr Errors" << " |"
+                  << std::endl
+                  << "---------------------------------------------------------------------------------"
+                  << std::endl
+                  << std::setw(colWidth) << _fileRx->segments()
+                  << std::setw(3 + colWidth) << _fileRx->dropped()
+                  << std::setw(3 + colWidth) << _fileRx->badSegments()
+                  << std::setw(3 + colWidth) << _fileRx->inProgress()
+                  << std::setw(3 + colWidth) << _fileRx->committed()
+                  << std::setw(3 + colWidth) << _fileRx->crcErrors()
+                  << std::setw(3 + colWidth) << _fileRx->expired()
+                  << std::setw(3 + colWidth) << _fileRx->writeErrors()
+                  << std::endl
+                  << "Segments of refused files: " << _fileRx->tooLarge()
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printTopTalkers()
+{
+    uint16_t colWidth = 10;
+    std::vector<ddTopTalkers::flow_> byPkts, byBytes;
+    _topTalkers->report(byPkts, byBytes);
+    double intervalS = _topTalkers->intervalS();
+
+    std::cout << "=================== Data Diode IN4004 Top Talkers Statistics ===================="
+              << std::endl
+              << "Interval: " << _topTalkers->intervalS() << "s"
+              << std::endl;
+    for (int list = 0; list < 2; list++) {
+        const std::vector<ddTopTalkers::flow_> &flows = list ? byBytes : byPkts;
+        std::cout << (list ? "By bytes" : "By packets")
+                  << std::endl
+                  << std::setw(44) << std::left << "Flow" << std::right << " | "
+                  << std::setw(colWidth) << "Packets" << " | "
+                  << std::setw(colWidth) << "Mbps" << " |"
+                  << std::endl
+                  << "---------------------------------------------------------------------------------"
+                  << std::endl;
+        for (uint32_t i = 0; i < flows.size(); i++) {
+            char flow[64];
+            ddTopTalkers::formatKey(flows[i].key, flow, sizeof(flow));
+            std::cout << std::setw(44) << std::left << flow << std::right
+                      << std::setw(3 + colWidth) << flows[i].pkts
+                      << std::setw(3 + colWidth) << std::fixed << std::setprecision(2)
+                      << flows[i].bytes * 8 / intervalS / 1000000
+                      << std::endl;
+        }
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printLcoreStats()
+{
+    uint16_t colWidth = 10;
+    static const char *histNames[BURST_HIST_SZ] = {
+        "0", "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64+"
+    };
+
+    std::cout << "===================== Data Diode IN4004 Lcore Statistics ========================"
+              << std::endl
+              << "Lcore" << " | "
+              << std::setw(colWidth) << "Busy %" << " | "
+              << std::setw(colWidth) << "RX %" << " | "
+              << std::setw(colWidth) << "TX %" << " | "
+              << std::setw(colWidth) << "Idle %" << " | "
+              << std::setw(colWidth) << "Cyc/Pkt" << " | "
+              << std::setw(colWidth) << "Packets" << " | "
+              << std::setw(colWidth) << "Stalls" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+
+    uint32_t lcoreId;
+    RTE_LCORE_FOREACH(lcoreId) {
+        if (0 == _lcoreQueueConf[lcoreId].nRxPort && !_scale)
+            continue;
+
+        // differences since the last print, the lcore keeps counting
+        struct lcoreCycles cur = _lcoreCycles[lcoreId];
+        struct lcoreCycles *last = &_lcoreCyclesLast[lcoreId];
+        uint64_t rx = cur.rx - last->rx;
+        uint64_t tx = cur.tx - last->tx;
+        uint64_t stats = cur.stats - last->stats;
+        uint64_t idle = cur.idle - last->idle;
+        uint64_t pkts = cur.pkts - last->pkts;
+        uint64_t bursts = 0, hist[BURST_HIST_SZ];
+        for (uint32_t i = 0; i < BURST_HIST_SZ; i++) {
+            hist[i] = cur.burstHist[i] - last->burstHist[i];
+            bursts += hist[i];
+        }
+        *last = cur;
+
+        double total = RTE_MAX(rx + tx + stats + idle, (uint64_t)1);
+        std::cout << std::setw(5) << lcoreId
+                  << std::setw(3 + colWidth) << std::fixed << std::setprecision(1)
+                  << 100.0 * (rx + tx + stats) / total
+                  << std::setw(3 + colWidth) << 100.0 * rx / total
+                  << std::setw(3 + colWidth) << 100.0 * tx / total
+                  << std::setw(3 + colWidth) << 100.0 * idle / total
+                  << std::setw(3 + colWidth) << std::setprecision(0)
+                  << (pkts ? (double)(rx + tx) / pkts : 0.0)
+                  << std::setw(3 + colWidth) << pkts
+                  << std::setw(3 + colWidth) << _lcoreStalls[lcoreId]
+                  << std::endl
+                  << "      bursts %";
+        for (uint32_t i = 0; i < BURST_HIST_SZ; i++) {
+            std::cout << " " << histNames[i] << ":" << std::setprecision(1)
+                      << (bursts ? 100.0 * hist[i] / bursts : 0.0);
+        }
+        std::cout << std::endl;
+    }
+    if (_scale) {
+        std::cout << std::endl << "Port owners:";
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+            uint16_t portId = it->second->portId();
+            std::cout << " " << portId << ":" << _portOwner[portId];
+            if (_portHandover[portId] >= 0)
+                std::cout << "->" << _portHandover[portId];
+        }
+        std::cout << "  Moves: " << _portMoves << std::endl << "Parked lcores:";
+        RTE_LCORE_FOREACH(lcoreId) {
+            if (_lcoreParked[lcoreId])
+                std::cout << " " << lcoreId;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printSenderStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "==================== Data Diode IN4004 Sender Statistics ========================"
+              << std::endl
+              << std::setw(17) << std::left << "Sender" << std::right << " | "
+              << std::setw(5) << "SID" << " | "
+              << std::setw(5) << "Port" << " | "
+              << std::setw(4) << "VLAN" << " | "
+              << std::setw(colWidth) << "RX" << " | "
+              << std::setw(colWidth) << "TX" << " | "
+              << std::setw(colWidth) << "Bad SID" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    for (uint32_t d = 0; d < _nInstances; d++) {
+        ddInstance *diode = _instances[d];
+        const ddConfig *config = diode->config();
+        if (_instancesConf && config->sendersFile())
+            std::cout << diode->name() << ":" << std::endl;
+        for (uint32_t i = 0; i < config->nSenders(); i++) {
+            const struct ddSender_ *sender = config->sender(i);
+            const struct ddSenderStats_ *stats = diode->senderStats(sender->slot);
+            ddPort *port = diode->egressPort(sender->portId);
+            char mac[ETHER_ADDR_FMT_SIZE];
+            ether_format_addr(mac, sizeof(mac), &sender->mac);
+            std::cout << std::setw(17) << std::left << mac << std::right
+                      << std::setw(3 + 5) << rte_be_to_cpu_16(sender->sId)
+                      << std::setw(3 + 5) << (NULL == port ? diode->accessPort() : port)->portId()
+                      << std::setw(3 + 4) << sender->vlan
+                      << std::setw(3 + colWidth) << stats->rxPkts
+                      << std::setw(3 + colWidth) << stats->txPkts
+                      << std::setw(3 + colWidth) << stats->badSId
+                      << std::endl;
+        }
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printHdrCompStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "================ Data Diode IN4004 Header Compression Statistics ================"
+              << std::endl
+              << "Refresh: every " << _hdrComp->refreshPkts() << " frames or "
+              << DD_HC_REFRESH_MS << "ms"
+              << std::endl
+              << "Direction" << " | "
+              << std::setw(colWidth) << "Compressed" << " | "
+              << std::setw(colWidth) << "Refreshes" << " | "
+              << std::setw(colWidth) << "Plain" << " | "
+              << std::setw(colWidth) << "No Context" << " | "
+              << std::setw(colWidth) << "Bad" << " | "
+              << std::setw(colWidth) << "Saved KB" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    if (PORTMODE_RX != _corePortMode) {
+        std::cout << std::setw(9) << "compress"
+                  << std::setw(3 + colWidth) << _hdrComp->txCompressed()
+                  << std::setw(3 + colWidth) << _hdrComp->txRefreshes()
+                  << std::setw(3 + colWidth) << _hdrComp->txPlain()
+                  << std::setw(3 + colWidth) << "-"
+                  << std::setw(3 + colWidth) << "-"
+                  << std::setw(3 + colWidth) << _hdrComp->txSavedBytes() / 1024
+                  << std::endl;
+    }
+    if (PORTMODE_TX != _corePortMode) {
+        std::cout << std::setw(9) << "rebuild"
+                  << std::setw(3 + colWidth) << _hdrComp->rxDecompressed()
+                  << std::setw(3 + colWidth) << _hdrComp->rxRefreshes()
+                  << std::setw(3 + colWidth) << "-"
+                  << std::setw(3 + colWidth) << _hdrComp->rxNoContext()
+                  << std::setw(3 + colWidth) << _hdrComp->rxBadFrames()
+                  << std::setw(3 + colWidth) << "-"
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printShedStats()
+{
+    uint16_t colWidth = 10;
+    struct rte_eth_stats ethStats;
+
+    std::cout << "====================== Data Diode IN4004 Shedding Statistics ===================="
+              << std::endl
+              << "Watermarks: class 3 " << (uint32_t)_shedPct[3] << "%"
+              << " class 2 " << (uint32_t)_shedPct[2] << "%"
+              << " class 1 " << (uint32_t)_shedPct[1] << "%"
+              << std::endl
+              << "Interface" << " | "
+              << std::setw(colWidth) << "Class 1" << " | "
+              << std::setw(colWidth) << "Class 2" << " | "
+              << std::setw(colWidth) << "Class 3" << " | "
+              << std::setw(colWidth) << "Shedding" << " | "
+              << std::setw(colWidth) << "imissed" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    for (uint16_t portId = 0; portId < RTE_MAX_ETHPORTS; portId++) {
+        ddPort *port = egressPort(portId);
+        if (NULL == port || !port->shedding())
+            continue;
+        rte_eth_stats_get(portId, &ethStats);
+        std::cout << " Port" << std::setw(4) << portId;
+        for (uint8_t c = 1; c < DD_SHED_CLASSES; c++)
+            std::cout << std::setw(3 + colWidth) << port->shedStats(c);
+        if (port->shedFrom() < DD_SHED_CLASSES)
+            std::cout << std::setw(3 + colWidth - 1) << (uint32_t)port->shedFrom() << "+";
+        else
+            std::cout << std::setw(3 + colWidth) << "-";
+        std::cout << std::setw(3 + colWidth) << ethStats.imissed
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printHeartbeatStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "=================== Data Diode IN4004 Heartbeat Statistics ======================"
+              << std::endl
+              << "Interval: " << _heartbeat->intervalMs() << "ms"
+              << " Sent: " << _heartbeat->sent()
+              << " Received: " << _heartbeat->received()
+              << " Bad: " << _heartbeat->badFrames()
+              << " Alarms: " << _heartbeat->alarms()
+              << std::endl;
+    if (_heartbeat->monitor()) {
+        std::cout << "Slot" << " | "
+                  << std::setw(colWidth) << "Received" << " | "
+                  << std::setw(colWidth) << "Missing" << " | "
+                  << std::setw(colWidth) << "Jitter us" << " | "
+                  << std::setw(colWidth) << "Uptime s" << " | "
+                  << std::setw(colWidth) << "Restarts" << " | "
+                  << std::setw(colWidth) << "State" << " |"
+                  << std::endl
+                  << "---------------------------------------------------------------------------------"
+                  << std::endl;
+        for (uint32_t slot = 0; slot < DD_SENDER_SLOTS; slot++) {
+            const struct ddHeartbeat::sender_ *s = _heartbeat->sender(slot);
+            if (0 == s->received)
+                continue;
+            std::cout << std::setw(4) << slot
+                      << std::setw(3 + colWidth) << s->received
+                      << std::setw(3 + colWidth) << s->missing
+                      << std::setw(3 + colWidth) << std::fixed << std::setprecision(1)
+                      << s->jitterNs / 1000.0
+                      << std::setw(3 + colWidth) << s->uptimeMs / 1000
+                      << std::setw(3 + colWidth) << s->restarts
+                      << std::setw(3 + colWidth) << (s->lost ? "lost" : "ok")
+                      << std::endl;
+        }
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printQualifyStats()
+{
+    std::cout << "=================== Data Diode IN4004 Link Qualification ========================"
+              << std::endl;
+    if (_qualify->sender()) {
+        int32_t step = _qualify->txStep();
+        std::cout << "Sending: ";
+        if (_qualify->txFinished())
+            std::cout << "finished";
+        else if (step < 0)
+            std::cout << "starting";
+        else
+            std::cout << "step " << step + 1 << "/" << DD_QUALIFY_STEPS
+                      << " size " << ddQualify::stepSize(step)
+                      << " rate " << (uint32_t)ddQualify::stepRate(step) << "%"
+                      << " (" << _qualify->pps() << " pps)";
+        std::cout << " Sent: " << _qualify->sent()
+                  << " No mbuf: " << _qualify->noMbuf()
+                  << std::endl;
+    }
+    if (_qualify->receiver()) {
+        std::cout << "Receiving: step " << _qualify->rxStep() + 1 << "/" << DD_QUALIFY_STEPS
+                  << " Done: " << _qualify->stepsDone()
+                  << " Late: " << _qualify->late()
+                  << " Bad: " << _qualify->badFrames()
+                  << std::endl;
+        _qualify->report(false);
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printInstanceStats()
+{
+    uint16_t colWidth = 10;
+
+    std::cout << "=================== Data Diode IN4004 Instance Statistics ======================="
+              << std::endl
+              << std::setw(colWidth + 5) << std::left << "Instance" << std::right << " | "
+              << std::setw(4) << "Role" << " | "
+              << std::setw(4) << "Core" << " | "
+              << std::setw(colWidth) << "RX" << " | "
+              << std::setw(colWidth) << "TX" << " | "
+              << std::setw(colWidth) << "Dropped" << " | "
+              << std::setw(colWidth - 2) << "Mbufs" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        ddInstance *diode = _instances[i];
+        uint64_t rx = 0, tx = 0, dropped = 0;
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it) {
+            if (it->second->diode() != diode)
+                continue;
+            rx += it->second->rxStats();
+            tx += it->second->txStats();
+            dropped += it->second->rxDropStats() + it->second->wrongDirDrops() +
+                       it->second->txDropStats();
+        }
+        // in use includes the mbufs waiting in the RX rings and lcore caches
+        std::cout << std::setw(colWidth + 5) << std::left << diode->name() << std::right
+                  << std::setw(3 + 4) << (PORTMODE_RX == diode->corePortMode() ? "rx" : "tx")
+                  << std::setw(3 + 4) << diode->corePort()->portId()
+                  << std::setw(3 + colWidth) << rx
+                  << std::setw(3 + colWidth) << tx
+                  << std::setw(3 + colWidth) << dropped
+                  << std::setw(1 + colWidth) << rte_mempool_in_use_count(diode->pktMbufPool())
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+uint64_t
+dataDiodeApp::mempoolBytes(const struct rte_mempool *pool)
+{
+    return (uint64_t)pool->populated_size *
+           (pool->header_size + pool->elt_size + pool->trailer_size);
+}
+
+void
+dataDiodeApp::printMempoolStats()
+{
+    uint16_t colWidth = 10;
+    // the pool of each instance, then the small size class
+    struct rte_mempool *pools[DD_MAX_INSTANCES + 1];
+    uint32_t dataSz[DD_MAX_INSTANCES + 1];
+    uint32_t nPools = 0;
+    for (uint32_t i = 0; i < _nInstances; i++) {
+        dataSz[nPools] = MBUF_DATA_SZ;
+        pools[nPools++] = _instances[i]->pktMbufPool();
+    }
+    dataSz[nPools] = MBUF_SMALL_DATA_SZ;
+    pools[nPools++] = _smallMbufPool;
+
+    std::cout << "==================== Data Diode IN4004 Mempool Statistics ======================="
+              << std::endl
+              << std::setw(16) << "Pool" << " | "
+              << std::setw(colWidth) << "Data room" << " | "
+              << std::setw(colWidth) << "Mbufs" << " | "
+              << std::setw(colWidth) << "In use" << " | "
+              << std::setw(colWidth) << "Use %" << " | "
+              << std::setw(colWidth) << "Memory KB" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    for (uint32_t i = 0; i < nPools; i++) {
+        if (NULL == pools[i])
+            continue;
+        // in use includes the mbufs waiting in the RX rings and lcore caches
+        uint32_t inUse = rte_mempool_in_use_count(pools[i]);
+        std::cout << std::setw(16) << pools[i]->name
+                  << std::setw(3 + colWidth) << dataSz[i]
+                  << std::setw(3 + colWidth) << pools[i]->size
+                  << std::setw(3 + colWidth) << inUse
+                  << std::setw(3 + colWidth) << std::fixed << std::setprecision(1)
+                  << 100.0 * inUse / pools[i]->size
+                  << std::setw(3 + colWidth) << mempoolBytes(pools[i]) / 1024
+                  << std::endl;
+    }
+    if (NULL != _smallMbufPool) {
+        std::cout << "Copied to small:";
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it)
+            std::cout << " " << it->second->portId() << ":" << it->second->compactStats();
+        std::cout << "  No small mbuf:";
+        for (ddPortMap::iterator it = _pMap.begin(); it != _pMap.end(); ++it)
+            std::cout << " " << it->second->portId() << ":" << it->second->compactNoMbufStats();
+        std::cout << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
+void
+dataDiodeApp::printEventStats()
+{
+    uint16_t colWidth = 10;
+    double usPerTsc = 1000000.0 / rte_get_tsc_hz();
+
+    std::cout << "===================== Data Diode IN4004 Event Statistics ========================"
+              << std::endl
+              << "Device: " << _eventDev->devName() << " Workers: " << _eventDev->nWorkers()
+              << std::endl
+              << "Lcore" << " | "
+              << std::setw(6) << "Role" << " | "
+              << std::setw(colWidth) << "In" << " | "
+              << std::setw(colWidth) << "Dropped" << " | "
+              << std::setw(colWidth) << "TX" << " | "
+              << std::setw(colWidth) << "Lat us" << " | "
+              << std::setw(colWidth) << "Max us" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl;
+    uint32_t lcoreId;
+    RTE_LCORE_FOREACH(lcoreId) {
+        const struct ddEventDev::lcoreStats_ *stats = _eventDev->stats(lcoreId);
+        bool worker = _eventDev->worker(lcoreId);
+        std::cout << std::setw(5) << lcoreId
+                  << std::setw(3 + 6) << (worker ? "worker" : "rx")
+                  << std::setw(3 + colWidth) << (worker ? stats->worked : stats->rx)
+                  << std::setw(3 + colWidth) << (worker ? stats->txDropped : stats->rxDropped)
+                  << std::setw(3 + colWidth) << stats->tx
+                  << std::setw(3 + colWidth) << std::fixed << std::setprecision(1)
+                  << (stats->tx ? stats->latencyTsc * usPerTsc / stats->tx : 0.0)
+                  << std::setw(3 + colWidth) << stats->latencyMaxTsc * usPerTsc
+                  << std::endl;
+    }
+    std::cout << std::endl
+              <<"================================================================================="
+              << std::endl;
+}
+
 void
 dataDiodeApp::printEthStats()
 {
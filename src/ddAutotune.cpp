@@ -0,0 +1,324 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <netinet/in.h>
+#include <rte_log.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_memcpy.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include "ddPort.h"
+#include "ddConfig.h"
+#include "ddAutotune.h"
+#include "dataDiode.h"
+
+
+// parameters swept, in the order they are swept
+enum {
+    PARAM_RX_BURST,
+    PARAM_TX_BURST,
+    PARAM_TX_DESC,
+    PARAM_MEMPOOL_CACHE,
+    PARAM_DRAIN_US,
+    PARAM_MAX           // Always a last entry
+};
+
+static const char *paramNames[PARAM_MAX] = {
+    "rx_burst", "tx_burst", "tx_desc", "mempool_cache", "tx_drain_us"
+};
+
+static const uint32_t rxBurstGrid[] = { 8, 16, 32, 64 };
+static const uint32_t txBurstGrid[] = { 8, 16, 32, 64 };
+static const uint32_t txDescGrid[] = { 256, 512, 1024, 2048, 4096 };
+static const uint32_t cacheGrid[] = { 64, 128, 256, 512 };
+static const uint32_t drainGrid[] = { 10, 25, 50, 100, 200 };
+
+static const struct {
+    const uint32_t *values;
+    uint32_t nValues;
+} grids[PARAM_MAX] = {
+    { rxBurstGrid, RTE_DIM(rxBurstGrid) },
+    { txBurstGrid, RTE_DIM(txBurstGrid) },
+    { txDescGrid, RTE_DIM(txDescGrid) },
+    { cacheGrid, RTE_DIM(cacheGrid) },
+    { drainGrid, RTE_DIM(drainGrid) },
+};
+
+static uint32_t
+getParam(const ddTuning &t, int param)
+{
+    switch (param) {
+    case PARAM_RX_BURST:        return t.rxBurst;
+    case PARAM_TX_BURST:        return t.txBurst;
+    case PARAM_TX_DESC:         return t.nbTxd;
+    case PARAM_MEMPOOL_CACHE:   return t.mempoolCache;
+    default:                    return t.drainUs;
+    }
+}
+
+static void
+setParam(ddTuning &t, int param, uint32_t value)
+{
+    switch (param) {
+    case PARAM_RX_BURST:        t.rxBurst = value; break;
+    case PARAM_TX_BURST:        t.txBurst = value; break;
+    case PARAM_TX_DESC:         t.nbTxd = value; break;
+    case PARAM_MEMPOOL_CACHE:   t.mempoolCache = value; break;
+    default:                    t.drainUs = value; break;
+    }
+}
+
+ddAutotune::ddAutotune(const char *tuningFile) :
+        _tuningFile(tuningFile), _ingress(NULL), _egress(NULL), _frameLen(0)
+{
+    dataDiodeApp &app = dataDiodeApp::instance();
+
+#ifndef _DD_TESTMODE_
+    if (dataDiodeApp::PORTMODE_RX == app.corePortMode()) {
+        _ingress = app.corePort();
+        _egress = app.accessPort();
+    } else {
+        _ingress = app.accessPort();
+        _egress = app.corePort();
+    }
+#else
+    _ingress = app.accessPort();
+    _egress = app.corePort(dataDiodeApp::PORTMODE_TX);
+#endif
+    if (NULL == _ingress || NULL == _egress)
+        rte_exit(EXIT_FAILURE, "Autotune needs the core and an access port\n");
+}
+
+void
+ddAutotune::buildFrame()
+{
+    dataDiodeApp &app = dataDiodeApp::instance();
+    uint8_t *p = _frame;
+
+    // frames entering the Rx-Only role are valid tunnel frames of the peer
+    if (_ingress != app.accessPort()) {
+        if (NULL != app.crypto())
+            rte_exit(EXIT_FAILURE, "Autotune of the Rx-Only role needs payload encryption disabled\n");
+        const ddConfig *config = app.config();
+        struct ddPort::tunnelHdr_ *tunnelHdr = reinterpret_cast<struct ddPort::tunnelHdr_ *>(p);
+        ether_addr_copy(_ingress->ethAddr(), &tunnelHdr->dAddr);
+        ether_addr_copy(config->peerCorePortEthAddr(), &tunnelHdr->sAddr);
+        tunnelHdr->etherType = rte_cpu_to_be_16(DATADIODE_TUNNEL_ETHTYPE);
+        tunnelHdr->sId = rte_cpu_to_be_16(config->peerSId());
+        p += sizeof(struct ddPort::tunnelHdr_);
+    }
+
+    // inner frame is UDP to the discard port, benchmarking addresses (RFC 2544)
+    struct ether_hdr *ethHdr = reinterpret_cast<struct ether_hdr *>(p);
+    memset(&ethHdr->d_addr, 0xFF, sizeof(ethHdr->d_addr));
+    ether_addr_copy(_ingress->ethAddr(), &ethHdr->s_addr);
+    ethHdr->ether_type = rte_cpu_to_be_16(ETHER_TYPE_IPv4);
+
+    uint16_t ipLen = DD_TUNE_FRAME_LEN - sizeof(struct ether_hdr);
+    struct ipv4_hdr *ipHdr = reinterpret_cast<struct ipv4_hdr *>(ethHdr + 1);
+    memset(ipHdr, 0, ipLen);
+    ipHdr->version_ihl = 0x45;
+    ipHdr->total_length = rte_cpu_to_be_16(ipLen);
+    ipHdr->time_to_live = 64;
+    ipHdr->next_proto_id = IPPROTO_UDP;
+    ipHdr->src_addr = rte_cpu_to_be_32(0xC6120001);    // 198.18.0.1
+    ipHdr->dst_addr = rte_cpu_to_be_32(0xC6120002);    // 198.18.0.2
+    ipHdr->hdr_checksum = rte_ipv4_cksum(ipHdr);
+
+    struct udp_hdr *udpHdr = reinterpret_cast<struct udp_hdr *>(ipHdr + 1);
+    udpHdr->src_port = rte_cpu_to_be_16(9);
+    udpHdr->dst_port = rte_cpu_to_be_16(9);
+    udpHdr->dgram_len = rte_cpu_to_be_16(ipLen - sizeof(struct ipv4_hdr));
+
+    _frameLen = (p - _frame) + DD_TUNE_FRAME_LEN;
+}
+
+struct rte_mempool*
+ddAutotune::pool(uint32_t cacheSz)
+{
+    // pools are kept to the end, frames of a trial may still sit in the NIC
+    std::map<uint32_t, struct rte_mempool *>::iterator it = _pools.find(cacheSz);
+    if (it != _pools.end())
+        return it->second;
+
+    char name[RTE_MEMPOOL_NAMESIZE];
+    snprintf(name, sizeof(name), "dd_tune_pool_%u", cacheSz);
+    struct rte_mempool *mp = rte_pktmbuf_pool_create(name, DD_TUNE_NB_MBUF, cacheSz, 0,
+                                                     MBUF_DATA_SZ, rte_socket_id());
+    if (NULL == mp)
+        rte_exit(EXIT_FAILURE, "Cannot create autotune pool %s\n", name);
+    _pools[cacheSz] = mp;
+    return mp;
+}
+
+void
+ddAutotune::apply(const ddTuning &tuning, const ddTuning &current)
+{
+    dataDiodeApp::instance().setTuning(tuning);
+    if (tuning.nbTxd != current.nbTxd)
+        _egress->setupTxQueue(tuning.nbTxd);
+    if (tuning.txBurst != current.txBurst)
+        _egress->setTxBurst(tuning.txBurst);
+}
+
+struct ddAutotune::result_
+ddAutotune::trial(const ddTuning &tuning)
+{
+    dataDiodeApp &app = dataDiodeApp::instance();
+    struct rte_mempool *mp = pool(tuning.mempoolCache);
+    struct rte_eth_dev_tx_buffer *txBuf = _egress->txBuffer();
+    const uint64_t hz = rte_get_tsc_hz();
+    const uint64_t trialTsc = hz * DD_TUNE_TRIAL_MS / 1000;
+    const uint64_t drainTsc = hz * tuning.drainUs / US_PER_S;
+    uint64_t generated = 0, latencySum = 0, latencyCnt = 0, pendingTsc = 0;
+    uint64_t sent0 = _egress->txStats();
+    uint64_t start = rte_rdtsc(), now = start, prevDrain = start;
+
+    while ((now = rte_rdtsc()) - start < trialTsc && !app.forceQuit()) {
+        struct rte_mbuf *pkts[MAX_PKT_BURST];
+        uint32_t n = tuning.rxBurst;
+
+        generated += n;
+        // an empty pool means frames pile up in front of the egress NIC
+        if (0 == rte_pktmbuf_alloc_bulk(mp, pkts, n)) {
+            for (uint32_t i = 0; i < n; i++)
+                rte_memcpy(rte_pktmbuf_append(pkts[i], _frameLen), _frame, _frameLen);
+
+            uint64_t handed = _egress->txStats() + _egress->txDropStats();
+            _ingress->incRxStats(n);
+            _ingress->processBurst(pkts, n);
+
+            // time frames spent in the TX buffer until handed to the NIC
+            if (_egress->txStats() + _egress->txDropStats() != handed) {
+                if (pendingTsc) {
+                    latencySum += now - pendingTsc;
+                    latencyCnt++;
+                }
+                pendingTsc = txBuf->length ? now : 0;
+            } else if (0 == pendingTsc && txBuf->length) {
+                pendingTsc = now;
+            }
+        }
+
+        if (now - prevDrain > drainTsc) {
+            _ingress->handleTx();
+            _egress->handleTx();
+            prevDrain = now;
+            if (pendingTsc && 0 == txBuf->length) {
+                latencySum += rte_rdtsc() - pendingTsc;
+                latencyCnt++;
+                pendingTsc = 0;
+            }
+        }
+    }
+    _egress->handleTx();
+
+    struct result_ res;
+    uint64_t sent = _egress->txStats() - sent0;
+    double elapsedUs = (double)(rte_rdtsc() - start) * US_PER_S / hz;
+    res.mpps = sent / elapsedUs;
+    res.dropRate = generated ? 1.0 - (double)sent / generated : 0;
+    res.dropRate = RTE_MAX(res.dropRate, 0.0);
+    res.latencyUs = latencyCnt ? (double)latencySum * US_PER_S / hz / latencyCnt : 0;
+    return res;
+}
+
+bool
+ddAutotune::better(const struct result_ &res, const struct result_ &best) const
+{
+    if (res.mpps > best.mpps * (1 + DD_TUNE_TIE))
+        return true;
+    return res.mpps >= best.mpps * (1 - DD_TUNE_TIE) && res.latencyUs < best.latencyUs;
+}
+
+void
+ddAutotune::run()
+{
+    dataDiodeApp &app = dataDiodeApp::instance();
+    uint16_t colWidth = 10;
+
+    buildFrame();
+    std::cout << "===================== Data Diode IN4004 Autotune ================================"
+              << std::endl
+              << "Port " << _ingress->portId() << " -> Port " << _egress->portId()
+              << ", " << DD_TUNE_TRIAL_MS << "ms per trial, " << _frameLen << " byte frames"
+              << std::endl
+              << std::setw(14) << "Parameter" << " | "
+              << std::setw(colWidth) << "Value" << " | "
+              << std::setw(colWidth) << "Mpps" << " | "
+              << std::setw(colWidth) << "Drop %" << " | "
+              << std::setw(colWidth) << "Latency us" << " |"
+              << std::endl
+              << "---------------------------------------------------------------------------------"
+              << std::endl << std::fixed << std::setprecision(3);
+
+    ddTuning best = app.tuning();
+    ddTuning current = best;
+    struct result_ bestRes = trial(best);
+    std::cout << std::setw(14) << "baseline" << std::setw(3 + colWidth) << "-"
+              << std::setw(3 + colWidth) << bestRes.mpps
+              << std::setw(3 + colWidth) << bestRes.dropRate * 100
+              << std::setw(3 + colWidth) << bestRes.latencyUs << std::endl;
+
+    // coordinate sweep: one parameter at a time around the best so far
+    for (int round = 0; round < DD_TUNE_ROUNDS && !app.forceQuit(); round++) {
+        for (int param = 0; param < PARAM_MAX && !app.forceQuit(); param++) {
+            for (uint32_t v = 0; v < grids[param].nValues && !app.forceQuit(); v++) {
+                uint32_t value = grids[param].values[v];
+                if (value == getParam(best, param))
+                    continue;
+
+                ddTuning candidate = best;
+                setParam(candidate, param, value);
+                apply(candidate, current);
+                current = candidate;
+
+                struct result_ res = trial(candidate);
+                std::cout << std::setw(14) << paramNames[param]
+                          << std::setw(3 + colWidth) << value
+                          << std::setw(3 + colWidth) << res.mpps
+                          << std::setw(3 + colWidth) << res.dropRate * 100
+                          << std::setw(3 + colWidth) << res.latencyUs << std::endl;
+                if (better(res, bestRes)) {
+                    best = candidate;
+                    bestRes = res;
+                }
+            }
+        }
+    }
+
+    std::cout << "================================================================================="
+              << std::endl
+              << "Best: " << best << std::endl
+              << "      " << bestRes.mpps << " Mpps, " << bestRes.dropRate * 100
+              << "% dropped, " << bestRes.latencyUs << " us" << std::endl;
+    if (app.forceQuit()) {
+        std::cout << "Autotune interrupted, " << _tuningFile << " not written" << std::endl;
+    } else if (best.save(_tuningFile.c_str())) {
+        std::cout << "Written to " << _tuningFile << ", used on next start" << std::endl;
+    }
+}
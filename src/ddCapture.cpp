@@ -0,0 +1,417 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <strings.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_malloc.h>
+#include <rte_ring.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include "ddCapture.h"
+
+
+// pcapng block types and options
+#define PCAPNG_SHB_TYPE         0x0A0D0D0A
+#define PCAPNG_IDB_TYPE         0x00000001
+#define PCAPNG_EPB_TYPE         0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_LINKTYPE_ETHERNET 1
+
+#define PCAPNG_PAD(len)         RTE_ALIGN_CEIL(len, 4)
+
+// mbuf carries the metadata header and the captured bytes
+#define DD_CAPTURE_MBUF_SZ      (RTE_PKTMBUF_HEADROOM + DD_CAPTURE_SNAPLEN)
+
+// writer thread sleeps this long when there is nothing to write
+#define DD_CAPTURE_IDLE_US      1000
+
+// and flushes what is buffered after being idle for this many rounds
+#define DD_CAPTURE_IDLE_FLUSH   100
+
+struct pcapngBlockHdr {
+    uint32_t  type;
+    uint32_t  totalLen;
+};
+
+struct pcapngShb {
+    struct pcapngBlockHdr hdr;
+    uint32_t  byteOrderMagic;
+    uint16_t  majorVersion;
+    uint16_t  minorVersion;
+    int64_t   sectionLen;
+    uint32_t  totalLen;
+} __attribute__((__packed__));
+
+struct pcapngIdb {
+    struct pcapngBlockHdr hdr;
+    uint16_t  linkType;
+    uint16_t  reserved;
+    uint32_t  snapLen;
+    uint16_t  optTsresolCode;
+    uint16_t  optTsresolLen;
+    uint8_t   optTsresol;
+    uint8_t   optTsresolPad[3];
+    uint16_t  optEndCode;
+    uint16_t  optEndLen;
+    uint32_t  totalLen;
+} __attribute__((__packed__));
+
+struct pcapngEpb {
+    struct pcapngBlockHdr hdr;
+    uint32_t  interfaceId;
+    uint32_t  tsHigh;
+    uint32_t  tsLow;
+    uint32_t  capturedLen;
+    uint32_t  origLen;
+} __attribute__((__packed__));
+
+struct pcapngOpt {
+    uint16_t  code;
+    uint16_t  len;
+};
+
+static const char *reasonNames[] = {
+    "forwarded",
+    "bad-dst-addr",
+    "bad-src-addr",
+    "bad-eth-type",
+    "bad-sid",
+    "wrong-direction",
+};
+
+ddCapture::ddCapture(Mode mode, uint32_t sampleRate, const char *dir) :
+        _mode(mode), _sampleRate(sampleRate ? sampleRate : 1), _dir(dir),
+        _pool(NULL), _ring(NULL), _stop(false),
+        _fd(-1), _fileIdx(0), _fileSz(0), _writeBuf(NULL), _writeLen(0),
+        _tscBase(0), _nsBase(0), _written(0), _bytesWritten(0),
+        _writeErrors(0), _rotations(0)
+{
+    bzero(_lcoreStats, sizeof(_lcoreStats));
+}
+
+bool
+ddCapture::parseMode(const char *arg, Mode *mode, uint32_t *sampleRate)
+{
+    *sampleRate = 1;
+    if (0 == strcmp(arg, "rejected")) {
+        *mode = MODE_REJECTED;
+    } else if (0 == strcmp(arg, "all")) {
+        *mode = MODE_ALL;
+    } else if (0 == strncmp(arg, "sample:", 7)) {
+        char *end = NULL;
+        *mode = MODE_SAMPLE;
+        *sampleRate = strtoul(arg + 7, &end, 10);
+        if (arg[7] == '\0' || *end != '\0' || *sampleRate == 0)
+            return false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char*
+ddCapture::reasonName(Reason reason)
+{
+    return (reason < REASON_MAX) ? reasonNames[reason] : "unknown";
+}
+
+const char*
+ddCapture::modeName() const
+{
+    switch (_mode) {
+    case MODE_REJECTED:
+        return "rejected";
+    case MODE_SAMPLE:
+        return "sample";
+    case MODE_ALL:
+        return "all";
+    default:
+        return "invalid";
+    }
+}
+
+void
+ddCapture::initialize()
+{
+    std::cout << "Initializing capture of " << modeName() << " frames to "
+              << _dir << " ..." << std::endl;
+
+    _pool = rte_pktmbuf_pool_create("dd_capture_pool", DD_CAPTURE_NB_MBUF,
+                                    DD_CAPTURE_POOL_CACHE_SZ, 0,
+                                    DD_CAPTURE_MBUF_SZ, rte_socket_id());
+    if (NULL == _pool)
+        rte_exit(EXIT_FAILURE, "Cannot create capture mbuf pool\n");
+
+    // any lcore may tap, only the writer thread consumes
+    _ring = rte_ring_create("dd_capture_ring", DD_CAPTURE_RING_SZ,
+                            rte_socket_id(), RING_F_SC_DEQ);
+    if (NULL == _ring)
+        rte_exit(EXIT_FAILURE, "Cannot create capture ring\n");
+
+    _writeBuf = (uint8_t *)malloc(DD_CAPTURE_WRITE_BUF_SZ);
+    if (NULL == _writeBuf)
+        rte_exit(EXIT_FAILURE, "Cannot allocate capture write buffer\n");
+
+    // wall clock reference for converting TSC to capture timestamps
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    _tscBase = rte_rdtsc();
+    _nsBase = (uint64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+
+    mkdir(_dir.c_str(), 0700);
+    openFile();
+
+    int ret = rte_ctrl_thread_create(&_writerThread, "dd-capture", NULL,
+                                     ddCapture::writerMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start capture writer thread: err = %d\n", ret);
+}
+
+void
+ddCapture::cleanup()
+{
+    _stop = true;
+    pthread_join(_writerThread, NULL);
+    flush();
+    if (_fd >= 0)
+        close(_fd);
+}
+
+void
+ddCapture::copy(struct rte_mbuf *pkt, uint16_t portId, Reason reason)
+{
+    struct lcoreStats_ *stats = &_lcoreStats[rte_lcore_id()];
+
+    // keep copying cheap, ring full means the frame is simply not captured
+    if (unlikely(rte_ring_full(_ring))) {
+        stats->ringFull++;
+        return;
+    }
+
+    struct rte_mbuf *copy = rte_pktmbuf_alloc(_pool);
+    if (unlikely(NULL == copy)) {
+        stats->noMbuf++;
+        return;
+    }
+
+    uint32_t len = RTE_MIN(rte_pktmbuf_data_len(pkt), (uint32_t)DD_CAPTURE_SNAPLEN);
+    rte_memcpy(rte_pktmbuf_append(copy, len), rte_pktmbuf_mtod(pkt, void *), len);
+
+    struct meta_ *meta = reinterpret_cast<struct meta_ *>(
+                rte_pktmbuf_prepend(copy, sizeof(struct meta_)));
+    meta->tsc = rte_rdtsc();
+    meta->origLen = pkt->pkt_len;
+    meta->portId = portId;
+    meta->reason = reason;
+
+    if (unlikely(0 != rte_ring_enqueue(_ring, copy))) {
+        rte_pktmbuf_free(copy);
+        stats->ringFull++;
+        return;
+    }
+    stats->captured++;
+}
+
+uint64_t
+ddCapture::captured() const
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++)
+        total += _lcoreStats[i].captured;
+    return total;
+}
+
+uint64_t
+ddCapture::dropped() const
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++)
+        total += _lcoreStats[i].ringFull + _lcoreStats[i].noMbuf;
+    return total;
+}
+
+void
+ddCapture::openFile()
+{
+    char path[PATH_MAX];
+
+    if (_fd >= 0) {
+        flush();
+        close(_fd);
+        _rotations++;
+
+        // keep only the newest files
+        if (_fileIdx >= DD_CAPTURE_NB_FILES) {
+            snprintf(path, sizeof(path), "%s/capture-%06u.pcapng",
+                     _dir.c_str(), _fileIdx - DD_CAPTURE_NB_FILES);
+            unlink(path);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/capture-%06u.pcapng", _dir.c_str(), _fileIdx++);
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (_fd < 0) {
+        RTE_LOG(ERR, USER1, "Cannot open capture file %s: %s\n", path, strerror(errno));
+        _writeErrors++;
+        return;
+    }
+    _fileSz = 0;
+
+    struct pcapngShb shb;
+    bzero(&shb, sizeof(shb));
+    shb.hdr.type = PCAPNG_SHB_TYPE;
+    shb.hdr.totalLen = shb.totalLen = sizeof(shb);
+    shb.byteOrderMagic = PCAPNG_BYTE_ORDER_MAGIC;
+    shb.majorVersion = 1;
+    shb.minorVersion = 0;
+    shb.sectionLen = -1;
+    append(&shb, sizeof(shb));
+
+    // timestamps are in nano seconds
+    struct pcapngIdb idb;
+    bzero(&idb, sizeof(idb));
+    idb.hdr.type = PCAPNG_IDB_TYPE;
+    idb.hdr.totalLen = idb.totalLen = sizeof(idb);
+    idb.linkType = PCAPNG_LINKTYPE_ETHERNET;
+    idb.snapLen = DD_CAPTURE_SNAPLEN;
+    idb.optTsresolCode = PCAPNG_OPT_IF_TSRESOL;
+    idb.optTsresolLen = 1;
+    idb.optTsresol = 9;
+    idb.optEndCode = PCAPNG_OPT_ENDOFOPT;
+    append(&idb, sizeof(idb));
+}
+
+void
+ddCapture::flush()
+{
+    uint32_t off = 0;
+    while (_fd >= 0 && off < _writeLen) {
+        ssize_t ret = write(_fd, _writeBuf + off, _writeLen - off);
+        if (ret < 0) {
+            if (EINTR == errno)
+                continue;
+            _writeErrors++;
+            break;
+        }
+        off += ret;
+    }
+    _bytesWritten += off;
+    _writeLen = 0;
+}
+
+void
+ddCapture::append(const void *data, uint32_t len)
+{
+    if (_writeLen + len > DD_CAPTURE_WRITE_BUF_SZ)
+        flush();
+    memcpy(_writeBuf + _writeLen, data, len);
+    _writeLen += len;
+    _fileSz += len;
+}
+
+void
+ddCapture::writeRecord(struct rte_mbuf *pkt)
+{
+    static const uint8_t pad[4] = { 0, 0, 0, 0 };
+    struct meta_ meta = *rte_pktmbuf_mtod(pkt, struct meta_ *);
+    rte_pktmbuf_adj(pkt, sizeof(struct meta_));
+
+    // comment records why the frame was captured and where
+    char comment[64];
+    uint32_t commentLen = snprintf(comment, sizeof(comment), "port=%u reason=%s",
+                                   meta.portId, reasonName(static_cast<Reason>(meta.reason)));
+    commentLen = RTE_MIN(commentLen, (uint32_t)sizeof(comment) - 1);
+
+    uint32_t capLen = rte_pktmbuf_data_len(pkt);
+    uint64_t hz = rte_get_tsc_hz();
+    uint64_t cycles = meta.tsc - _tscBase;
+    uint64_t ns = _nsBase + (cycles / hz) * NS_PER_S + (cycles % hz) * NS_PER_S / hz;
+
+    struct pcapngEpb epb;
+    epb.hdr.type = PCAPNG_EPB_TYPE;
+    epb.hdr.totalLen = sizeof(epb) + PCAPNG_PAD(capLen) +
+                       sizeof(struct pcapngOpt) + PCAPNG_PAD(commentLen) +
+                       sizeof(struct pcapngOpt) + sizeof(uint32_t);
+    epb.interfaceId = 0;
+    epb.tsHigh = ns >> 32;
+    epb.tsLow = ns & 0xFFFFFFFF;
+    epb.capturedLen = capLen;
+    epb.origLen = meta.origLen;
+
+    append(&epb, sizeof(epb));
+    append(rte_pktmbuf_mtod(pkt, void *), capLen);
+    append(pad, PCAPNG_PAD(capLen) - capLen);
+
+    struct pcapngOpt opt;
+    opt.code = PCAPNG_OPT_COMMENT;
+    opt.len = commentLen;
+    append(&opt, sizeof(opt));
+    append(comment, commentLen);
+    append(pad, PCAPNG_PAD(commentLen) - commentLen);
+    opt.code = PCAPNG_OPT_ENDOFOPT;
+    opt.len = 0;
+    append(&opt, sizeof(opt));
+    append(&epb.hdr.totalLen, sizeof(uint32_t));
+    _written++;
+}
+
+void*
+ddCapture::writerMain(void *arg)
+{
+    reinterpret_cast<ddCapture *>(arg)->writerLoop();
+    return NULL;
+}
+
+void
+ddCapture::writerLoop()
+{
+    struct rte_mbuf *pkts[64];
+    uint32_t idleRounds = 0;
+
+    while (!_stop) {
+        uint32_t n = rte_ring_dequeue_burst(_ring, (void **)pkts, RTE_DIM(pkts), NULL);
+        if (0 == n) {
+            // make buffered records visible once traffic calms down
+            if (++idleRounds == DD_CAPTURE_IDLE_FLUSH)
+                flush();
+            usleep(DD_CAPTURE_IDLE_US);
+            continue;
+        }
+        idleRounds = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            writeRecord(pkts[i]);
+            rte_pktmbuf_free(pkts[i]);
+        }
+        if (_fileSz >= DD_CAPTURE_FILE_SZ)
+            openFile();
+    }
+}
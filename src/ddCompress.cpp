@@ -0,0 +1,491 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <rte_log.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_malloc.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_comp.h>
+#include <rte_compressdev.h>
+#ifdef _DD_LZ4_
+#include <lz4.h>
+#endif
+#include "ddConfig.h"
+#include "ddCompress.h"
+
+
+#define DD_COMP_SLOT_MASK       (DD_COMP_NB_SLOTS - 1)
+
+// slot of the frame is kept in the user area right after the op
+#define DD_COMP_OP_SLOT(op)     (*reinterpret_cast<uint32_t *>((op) + 1))
+
+// queue pair used for each direction
+#define DD_COMP_QP(dir)         static_cast<uint16_t>(dir)
+
+// deflate window, 2^15 bytes
+#define DD_COMP_WINDOW_SZ       15
+
+ddCompress::ddCompress(const char *engine) :
+        _engine(engine), _algo(ALGO_DEFLATE), _devId(-1),
+        _opPool(NULL), _pktPool(NULL)
+{
+    bzero(_privXform, sizeof(_privXform));
+    bzero(_stage, sizeof(_stage));
+
+    if (_engine == DD_COMP_ENGINE_LZ4) {
+        _algo = ALGO_LZ4;
+    }
+}
+
+const char*
+ddCompress::dirName(Direction dir)
+{
+    return (DIR_COMPRESS == dir) ? "Compress" : "Decomp";
+}
+
+bool
+ddCompress::channelEnabled(const ddConfig *config, struct rte_mbuf *pkt) const
+{
+    if (config->compAllChannels())
+        return true;
+
+    uint16_t dstPort;
+    return ddConfig::innerDstPort(pkt, &dstPort) && config->compChannel(dstPort);
+}
+
+void
+ddCompress::initializeDev()
+{
+    _devId = rte_compressdev_get_dev_id(_engine.c_str());
+    if (_devId < 0)
+        rte_exit(EXIT_FAILURE, "Compression device %s not found. Add it with --vdev\n",
+                 _engine.c_str());
+
+    struct rte_compressdev_info devInfo;
+    rte_compressdev_info_get(_devId, &devInfo);
+    if (devInfo.max_nb_queue_pairs != 0 && devInfo.max_nb_queue_pairs < DIR_MAX)
+        rte_exit(EXIT_FAILURE, "Compression device %s supports only %u queue pairs\n",
+                 _engine.c_str(), devInfo.max_nb_queue_pairs);
+
+    int socketId = rte_compressdev_socket_id(_devId);
+    if (socketId < 0)
+        socketId = rte_socket_id();
+
+    struct rte_compressdev_config conf;
+    bzero(&conf, sizeof(conf));
+    conf.socket_id = socketId;
+    conf.nb_queue_pairs = DIR_MAX;
+    conf.max_nb_priv_xforms = DIR_MAX;
+    conf.max_nb_streams = 0;
+    int ret = rte_compressdev_configure(_devId, &conf);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot configure compression device: err = %d, dev = %s\n",
+                 ret, _engine.c_str());
+
+    for (uint16_t qp = 0; qp < DIR_MAX; qp++) {
+        ret = rte_compressdev_queue_pair_setup(_devId, qp, DD_COMP_NB_SLOTS, socketId);
+        if (ret < 0)
+            rte_exit(EXIT_FAILURE, "Compression queue pair setup failed: err = %d, qp = %u\n",
+                     ret, qp);
+    }
+
+    _opPool = rte_comp_op_pool_create("dd_comp_op_pool", DD_COMP_NB_OPS,
+                                      DD_COMP_OP_CACHE_SZ, sizeof(uint32_t),
+                                      socketId);
+    if (NULL == _opPool)
+        rte_exit(EXIT_FAILURE, "Cannot create compression op pool\n");
+
+    ret = rte_compressdev_start(_devId);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Compression device start failed: err = %d, dev = %s\n",
+                 ret, _engine.c_str());
+
+    // stateless deflate, one private xform per direction
+    struct rte_comp_xform xform;
+    bzero(&xform, sizeof(xform));
+    xform.type = RTE_COMP_COMPRESS;
+    xform.compress.algo = RTE_COMP_ALGO_DEFLATE;
+    xform.compress.deflate.huffman = RTE_COMP_HUFFMAN_DEFAULT;
+    xform.compress.level = RTE_COMP_LEVEL_PMD_DEFAULT;
+    xform.compress.window_size = DD_COMP_WINDOW_SZ;
+    xform.compress.chksum = RTE_COMP_CHECKSUM_NONE;
+    ret = rte_compressdev_private_xform_create(_devId, &xform, &_privXform[DIR_COMPRESS]);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot create compress xform: err = %d\n", ret);
+
+    bzero(&xform, sizeof(xform));
+    xform.type = RTE_COMP_DECOMPRESS;
+    xform.decompress.algo = RTE_COMP_ALGO_DEFLATE;
+    xform.decompress.chksum = RTE_COMP_CHECKSUM_NONE;
+    xform.decompress.window_size = DD_COMP_WINDOW_SZ;
+    ret = rte_compressdev_private_xform_create(_devId, &xform, &_privXform[DIR_DECOMPRESS]);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot create decompress xform: err = %d\n", ret);
+}
+
+void
+ddCompress::initialize(struct rte_mempool *pktPool)
+{
+    std::cout << "Initializing compression engine " << _engine << " ..." << std::endl;
+
+    _pktPool = pktPool;
+    for (int dir = 0; dir < DIR_MAX; dir++) {
+        _stage[dir].slots = (struct slot_ *)rte_zmalloc("dd_comp_slots",
+                                     DD_COMP_NB_SLOTS * sizeof(struct slot_), 0);
+        if (NULL == _stage[dir].slots)
+            rte_exit(EXIT_FAILURE, "Cannot allocate compression stage\n");
+    }
+
+    if (ALGO_LZ4 == _algo) {
+#ifndef _DD_LZ4_
+        rte_exit(EXIT_FAILURE, "Built without LZ4 support, rebuild with DD_LZ4=1\n");
+#endif
+        return;
+    }
+    initializeDev();
+}
+
+struct rte_mbuf*
+ddCompress::allocDst(struct rte_mbuf *src, uint16_t len)
+{
+    struct rte_mbuf *dst = rte_pktmbuf_alloc(_pktPool);
+    if (NULL == dst)
+        return NULL;
+
+    if (NULL == rte_pktmbuf_append(dst, len)) {
+        rte_pktmbuf_free(dst);
+        return NULL;
+    }
+    dst->port = src->port;
+    dst->udata64 = src->udata64;
+    return dst;
+}
+
+void
+ddCompress::complete(Direction dir, uint32_t slot, struct rte_mbuf *pkt)
+{
+    struct slot_ *s = &_stage[dir].slots[slot];
+    s->pkt = pkt;
+    s->done = 1;
+    if (NULL != pkt)
+        _stage[dir].stats.bytesOut += pkt->pkt_len;
+}
+
+void
+ddCompress::bypass(Direction dir, uint32_t slot, struct rte_mbuf *pkt)
+{
+    struct stats_ *stats = &_stage[dir].stats;
+
+    if (DIR_COMPRESS == dir) {
+        uint16_t origLen = pkt->pkt_len;
+        struct compHdr_ *hdr = reinterpret_cast<struct compHdr_ *>(
+                    rte_pktmbuf_prepend(pkt, sizeof(struct compHdr_)));
+        if (NULL == hdr) {
+            rte_pktmbuf_free(pkt);
+            stats->dropped++;
+            complete(dir, slot, NULL);
+            return;
+        }
+        hdr->algo = ALGO_NONE;
+        hdr->reserved = 0;
+        hdr->origLen = rte_cpu_to_be_16(origLen);
+    } else {
+        rte_pktmbuf_adj(pkt, sizeof(struct compHdr_));
+    }
+    stats->bypassed++;
+    complete(dir, slot, pkt);
+}
+
+void
+ddCompress::finishOp(Direction dir, struct rte_comp_op *op)
+{
+    struct stats_ *stats = &_stage[dir].stats;
+    uint32_t slot = DD_COMP_OP_SLOT(op);
+    struct rte_mbuf *src = op->m_src;
+    struct rte_mbuf *dst = op->m_dst;
+
+    if (DIR_COMPRESS == dir) {
+        // output buffer was sized so that anything not shrinking overflows
+        if (RTE_COMP_OP_STATUS_SUCCESS != op->status) {
+            if (RTE_COMP_OP_STATUS_OUT_OF_SPACE_TERMINATED != op->status &&
+                RTE_COMP_OP_STATUS_NOT_PROCESSED != op->status)
+                stats->errors++;
+            rte_pktmbuf_free(dst);
+            bypass(dir, slot, src);
+            return;
+        }
+        rte_pktmbuf_trim(dst, dst->pkt_len - op->produced);
+        struct compHdr_ *hdr = reinterpret_cast<struct compHdr_ *>(
+                    rte_pktmbuf_prepend(dst, sizeof(struct compHdr_)));
+        hdr->algo = ALGO_DEFLATE;
+        hdr->reserved = 0;
+        hdr->origLen = rte_cpu_to_be_16(src->pkt_len);
+        rte_pktmbuf_free(src);
+        stats->processed++;
+        complete(dir, slot, dst);
+    } else {
+        if (RTE_COMP_OP_STATUS_SUCCESS != op->status ||
+            op->produced != dst->pkt_len) {
+            stats->errors++;
+            rte_pktmbuf_free(src);
+            rte_pktmbuf_free(dst);
+            complete(dir, slot, NULL);
+            return;
+        }
+        rte_pktmbuf_free(src);
+        stats->processed++;
+        complete(dir, slot, dst);
+    }
+}
+
+void
+ddCompress::processLz4(Direction dir, uint32_t slot, struct rte_mbuf *pkt)
+{
+#ifdef _DD_LZ4_
+    struct stats_ *stats = &_stage[dir].stats;
+
+    if (DIR_COMPRESS == dir) {
+        uint16_t cap = pkt->pkt_len - sizeof(struct compHdr_) - 1;
+        struct rte_mbuf *dst = allocDst(pkt, cap);
+        if (NULL == dst) {
+            bypass(dir, slot, pkt);
+            return;
+        }
+        int produced = LZ4_compress_default(rte_pktmbuf_mtod(pkt, const char *),
+                                            rte_pktmbuf_mtod(dst, char *),
+                                            pkt->pkt_len, cap);
+        if (produced <= 0) {
+            rte_pktmbuf_free(dst);
+            bypass(dir, slot, pkt);
+            return;
+        }
+        rte_pktmbuf_trim(dst, cap - produced);
+        struct compHdr_ *hdr = reinterpret_cast<struct compHdr_ *>(
+                    rte_pktmbuf_prepend(dst, sizeof(struct compHdr_)));
+        hdr->algo = ALGO_LZ4;
+        hdr->reserved = 0;
+        hdr->origLen = rte_cpu_to_be_16(pkt->pkt_len);
+        rte_pktmbuf_free(pkt);
+        stats->processed++;
+        complete(dir, slot, dst);
+    } else {
+        struct compHdr_ *hdr = rte_pktmbuf_mtod(pkt, struct compHdr_ *);
+        uint16_t origLen = rte_be_to_cpu_16(hdr->origLen);
+        struct rte_mbuf *dst = allocDst(pkt, origLen);
+        int produced = -1;
+        if (NULL != dst) {
+            produced = LZ4_decompress_safe(rte_pktmbuf_mtod_offset(pkt, const char *,
+                                                sizeof(struct compHdr_)),
+                                           rte_pktmbuf_mtod(dst, char *),
+                                           pkt->pkt_len - sizeof(struct compHdr_),
+                                           origLen);
+        }
+        rte_pktmbuf_free(pkt);
+        if (produced != origLen) {
+            rte_pktmbuf_free(dst);
+            stats->errors++;
+            complete(dir, slot, NULL);
+            return;
+        }
+        stats->processed++;
+        complete(dir, slot, dst);
+    }
+#else
+    RTE_SET_USED(dir);
+    RTE_SET_USED(slot);
+    rte_pktmbuf_free(pkt);
+#endif
+}
+
+uint16_t
+ddCompress::enqueueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts)
+{
+    struct stage_ *stage = &_stage[dir];
+    struct stats_ *stats = &stage->stats;
+    struct rte_comp_op *ops[nPkts];
+    uint16_t nOps = 0;
+
+    if (0 == nPkts)
+        return 0;
+
+    if (ALGO_DEFLATE == _algo &&
+        nPkts != rte_comp_op_bulk_alloc(_opPool, ops, nPkts)) {
+        for (uint16_t i = 0; i < nPkts; i++)
+            rte_pktmbuf_free(pkts[i]);
+        stats->dropped += nPkts;
+        return 0;
+    }
+
+    uint64_t tsc = rte_rdtsc();
+    for (uint16_t i = 0; i < nPkts; i++) {
+        struct rte_mbuf *pkt = pkts[i];
+
+        // never overtake frames still in the stage
+        if (unlikely(stage->tail - stage->head == DD_COMP_NB_SLOTS)) {
+            rte_pktmbuf_free(pkt);
+            stats->dropped++;
+            continue;
+        }
+        uint32_t slot = stage->tail++ & DD_COMP_SLOT_MASK;
+        stage->slots[slot].pkt = NULL;
+        stage->slots[slot].enqTsc = tsc;
+        stage->slots[slot].done = 0;
+        stats->in++;
+        stats->bytesIn += pkt->pkt_len;
+
+        uint16_t dstLen;
+        if (DIR_COMPRESS == dir) {
+            if (pkt->pkt_len < DD_COMP_MIN_LEN || !rte_pktmbuf_is_contiguous(pkt)) {
+                bypass(dir, slot, pkt);
+                continue;
+            }
+            // compressed frame must be smaller than the original
+            dstLen = pkt->pkt_len - sizeof(struct compHdr_) - 1;
+        } else {
+            struct compHdr_ *hdr = rte_pktmbuf_mtod(pkt, struct compHdr_ *);
+            if (pkt->pkt_len < sizeof(struct compHdr_) ||
+                !rte_pktmbuf_is_contiguous(pkt) ||
+                (ALGO_NONE != hdr->algo && _algo != hdr->algo)) {
+                rte_pktmbuf_free(pkt);
+                stats->errors++;
+                complete(dir, slot, NULL);
+                continue;
+            }
+            if (ALGO_NONE == hdr->algo) {
+                bypass(dir, slot, pkt);
+                continue;
+            }
+            dstLen = rte_be_to_cpu_16(hdr->origLen);
+        }
+
+        if (ALGO_LZ4 == _algo) {
+            processLz4(dir, slot, pkt);
+            continue;
+        }
+
+        struct rte_mbuf *dst = allocDst(pkt, dstLen);
+        if (NULL == dst) {
+            if (DIR_COMPRESS == dir) {
+                bypass(dir, slot, pkt);
+            } else {
+                rte_pktmbuf_free(pkt);
+                stats->dropped++;
+                complete(dir, slot, NULL);
+            }
+            continue;
+        }
+
+        struct rte_comp_op *op = ops[nOps++];
+        op->op_type = RTE_COMP_OP_STATELESS;
+        op->private_xform = _privXform[dir];
+        op->m_src = pkt;
+        op->m_dst = dst;
+        op->src.offset = (DIR_COMPRESS == dir) ? 0 : sizeof(struct compHdr_);
+        op->src.length = pkt->pkt_len - op->src.offset;
+        op->dst.offset = 0;
+        op->flush_flag = RTE_COMP_FLUSH_FINAL;
+        op->status = RTE_COMP_OP_STATUS_NOT_PROCESSED;
+        DD_COMP_OP_SLOT(op) = slot;
+    }
+
+    if (ALGO_DEFLATE != _algo)
+        return nPkts;
+
+    uint16_t nEnq = rte_compressdev_enqueue_burst(_devId, DD_COMP_QP(dir), ops, nOps);
+
+    // queue pair is full, frames are completed right away so the order holds
+    for (uint16_t i = nEnq; i < nOps; i++) {
+        finishOp(dir, ops[i]);
+    }
+    if (nPkts > nEnq)
+        rte_mempool_put_bulk(_opPool, (void **)&ops[nEnq], nPkts - nEnq);
+    return nEnq;
+}
+
+uint16_t
+ddCompress::dequeueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts)
+{
+    struct stage_ *stage = &_stage[dir];
+    struct stats_ *stats = &stage->stats;
+
+    if (ALGO_DEFLATE == _algo) {
+        struct rte_comp_op *ops[nPkts];
+        uint16_t nDeq = rte_compressdev_dequeue_burst(_devId, DD_COMP_QP(dir), ops, nPkts);
+        for (uint16_t i = 0; i < nDeq; i++) {
+            finishOp(dir, ops[i]);
+        }
+        if (nDeq)
+            rte_mempool_put_bulk(_opPool, (void **)ops, nDeq);
+    }
+
+    // release finished frames in the order they entered the stage
+    uint16_t nOut = 0;
+    uint64_t tsc = rte_rdtsc();
+    while (stage->head != stage->tail && nOut < nPkts) {
+        struct slot_ *s = &stage->slots[stage->head & DD_COMP_SLOT_MASK];
+        if (!s->done)
+            break;
+
+        uint64_t latency = tsc - s->enqTsc;
+        stats->latencyCycles += latency;
+        if (latency > stats->latencyMax)
+            stats->latencyMax = latency;
+
+        if (NULL != s->pkt) {
+            pkts[nOut++] = s->pkt;
+            stats->out++;
+        }
+        stage->head++;
+    }
+    return nOut;
+}
+
+double
+ddCompress::ratio(Direction dir) const
+{
+    const struct stats_ *stats = &_stage[dir].stats;
+    if (0 == stats->bytesIn || 0 == stats->bytesOut)
+        return 0;
+    if (DIR_COMPRESS == dir)
+        return (double)stats->bytesIn / stats->bytesOut;
+    return (double)stats->bytesOut / stats->bytesIn;
+}
+
+double
+ddCompress::avgLatencyUs(Direction dir) const
+{
+    const struct stats_ *stats = &_stage[dir].stats;
+    uint64_t nFrames = stats->in - inFlight(dir);
+    if (0 == nFrames)
+        return 0;
+    return (double)stats->latencyCycles * US_PER_S /
+           (nFrames * (double)rte_get_tsc_hz());
+}
+
+double
+ddCompress::maxLatencyUs(Direction dir) const
+{
+    return (double)_stage[dir].stats.latencyMax * US_PER_S / rte_get_tsc_hz();
+}
@@ -0,0 +1,534 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+#include <unistd.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <rte_ether.h>
+#include <rte_byteorder.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include "ddConfig.h"
+
+
+#define DD_IPPROTO_TCP          6
+#define DD_IPPROTO_UDP          17
+
+ddConfig::ddConfig() :
+        _generation(0), _instance(0), _sId(0), _peerSId(0), _compAllChannels(true),
+        _shedDefault(0),
+        _nSenders(0), _sendersFile(false), _senderHash(NULL),
+        _nRewrites(0), _rewriteHash(NULL)
+{
+    bzero(_peerCorePortEthAddr, sizeof(_peerCorePortEthAddr));
+    bzero(_compChannels, sizeof(_compChannels));
+    bzero(_shedClasses, sizeof(_shedClasses));
+    bzero(_senders, sizeof(_senders));
+    bzero(_rewrites, sizeof(_rewrites));
+}
+
+ddConfig::~ddConfig()
+{
+    if (NULL != _senderHash)
+        rte_hash_free(_senderHash);
+    if (NULL != _rewriteHash)
+        rte_hash_free(_rewriteHash);
+}
+
+bool
+ddConfig::readId(const char *path, uint16_t *id)
+{
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile) {
+        std::cerr << "Unable to open configuration file " << path << std::endl;
+        return false;
+    }
+    uint32_t val;
+    int ret = fscanf(inputFile, "%u", &val);
+    std::fclose(inputFile);
+    if (1 != ret) {
+        std::cerr << "Invalid configuration in " << path << std::endl;
+        return false;
+    }
+    *id = static_cast<uint16_t>(val & 0xFFFF);
+    return true;
+}
+
+bool
+ddConfig::readMac(const char *path, struct ether_addr *mac)
+{
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile) {
+        std::cerr << "Unable to open configuration file " << path << std::endl;
+        return false;
+    }
+    uint32_t pM[6];
+    int ret = fscanf(inputFile, "%02x:%02x:%02x:%02x:%02x:%02x",
+                     &pM[0], &pM[1], &pM[2], &pM[3], &pM[4], &pM[5]);
+    std::fclose(inputFile);
+    if (6 != ret) {
+        std::cerr << "Invalid MAC address in " << path << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 6; i++)
+        mac->addr_bytes[i] = static_cast<uint8_t>(pM[i] & 0xFF);
+    return true;
+}
+
+void
+ddConfig::readCompChannels(const char *path)
+{
+    // all channels are compressed when the file is absent
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile)
+        return;
+
+    char line[128];
+    while (NULL != fgets(line, sizeof(line), inputFile)) {
+        char *end = NULL;
+        if ('#' == line[0] || '\n' == line[0])
+            continue;
+        unsigned long port = strtoul(line, &end, 10);
+        if (end == line || port > 65535) {
+            std::cerr << "Ignoring invalid channel " << line << std::endl;
+            continue;
+        }
+        _compChannels[port / 8] |= (1 << (port % 8));
+        _compAllChannels = false;
+    }
+    std::fclose(inputFile);
+}
+
+void
+ddConfig::readShedClasses(const char *path)
+{
+    // nothing is shed when the file is absent
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile)
+        return;
+
+    // <PORT>[-<PORT>] <CLASS> or default <CLASS> per line, the default
+    // goes first wherever it is in the file
+    char line[128];
+    for (int pass = 0; pass < 2; pass++) {
+        rewind(inputFile);
+        while (NULL != fgets(line, sizeof(line), inputFile)) {
+            char *end = NULL;
+            if ('#' == line[0] || '\n' == line[0])
+                continue;
+            bool isDefault = (0 == strncmp(line, "default", 7));
+            if (isDefault != (0 == pass))
+                continue;
+            unsigned long first = 0, last = 65535;
+            if (isDefault) {
+                end = line + 7;
+            } else {
+                first = last = strtoul(line, &end, 10);
+                if (end != line && '-' == *end)
+                    last = strtoul(end + 1, &end, 10);
+            }
+            char *classEnd = NULL;
+            unsigned long cls = strtoul(end, &classEnd, 10);
+            if (end == line || classEnd == end || first > last || last > 65535 ||
+                cls >= DD_SHED_CLASSES) {
+                std::cerr << "Ignoring invalid priority " << line << std::endl;
+                continue;
+            }
+            if (isDefault)
+                _shedDefault = cls;
+            for (unsigned long port = first; port <= last; port++) {
+                _shedClasses[port / 4] &= ~(0x3 << (2 * (port % 4)));
+                _shedClasses[port / 4] |= cls << (2 * (port % 4));
+            }
+        }
+    }
+    std::fclose(inputFile);
+}
+
+bool
+ddConfig::innerDstPort(const struct rte_mbuf *pkt, uint16_t *dstPort)
+{
+    uint32_t off = sizeof(struct ether_hdr);
+    const struct ether_hdr *ethHdr = rte_pktmbuf_mtod(pkt, const struct ether_hdr *);
+    uint16_t etherType = ethHdr->ether_type;
+    if (etherType == rte_cpu_to_be_16(ETHER_TYPE_VLAN)) {
+        const struct vlan_hdr *vlanHdr = rte_pktmbuf_mtod_offset(pkt, const struct vlan_hdr *, off);
+        etherType = vlanHdr->eth_proto;
+        off += sizeof(struct vlan_hdr);
+    }
+
+    uint8_t proto;
+    if (etherType == rte_cpu_to_be_16(ETHER_TYPE_IPv4)) {
+        const struct ipv4_hdr *ipHdr = rte_pktmbuf_mtod_offset(pkt, const struct ipv4_hdr *, off);
+        // only the first fragment carries L4 header
+        if (ipHdr->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK))
+            return false;
+        proto = ipHdr->next_proto_id;
+        off += (ipHdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    } else if (etherType == rte_cpu_to_be_16(ETHER_TYPE_IPv6)) {
+        const struct ipv6_hdr *ipHdr = rte_pktmbuf_mtod_offset(pkt, const struct ipv6_hdr *, off);
+        proto = ipHdr->proto;
+        off += sizeof(struct ipv6_hdr);
+    } else {
+        return false;
+    }
+
+    if ((DD_IPPROTO_TCP != proto && DD_IPPROTO_UDP != proto) ||
+        pkt->data_len < off + 4)
+        return false;
+
+    // destination port follows the source port in both TCP and UDP
+    *dstPort = rte_be_to_cpu_16(*rte_pktmbuf_mtod_offset(pkt, const uint16_t *, off + 2));
+    return true;
+}
+
+bool
+ddConfig::readSenders(const char *path)
+{
+    // without the file the peer core port is the only sender
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile) {
+        _senders[0].mac = _peerCorePortEthAddr[0];
+        _senders[0].sId = rte_cpu_to_be_16(_peerSId);
+        _senders[0].portId = DD_SENDER_DEFAULT_PORT;
+        _nSenders = 1;
+        return true;
+    }
+
+    // <MAC> <SID> [port <N>] [vlan <N>] per line
+    char line[256];
+    bool valid = true;
+    uint32_t lineNo = 0;
+    _sendersFile = true;
+    while (valid && NULL != fgets(line, sizeof(line), inputFile)) {
+        uint32_t pM[6], sId;
+        int consumed = 0;
+        lineNo++;
+        if ('#' == line[0] || '\n' == line[0])
+            continue;
+        if (7 != sscanf(line, "%02x:%02x:%02x:%02x:%02x:%02x %u%n",
+                        &pM[0], &pM[1], &pM[2], &pM[3], &pM[4], &pM[5], &sId, &consumed) ||
+            sId > 0xFFFF || _nSenders == DD_MAX_SENDERS) {
+            std::cerr << "Invalid sender " << line << std::endl;
+            valid = false;
+            break;
+        }
+
+        struct ddSender_ *sender = &_senders[_nSenders];
+        for (int i = 0; i < 6; i++)
+            sender->mac.addr_bytes[i] = static_cast<uint8_t>(pM[i] & 0xFF);
+        sender->sId = rte_cpu_to_be_16(sId);
+        sender->portId = DD_SENDER_DEFAULT_PORT;
+        sender->vlan = 0;
+
+        char *save = NULL;
+        for (char *tok = strtok_r(line + consumed, " \t\n", &save); NULL != tok;
+             tok = strtok_r(NULL, " \t\n", &save)) {
+            char *arg = strtok_r(NULL, " \t\n", &save);
+            char *end = NULL;
+            unsigned long val = (NULL == arg) ? 0 : strtoul(arg, &end, 10);
+            if (NULL == arg || *end != '\0') {
+                valid = false;
+            } else if (0 == strcmp(tok, "port") && val < RTE_MAX_ETHPORTS) {
+                sender->portId = val;
+            } else if (0 == strcmp(tok, "vlan") && val >= 1 && val <= 4094) {
+                sender->vlan = val;
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            std::cerr << "Invalid sender " << line << std::endl;
+            break;
+        }
+        // a second entry would shadow the first one in the sender table
+        for (uint32_t i = 0; valid && i < _nSenders; i++)
+            valid = !is_same_ether_addr(&_senders[i].mac, &sender->mac);
+        if (!valid) {
+            char mac[ETHER_ADDR_FMT_SIZE];
+            ether_format_addr(mac, sizeof(mac), &sender->mac);
+            std::cerr << "Duplicate sender " << mac << " on line " << lineNo
+                      << " of " << path << std::endl;
+            break;
+        }
+        _nSenders++;
+    }
+    std::fclose(inputFile);
+    return valid && _nSenders > 0;
+}
+
+void
+ddConfig::assignSlots(const ddConfig *prev)
+{
+    bool used[DD_SENDER_SLOTS];
+    bzero(used, sizeof(used));
+
+    // a sender that stays keeps its counters
+    for (uint32_t i = 0; i < _nSenders; i++) {
+        void *idx;
+        _senders[i].isNew = true;
+        if (NULL != prev &&
+            0 <= rte_hash_lookup_data(prev->_senderHash, &_senders[i].mac, &idx)) {
+            _senders[i].slot = prev->_senders[(uintptr_t)idx].slot;
+            _senders[i].isNew = false;
+            used[_senders[i].slot] = true;
+        }
+    }
+    // and new ones do not take a slot the old snapshot is still counting in
+    for (uint32_t i = 0; NULL != prev && i < prev->_nSenders; i++)
+        used[prev->_senders[i].slot] = true;
+
+    uint32_t slot = 0;
+    for (uint32_t i = 0; i < _nSenders; i++) {
+        if (!_senders[i].isNew)
+            continue;
+        while (used[slot])
+            slot++;
+        _senders[i].slot = slot;
+        used[slot] = true;
+    }
+}
+
+bool
+ddConfig::createSenderHash()
+{
+    // hugepage objects are shared with an instance taking over, the
+    // names have to be unique across processes
+    char name[RTE_HASH_NAMESIZE];
+    snprintf(name, sizeof(name), "dd_senders_%d_%u_%u", (int)getpid(), _instance, _generation);
+
+    struct rte_hash_parameters params;
+    bzero(&params, sizeof(params));
+    params.name = name;
+    params.entries = 2 * DD_MAX_SENDERS;
+    params.key_len = sizeof(struct ether_addr);
+    params.hash_func = rte_hash_crc;
+    params.socket_id = rte_socket_id();
+
+    _senderHash = rte_hash_create(&params);
+    if (NULL == _senderHash) {
+        std::cerr << "Unable to create sender table" << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < _nSenders; i++) {
+        if (0 != rte_hash_add_key_data(_senderHash, &_senders[i].mac, (void *)(uintptr_t)i)) {
+            std::cerr << "Unable to add sender " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// IPv4 or IPv6 address of the given family (0 for either), returns the family
+static uint8_t
+parseAddr(const char *str, uint8_t family, uint8_t *addr)
+{
+    if (4 != family && 1 == inet_pton(AF_INET6, str, addr))
+        return 6;
+    if (6 != family && 1 == inet_pton(AF_INET, str, addr))
+        return 4;
+    return 0;
+}
+
+static bool
+parseMac(const char *str, struct ether_addr *mac)
+{
+    uint32_t pM[6];
+    char tail;
+    if (6 != sscanf(str, "%02x:%02x:%02x:%02x:%02x:%02x%c",
+                    &pM[0], &pM[1], &pM[2], &pM[3], &pM[4], &pM[5], &tail))
+        return false;
+    for (int i = 0; i < 6; i++)
+        mac->addr_bytes[i] = static_cast<uint8_t>(pM[i] & 0xFF);
+    return true;
+}
+
+bool
+ddConfig::readRewrites(const char *path)
+{
+    // frames leave unchanged when the file is absent
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile)
+        return true;
+
+    // <IP> [dport <N>] [dmac <MAC>] [smac <MAC>] [set-ip <IP>] [set-dport <N>]
+    char line[256];
+    bool valid = true;
+    while (valid && NULL != fgets(line, sizeof(line), inputFile)) {
+        if ('#' == line[0] || '\n' == line[0])
+            continue;
+        if (_nRewrites == DD_MAX_REWRITES) {
+            valid = false;
+            break;
+        }
+
+        struct ddRewrite_ *rule = &_rewrites[_nRewrites];
+        char *save = NULL;
+        char *tok = strtok_r(line, " \t\n", &save);
+        rule->key.family = (NULL == tok) ? 0 : parseAddr(tok, 0, rule->key.dstAddr);
+        valid = (0 != rule->key.family);
+        while (valid && NULL != (tok = strtok_r(NULL, " \t\n", &save))) {
+            char *arg = strtok_r(NULL, " \t\n", &save);
+            char *end = NULL;
+            unsigned long val = (NULL == arg) ? 0 : strtoul(arg, &end, 10);
+            bool num = (NULL != arg && *end == '\0' && val >= 1 && val <= 65535);
+            if (NULL == arg) {
+                valid = false;
+            } else if (0 == strcmp(tok, "dport") && num) {
+                rule->key.dstPort = rte_cpu_to_be_16(val);
+            } else if (0 == strcmp(tok, "dmac")) {
+                rule->setDMac = valid = parseMac(arg, &rule->dMac);
+            } else if (0 == strcmp(tok, "smac")) {
+                rule->setSMac = valid = parseMac(arg, &rule->sMac);
+            } else if (0 == strcmp(tok, "set-ip")) {
+                rule->setAddr = valid =
+                    (rule->key.family == parseAddr(arg, rule->key.family, rule->dstAddr));
+            } else if (0 == strcmp(tok, "set-dport") && num) {
+                rule->dstPort = rte_cpu_to_be_16(val);
+                rule->setPort = true;
+            } else {
+                valid = false;
+            }
+        }
+        // a port is only rewritten where it is matched on
+        if (rule->setPort && 0 == rule->key.dstPort)
+            valid = false;
+        if (!(rule->setDMac || rule->setSMac || rule->setAddr || rule->setPort))
+            valid = false;
+        if (!valid)
+            break;
+        _nRewrites++;
+    }
+    if (!valid)
+        std::cerr << "Invalid rewrite rule " << line << std::endl;
+    std::fclose(inputFile);
+    return valid;
+}
+
+bool
+ddConfig::createRewriteHash()
+{
+    if (0 == _nRewrites)
+        return true;
+
+    char name[RTE_HASH_NAMESIZE];
+    snprintf(name, sizeof(name), "dd_rewrite_%d_%u_%u", (int)getpid(), _instance, _generation);
+
+    struct rte_hash_parameters params;
+    bzero(&params, sizeof(params));
+    params.name = name;
+    params.entries = 2 * DD_MAX_REWRITES;
+    params.key_len = sizeof(struct ddRewriteKey_);
+    params.hash_func = rte_hash_crc;
+    params.socket_id = rte_socket_id();
+
+    _rewriteHash = rte_hash_create(&params);
+    if (NULL == _rewriteHash) {
+        std::cerr << "Unable to create rewrite table" << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < _nRewrites; i++) {
+        if (0 != rte_hash_add_key_data(_rewriteHash, &_rewrites[i].key, (void *)(uintptr_t)i)) {
+            std::cerr << "Unable to add rewrite rule " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// path of a configuration file in dir, valid until the next call
+static const char*
+configPath(const char *dir, const char *file)
+{
+    static char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    return path;
+}
+
+ddConfig*
+ddConfig::load(const char *dir, uint16_t instance, uint32_t generation, const ddConfig *prev)
+{
+    ddConfig *config = new ddConfig;
+    config->_generation = generation;
+    config->_instance = instance;
+
+    bool valid = readId(configPath(dir, DD_CONFIG_SID_FILE), &config->_sId) &&
+                 readId(configPath(dir, DD_CONFIG_PEER_SID_FILE), &config->_peerSId) &&
+                 readMac(configPath(dir, DD_CONFIG_PEER_MAC_FILE),
+                         &config->_peerCorePortEthAddr[0]);
+#ifdef _DD_TESTMODE_
+    valid = valid && readMac(configPath(dir, DD_CONFIG_PEER_MAC1_FILE),
+                             &config->_peerCorePortEthAddr[1]);
+#endif
+    if (!valid) {
+        delete config;
+        return NULL;
+    }
+    config->readCompChannels(configPath(dir, DD_CONFIG_COMPRESS_FILE));
+    config->readShedClasses(configPath(dir, DD_CONFIG_PRIORITY_FILE));
+
+    if (!config->readSenders(configPath(dir, DD_CONFIG_SENDERS_FILE)) ||
+        !config->createSenderHash()) {
+        delete config;
+        return NULL;
+    }
+    config->assignSlots(prev);
+
+    if (!config->readRewrites(configPath(dir, DD_CONFIG_REWRITE_FILE)) ||
+        !config->createRewriteHash()) {
+        delete config;
+        return NULL;
+    }
+    return config;
+}
+
+bool
+ddConfig::differs(const ddConfig *other) const
+{
+    return _sId != other->_sId || _peerSId != other->_peerSId ||
+           0 != memcmp(_peerCorePortEthAddr, other->_peerCorePortEthAddr,
+                       sizeof(_peerCorePortEthAddr)) ||
+           _compAllChannels != other->_compAllChannels ||
+           0 != memcmp(_compChannels, other->_compChannels, sizeof(_compChannels)) ||
+           _shedDefault != other->_shedDefault ||
+           0 != memcmp(_shedClasses, other->_shedClasses, sizeof(_shedClasses)) ||
+           sendersDiffer(other) || _nRewrites != other->_nRewrites ||
+           0 != memcmp(_rewrites, other->_rewrites, sizeof(_rewrites[0]) * _nRewrites);
+}
+
+bool
+ddConfig::sendersDiffer(const ddConfig *other) const
+{
+    if (_nSenders != other->_nSenders)
+        return true;
+    for (uint32_t i = 0; i < _nSenders; i++) {
+        const struct ddSender_ *a = &_senders[i];
+        const struct ddSender_ *b = &other->_senders[i];
+        if (0 != memcmp(&a->mac, &b->mac, sizeof(a->mac)) || a->sId != b->sId ||
+            a->portId != b->portId || a->vlan != b->vlan)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,393 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <rte_log.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_random.h>
+#include <rte_crypto.h>
+#include <rte_cryptodev.h>
+#include "ddPort.h"
+#include "ddCrypto.h"
+
+
+// IV is stored in the private area right after the symmetric operation
+#define DD_CRYPTO_IV_OFFSET (sizeof(struct rte_crypto_op) + \
+                             sizeof(struct rte_crypto_sym_op))
+
+// queue pair used for each direction
+#define DD_CRYPTO_QP(dir)   static_cast<uint16_t>(dir)
+
+ddCrypto::ddCrypto(const char *devName, Algo algo) :
+        _devName(devName), _devId(-1), _algo(algo),
+        _blockSz(1), _digestLen(0),
+        _opPool(NULL), _sessPool(NULL), _ivSeq(0)
+{
+    bzero(_cipherKey, sizeof(_cipherKey));
+    bzero(_authKey, sizeof(_authKey));
+    bzero(_sess, sizeof(_sess));
+    bzero(_stats, sizeof(_stats));
+
+    if (ALGO_AES_CBC_HMAC_SHA256 == _algo) {
+        _blockSz = 16;
+        _digestLen = DD_CRYPTO_DIGEST_LEN;
+    }
+}
+
+ddCrypto::Algo
+ddCrypto::parseAlgo(const char *name)
+{
+    if (0 == strcmp(name, "null"))
+        return ALGO_NULL;
+    if (0 == strcmp(name, "aes-cbc-sha256"))
+        return ALGO_AES_CBC_HMAC_SHA256;
+    return ALGO_INVALID;
+}
+
+const char*
+ddCrypto::algoName() const
+{
+    return (ALGO_NULL == _algo) ? "null" : "aes-cbc-sha256";
+}
+
+const char*
+ddCrypto::dirName(Direction dir)
+{
+    return (DIR_ENCRYPT == dir) ? "Encrypt" : "Decrypt";
+}
+
+void
+ddCrypto::loadKeys(const char *path)
+{
+    if (ALGO_NULL == _algo)
+        return;
+
+    // key file holds cipher key followed by auth key as a hex string
+    std::FILE* keyFile = std::fopen(path, "r");
+    if (!keyFile) {
+        rte_exit(EXIT_FAILURE, "Unable to open crypto key file %s. Exiting...\n",
+                 path);
+    }
+
+    uint32_t i;
+    for (i = 0; i < DD_CRYPTO_CIPHER_KEY_LEN; i++) {
+        if (1 != fscanf(keyFile, " %2hhx", &_cipherKey[i]))
+            break;
+    }
+    for (uint32_t j = 0; i == DD_CRYPTO_CIPHER_KEY_LEN &&
+                         j < DD_CRYPTO_AUTH_KEY_LEN; j++, i++) {
+        if (1 != fscanf(keyFile, " %2hhx", &_authKey[j]))
+            break;
+    }
+    std::fclose(keyFile);
+
+    if (i != DD_CRYPTO_CIPHER_KEY_LEN + DD_CRYPTO_AUTH_KEY_LEN) {
+        rte_exit(EXIT_FAILURE, "Crypto key file %s must contain %u hex bytes. Exiting...\n",
+                 path, DD_CRYPTO_CIPHER_KEY_LEN + DD_CRYPTO_AUTH_KEY_LEN);
+    }
+}
+
+void
+ddCrypto::createSession(Direction dir)
+{
+    struct rte_crypto_sym_xform cipherXform;
+    struct rte_crypto_sym_xform authXform;
+
+    bzero(&cipherXform, sizeof(cipherXform));
+    bzero(&authXform, sizeof(authXform));
+
+    cipherXform.type = RTE_CRYPTO_SYM_XFORM_CIPHER;
+    authXform.type = RTE_CRYPTO_SYM_XFORM_AUTH;
+
+    if (ALGO_NULL == _algo) {
+        cipherXform.cipher.algo = RTE_CRYPTO_CIPHER_NULL;
+        authXform.auth.algo = RTE_CRYPTO_AUTH_NULL;
+    } else {
+        cipherXform.cipher.algo = RTE_CRYPTO_CIPHER_AES_CBC;
+        cipherXform.cipher.key.data = _cipherKey;
+        cipherXform.cipher.key.length = DD_CRYPTO_CIPHER_KEY_LEN;
+        cipherXform.cipher.iv.offset = DD_CRYPTO_IV_OFFSET;
+        cipherXform.cipher.iv.length = DD_CRYPTO_IV_LEN;
+
+        authXform.auth.algo = RTE_CRYPTO_AUTH_SHA256_HMAC;
+        authXform.auth.key.data = _authKey;
+        authXform.auth.key.length = DD_CRYPTO_AUTH_KEY_LEN;
+        authXform.auth.digest_length = _digestLen;
+    }
+
+    // encrypt-then-MAC on the way out, verify-then-decrypt on the way in
+    struct rte_crypto_sym_xform *xform;
+    if (DIR_ENCRYPT == dir) {
+        cipherXform.cipher.op = RTE_CRYPTO_CIPHER_OP_ENCRYPT;
+        authXform.auth.op = RTE_CRYPTO_AUTH_OP_GENERATE;
+        cipherXform.next = &authXform;
+        xform = &cipherXform;
+    } else {
+        cipherXform.cipher.op = RTE_CRYPTO_CIPHER_OP_DECRYPT;
+        authXform.auth.op = RTE_CRYPTO_AUTH_OP_VERIFY;
+        authXform.next = &cipherXform;
+        xform = &authXform;
+    }
+
+    _sess[dir] = rte_cryptodev_sym_session_create(_sessPool);
+    if (NULL == _sess[dir])
+        rte_exit(EXIT_FAILURE, "Cannot create %s crypto session\n", dirName(dir));
+
+    int ret = rte_cryptodev_sym_session_init(_devId, _sess[dir], xform, _sessPool);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot initialize %s crypto session: err = %d, dev = %s\n",
+                 dirName(dir), ret, _devName.c_str());
+}
+
+void
+ddCrypto::initialize()
+{
+    std::cout << "Initializing crypto device " << _devName
+              << " (" << algoName() << ") ..." << std::endl;
+
+    _devId = rte_cryptodev_get_dev_id(_devName.c_str());
+    if (_devId < 0)
+        rte_exit(EXIT_FAILURE, "Crypto device %s not found. Add it with --vdev\n",
+                 _devName.c_str());
+
+    struct rte_cryptodev_info devInfo;
+    rte_cryptodev_info_get(_devId, &devInfo);
+    if (devInfo.max_nb_queue_pairs < DIR_MAX)
+        rte_exit(EXIT_FAILURE, "Crypto device %s supports only %u queue pairs\n",
+                 _devName.c_str(), devInfo.max_nb_queue_pairs);
+
+    int socketId = rte_cryptodev_socket_id(_devId);
+    if (socketId < 0)
+        socketId = rte_socket_id();
+
+    struct rte_cryptodev_config conf;
+    bzero(&conf, sizeof(conf));
+    conf.socket_id = socketId;
+    conf.nb_queue_pairs = DIR_MAX;
+    int ret = rte_cryptodev_configure(_devId, &conf);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot configure crypto device: err = %d, dev = %s\n",
+                 ret, _devName.c_str());
+
+    // session header and private data of the device share one pool
+    uint32_t sessSz = RTE_MAX(rte_cryptodev_get_header_session_size(),
+                              rte_cryptodev_get_private_session_size(_devId));
+    _sessPool = rte_mempool_create("dd_crypto_sess_pool", 2 * DIR_MAX * 4, sessSz,
+                                   0, 0, NULL, NULL, NULL, NULL, socketId, 0);
+    if (NULL == _sessPool)
+        rte_exit(EXIT_FAILURE, "Cannot create crypto session pool\n");
+
+    struct rte_cryptodev_qp_conf qpConf;
+    qpConf.nb_descriptors = DD_CRYPTO_NB_DESC;
+    for (uint16_t qp = 0; qp < DIR_MAX; qp++) {
+        ret = rte_cryptodev_queue_pair_setup(_devId, qp, &qpConf, socketId, _sessPool);
+        if (ret < 0)
+            rte_exit(EXIT_FAILURE, "Crypto queue pair setup failed: err = %d, qp = %u\n",
+                     ret, qp);
+    }
+
+    _opPool = rte_crypto_op_pool_create("dd_crypto_op_pool",
+                                        RTE_CRYPTO_OP_TYPE_SYMMETRIC,
+                                        DD_CRYPTO_NB_OPS, DD_CRYPTO_OP_CACHE_SZ,
+                                        sizeof(struct opPriv_), socketId);
+    if (NULL == _opPool)
+        rte_exit(EXIT_FAILURE, "Cannot create crypto op pool\n");
+
+    ret = rte_cryptodev_start(_devId);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Crypto device start failed: err = %d, dev = %s\n",
+                 ret, _devName.c_str());
+
+    createSession(DIR_ENCRYPT);
+    createSession(DIR_DECRYPT);
+}
+
+bool
+ddCrypto::prepareOp(Direction dir, struct rte_crypto_op *op, struct rte_mbuf *pkt)
+{
+    const uint32_t hdrOff = sizeof(struct ddPort::tunnelHdr_);
+    const uint32_t dataOff = hdrOff + sizeof(struct cryptoHdr_);
+    uint32_t cipherLen;
+
+    // digest and ciphertext must be contiguous
+    if (!rte_pktmbuf_is_contiguous(pkt) || pkt->pkt_len < dataOff) {
+        return false;
+    }
+
+    struct cryptoHdr_ *cHdr = rte_pktmbuf_mtod_offset(pkt, struct cryptoHdr_ *, hdrOff);
+    if (DIR_ENCRYPT == dir) {
+        uint32_t innerLen = pkt->pkt_len - dataOff;
+        cipherLen = RTE_ALIGN_CEIL(innerLen, _blockSz);
+        char *tail = rte_pktmbuf_append(pkt, cipherLen - innerLen + _digestLen);
+        if (NULL == tail) {
+            return false;
+        }
+        // padding content is ignored by the peer
+        memset(tail, 0, cipherLen - innerLen);
+
+        // IV: per device sequence number followed by random bits
+        uint64_t seq = _ivSeq++;
+        uint64_t rnd = rte_rand();
+        memcpy(&cHdr->iv[0], &seq, sizeof(seq));
+        memcpy(&cHdr->iv[sizeof(seq)], &rnd, sizeof(rnd));
+        cHdr->innerLen = rte_cpu_to_be_16(innerLen);
+    } else {
+        if (pkt->pkt_len < dataOff + _digestLen) {
+            return false;
+        }
+        cipherLen = pkt->pkt_len - dataOff - _digestLen;
+        if (0 != cipherLen % _blockSz) {
+            return false;
+        }
+    }
+
+    struct opPriv_ *priv = rte_crypto_op_ctod_offset(op, struct opPriv_ *,
+                                                     DD_CRYPTO_IV_OFFSET);
+    memcpy(priv->iv, cHdr->iv, DD_CRYPTO_IV_LEN);
+
+    rte_crypto_op_attach_sym_session(op, _sess[dir]);
+    struct rte_crypto_sym_op *symOp = op->sym;
+    symOp->m_src = pkt;
+    symOp->m_dst = NULL;
+    symOp->cipher.data.offset = dataOff;
+    symOp->cipher.data.length = cipherLen;
+    symOp->auth.data.offset = hdrOff;
+    symOp->auth.data.length = sizeof(struct cryptoHdr_) + cipherLen;
+    symOp->auth.digest.data = rte_pktmbuf_mtod_offset(pkt, uint8_t *, dataOff + cipherLen);
+    symOp->auth.digest.phys_addr = rte_pktmbuf_iova_offset(pkt, dataOff + cipherLen);
+    return true;
+}
+
+uint16_t
+ddCrypto::enqueueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts)
+{
+    struct rte_crypto_op *ops[nPkts];
+    struct stats_ *stats = &_stats[dir];
+
+    if (0 == nPkts)
+        return 0;
+
+    if (0 == rte_crypto_op_bulk_alloc(_opPool, RTE_CRYPTO_OP_TYPE_SYMMETRIC,
+                                      ops, nPkts)) {
+        for (uint16_t i = 0; i < nPkts; i++)
+            rte_pktmbuf_free(pkts[i]);
+        stats->enqDropped += nPkts;
+        return 0;
+    }
+
+    uint16_t nOps = 0;
+    uint64_t tsc = rte_rdtsc();
+    for (uint16_t i = 0; i < nPkts; i++) {
+        if (unlikely(!prepareOp(dir, ops[nOps], pkts[i]))) {
+            rte_pktmbuf_free(pkts[i]);
+            stats->badLen++;
+            continue;
+        }
+        rte_crypto_op_ctod_offset(ops[nOps], struct opPriv_ *,
+                                  DD_CRYPTO_IV_OFFSET)->enqTsc = tsc;
+        nOps++;
+    }
+
+    uint16_t nEnq = rte_cryptodev_enqueue_burst(_devId, DD_CRYPTO_QP(dir), ops, nOps);
+    stats->enqueued += nEnq;
+
+    // queue pair is full, drop the rest rather than stalling the poll loop
+    for (uint16_t i = nEnq; i < nOps; i++) {
+        rte_pktmbuf_free(ops[i]->sym->m_src);
+        stats->enqDropped++;
+    }
+    if (nPkts > nEnq)
+        rte_mempool_put_bulk(_opPool, (void **)&ops[nEnq], nPkts - nEnq);
+    return nEnq;
+}
+
+uint16_t
+ddCrypto::dequeueBurst(Direction dir, struct rte_mbuf **pkts, uint16_t nPkts)
+{
+    struct rte_crypto_op *ops[nPkts];
+    struct stats_ *stats = &_stats[dir];
+    const uint32_t dataOff = sizeof(struct ddPort::tunnelHdr_) + sizeof(struct cryptoHdr_);
+
+    uint16_t nDeq = rte_cryptodev_dequeue_burst(_devId, DD_CRYPTO_QP(dir), ops, nPkts);
+    if (0 == nDeq)
+        return 0;
+
+    stats->dequeued += nDeq;
+    uint64_t tsc = rte_rdtsc();
+    uint16_t nOut = 0;
+    for (uint16_t i = 0; i < nDeq; i++) {
+        struct rte_crypto_op *op = ops[i];
+        struct rte_mbuf *pkt = op->sym->m_src;
+
+        uint64_t latency = tsc - rte_crypto_op_ctod_offset(op, struct opPriv_ *,
+                                                           DD_CRYPTO_IV_OFFSET)->enqTsc;
+        stats->latencyCycles += latency;
+        if (latency > stats->latencyMax)
+            stats->latencyMax = latency;
+
+        if (unlikely(RTE_CRYPTO_OP_STATUS_SUCCESS != op->status)) {
+            if (RTE_CRYPTO_OP_STATUS_AUTH_FAILED == op->status)
+                stats->authFailed++;
+            else
+                stats->opFailed++;
+            rte_pktmbuf_free(pkt);
+            continue;
+        }
+
+        if (DIR_DECRYPT == dir) {
+            // strip crypto header, padding and digest, the tunnel header is
+            // moved up to the inner frame so that its frame type is retained
+            const uint32_t hdrOff = sizeof(struct ddPort::tunnelHdr_);
+            struct cryptoHdr_ *cHdr = rte_pktmbuf_mtod_offset(pkt, struct cryptoHdr_ *,
+                                                              hdrOff);
+            uint16_t innerLen = rte_be_to_cpu_16(cHdr->innerLen);
+            if (unlikely(innerLen > pkt->pkt_len - dataOff - _digestLen)) {
+                stats->badLen++;
+                rte_pktmbuf_free(pkt);
+                continue;
+            }
+            void *tunnelHdr = rte_pktmbuf_mtod(pkt, void *);
+            rte_pktmbuf_adj(pkt, sizeof(struct cryptoHdr_));
+            memmove(rte_pktmbuf_mtod(pkt, void *), tunnelHdr, hdrOff);
+            rte_pktmbuf_trim(pkt, pkt->pkt_len - hdrOff - innerLen);
+        }
+        pkts[nOut++] = pkt;
+    }
+    rte_mempool_put_bulk(_opPool, (void **)ops, nDeq);
+    return nOut;
+}
+
+double
+ddCrypto::avgLatencyUs(Direction dir) const
+{
+    if (0 == _stats[dir].dequeued)
+        return 0;
+    return (double)_stats[dir].latencyCycles * US_PER_S /
+           (_stats[dir].dequeued * (double)rte_get_tsc_hz());
+}
+
+double
+ddCrypto::maxLatencyUs(Direction dir) const
+{
+    return (double)_stats[dir].latencyMax * US_PER_S / rte_get_tsc_hz();
+}
@@ -0,0 +1,310 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstring>
+#include <strings.h>
+#include <netinet/in.h>
+#include <rte_log.h>
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_ethdev.h>
+#include <rte_eventdev.h>
+#include <rte_service.h>
+#include <rte_hash_crc.h>
+#include "ddEventDev.h"
+#include "ddPort.h"
+#include "dataDiode.h"
+
+
+ddEventDev::ddEventDev(const char *devName) :
+        _devName(devName), _devId(0), _serviceId(0), _hasService(false), _nWorkers(0)
+{
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++)
+        _evPort[i] = -1;
+    bzero(_worker, sizeof(_worker));
+    bzero(_ports, sizeof(_ports));
+    bzero(_rxPorts, sizeof(_rxPorts));
+    bzero(_nRxPorts, sizeof(_nRxPorts));
+    bzero(_stats, sizeof(_stats));
+}
+
+void
+ddEventDev::initialize()
+{
+    std::cout << "Initializing event device " << _devName << " ..." << std::endl;
+
+    int ret = rte_event_dev_get_dev_id(_devName.c_str());
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Event device %s not found, add it with --vdev\n",
+                 _devName.c_str());
+    _devId = ret;
+
+    // lcores that own a port feed it in, all others work
+    const ddPortMap &ports = dataDiodeApp::instance().portMap();
+    for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+        uint16_t portId = it->second->portId();
+        int owner = dataDiodeApp::instance().portOwner(portId);
+        _ports[portId] = it->second;
+        if (owner >= 0)
+            _rxPorts[owner][_nRxPorts[owner]++] = it->second;
+    }
+    uint32_t lcoreId, nEvPorts = 0;
+    RTE_LCORE_FOREACH(lcoreId) {
+        _evPort[lcoreId] = nEvPorts++;
+        _worker[lcoreId] = (0 == _nRxPorts[lcoreId]);
+        if (_worker[lcoreId])
+            _nWorkers++;
+    }
+    if (0 == _nWorkers)
+        rte_exit(EXIT_FAILURE, "Event mode needs lcores without a port as workers\n");
+
+    struct rte_event_dev_info info;
+    rte_event_dev_info_get(_devId, &info);
+    if (nEvPorts > info.max_event_ports || DD_EVENT_NB_QUEUES > info.max_event_queues)
+        rte_exit(EXIT_FAILURE, "Event device %s supports %u ports and %u queues\n",
+                 _devName.c_str(), info.max_event_ports, info.max_event_queues);
+
+    struct rte_event_dev_config devConf;
+    bzero(&devConf, sizeof(devConf));
+    devConf.nb_event_queues = DD_EVENT_NB_QUEUES;
+    devConf.nb_event_ports = nEvPorts;
+    devConf.nb_events_limit = RTE_MIN(info.max_num_events, (int32_t)DD_EVENT_LIMIT);
+    devConf.nb_event_queue_flows = RTE_MIN(info.max_event_queue_flows, (uint32_t)DD_EVENT_NB_FLOWS);
+    devConf.nb_event_port_dequeue_depth = info.max_event_port_dequeue_depth;
+    devConf.nb_event_port_enqueue_depth = info.max_event_port_enqueue_depth;
+    devConf.dequeue_timeout_ns = info.min_dequeue_timeout_ns;
+    ret = rte_event_dev_configure(_devId, &devConf);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot configure event device: err = %d\n", ret);
+
+    for (uint8_t q = 0; q < DD_EVENT_NB_QUEUES; q++) {
+        struct rte_event_queue_conf queueConf;
+        rte_event_queue_default_conf_get(_devId, q, &queueConf);
+        queueConf.schedule_type = RTE_SCHED_TYPE_ATOMIC;
+        queueConf.nb_atomic_flows = devConf.nb_event_queue_flows;
+        queueConf.priority = RTE_EVENT_DEV_PRIORITY_NORMAL;
+        ret = rte_event_queue_setup(_devId, q, &queueConf);
+        if (ret < 0)
+            rte_exit(EXIT_FAILURE, "Cannot setup event queue %u: err = %d\n", q, ret);
+    }
+
+    RTE_LCORE_FOREACH(lcoreId) {
+        struct rte_event_port_conf portConf;
+        rte_event_port_default_conf_get(_devId, _evPort[lcoreId], &portConf);
+        // injection stops short of the limit, forwarded events always fit
+        portConf.new_event_threshold = devConf.nb_events_limit * 3 / 4;
+        portConf.dequeue_depth = RTE_MIN(portConf.dequeue_depth, (uint16_t)MAX_PKT_BURST);
+        portConf.enqueue_depth = RTE_MIN(portConf.enqueue_depth, (uint16_t)MAX_PKT_BURST);
+        ret = rte_event_port_setup(_devId, _evPort[lcoreId], &portConf);
+        if (ret < 0)
+            rte_exit(EXIT_FAILURE, "Cannot setup event port of lcore %u: err = %d\n",
+                     lcoreId, ret);
+        // workers take both stages
+        if (_worker[lcoreId] &&
+            DD_EVENT_NB_QUEUES != rte_event_port_link(_devId, _evPort[lcoreId], NULL, NULL, 0))
+            rte_exit(EXIT_FAILURE, "Cannot link event port of lcore %u\n", lcoreId);
+    }
+
+    // software devices schedule on a service, run by the master lcore
+    if (0 == rte_event_dev_service_id_get(_devId, &_serviceId)) {
+        _hasService = true;
+        rte_service_runstate_set(_serviceId, 1);
+        rte_service_set_runstate_mapped_check(_serviceId, 0);
+    }
+
+    ret = rte_event_dev_start(_devId);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot start event device: err = %d\n", ret);
+    std::cout << "Event device " << _devName << ": " << _nWorkers << " workers, "
+              << nEvPorts - _nWorkers << " RX lcores" << std::endl;
+}
+
+void
+ddEventDev::cleanup()
+{
+    rte_event_dev_stop(_devId);
+    rte_event_dev_close(_devId);
+}
+
+uint32_t
+ddEventDev::flowHash(const struct rte_mbuf *pkt)
+{
+    const uint8_t *data = rte_pktmbuf_mtod(pkt, const uint8_t *);
+    uint32_t len = rte_pktmbuf_data_len(pkt);
+    const struct ether_hdr *eth = reinterpret_cast<const struct ether_hdr *>(data);
+
+    // tunnel frames are spread by the flow they carry
+    if (len >= sizeof(struct ddPort::tunnelHdr_) + sizeof(struct ether_hdr) &&
+        eth->ether_type == rte_cpu_to_be_16(DATADIODE_TUNNEL_ETHTYPE)) {
+        data += sizeof(struct ddPort::tunnelHdr_);
+        len -= sizeof(struct ddPort::tunnelHdr_);
+        eth = reinterpret_cast<const struct ether_hdr *>(data);
+    }
+
+    uint32_t hash = rte_hash_crc(eth, 2 * sizeof(struct ether_addr), 0);
+    if (eth->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv4) &&
+        len >= sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr)) {
+        const struct ipv4_hdr *ip = reinterpret_cast<const struct ipv4_hdr *>(eth + 1);
+        uint32_t ihl = (ip->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+        hash = rte_hash_crc(&ip->src_addr, 2 * sizeof(uint32_t), hash);
+
+        // all fragments of a datagram stay in one flow
+        if ((IPPROTO_TCP == ip->next_proto_id || IPPROTO_UDP == ip->next_proto_id) &&
+            0 == (ip->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK | IPV4_HDR_MF_FLAG)) &&
+            len >= sizeof(struct ether_hdr) + ihl + 2 * sizeof(uint16_t))
+            hash = rte_hash_crc(reinterpret_cast<const uint8_t *>(ip) + ihl,
+                                2 * sizeof(uint16_t), hash);
+    }
+    return hash & DD_EVENT_FLOW_MASK;
+}
+
+uint32_t
+ddEventDev::inject(uint32_t lcoreId, ddPort *port)
+{
+    // wrong-direction ports are not injected
+    if (unlikely(ddPort::RXMODE_POLL != port->rxMode()))
+        return port->handleRx();
+
+    struct rte_mbuf *pkts[MAX_PKT_BURST];
+    struct rte_event ev[MAX_PKT_BURST];
+    uint32_t nRx = rte_eth_rx_burst(port->portId(), 0, pkts,
+                                    dataDiodeApp::instance().tuning().rxBurst);
+    if (0 == nRx)
+        return 0;
+    port->incRxStats(nRx);
+    port->compact(pkts, nRx);
+
+    uint64_t now = rte_rdtsc();
+    for (uint32_t j = 0; j < nRx; j++) {
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[j], void *));
+        pkts[j]->timestamp = now;
+        ev[j].event = 0;
+        ev[j].flow_id = flowHash(pkts[j]);
+        ev[j].op = RTE_EVENT_OP_NEW;
+        ev[j].sched_type = RTE_SCHED_TYPE_ATOMIC;
+        ev[j].queue_id = DD_EVENT_Q_WORK;
+        ev[j].event_type = RTE_EVENT_TYPE_ETHDEV;
+        ev[j].priority = RTE_EVENT_DEV_PRIORITY_NORMAL;
+        ev[j].mbuf = pkts[j];
+    }
+
+    // the device pushes back at its threshold, the port drops like a full ring
+    struct lcoreStats_ *stats = &_stats[lcoreId];
+    uint32_t nEnq = rte_event_enqueue_new_burst(_devId, _evPort[lcoreId], ev, nRx);
+    for (uint32_t j = nEnq; j < nRx; j++)
+        rte_pktmbuf_free(pkts[j]);
+    port->incRxDropStats(nRx - nEnq);
+    stats->rx += nEnq;
+    stats->rxDropped += nRx - nEnq;
+    return nRx;
+}
+
+void
+ddEventDev::transmit(struct lcoreStats_ *stats, struct rte_event *ev, uint32_t nEv)
+{
+    struct rte_mbuf *pkts[MAX_PKT_BURST];
+    uint64_t now = rte_rdtsc();
+
+    // the burst may hold several egress ports, each sent in one go
+    while (nEv) {
+        uint32_t egressId = ev[0].flow_id, nPkts = 0, nRest = 0;
+        for (uint32_t j = 0; j < nEv; j++) {
+            if (ev[j].flow_id == egressId)
+                pkts[nPkts++] = ev[j].mbuf;
+            else
+                ev[nRest++] = ev[j];
+        }
+        nEv = nRest;
+
+        ddPort *egress = _ports[egressId];
+        uint32_t sent = egress->linkUp() ? rte_eth_tx_burst(egressId, 0, pkts, nPkts) : 0;
+        for (uint32_t j = 0; j < sent; j++) {
+            uint64_t latency = now - pkts[j]->timestamp;
+            stats->latencyTsc += latency;
+            stats->latencyMaxTsc = RTE_MAX(stats->latencyMaxTsc, latency);
+        }
+        for (uint32_t j = sent; j < nPkts; j++)
+            rte_pktmbuf_free(pkts[j]);
+        egress->incTxStats(sent);
+        egress->incTxDropStats(nPkts - sent);
+        if (!egress->linkUp())
+            egress->incTxLinkDownStats(nPkts);
+        stats->tx += sent;
+        stats->txDropped += nPkts - sent;
+    }
+}
+
+uint32_t
+ddEventDev::work(uint32_t lcoreId)
+{
+    struct rte_event ev[MAX_PKT_BURST];
+    struct rte_event txEv[MAX_PKT_BURST];
+    uint32_t nFwd = 0, nTx = 0;
+    uint32_t nEv = rte_event_dequeue_burst(_devId, _evPort[lcoreId], ev, MAX_PKT_BURST, 0);
+    if (0 == nEv)
+        return 0;
+
+    // frames not forwarded are released by the next dequeue
+    struct lcoreStats_ *stats = &_stats[lcoreId];
+    for (uint32_t j = 0; j < nEv; j++) {
+        if (DD_EVENT_Q_TX == ev[j].queue_id) {
+            txEv[nTx++] = ev[j];
+            continue;
+        }
+        struct rte_mbuf *pkt = ev[j].mbuf;
+        ddPort *egress = _ports[pkt->port]->processEvent(&pkt);
+        stats->worked++;
+        if (NULL == egress)
+            continue;
+        ev[nFwd] = ev[j];
+        ev[nFwd].mbuf = pkt;
+        ev[nFwd].flow_id = egress->portId();
+        ev[nFwd].queue_id = DD_EVENT_Q_TX;
+        ev[nFwd].op = RTE_EVENT_OP_FORWARD;
+        ev[nFwd].sched_type = RTE_SCHED_TYPE_ATOMIC;
+        ev[nFwd].event_type = RTE_EVENT_TYPE_CPU;
+        nFwd++;
+    }
+
+    transmit(stats, txEv, nTx);
+
+    // forwarded events hold credits already, retry until they are taken
+    uint32_t nEnq = 0;
+    while (nEnq < nFwd && !dataDiodeApp::instance().forceQuit())
+        nEnq += rte_event_enqueue_forward_burst(_devId, _evPort[lcoreId],
+                                                &ev[nEnq], nFwd - nEnq);
+    return nEv;
+}
+
+uint32_t
+ddEventDev::poll(uint32_t lcoreId)
+{
+    if (_hasService && lcoreId == rte_get_master_lcore())
+        rte_service_run_iter_on_app_lcore(_serviceId, 1);
+
+    if (_worker[lcoreId])
+        return work(lcoreId);
+    uint32_t nRx = 0;
+    for (uint32_t i = 0; i < _nRxPorts[lcoreId]; i++)
+        nRx += inject(lcoreId, _rxPorts[lcoreId][i]);
+    return nRx;
+}
@@ -0,0 +1,555 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <rte_log.h>
+#include <rte_byteorder.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_random.h>
+#include <rte_hash_crc.h>
+#include "ddFileXfer.h"
+#include "dataDiode.h"
+
+
+// spool is scanned again after this long when there was nothing to send
+#define DD_FILE_IDLE_US         500000
+
+// reader thread backs off this long while the ring or pool is full
+#define DD_FILE_WAIT_US         100
+
+// writer thread sleeps this long when no segment is pending
+#define DD_FILE_RX_IDLE_US      1000
+
+#define DD_FILE_NAME_MAX        255
+
+// segments the token bucket may accumulate while idle
+#define DD_FILE_BUCKET_SEGS     32
+
+#define DD_FILE_SEG_BYTES       (DD_FILE_SEG_SZ + sizeof(struct ddFileHdr_))
+
+// CRC32-C of a mapped file, in chunks as the length is 32 bits
+static uint32_t
+fileCrc(const uint8_t *data, uint64_t size)
+{
+    uint32_t crc = 0;
+    for (uint64_t off = 0; off < size; off += (1 << 30)) {
+        uint32_t len = RTE_MIN(size - off, (uint64_t)(1 << 30));
+        crc = rte_hash_crc(data + off, len, crc);
+    }
+    return crc;
+}
+
+// anything but hidden entries, writers create files under a dot name
+// and rename them into the spool when complete
+static int
+spoolFilter(const struct dirent *entry)
+{
+    return '.' != entry->d_name[0] &&
+           (DT_REG == entry->d_type || DT_UNKNOWN == entry->d_type);
+}
+
+ddFileTx::ddFileTx(const char *spoolDir, uint32_t rateMbps) :
+        _spoolDir(spoolDir), _rateMbps(rateMbps ? rateMbps : DD_FILE_RATE_MBPS),
+        _pool(NULL), _ring(NULL), _stop(false), _nextFileId(0),
+        _bytesPerTsc(0), _tokens(0), _bucketSz(0), _lastTsc(0),
+        _segments(0), _bytes(0), _filesSent(0), _readErrors(0), _noMbuf(0)
+{
+}
+
+void
+ddFileTx::initialize()
+{
+    std::cout << "Initializing file transfer from " << _spoolDir << " at "
+              << _rateMbps << " Mbps ..." << std::endl;
+
+    _pool = rte_pktmbuf_pool_create("dd_filetx_pool", DD_FILE_NB_MBUF,
+                                    DD_FILE_POOL_CACHE_SZ, 0,
+                                    MBUF_DATA_SZ, rte_socket_id());
+    if (NULL == _pool)
+        rte_exit(EXIT_FAILURE, "Cannot create file transfer mbuf pool\n");
+
+    // reader thread produces, the access port lcore consumes
+    _ring = rte_ring_create("dd_filetx_ring", DD_FILE_RING_SZ, rte_socket_id(),
+                            RING_F_SP_ENQ | RING_F_SC_DEQ);
+    if (NULL == _ring)
+        rte_exit(EXIT_FAILURE, "Cannot create file transfer ring\n");
+
+    _bytesPerTsc = (double)_rateMbps * 1000000 / 8 / rte_get_tsc_hz();
+    _bucketSz = DD_FILE_BUCKET_SEGS * DD_FILE_SEG_BYTES;
+    _lastTsc = rte_rdtsc();
+
+    // file ids of a restarted sender must not match those still open
+    // on the receiver
+    _nextFileId = rte_rand();
+
+    std::string sentDir = _spoolDir + "/" DD_FILE_SENT_DIR;
+    mkdir(_spoolDir.c_str(), 0700);
+    mkdir(sentDir.c_str(), 0700);
+
+    int ret = rte_ctrl_thread_create(&_readerThread, "dd-filetx", NULL,
+                                     ddFileTx::readerMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start file transfer thread: err = %d\n", ret);
+}
+
+void
+ddFileTx::cleanup()
+{
+    _stop = true;
+    pthread_join(_readerThread, NULL);
+}
+
+uint32_t
+ddFileTx::dequeueBurst(struct rte_mbuf **pkts, uint32_t n)
+{
+    uint64_t now = rte_rdtsc();
+    _tokens = RTE_MIN(_tokens + (now - _lastTsc) * _bytesPerTsc, _bucketSz);
+    _lastTsc = now;
+
+    n = RTE_MIN(n, (uint32_t)(_tokens / DD_FILE_SEG_BYTES));
+    if (0 == n)
+        return 0;
+
+    n = rte_ring_sc_dequeue_burst(_ring, (void **)pkts, n, NULL);
+    for (uint32_t i = 0; i < n; i++) {
+        _tokens -= rte_pktmbuf_pkt_len(pkts[i]);
+        _bytes += rte_pktmbuf_pkt_len(pkts[i]);
+    }
+    _segments += n;
+    return n;
+}
+
+bool
+ddFileTx::queueSegment(uint32_t fileId, uint8_t type, uint64_t offset, uint64_t size,
+                       uint32_t crc, const void *data, uint16_t len)
+{
+    struct rte_mbuf *pkt;
+    while (NULL == (pkt = rte_pktmbuf_alloc(_pool))) {
+        _noMbuf++;
+        if (_stop)
+            return false;
+        usleep(DD_FILE_WAIT_US);
+    }
+
+    struct ddFileHdr_ *hdr = reinterpret_cast<struct ddFileHdr_ *>(
+                rte_pktmbuf_append(pkt, sizeof(struct ddFileHdr_) + len));
+    hdr->fileId = rte_cpu_to_be_32(fileId);
+    hdr->type = type;
+    hdr->reserved = 0;
+    hdr->len = rte_cpu_to_be_16(len);
+    hdr->offset = rte_cpu_to_be_64(offset);
+    hdr->size = rte_cpu_to_be_64(size);
+    hdr->crc = rte_cpu_to_be_32(crc);
+    hdr->reserved2 = 0;
+    memcpy(hdr + 1, data, len);
+
+    // the lcore drains the ring at the configured rate
+    while (0 != rte_ring_sp_enqueue(_ring, pkt)) {
+        if (_stop) {
+            rte_pktmbuf_free(pkt);
+            return false;
+        }
+        usleep(DD_FILE_WAIT_US);
+    }
+    return true;
+}
+
+bool
+ddFileTx::sendFile(const char *name)
+{
+    std::string path = _spoolDir + "/" + name;
+    struct stat st;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        RTE_LOG(ERR, USER1, "Cannot open %s: %s\n", path.c_str(), strerror(errno));
+        _readErrors++;
+        return false;
+    }
+    if (0 != fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    uint64_t size = st.st_size;
+    uint8_t *map = NULL;
+    if (size) {
+        void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == addr) {
+            RTE_LOG(ERR, USER1, "Cannot map %s: %s\n", path.c_str(), strerror(errno));
+            _readErrors++;
+            close(fd);
+            return false;
+        }
+        madvise(addr, size, MADV_SEQUENTIAL);
+        map = (uint8_t *)addr;
+    }
+
+    uint32_t fileId = _nextFileId++;
+    uint32_t crc = fileCrc(map, size);
+    uint16_t nameLen = RTE_MIN(strlen(name), (size_t)DD_FILE_NAME_MAX);
+
+    // the name goes in front and behind the data, either one is enough
+    bool ok = queueSegment(fileId, SEG_START, 0, size, crc, name, nameLen);
+    for (uint64_t off = 0; ok && off < size; off += DD_FILE_SEG_SZ) {
+        uint16_t len = RTE_MIN(size - off, (uint64_t)DD_FILE_SEG_SZ);
+        ok = queueSegment(fileId, SEG_DATA, off, size, crc, map + off, len);
+    }
+    ok = ok && queueSegment(fileId, SEG_END, 0, size, crc, name, nameLen);
+
+    if (size)
+        munmap(map, size);
+    close(fd);
+
+    if (ok) {
+        std::string sentPath = _spoolDir + "/" DD_FILE_SENT_DIR "/" + name;
+        if (0 != rename(path.c_str(), sentPath.c_str())) {
+            RTE_LOG(ERR, USER1, "Cannot move %s: %s\n", path.c_str(), strerror(errno));
+            _readErrors++;
+        }
+        _filesSent++;
+    }
+    return ok;
+}
+
+void*
+ddFileTx::readerMain(void *arg)
+{
+    reinterpret_cast<ddFileTx *>(arg)->readerLoop();
+    return NULL;
+}
+
+void
+ddFileTx::readerLoop()
+{
+    while (!_stop) {
+        struct dirent **entries;
+        int n = scandir(_spoolDir.c_str(), &entries, spoolFilter, alphasort);
+        uint32_t sent = 0;
+        for (int i = 0; i < n; i++) {
+            if (!_stop && sendFile(entries[i]->d_name))
+                sent++;
+            free(entries[i]);
+        }
+        if (n >= 0)
+            free(entries);
+        if (0 == sent)
+            usleep(DD_FILE_IDLE_US);
+    }
+}
+
+ddFileRx::ddFileRx(const char *outDir) :
+        _outDir(outDir), _ring(NULL), _stop(false),
+        _segments(0), _dropped(0), _badSegments(0), _committed(0),
+        _crcErrors(0), _expired(0), _writeErrors(0), _tooLarge(0), _inProgress(0)
+{
+}
+
+std::string
+ddFileRx::partPath(uint32_t fileId) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/.file-%08x.part", fileId);
+    return _outDir + name;
+}
+
+void
+ddFileRx::initialize()
+{
+    std::cout << "Initializing file transfer to " << _outDir << " ..." << std::endl;
+
+    // core lcore produces, the writer thread consumes
+    _ring = rte_ring_create("dd_filerx_ring", DD_FILE_RING_SZ, rte_socket_id(),
+                            RING_F_SP_ENQ | RING_F_SC_DEQ);
+    if (NULL == _ring)
+        rte_exit(EXIT_FAILURE, "Cannot create file transfer ring\n");
+
+    mkdir(_outDir.c_str(), 0700);
+
+    // part files of a previous run can not be completed any more
+    DIR *dir = opendir(_outDir.c_str());
+    if (NULL == dir)
+        rte_exit(EXIT_FAILURE, "Cannot open file transfer directory %s: %s\n",
+                 _outDir.c_str(), strerror(errno));
+    struct dirent *entry;
+    while (NULL != (entry = readdir(dir))) {
+        if (0 == strncmp(entry->d_name, ".file-", 6)) {
+            std::string path = _outDir + "/" + entry->d_name;
+            unlink(path.c_str());
+        }
+    }
+    closedir(dir);
+
+    int ret = rte_ctrl_thread_create(&_writerThread, "dd-filerx", NULL,
+                                     ddFileRx::writerMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start file transfer thread: err = %d\n", ret);
+}
+
+void
+ddFileRx::cleanup()
+{
+    _stop = true;
+    pthread_join(_writerThread, NULL);
+
+    // incomplete files are left as part files and removed on next start
+    for (std::map<uint32_t, struct rxFile_ *>::iterator it = _files.begin();
+         it != _files.end(); ++it) {
+        if (it->second->size)
+            munmap(it->second->map, it->second->size);
+        close(it->second->fd);
+        delete it->second;
+    }
+    _files.clear();
+}
+
+struct ddFileRx::rxFile_*
+ddFileRx::openFile(uint32_t fileId, uint64_t size)
+{
+    // the size is as the sender claims, the part file is sparse until
+    // the segments arrive
+    uint64_t reserved = 0;
+    for (std::map<uint32_t, struct rxFile_ *>::iterator it = _files.begin();
+         it != _files.end(); ++it)
+        reserved += it->second->size - it->second->received;
+    struct statvfs fs;
+    if (size > DD_FILE_RX_MAX_SZ ||
+        (0 == statvfs(_outDir.c_str(), &fs) &&
+         size + reserved > (uint64_t)fs.f_bavail * fs.f_frsize)) {
+        RTE_LOG(ERR, USER1, "Refusing file %08x of %lu bytes\n", fileId, (unsigned long)size);
+        _tooLarge++;
+        return NULL;
+    }
+
+    std::string path = partPath(fileId);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || 0 != ftruncate(fd, size)) {
+        RTE_LOG(ERR, USER1, "Cannot create %s: %s\n", path.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        _writeErrors++;
+        return NULL;
+    }
+
+    uint8_t *map = NULL;
+    if (size) {
+        void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == addr) {
+            RTE_LOG(ERR, USER1, "Cannot map %s: %s\n", path.c_str(), strerror(errno));
+            close(fd);
+            unlink(path.c_str());
+            _writeErrors++;
+            return NULL;
+        }
+        map = (uint8_t *)addr;
+    }
+
+    struct rxFile_ *file = new rxFile_;
+    file->fd = fd;
+    file->map = map;
+    file->size = size;
+    file->received = 0;
+    file->crc = 0;
+    file->named = false;
+    file->segs.assign((size + DD_FILE_SEG_SZ - 1) / DD_FILE_SEG_SZ, false);
+    file->lastSeen = time(NULL);
+    _files[fileId] = file;
+    _inProgress = _files.size();
+    return file;
+}
+
+void
+ddFileRx::closeFile(uint32_t fileId, struct rxFile_ *file, bool commit)
+{
+    std::string path = partPath(fileId);
+
+    if (commit && fileCrc(file->map, file->size) != file->crc) {
+        RTE_LOG(ERR, USER1, "CRC mismatch on received file %s\n", file->name.c_str());
+        _crcErrors++;
+        commit = false;
+    }
+    if (file->size)
+        munmap(file->map, file->size);
+
+    if (commit) {
+        // visible under its name only once complete and on disk
+        std::string finalPath = _outDir + "/" + file->name;
+        if (0 != fsync(file->fd) || 0 != rename(path.c_str(), finalPath.c_str())) {
+            RTE_LOG(ERR, USER1, "Cannot commit %s: %s\n", finalPath.c_str(), strerror(errno));
+            _writeErrors++;
+            commit = false;
+        } else {
+            _committed++;
+        }
+    }
+    close(file->fd);
+    if (!commit)
+        unlink(path.c_str());
+
+    _files.erase(fileId);
+    _inProgress = _files.size();
+    delete file;
+}
+
+void
+ddFileRx::handleSegment(struct rte_mbuf *pkt)
+{
+    uint32_t pktLen = rte_pktmbuf_data_len(pkt);
+    if (pktLen < sizeof(struct ddFileHdr_)) {
+        _badSegments++;
+        return;
+    }
+    const struct ddFileHdr_ *hdr = rte_pktmbuf_mtod(pkt, const struct ddFileHdr_ *);
+    const char *data = reinterpret_cast<const char *>(hdr + 1);
+    uint32_t fileId = rte_be_to_cpu_32(hdr->fileId);
+    uint16_t len = rte_be_to_cpu_16(hdr->len);
+    uint64_t offset = rte_be_to_cpu_64(hdr->offset);
+    uint64_t size = rte_be_to_cpu_64(hdr->size);
+    if (sizeof(struct ddFileHdr_) + len > pktLen) {
+        _badSegments++;
+        return;
+    }
+
+    struct rxFile_ *file = NULL;
+    std::map<uint32_t, struct rxFile_ *>::iterator it = _files.find(fileId);
+    if (it != _files.end()) {
+        file = it->second;
+        if (file->size != size) {
+            _badSegments++;
+            return;
+        }
+    }
+    if (NULL == file && _completed.end() != _completed.find(fileId))
+        return;
+
+    switch (hdr->type) {
+    case ddFileTx::SEG_START:
+    case ddFileTx::SEG_END:
+    {
+        // plain names only, nothing that leaves the output directory
+        std::string name(data, len);
+        if (0 == len || len > DD_FILE_NAME_MAX || '.' == name[0] ||
+            std::string::npos != name.find_first_of(std::string("/\0", 2))) {
+            _badSegments++;
+            return;
+        }
+        if (NULL == file && NULL == (file = openFile(fileId, size)))
+            return;
+        file->name = name;
+        file->crc = rte_be_to_cpu_32(hdr->crc);
+        file->named = true;
+        break;
+    }
+    case ddFileTx::SEG_DATA:
+        if (0 != offset % DD_FILE_SEG_SZ || offset + len > size ||
+            (DD_FILE_SEG_SZ != len && offset + len != size)) {
+            _badSegments++;
+            return;
+        }
+        if (NULL == file && NULL == (file = openFile(fileId, size)))
+            return;
+        if (!file->segs[offset / DD_FILE_SEG_SZ]) {
+            memcpy(file->map + offset, data, len);
+            file->segs[offset / DD_FILE_SEG_SZ] = true;
+            file->received += len;
+        }
+        break;
+    default:
+        _badSegments++;
+        return;
+    }
+
+    file->lastSeen = time(NULL);
+    if (file->named && file->received == file->size) {
+        _completed[fileId] = file->lastSeen;
+        closeFile(fileId, file, true);
+    }
+}
+
+void
+ddFileRx::expire()
+{
+    time_t now = time(NULL);
+    std::map<uint32_t, struct rxFile_ *>::iterator it = _files.begin();
+    while (it != _files.end()) {
+        uint32_t fileId = it->first;
+        struct rxFile_ *file = it->second;
+        ++it;
+        if (now - file->lastSeen > DD_FILE_RX_TIMEOUT_S) {
+            RTE_LOG(WARNING, USER1, "Discarding incomplete file %s (%lu of %lu bytes)\n",
+                    file->named ? file->name.c_str() : "<unnamed>",
+                    (unsigned long)file->received, (unsigned long)file->size);
+            closeFile(fileId, file, false);
+            _expired++;
+        }
+    }
+
+    std::map<uint32_t, time_t>::iterator done = _completed.begin();
+    while (done != _completed.end()) {
+        if (now - done->second > DD_FILE_RX_TIMEOUT_S)
+            _completed.erase(done++);
+        else
+            ++done;
+    }
+}
+
+void*
+ddFileRx::writerMain(void *arg)
+{
+    reinterpret_cast<ddFileRx *>(arg)->writerLoop();
+    return NULL;
+}
+
+void
+ddFileRx::writerLoop()
+{
+    struct rte_mbuf *pkts[64];
+    time_t lastExpire = time(NULL);
+
+    while (!_stop) {
+        uint32_t n = rte_ring_sc_dequeue_burst(_ring, (void **)pkts, RTE_DIM(pkts), NULL);
+        for (uint32_t i = 0; i < n; i++) {
+            handleSegment(pkts[i]);
+            rte_pktmbuf_free(pkts[i]);
+        }
+        if (time(NULL) != lastExpire) {
+            lastExpire = time(NULL);
+            expire();
+        }
+        if (0 == n)
+            usleep(DD_FILE_RX_IDLE_US);
+    }
+}
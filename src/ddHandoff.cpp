@@ -0,0 +1,255 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <unistd.h>
+#include <signal.h>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_atomic.h>
+#include <rte_lcore.h>
+#include <rte_memzone.h>
+#include "ddHandoff.h"
+#include "ddPort.h"
+#include "dataDiode.h"
+
+
+// has the process gone away without letting go of the ports
+static bool
+processGone(int32_t pid)
+{
+    return pid > 0 && kill(pid, 0) < 0 && ESRCH == errno;
+}
+
+ddHandoff::ddHandoff(bool takeover) :
+        _mz(NULL), _shm(NULL), _takeover(takeover), _watching(false),
+        _pending(false), _handedOff(false),
+        _generation(0), _requestTsc(0), _maxGapTsc(0)
+{
+    rte_atomic32_init(&_looping);
+    rte_atomic32_init(&_taking);
+    bzero((void *)_taken, sizeof(_taken));
+    bzero(_gapTsc, sizeof(_gapTsc));
+}
+
+void
+ddHandoff::initialize(bool accepting)
+{
+    if (!_takeover) {
+        // a new primary starts with fresh hugepages, nothing to keep
+        _mz = rte_memzone_lookup(DD_HANDOFF_MZ_NAME);
+        if (NULL == _mz)
+            _mz = rte_memzone_reserve(DD_HANDOFF_MZ_NAME, sizeof(struct ddHandoffShm_),
+                                      rte_socket_id(), 0);
+        if (NULL == _mz)
+            rte_exit(EXIT_FAILURE, "Cannot reserve memzone %s for handoff\n",
+                     DD_HANDOFF_MZ_NAME);
+        _shm = reinterpret_cast<struct ddHandoffShm_ *>(_mz->addr);
+        bzero(_shm, sizeof(struct ddHandoffShm_));
+        _shm->magic = DD_HANDOFF_MAGIC;
+        _shm->version = DD_HANDOFF_VERSION;
+        _shm->ownerPid = getpid();
+        _shm->accepting = accepting;
+        _shm->state = STATE_IDLE;
+        return;
+    }
+
+    _mz = rte_memzone_lookup(DD_HANDOFF_MZ_NAME);
+    if (NULL == _mz)
+        rte_exit(EXIT_FAILURE, "No running instance to take over\n");
+    _shm = reinterpret_cast<struct ddHandoffShm_ *>(_mz->addr);
+    if (DD_HANDOFF_MAGIC != _shm->magic || DD_HANDOFF_VERSION != _shm->version)
+        rte_exit(EXIT_FAILURE, "Running instance uses handoff version %u, expected %u\n",
+                 _shm->version, DD_HANDOFF_VERSION);
+    if (!_shm->accepting)
+        rte_exit(EXIT_FAILURE, "Running instance %d can not hand off its ports\n",
+                 _shm->ownerPid);
+    if (STATE_IDLE != _shm->state && !processGone(_shm->takerPid))
+        rte_exit(EXIT_FAILURE, "Instance %d is already taking over\n", _shm->takerPid);
+    _generation = _shm->generation;
+
+    std::cout << "Taking over from instance " << _shm->ownerPid << " (handoff "
+              << _generation + 1 << ") ..." << std::endl;
+}
+
+void
+ddHandoff::cleanup()
+{
+    if (_watching)
+        pthread_join(_thread, NULL);
+    if (!_takeover && !_handedOff) {
+        // nobody can take over from an instance that is gone
+        _shm->accepting = false;
+        _shm->ownerPid = 0;
+    }
+}
+
+void
+ddHandoff::publish(const ddPort *port)
+{
+    _shm->ports[port->portId()].rxMode = port->rxMode();
+}
+
+void
+ddHandoff::request()
+{
+    _pending = true;
+    _watching = true;
+    _requestTsc = rte_rdtsc();
+    _shm->takerPid = getpid();
+    rte_smp_wmb();
+    _shm->state = STATE_REQUESTED;
+
+    int ret = rte_ctrl_thread_create(&_thread, "dd-handoff", NULL,
+                                     ddHandoff::watchMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start handoff thread: err = %d\n", ret);
+}
+
+bool
+ddHandoff::accept()
+{
+    if (_handedOff)
+        return true;
+    if (!_shm->accepting ||
+        !rte_atomic32_cmpset(&_shm->state, STATE_REQUESTED, STATE_ACCEPTED))
+        return false;
+
+    // seen by every lcore before it leaves its main loop
+    _handedOff = true;
+    rte_smp_wmb();
+    RTE_LOG(INFO, USER1, "Handing off ports to instance %d\n", _shm->takerPid);
+    return true;
+}
+
+void
+ddHandoff::release(ddPort *port)
+{
+    struct ddHandoffShm_::port_ *p = &_shm->ports[port->portId()];
+    p->rx = port->rxStats();
+    p->tx = port->txStats();
+    p->rxDropped = port->rxDropStats();
+    p->txDropped = port->txDropStats();
+    p->releaseTsc = rte_rdtsc();
+    rte_smp_wmb();
+    p->released = _shm->generation + 1;
+}
+
+bool
+ddHandoff::take()
+{
+    // an access port taken early would send on the core port the owner
+    // may still flush, the ports are taken together
+    const ddPortMap &ports = dataDiodeApp::instance().portMap();
+    for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+        if (_shm->ports[it->second->portId()].released != _generation + 1)
+            return false;
+    }
+    // the other lcores poll once the first one carried the counters over
+    if (!rte_atomic32_test_and_set(&_taking))
+        return false;
+    rte_smp_rmb();
+
+    // both processes read the same TSC
+    uint64_t now = rte_rdtsc();
+    for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+        uint16_t portId = it->second->portId();
+        struct ddHandoffShm_::port_ *p = &_shm->ports[portId];
+        _gapTsc[portId] = now - p->releaseTsc;
+        it->second->carryStats(p->rx, p->tx, p->rxDropped, p->txDropped);
+    }
+    rte_smp_wmb();
+    for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it)
+        _taken[it->second->portId()] = true;
+    return true;
+}
+
+void*
+ddHandoff::watchMain(void *arg)
+{
+    reinterpret_cast<ddHandoff *>(arg)->watchLoop();
+    return NULL;
+}
+
+void
+ddHandoff::watchLoop()
+{
+    dataDiodeApp &app = dataDiodeApp::instance();
+    const ddPortMap &ports = app.portMap();
+    uint64_t deadline = _requestTsc + rte_get_tsc_hz() / 1000 * DD_HANDOFF_WAIT_MS;
+
+    while (!app.forceQuit()) {
+        usleep(DD_HANDOFF_POLL_US);
+        bool all = true;
+        for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it)
+            all = all && _taken[it->second->portId()];
+        if (all)
+            break;
+
+        // the owner crashed, or quit after accepting, nobody else lets go
+        if (processGone(_shm->ownerPid)) {
+            RTE_LOG(WARNING, USER1, "Instance %d is gone, taking its ports\n",
+                    _shm->ownerPid);
+            for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+                struct ddHandoffShm_::port_ *p = &_shm->ports[it->second->portId()];
+                if (p->released != _generation + 1) {
+                    p->releaseTsc = rte_rdtsc();
+                    rte_smp_wmb();
+                    p->released = _generation + 1;
+                }
+            }
+            continue;
+        }
+
+        // an owner busy releasing is waited for, one that never answered not
+        if (rte_rdtsc() > deadline &&
+            rte_atomic32_cmpset(&_shm->state, STATE_REQUESTED, STATE_IDLE)) {
+            RTE_LOG(ERR, USER1, "Instance %d did not hand off its ports within %u ms\n",
+                    _shm->ownerPid, DD_HANDOFF_WAIT_MS);
+            _shm->takerPid = 0;
+            app.quit();
+            return;
+        }
+    }
+    if (app.forceQuit())
+        return;
+
+    rte_smp_rmb();
+    for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+        uint16_t portId = it->second->portId();
+        _maxGapTsc = RTE_MAX(_maxGapTsc, _gapTsc[portId]);
+        RTE_LOG(INFO, USER1, "Port %u taken over, %lu us without polling\n", portId,
+                (unsigned long)(_gapTsc[portId] * US_PER_S / rte_get_tsc_hz()));
+    }
+
+    // this instance owns the ports now and can hand them on in turn
+    _shm->ownerPid = getpid();
+    _shm->takerPid = 0;
+    _shm->generation = _generation + 1;
+    rte_smp_wmb();
+    _shm->state = STATE_IDLE;
+    _pending = false;
+    _takeover = false;
+    std::cout << "Took over from the running instance in "
+              << (rte_rdtsc() - _requestTsc) * US_PER_S / rte_get_tsc_hz() << " us" << std::endl;
+}
@@ -0,0 +1,334 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstring>
+#include <strings.h>
+#include <netinet/in.h>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_prefetch.h>
+#include <rte_byteorder.h>
+#include <rte_hash_crc.h>
+#include <rte_random.h>
+#include "ddHdrComp.h"
+#include "ddPort.h"
+#include "ddConfig.h"
+#include "dataDiode.h"
+
+
+// context id of the context idx of an access port
+#define DD_HC_CID(portId, idx)      ((uint16_t)(((portId) << 10) | (idx)))
+#define DD_HC_RX_CONTEXTS           (DD_HC_RX_SETS * DD_HC_WAYS)
+
+// offsets of the fields that change from frame to frame
+#define DD_HC_IP_OFF                sizeof(struct ether_hdr)
+#define DD_HC_UDP_OFF               (DD_HC_IP_OFF + sizeof(struct ipv4_hdr))
+
+ddHdrComp::ddHdrComp(uint32_t refreshPkts) :
+        _refreshPkts(refreshPkts), _refreshTsc(0), _epoch(0), _rx(NULL),
+        _decompressed(0), _rxRefreshes(0), _noContext(0), _badFrames(0)
+{
+    // context ids are 16 bits
+    RTE_BUILD_BUG_ON(RTE_MAX_ETHPORTS * DD_HC_TX_CONTEXTS > 65536);
+    bzero(_tx, sizeof(_tx));
+}
+
+void
+ddHdrComp::initialize(bool tx, bool rx)
+{
+    _refreshTsc = rte_get_tsc_hz() / 1000 * DD_HC_REFRESH_MS;
+
+    if (tx) {
+        // a restart or takeover starts with other generations and epoch
+        _epoch = 1 + rte_rand() % 255;
+        dataDiodeApp &app = dataDiodeApp::instance();
+        const ddPortMap &ports = app.portMap();
+        for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+            uint16_t portId = it->first;
+            if (NULL == app.egressPort(portId))
+                continue;
+            _tx[portId] = (struct txTable_ *)rte_zmalloc_socket("dd_hc_tx",
+                                     sizeof(struct txTable_), RTE_CACHE_LINE_SIZE,
+                                     rte_eth_dev_socket_id(portId));
+            if (NULL == _tx[portId])
+                rte_exit(EXIT_FAILURE, "Cannot allocate header compression contexts "
+                         "of port %u\n", portId);
+            for (uint32_t i = 0; i < DD_HC_TX_CONTEXTS; i++) {
+                _tx[portId]->ctx[i].cid = DD_HC_CID(portId, i);
+                _tx[portId]->ctx[i].gen = rte_rand();
+            }
+        }
+    }
+    if (rx) {
+        _rx = (struct ctx_ *)rte_zmalloc("dd_hc_rx", sizeof(struct ctx_) * DD_HC_RX_CONTEXTS,
+                                         RTE_CACHE_LINE_SIZE);
+        if (NULL == _rx)
+            rte_exit(EXIT_FAILURE, "Cannot allocate header compression contexts\n");
+    }
+}
+
+bool
+ddHdrComp::key(const struct rte_mbuf *pkt, uint8_t *hdr)
+{
+    if (rte_pktmbuf_data_len(pkt) < DD_HC_HDR_LEN)
+        return false;
+    const struct ether_hdr *eth = rte_pktmbuf_mtod(pkt, const struct ether_hdr *);
+    const struct ipv4_hdr *ip = (const struct ipv4_hdr *)(eth + 1);
+    const struct udp_hdr *udp = (const struct udp_hdr *)(ip + 1);
+    uint16_t ipLen = rte_be_to_cpu_16(ip->total_length);
+
+    // no options, fragments or Ethernet padding, the lengths can be
+    // derived from the IPv4 total length
+    if (eth->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4) ||
+        ip->version_ihl != 0x45 || ip->next_proto_id != IPPROTO_UDP ||
+        (ip->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_MF_FLAG | IPV4_HDR_OFFSET_MASK)) ||
+        rte_pktmbuf_pkt_len(pkt) != sizeof(struct ether_hdr) + ipLen ||
+        rte_be_to_cpu_16(udp->dgram_len) != ipLen - sizeof(struct ipv4_hdr))
+        return false;
+
+    rte_memcpy(hdr, eth, DD_HC_HDR_LEN);
+    struct ipv4_hdr *kIp = (struct ipv4_hdr *)(hdr + DD_HC_IP_OFF);
+    struct udp_hdr *kUdp = (struct udp_hdr *)(hdr + DD_HC_UDP_OFF);
+    kIp->total_length = 0;
+    kIp->packet_id = 0;
+    kIp->hdr_checksum = 0;
+    kUdp->dgram_len = 0;
+    kUdp->dgram_cksum = 0;
+    return true;
+}
+
+void
+ddHdrComp::compress(uint16_t portId, struct rte_mbuf **pkts, uint32_t n, uint8_t *results)
+{
+    struct txTable_ *table = _tx[portId];
+    uint64_t now = rte_rdtsc();
+    uint8_t hdr[DD_HC_HDR_LEN];
+
+    for (uint32_t j = 0; j < n; j++) {
+        struct rte_mbuf *pkt = pkts[j];
+        results[j] = RESULT_PLAIN;
+        if (!key(pkt, hdr)) {
+            table->plain++;
+            continue;
+        }
+
+        // the flow in its set, or the least recently used context of it
+        struct ctx_ *set = &table->ctx[(rte_hash_crc(hdr, DD_HC_HDR_LEN, 0) %
+                                        DD_HC_TX_SETS) * DD_HC_WAYS];
+        struct ctx_ *ctx = NULL, *lru = set;
+        for (uint32_t w = 0; w < DD_HC_WAYS && NULL == ctx; w++) {
+            if (set[w].valid && 0 == memcmp(set[w].hdr, hdr, DD_HC_HDR_LEN))
+                ctx = &set[w];
+            else if (!set[w].valid || set[w].lastTsc < lru->lastTsc)
+                lru = &set[w];
+        }
+        bool refresh = false;
+        if (NULL == ctx) {
+            ctx = lru;
+            rte_memcpy(ctx->hdr, hdr, DD_HC_HDR_LEN);
+            ctx->gen++;
+            ctx->valid = true;
+            refresh = true;
+        }
+        ctx->lastTsc = now;
+        if (refresh || ++ctx->sinceRefresh >= _refreshPkts ||
+            now - ctx->refreshTsc >= _refreshTsc) {
+            ctx->sinceRefresh = 0;
+            ctx->refreshTsc = now;
+            struct ctxHdr_ *ctxHdr = (struct ctxHdr_ *)rte_pktmbuf_prepend(pkt,
+                                                             sizeof(struct ctxHdr_));
+            if (NULL == ctxHdr) {
+                // sent as it is, the context follows with the next frame
+                ctx->refreshTsc = 0;
+                table->plain++;
+                continue;
+            }
+            ctxHdr->cid = rte_cpu_to_be_16(ctx->cid);
+            ctxHdr->gen = ctx->gen;
+            ctxHdr->epoch = _epoch;
+            results[j] = RESULT_REFRESH;
+            table->refreshes++;
+            continue;
+        }
+
+        const struct ipv4_hdr *ip = rte_pktmbuf_mtod_offset(pkt, const struct ipv4_hdr *,
+                                                            DD_HC_IP_OFF);
+        const struct udp_hdr *udp = rte_pktmbuf_mtod_offset(pkt, const struct udp_hdr *,
+                                                            DD_HC_UDP_OFF);
+        uint16_t ipLen = ip->total_length;
+        uint16_t ipId = ip->packet_id;
+        uint16_t udpCsum = udp->dgram_cksum;
+        rte_pktmbuf_adj(pkt, DD_HC_HDR_LEN - sizeof(struct compHdr_));
+        struct compHdr_ *compHdr = rte_pktmbuf_mtod(pkt, struct compHdr_ *);
+        compHdr->ctx.cid = rte_cpu_to_be_16(ctx->cid);
+        compHdr->ctx.gen = ctx->gen;
+        compHdr->ctx.epoch = _epoch;
+        compHdr->ipLen = ipLen;
+        compHdr->ipId = ipId;
+        compHdr->udpCsum = udpCsum;
+        results[j] = RESULT_COMPRESSED;
+        table->compressed++;
+        table->savedBytes += DD_HC_HDR_LEN - sizeof(struct compHdr_);
+    }
+}
+
+ddHdrComp::ctx_*
+ddHdrComp::rxSet(uint16_t slot, uint16_t cid) const
+{
+    uint32_t h = rte_hash_crc_4byte(((uint32_t)slot << 16) | cid, 0);
+    return &_rx[(h % DD_HC_RX_SETS) * DD_HC_WAYS];
+}
+
+void
+ddHdrComp::decompress(struct rte_mbuf **pkts, const uint32_t *idx, uint32_t n,
+                      uint64_t refresh)
+{
+    struct ctx_ *sets[2 * MAX_PKT_BURST];
+    uint64_t now = rte_rdtsc();
+
+    // contexts of the whole burst first, they are rarely in the cache
+    for (uint32_t k = 0; k < n; k++) {
+        const struct ctxHdr_ *ctxHdr = rte_pktmbuf_mtod(pkts[idx[k]], const struct ctxHdr_ *);
+        sets[k] = rxSet(ddSenderTagSlot(pkts[idx[k]]->udata64),
+                        rte_be_to_cpu_16(ctxHdr->cid));
+        rte_prefetch0(sets[k]);
+        rte_prefetch0(&sets[k][DD_HC_WAYS / 2]);
+    }
+
+    for (uint32_t k = 0; k < n; k++) {
+        struct rte_mbuf *pkt = pkts[idx[k]];
+        uint16_t slot = ddSenderTagSlot(pkt->udata64);
+        struct ctx_ *set = sets[k];
+        struct ctxHdr_ ctxHdr = *rte_pktmbuf_mtod(pkt, struct ctxHdr_ *);
+        uint16_t cid = rte_be_to_cpu_16(ctxHdr.cid);
+
+        struct ctx_ *ctx = NULL, *lru = set;
+        for (uint32_t w = 0; w < DD_HC_WAYS && NULL == ctx; w++) {
+            if (set[w].valid && set[w].cid == cid && set[w].slot == slot)
+                ctx = &set[w];
+            else if (!set[w].valid || set[w].lastTsc < lru->lastTsc)
+                lru = &set[w];
+        }
+
+        if (refresh & (1ULL << k)) {
+            // the full frame follows, it (re)establishes the context
+            rte_pktmbuf_adj(pkt, sizeof(struct ctxHdr_));
+            if (NULL == ctx)
+                ctx = lru;
+            if (!key(pkt, ctx->hdr)) {
+                ctx->valid = false;
+                _badFrames++;
+                rte_pktmbuf_free(pkt);
+                pkts[idx[k]] = NULL;
+                continue;
+            }
+            ctx->cid = cid;
+            ctx->slot = slot;
+            ctx->gen = ctxHdr.gen;
+            ctx->epoch = ctxHdr.epoch;
+            ctx->valid = true;
+            ctx->lastTsc = now;
+            _rxRefreshes++;
+            continue;
+        }
+
+        // context lost with its refresh, replaced since or set up by an
+        // earlier Tx-Only process
+        if (NULL == ctx || ctx->gen != ctxHdr.gen || ctx->epoch != ctxHdr.epoch ||
+            rte_pktmbuf_data_len(pkt) < sizeof(struct compHdr_)) {
+            _noContext++;
+            rte_pktmbuf_free(pkt);
+            pkts[idx[k]] = NULL;
+            continue;
+        }
+        ctx->lastTsc = now;
+
+        struct compHdr_ compHdr = *rte_pktmbuf_mtod(pkt, struct compHdr_ *);
+        uint16_t ipLen = rte_be_to_cpu_16(compHdr.ipLen);
+        uint32_t payloadLen = rte_pktmbuf_pkt_len(pkt) - sizeof(struct compHdr_);
+        uint32_t wantLen = ipLen - sizeof(struct ipv4_hdr) - sizeof(struct udp_hdr);
+        if (ipLen < sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr) || payloadLen < wantLen) {
+            _badFrames++;
+            rte_pktmbuf_free(pkt);
+            pkts[idx[k]] = NULL;
+            continue;
+        }
+        // the core link pads short frames
+        if (payloadLen > wantLen)
+            rte_pktmbuf_trim(pkt, payloadLen - wantLen);
+
+        rte_pktmbuf_adj(pkt, sizeof(struct compHdr_));
+        uint8_t *hdr = (uint8_t *)rte_pktmbuf_prepend(pkt, DD_HC_HDR_LEN);
+        if (NULL == hdr) {
+            _badFrames++;
+            rte_pktmbuf_free(pkt);
+            pkts[idx[k]] = NULL;
+            continue;
+        }
+        rte_memcpy(hdr, ctx->hdr, DD_HC_HDR_LEN);
+        struct ipv4_hdr *ip = (struct ipv4_hdr *)(hdr + DD_HC_IP_OFF);
+        struct udp_hdr *udp = (struct udp_hdr *)(hdr + DD_HC_UDP_OFF);
+        ip->total_length = compHdr.ipLen;
+        ip->packet_id = compHdr.ipId;
+        ip->hdr_checksum = rte_ipv4_cksum(ip);
+        udp->dgram_len = rte_cpu_to_be_16(ipLen - sizeof(struct ipv4_hdr));
+        udp->dgram_cksum = compHdr.udpCsum;
+        _decompressed++;
+    }
+}
+
+uint64_t
+ddHdrComp::txCompressed() const
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < RTE_MAX_ETHPORTS; i++)
+        sum += (NULL != _tx[i]) ? _tx[i]->compressed : 0;
+    return sum;
+}
+
+uint64_t
+ddHdrComp::txRefreshes() const
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < RTE_MAX_ETHPORTS; i++)
+        sum += (NULL != _tx[i]) ? _tx[i]->refreshes : 0;
+    return sum;
+}
+
+uint64_t
+ddHdrComp::txPlain() const
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < RTE_MAX_ETHPORTS; i++)
+        sum += (NULL != _tx[i]) ? _tx[i]->plain : 0;
+    return sum;
+}
+
+uint64_t
+ddHdrComp::txSavedBytes() const
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < RTE_MAX_ETHPORTS; i++)
+        sum += (NULL != _tx[i]) ? _tx[i]->savedBytes : 0;
+    return sum;
+}
@@ -0,0 +1,220 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstring>
+#include <strings.h>
+#include <unistd.h>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_atomic.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include "ddHeartbeat.h"
+#include "ddPort.h"
+#include "dataDiode.h"
+
+
+// TSC ticks to nanoseconds without overflowing on long uptimes
+static inline uint64_t
+tscToNs(uint64_t tsc, uint64_t hz)
+{
+    return (tsc / hz) * NS_PER_S + (tsc % hz) * NS_PER_S / hz;
+}
+
+ddHeartbeat::ddHeartbeat(uint32_t intervalMs) :
+        _intervalMs(intervalMs ? intervalMs : DD_HEARTBEAT_MS), _intervalTsc(0),
+        _startTsc(0), _nextTsc(0), _seq(0), _pool(NULL), _senders(NULL),
+        _monitor(false), _stop(false),
+        _sent(0), _noMbuf(0), _received(0), _badFrames(0), _alarms(0)
+{
+}
+
+void
+ddHeartbeat::initialize(struct rte_mempool *pool, bool monitor)
+{
+    std::cout << "Initializing heartbeat every " << _intervalMs << " ms ..." << std::endl;
+
+    _pool = pool;
+    _startTsc = rte_rdtsc();
+    _intervalTsc = rte_get_tsc_hz() / 1000 * _intervalMs;
+    _nextTsc = _startTsc;
+
+    _senders = (struct sender_ *)rte_zmalloc("dd_heartbeat",
+                sizeof(struct sender_) * DD_SENDER_SLOTS, RTE_CACHE_LINE_SIZE);
+    if (NULL == _senders)
+        rte_exit(EXIT_FAILURE, "Cannot allocate heartbeat state\n");
+
+    _monitor = monitor;
+    if (_monitor) {
+        int ret = rte_ctrl_thread_create(&_monitorThread, "dd-heartbeat", NULL,
+                                         ddHeartbeat::monitorMain, this);
+        if (ret != 0)
+            rte_exit(EXIT_FAILURE, "Cannot start heartbeat thread: err = %d\n", ret);
+    }
+}
+
+void
+ddHeartbeat::cleanup()
+{
+    _stop = true;
+    if (_monitor)
+        pthread_join(_monitorThread, NULL);
+    rte_free(_senders);
+    _senders = NULL;
+}
+
+struct rte_mbuf*
+ddHeartbeat::poll()
+{
+    uint64_t now = rte_rdtsc();
+    if (likely(now < _nextTsc))
+        return NULL;
+    _nextTsc = now + _intervalTsc;
+
+    struct rte_mbuf *pkt = rte_pktmbuf_alloc(_pool);
+    if (NULL == pkt) {
+        _noMbuf++;
+        return NULL;
+    }
+    struct ddHeartbeatHdr_ *hdr = reinterpret_cast<struct ddHeartbeatHdr_ *>(
+                rte_pktmbuf_append(pkt, sizeof(struct ddHeartbeatHdr_)));
+    if (NULL == hdr) {
+        rte_pktmbuf_free(pkt);
+        _noMbuf++;
+        return NULL;
+    }
+
+    dataDiodeApp &app = dataDiodeApp::instance();
+#ifndef _DD_TESTMODE_
+    ddPort *corePort = app.corePort();
+#else
+    ddPort *corePort = app.corePort(dataDiodeApp::PORTMODE_TX);
+#endif
+    hdr->seq = rte_cpu_to_be_32(++_seq);
+    hdr->intervalMs = rte_cpu_to_be_32(_intervalMs);
+    hdr->tscHz = rte_cpu_to_be_64(rte_get_tsc_hz());
+    hdr->uptimeMs = rte_cpu_to_be_64((now - _startTsc) * 1000 / rte_get_tsc_hz());
+    hdr->accessRx = rte_cpu_to_be_64(app.accessPort()->rxStats());
+    hdr->tunnelTx = rte_cpu_to_be_64(corePort->txStats());
+    hdr->txDropped = rte_cpu_to_be_64(corePort->txDropStats());
+    // stamped last, as close to the wire as the tx buffer allows
+    hdr->tsc = rte_cpu_to_be_64(rte_rdtsc());
+    _sent++;
+    return pkt;
+}
+
+void
+ddHeartbeat::receive(struct rte_mbuf *pkt)
+{
+    uint64_t now = rte_rdtsc();
+    const struct ddHeartbeatHdr_ *hdr = rte_pktmbuf_mtod(pkt, const struct ddHeartbeatHdr_ *);
+    if (unlikely(rte_pktmbuf_data_len(pkt) < sizeof(struct ddHeartbeatHdr_) ||
+                 0 == (pkt->udata64 & DD_SENDER_TAG_VALID) || 0 == hdr->tscHz)) {
+        _badFrames++;
+        rte_pktmbuf_free(pkt);
+        return;
+    }
+
+    struct sender_ *s = &_senders[ddSenderTagSlot(pkt->udata64)];
+    uint32_t seq = rte_be_to_cpu_32(hdr->seq);
+    uint64_t uptimeMs = rte_be_to_cpu_64(hdr->uptimeMs);
+    uint64_t txNs = tscToNs(rte_be_to_cpu_64(hdr->tsc), rte_be_to_cpu_64(hdr->tscHz));
+    uint64_t rxNs = tscToNs(now, rte_get_tsc_hz());
+
+    if (0 != s->received) {
+        int32_t gap = (int32_t)(seq - s->lastSeq);
+        if (gap <= 0 || uptimeMs < s->uptimeMs) {
+            // sender restarted, its clock and sequence start over
+            s->restarts++;
+        } else {
+            s->missing += gap - 1;
+            // transit time variation, clocks of both sides need not agree
+            int64_t d = (int64_t)(rxNs - s->lastRxNs) - (int64_t)(txNs - s->lastTxNs);
+            uint64_t absD = d < 0 ? -d : d;
+            s->jitterNs += ((int64_t)absD - (int64_t)s->jitterNs) / 16;
+        }
+    }
+    s->lastSeq = seq;
+    s->lastRxNs = rxNs;
+    s->lastTxNs = txNs;
+    s->uptimeMs = uptimeMs;
+    s->accessRx = rte_be_to_cpu_64(hdr->accessRx);
+    s->tunnelTx = rte_be_to_cpu_64(hdr->tunnelTx);
+    s->txDropped = rte_be_to_cpu_64(hdr->txDropped);
+    s->received++;
+    rte_smp_wmb();
+    s->lastRxTsc = now;
+    _received++;
+    rte_pktmbuf_free(pkt);
+}
+
+void*
+ddHeartbeat::monitorMain(void *arg)
+{
+    reinterpret_cast<ddHeartbeat *>(arg)->monitorLoop();
+    return NULL;
+}
+
+void
+ddHeartbeat::monitorLoop()
+{
+    const uint64_t lostTsc = DD_HEARTBEAT_MISS * _intervalTsc;
+    bool silent = false;
+
+    while (!_stop && !dataDiodeApp::instance().forceQuit()) {
+        usleep(_intervalMs * 1000);
+        uint64_t now = rte_rdtsc();
+
+        // nothing at all since start, an idle sender still sends heartbeats
+        if (0 == _received && !silent && now - _startTsc > lostTsc) {
+            RTE_LOG(ERR, USER1, "No heartbeat received for %u ms, core link down?\n",
+                    DD_HEARTBEAT_MISS * _intervalMs);
+            silent = true;
+            _alarms++;
+        }
+
+        for (uint32_t slot = 0; slot < DD_SENDER_SLOTS; slot++) {
+            struct sender_ *s = &_senders[slot];
+            uint64_t lastRxTsc = s->lastRxTsc;
+            if (0 == lastRxTsc)
+                continue;
+
+            if (!s->lost && now > lastRxTsc && now - lastRxTsc > lostTsc) {
+                RTE_LOG(ERR, USER1, "Heartbeat of sender %u lost, none for %lu ms\n", slot,
+                        (unsigned long)((now - lastRxTsc) * 1000 / rte_get_tsc_hz()));
+                s->lost = true;
+                _alarms++;
+            } else if (s->lost && (now < lastRxTsc || now - lastRxTsc <= lostTsc)) {
+                RTE_LOG(WARNING, USER1, "Heartbeat of sender %u restored\n", slot);
+                s->lost = false;
+            }
+
+            uint64_t missing = s->missing;
+            if (missing != s->reportedMissing) {
+                RTE_LOG(WARNING, USER1, "Sender %u missed %lu heartbeats\n", slot,
+                        (unsigned long)(missing - s->reportedMissing));
+                s->reportedMissing = missing;
+                _alarms++;
+            }
+        }
+    }
+}
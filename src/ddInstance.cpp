@@ -0,0 +1,345 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <strings.h>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_atomic.h>
+#include <rte_lcore.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include "ddInstance.h"
+#include "ddPort.h"
+
+
+ddInstance::ddInstance(uint16_t id, const char *name, const char *configDir,
+                       dataDiodeApp::PortMode corePortMode, uint64_t portMask,
+                       int corePortId, uint32_t nbMbufs) :
+        _id(id), _corePortMode(corePortMode), _portMask(portMask),
+        _accessPort(NULL), _nbMbufs(nbMbufs), _pktMbufPool(NULL), _config(NULL)
+{
+    snprintf(_name, sizeof(_name), "%s", name);
+    snprintf(_configDir, sizeof(_configDir), "%s", configDir);
+    bzero(_lcores, sizeof(_lcores));
+    bzero(_egressPorts, sizeof(_egressPorts));
+    bzero(_senderStats, sizeof(_senderStats));
+#ifndef _DD_TESTMODE_
+    _corePortId = corePortId;
+    _corePort = NULL;
+#else
+    // Rx-Only and Tx-Only core ports of the test setup
+    RTE_SET_USED(corePortId);
+    _corePortId[0] = 0;
+    _corePortId[1] = 1;
+    _corePort[0] = NULL;
+    _corePort[1] = NULL;
+#endif
+}
+
+void
+ddInstance::ownAllLcores()
+{
+    uint32_t lcoreId;
+    RTE_LCORE_FOREACH(lcoreId)
+        _lcores[lcoreId] = true;
+}
+
+int
+ddInstance::socketId() const
+{
+#ifndef _DD_TESTMODE_
+    return rte_eth_dev_socket_id(_corePortId);
+#else
+    return rte_socket_id();
+#endif
+}
+
+bool
+ddInstance::parseLcores(const char *list)
+{
+    const char *p = list;
+    while ('\0' != *p) {
+        char *end = NULL;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        if (end != p && '-' == *end)
+            last = strtoul(end + 1, &end, 10);
+        if (end == p || first > last || last >= RTE_MAX_LCORE ||
+            ('\0' != *end && ',' != *end)) {
+            std::cerr << "Invalid lcores " << list << " of instance " << _name << std::endl;
+            return false;
+        }
+        // the master lcore prints the statistics, it belongs to no instance
+        for (unsigned long lcoreId = first; lcoreId <= last; lcoreId++) {
+            if (!rte_lcore_is_enabled(lcoreId) || lcoreId == rte_get_master_lcore()) {
+                std::cerr << "Lcore " << lcoreId << " of instance " << _name
+                          << " is not enabled or the master lcore" << std::endl;
+                return false;
+            }
+            _lcores[lcoreId] = true;
+        }
+        p = (',' == *end) ? end + 1 : end;
+    }
+    return true;
+}
+
+// names become directory and mempool names
+static bool
+validName(const char *name)
+{
+    if (strlen(name) >= DD_INSTANCE_NAME_SZ)
+        return false;
+    for (const char *p = name; '\0' != *p; p++) {
+        if (!isalnum(*p) && '_' != *p && '-' != *p)
+            return false;
+    }
+    return true;
+}
+
+uint32_t
+ddInstance::readInstances(const char *path, uint32_t nbMbufs, ddInstance **instances)
+{
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile) {
+        std::cerr << "Unable to open configuration file " << path << std::endl;
+        return 0;
+    }
+
+    // <NAME> rx|tx <PORTMASK> <CORE PORT> <LCORES> [mbufs <N>] per line
+    char line[256];
+    uint32_t n = 0;
+    uint64_t portsTaken = 0;
+    bool valid = true;
+    while (valid && NULL != fgets(line, sizeof(line), inputFile)) {
+        char name[64] = "", mode[8] = "", ports[32] = "", lcores[128] = "", key[16] = "";
+        char extra[2] = "";
+        int corePortId = -1;
+        uint32_t mbufs = nbMbufs;
+        // blank and comment lines may be indented or end in CRLF
+        const char *first = line + strspn(line, " \t\r\n");
+        if ('#' == *first || '\0' == *first)
+            continue;
+        // anything after the last field makes an 8th one
+        int nFields = sscanf(first, "%63s %7s %31s %d %127s %15s %u %1s",
+                             name, mode, ports, &corePortId, lcores, key, &mbufs, extra);
+        char *end = NULL;
+        uint64_t portMask = strtoull(ports, &end, 16);
+        valid = false;
+        if (5 != nFields && !(7 == nFields && 0 == strcmp(key, "mbufs") && mbufs > 0)) {
+            std::cerr << "Invalid instance " << line;
+        } else if (n == DD_MAX_INSTANCES) {
+            std::cerr << "More than " << DD_MAX_INSTANCES << " instances" << std::endl;
+        } else if (!validName(name)) {
+            std::cerr << "Invalid instance name " << name << std::endl;
+        } else if (0 != strcmp(mode, "rx") && 0 != strcmp(mode, "tx")) {
+            std::cerr << "Invalid role " << mode << " of instance " << name << std::endl;
+        } else if (*end != '\0' || 0 == portMask || (portMask & portsTaken) ||
+                   corePortId < 0 || corePortId >= 64 ||
+                   !(portMask & (1ULL << corePortId)) || portMask == (1ULL << corePortId)) {
+            std::cerr << "Instance " << name << " needs ports of its own, the core port "
+                      << "and at least one access port" << std::endl;
+        } else {
+            valid = true;
+            for (uint32_t i = 0; i < n; i++)
+                valid = valid && 0 != strcmp(instances[i]->name(), name);
+            if (!valid)
+                std::cerr << "Instance " << name << " is defined twice" << std::endl;
+            for (uint16_t portId = 0; valid && portId < 64; portId++) {
+                if ((portMask & (1ULL << portId)) && !rte_eth_dev_is_valid_port(portId)) {
+                    std::cerr << "Port " << portId << " of instance " << name
+                              << " does not exist" << std::endl;
+                    valid = false;
+                }
+            }
+        }
+        if (!valid)
+            break;
+
+        char configDir[PATH_MAX];
+        snprintf(configDir, sizeof(configDir), "%s/%s", DD_CONFIG_DIR, name);
+        ddInstance *instance = new ddInstance(n, name, configDir,
+                                              (0 == strcmp(mode, "rx")) ?
+                                              dataDiodeApp::PORTMODE_RX : dataDiodeApp::PORTMODE_TX,
+                                              portMask, corePortId, mbufs);
+        instances[n++] = instance;
+        portsTaken |= portMask;
+        valid = instance->parseLcores(lcores);
+
+        // no lcore polls ports of two instances
+        for (uint32_t i = 0; valid && i + 1 < n; i++) {
+            for (uint32_t lcoreId = 0; lcoreId < RTE_MAX_LCORE; lcoreId++) {
+                if (instance->ownsLcore(lcoreId) && instances[i]->ownsLcore(lcoreId)) {
+                    std::cerr << "Lcore " << lcoreId << " is in instances " << instances[i]->name()
+                              << " and " << name << std::endl;
+                    valid = false;
+                    break;
+                }
+            }
+        }
+    }
+    std::fclose(inputFile);
+
+    if (valid && 0 == n)
+        std::cerr << "No instance in " << path << std::endl;
+    if (!valid) {
+        for (uint32_t i = 0; i < n; i++)
+            delete instances[i];
+        n = 0;
+    }
+    return n;
+}
+
+void
+ddInstance::createMempool(const char *poolName, int socketId, uint32_t cacheSize, bool lookup)
+{
+    // the NIC RX rings of a running instance fill from its pool and stay
+    // as they are
+    if (lookup) {
+        _pktMbufPool = rte_mempool_lookup(poolName);
+        if (_pktMbufPool != NULL)
+            _nbMbufs = _pktMbufPool->size;
+    } else {
+        _pktMbufPool = rte_pktmbuf_pool_create(poolName, _nbMbufs, cacheSize,
+                                               0, MBUF_DATA_SZ, socketId);
+    }
+    if (_pktMbufPool == NULL) {
+        rte_exit(EXIT_FAILURE,
+                 "Could not initializing memory buffer pool of %s.\nExiting...\n", _name);
+    }
+    std::cout << "Mempool " << _pktMbufPool->name << ": " << _nbMbufs << " mbufs of "
+              << MBUF_DATA_SZ << " bytes, " << dataDiodeApp::mempoolBytes(_pktMbufPool) / 1024
+              << " KB" << std::endl;
+}
+
+ddPort*
+ddInstance::createPort(uint16_t portId)
+{
+    ddPort *pPort;
+
+#ifndef _DD_TESTMODE_
+    if (portId == _corePortId) {
+        if (dataDiodeApp::PORTMODE_RX == _corePortMode) {
+            std::cout << "Setting Rx-Only role on Port: "
+                      << portId << std::endl;
+            pPort = new ddRxOnlyCorePort(portId, this);
+            _corePort = pPort;
+        } else if (dataDiodeApp::PORTMODE_TX == _corePortMode) {
+            std::cout << "Setting Tx-Only role on Port: "
+                      << portId << std::endl;
+            pPort = new ddTxOnlyCorePort(portId, this);
+            _corePort = pPort;
+        } else {
+            rte_exit(EXIT_FAILURE, "Invalid Port mode %u for port: %u.\nExiting...\n",
+                     _corePortMode, portId);
+        }
+#else
+    std::cerr << "WARNING: Running the Application in test mode" << std::endl;
+    std::cerr << "WARNING: Test mode is not to be run in production network" << std::endl;
+    std::cout << "Setting Rx-Only and Tx-only roles on Port: "
+              << _corePortId[0] << " and Port: " << _corePortId[1]
+              << std::endl;
+    if (portId == _corePortId[0]) {
+            pPort = new ddRxOnlyCorePort(portId, this);
+            _corePort[0] = pPort;
+    } else if (portId == _corePortId[1]) {
+            pPort = new ddTxOnlyCorePort(portId, this);
+            _corePort[1] = pPort;
+#endif
+    } else {
+        std::cout << "Setting Access port " << portId << std::endl;
+        pPort = new ddAccessPort(portId, this);
+        if (NULL == _accessPort) {
+            _accessPort = pPort;
+        }
+        _egressPorts[portId] = pPort;
+    }
+    return pPort;
+}
+
+#ifndef _DD_TESTMODE_
+const struct ether_addr*
+ddInstance::corePortEthAddr() const
+{
+    return _corePort->ethAddr();
+}
+#else
+const struct ether_addr*
+ddInstance::corePortEthAddr(uint16_t portId) const
+{
+    return _corePort[portId]->ethAddr();
+}
+#endif
+
+bool
+ddInstance::loadConfig(uint32_t generation)
+{
+    _config = ddConfig::load(_configDir, _id, generation);
+    return NULL != _config;
+}
+
+ddConfig*
+ddInstance::reloadConfig(uint32_t generation, bool *failed)
+{
+    ddConfig *oldConfig = _config;
+    ddConfig *newConfig = ddConfig::load(_configDir, _id, generation, oldConfig);
+    *failed = (NULL == newConfig);
+    if (NULL == newConfig) {
+        // forwarding continues with the current snapshot
+        std::cerr << "Config reload of " << _name << " failed, keeping generation "
+                  << oldConfig->generation() << std::endl;
+        return NULL;
+    }
+    if (!newConfig->differs(oldConfig)) {
+        delete newConfig;
+        return NULL;
+    }
+    prepareSenders(newConfig);
+
+    // publish the fully built snapshot, the caller waits for the readers
+    // of the old one
+    rte_smp_wmb();
+    _config = newConfig;
+    std::cout << "Config generation " << newConfig->generation() << " active on " << _name
+              << ": SID " << newConfig->sId() << " peer SID " << newConfig->peerSId()
+              << std::endl;
+    return oldConfig;
+}
+
+void
+ddInstance::prepareSenders(const ddConfig *config)
+{
+    for (uint32_t i = 0; i < config->nSenders(); i++) {
+        const struct ddSender_ *sender = config->sender(i);
+        // nobody counts in the slot of a new sender until it is published
+        if (sender->isNew)
+            bzero(&_senderStats[sender->slot], sizeof(_senderStats[sender->slot]));
+        if (DD_SENDER_DEFAULT_PORT != sender->portId && NULL == egressPort(sender->portId)) {
+            char mac[ETHER_ADDR_FMT_SIZE];
+            ether_format_addr(mac, sizeof(mac), &sender->mac);
+            std::cerr << "WARNING: sender " << mac << " port " << sender->portId
+                      << " is not an access port of " << _name << ", using port "
+                      << (NULL == _accessPort ? 0 : _accessPort->portId()) << std::endl;
+        }
+    }
+}
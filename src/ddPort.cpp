@@ -16,6 +16,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 
+#include <cerrno>
 #include <rte_log.h>
 #include <rte_byteorder.h>
 #include <rte_mbuf.h>
@@ -28,60 +29,152 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 #include <rte_cycles.h>
 #include <rte_lcore.h>
 #include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_tcp.h>
+#include <rte_hash.h>
+#include <netinet/in.h>
 #include "ddPort.h"
+#include "ddInstance.h"
+#include "ddCrypto.h"
+#include "ddCompress.h"
+#include "ddCapture.h"
+#include "ddSpill.h"
+#include "ddFileXfer.h"
+#include "ddTopTalkers.h"
+#include "ddHeartbeat.h"
+#include "ddQualify.h"
+#include "ddHdrComp.h"
+#include "ddTrace.h"
+#include "ddConfig.h"
 #include "dataDiode.h"
 
 
-static uint16_t nb_rxd = RTE_TEST_RX_DESC_DEFAULT;
-static uint16_t nb_txd = RTE_TEST_TX_DESC_DEFAULT;
-
 static struct rte_eth_conf portConf;
 
-void
-ddPort::checkLinkStatus()
+// Inner headers of a de-capsulated frame the address rewrite touches
+struct rewriteHdrs_ {
+    struct ether_hdr *eth;
+    struct ipv4_hdr *ip4;
+    struct ipv6_hdr *ip6;
+    struct udp_hdr *udp;
+    uint16_t *l4Csum;       // UDP or TCP checksum, covers the addresses
+};
+
+// RFC 1624 incremental update of a one's complement checksum over len
+// bytes (even) that change from oldData to newData
+static inline uint16_t
+csumUpdate(uint16_t csum, const void *oldData, const void *newData, uint32_t len)
 {
-#define CHECK_INTERVAL 100 // 100ms
-#define MAX_CHECK_TIME 20  // 2s (20 * 100ms) in total
-    uint16_t portid;
-    uint8_t count, print_flag = 0;
-    struct rte_eth_link link;
+    const uint16_t *o = reinterpret_cast<const uint16_t *>(oldData);
+    const uint16_t *n = reinterpret_cast<const uint16_t *>(newData);
+    uint32_t sum = (uint16_t)~csum;
+    for (uint32_t i = 0; i < len / 2; i++)
+        sum += (uint16_t)~o[i] + n[i];
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
 
-    std::cout << "Checking link status for port " << _portId;
-    for (count = 0; count <= MAX_CHECK_TIME; count++) {
-        if (dataDiodeApp::instance().forceQuit())
+// find the headers and build the rule key of a frame, an untagged or
+// 802.1Q tagged IPv4/IPv6 frame in a single segment
+static void
+rewriteKey(struct rte_mbuf *pkt, struct rewriteHdrs_ *hdrs, struct ddRewriteKey_ *key)
+{
+    uint8_t *data = rte_pktmbuf_mtod(pkt, uint8_t *);
+    uint32_t dataLen = rte_pktmbuf_data_len(pkt);
+    uint32_t off = sizeof(struct ether_hdr);
+    uint8_t proto = 0;
+
+    memset(hdrs, 0, sizeof(*hdrs));
+    memset(key, 0, sizeof(*key));
+    hdrs->eth = reinterpret_cast<struct ether_hdr *>(data);
+    uint16_t etherType = hdrs->eth->ether_type;
+    if (etherType == rte_cpu_to_be_16(ETHER_TYPE_VLAN) &&
+        dataLen >= off + sizeof(struct vlan_hdr)) {
+        etherType = reinterpret_cast<struct vlan_hdr *>(data + off)->eth_proto;
+        off += sizeof(struct vlan_hdr);
+    }
+
+    if (etherType == rte_cpu_to_be_16(ETHER_TYPE_IPv4) &&
+        dataLen >= off + sizeof(struct ipv4_hdr)) {
+        hdrs->ip4 = reinterpret_cast<struct ipv4_hdr *>(data + off);
+        key->family = 4;
+        memcpy(key->dstAddr, &hdrs->ip4->dst_addr, sizeof(hdrs->ip4->dst_addr));
+        proto = hdrs->ip4->next_proto_id;
+        // L4 header only in the first fragment
+        if (0 != (hdrs->ip4->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK)))
             return;
+        off += (hdrs->ip4->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    } else if (etherType == rte_cpu_to_be_16(ETHER_TYPE_IPv6) &&
+               dataLen >= off + sizeof(struct ipv6_hdr)) {
+        hdrs->ip6 = reinterpret_cast<struct ipv6_hdr *>(data + off);
+        key->family = 6;
+        memcpy(key->dstAddr, hdrs->ip6->dst_addr, sizeof(hdrs->ip6->dst_addr));
+        // extension headers are not followed
+        proto = hdrs->ip6->proto;
+        off += sizeof(struct ipv6_hdr);
+    } else {
+        return;
+    }
 
-        bzero(&link, sizeof(link));
-        rte_eth_link_get_nowait(portid, &link);
-        // print link status if flag set
-        if (print_flag == 1) {
-            if (link.link_status)
-                std::cout << "Port " << _portId << " Link Up. Speed "
-                          << link.link_speed << " Mbps - "
-                          << ((link.link_duplex == ETH_LINK_FULL_DUPLEX) ?
-                                 ("full-duplex") : ("half-duplex"))
-                          << std::endl;
-            else
-                std::cout << "Port " << _portId << " Link Down" << std::endl;
-                continue;
-        }
+    if (IPPROTO_UDP == proto && dataLen >= off + sizeof(struct udp_hdr)) {
+        hdrs->udp = reinterpret_cast<struct udp_hdr *>(data + off);
+        hdrs->l4Csum = &hdrs->udp->dgram_cksum;
+        key->dstPort = hdrs->udp->dst_port;
+    } else if (IPPROTO_TCP == proto && dataLen >= off + sizeof(struct tcp_hdr)) {
+        hdrs->l4Csum = &reinterpret_cast<struct tcp_hdr *>(data + off)->cksum;
+    }
+}
 
-        std::cout << ".";
-        rte_delay_ms(CHECK_INTERVAL);
+bool
+ddPort::checkLinkStatus(bool log)
+{
+    struct rte_eth_link link;
 
-        // set the print_flag if all ports up or timeout
-        if (count == (MAX_CHECK_TIME - 1)) {
-            print_flag = 1;
-            std::cout << "done" << std::endl;
-        }
+    bzero(&link, sizeof(link));
+    rte_eth_link_get_nowait(_portId, &link);
+    bool up = link.link_status;
+    if (up != _linkUp) {
+        trace(DD_TRACE_LINK, 0, up);
+        if (!up)
+            _linkDowns++;
+        if (log && up)
+            RTE_LOG(WARNING, USER1, "Port %u link up, %u Mbps\n", _portId, link.link_speed);
+        else if (log)
+            RTE_LOG(ERR, USER1, "Port %u link down\n", _portId);
     }
+    _linkSpeed = link.link_speed;
+    // lcores see the change from their next frame on
+    _linkUp = up;
+    return up;
+}
+
+int
+ddPort::lscCallback(__attribute__((unused)) uint16_t portId,
+                    __attribute__((unused)) enum rte_eth_event_type type,
+                    void *param, __attribute__((unused)) void *retParam)
+{
+    // runs on the EAL interrupt thread, the link thread does the rest
+    ddPort *port = reinterpret_cast<ddPort *>(param);
+    port->_lscEvents++;
+    port->_lscPending = true;
+    return 0;
 }
 
 //static uint32_t rxQueuePerLcore = 1;
 
-ddPort::ddPort(uint16_t portId) :
-        _portId(portId), _txBuffer(NULL)
+ddPort::ddPort(uint16_t portId, ddInstance *diode) :
+        _portId(portId), _diode(diode), _txBuffer(NULL), _lscEvents(0), _lscPending(false),
+        _lscCapable(false), _linkUp(false), _linkDowns(0), _linkSpeed(0),
+        _rxMode(RXMODE_POLL), _dropFlow(NULL), _dropFlowCounted(false),
+        _drainTsc(0), _nextDrainTsc(0),
+        _tracedRxDropped(0), _tracedTxDropped(0), _tracedTxLinkDown(0),
+        _shedding(false), _shedByCount(false), _shedFrom(DD_SHED_CLASSES)
 {
+    bzero(_shedDesc, sizeof(_shedDesc));
+    bzero(_shed, sizeof(_shed));
     portConf.rxmode.split_hdr_size = 0;
     portConf.rxmode.ignore_offload_bitfield = 1;
     portConf.rxmode.offloads = DEV_RX_OFFLOAD_CRC_STRIP;
@@ -108,12 +201,30 @@ ddPort::initialize()
     if (_devInfo.tx_offload_capa & DEV_TX_OFFLOAD_MBUF_FAST_FREE) {
         _localPortConf.txmode.offloads |= DEV_TX_OFFLOAD_MBUF_FAST_FREE;
     }
-    int ret = rte_eth_dev_configure(_portId, 1, 1, &_localPortConf);
+    // link changes after startup are reported where the device can interrupt
+    if (rte_eth_devices[_portId].data->dev_flags & RTE_ETH_DEV_INTR_LSC) {
+        _lscCapable = true;
+        _localPortConf.intr_conf.lsc = 1;
+        rte_eth_dev_callback_register(_portId, RTE_ETH_EVENT_INTR_LSC,
+                                      ddPort::lscCallback, this);
+    }
+    // Nothing is received in the wrong direction, such a port gets no RX
+    // queue if the device allows for it, then the NIC drops what arrives
+    int ret = -1;
+    if (wrongDirection()) {
+        ret = rte_eth_dev_configure(_portId, 0, 1, &_localPortConf);
+        if (0 == ret)
+            _rxMode = RXMODE_NONE;
+    }
+    if (RXMODE_NONE != _rxMode)
+        ret = rte_eth_dev_configure(_portId, 1, 1, &_localPortConf);
     if (ret < 0)
         rte_exit(EXIT_FAILURE,
                  "Cannot configure device: err = %d, port = %u\n",
                  ret, _portId);
 
+    uint16_t nb_rxd = dataDiodeApp::instance().tuning().nbRxd;
+    uint16_t nb_txd = dataDiodeApp::instance().tuning().nbTxd;
     ret = rte_eth_dev_adjust_nb_rx_tx_desc(_portId, &nb_rxd, &nb_txd);
     if (ret < 0)
         rte_exit(EXIT_FAILURE,
@@ -126,13 +237,15 @@ ddPort::initialize()
     _rxqConf = _devInfo.default_rxconf;
 
     _rxqConf.offloads = portConf.rxmode.offloads;
-    ret = rte_eth_rx_queue_setup(_portId, 0, nb_rxd,
-                                 rte_eth_dev_socket_id(_portId),
-                                 &_rxqConf,
-                                 dataDiodeApp::instance().pktMbufPool());
-    if (ret < 0)
-        rte_exit(EXIT_FAILURE, "Port rx queue setup failed :err=%d, port=%u\n",
-                 ret, _portId);
+    if (RXMODE_NONE != _rxMode) {
+        ret = rte_eth_rx_queue_setup(_portId, 0, nb_rxd,
+                                     rte_eth_dev_socket_id(_portId),
+                                     &_rxqConf,
+                                     diode()->pktMbufPool());
+        if (ret < 0)
+            rte_exit(EXIT_FAILURE, "Port rx queue setup failed :err=%d, port=%u\n",
+                     ret, _portId);
+    }
 
     // init one TX queue on each port
     _txqConf = _devInfo.default_txconf;
@@ -145,6 +258,26 @@ ddPort::initialize()
         rte_exit(EXIT_FAILURE, "Port tx queue setup failed :err=%d, port=%u\n",
             ret, _portId);
 
+    initTxBuffer();
+    start();
+
+    // else a drop-all flow rule, or as last resort a rarely polled queue
+    if (wrongDirection() && RXMODE_POLL == _rxMode) {
+        _rxMode = installDropFlow() ? RXMODE_FLOW_DROP : RXMODE_DRAIN;
+        _drainTsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * DD_DRAIN_POLL_US;
+    }
+    // frames for other stations need not even reach the NIC queues then
+    if (!wrongDirection())
+        rte_eth_promiscuous_enable(_portId);
+    std::cout << "Port " << _portId << " receives by " << rxModeName() << std::endl;
+
+    // the link comes up in the background, dataDiodeApp waits for all ports at once
+    checkLinkStatus(false);
+}
+
+void
+ddPort::initTxBuffer()
+{
     /* Initialize TX buffers */
     _txBuffer = (rte_eth_dev_tx_buffer*)rte_zmalloc_socket("tx_buffer",
                                    RTE_ETH_TX_BUFFER_SIZE(MAX_PKT_BURST),
@@ -153,17 +286,361 @@ ddPort::initialize()
         rte_exit(EXIT_FAILURE, "Cannot allocate buffer for tx on port %u\n",
                  _portId);
 
-    rte_eth_tx_buffer_init(_txBuffer, MAX_PKT_BURST);
+    rte_eth_tx_buffer_init(_txBuffer, dataDiodeApp::instance().tuning().txBurst);
 
-    ret = rte_eth_tx_buffer_set_err_callback(_txBuffer,
-                                             rte_eth_tx_buffer_count_callback,
-                                             &_stats.txDropped);
+    int ret = rte_eth_tx_buffer_set_err_callback(_txBuffer,
+                                                 rte_eth_tx_buffer_count_callback,
+                                                 &_stats.txDropped);
     if (ret < 0)
         rte_exit(EXIT_FAILURE,
                  "Cannot set error callback for tx buffer on port %u\n",
                  _portId);
+}
+
+void
+ddPort::attach(uint32_t rxMode)
+{
+    std::cout << "Attaching to port " << _portId << " ..." << std::endl;
+
+    // queues, offloads and flow rules stay as the running instance set
+    // them up. Its drop rule is not ours to query, the NIC counters are.
+    // Link interrupts go to the primary process only, the link thread
+    // reads the link of every port regularly.
+    _rxMode = (RxMode)rxMode;
+    _drainTsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * DD_DRAIN_POLL_US;
+    rte_eth_macaddr_get(_portId, &_ethAddr);
+    initTxBuffer();
+    std::cout << "Port " << _portId << " receives by " << rxModeName() << std::endl;
+    checkLinkStatus(false);
+}
+
+void
+ddPort::trace(uint8_t type, uint8_t reason, uint32_t value)
+{
+    ddTrace *trace = dataDiodeApp::instance().trace();
+    if (NULL != trace)
+        trace->record(type, reason, _portId, value);
+}
+
+void
+ddPort::flushTx()
+{
+    if (unlikely(!_linkUp)) {
+        if (_txBuffer->length) {
+            _stats.txLinkDown += _txBuffer->length;
+            rte_eth_tx_buffer_count_callback(_txBuffer->pkts, _txBuffer->length,
+                                             &_stats.txDropped);
+            _txBuffer->length = 0;
+        }
+    } else {
+        uint16_t sent = rte_eth_tx_buffer_flush(_portId, 0, _txBuffer);
+        _stats.tx += sent;
+        if (sent)
+            trace(DD_TRACE_TX_FLUSH, 0, sent);
+    }
+
+    // drops since the last flush, by send() or the flush itself
+    if (unlikely(_stats.txDropped != _tracedTxDropped)) {
+        uint64_t linkDown = _stats.txLinkDown - _tracedTxLinkDown;
+        uint64_t other = _stats.txDropped - _tracedTxDropped - linkDown;
+        if (linkDown)
+            trace(DD_TRACE_DROP, DD_TRACE_DROP_TX_LINK_DOWN, linkDown);
+        if (other)
+            trace(DD_TRACE_DROP, DD_TRACE_DROP_TX, other);
+        _tracedTxDropped = _stats.txDropped;
+        _tracedTxLinkDown = _stats.txLinkDown;
+    }
+}
+
+void
+ddPort::setupTxQueue(uint16_t nbTxd)
+{
+    uint16_t nb_rxd = dataDiodeApp::instance().tuning().nbRxd;
+    rte_eth_dev_adjust_nb_rx_tx_desc(_portId, &nb_rxd, &nbTxd);
+
+    rte_eth_dev_stop(_portId);
+    int ret = rte_eth_tx_queue_setup(_portId, 0, nbTxd,
+                                     rte_eth_dev_socket_id(_portId),
+                                     &_txqConf);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Port tx queue setup failed :err=%d, port=%u\n",
+            ret, _portId);
     start();
-    rte_eth_promiscuous_enable(_portId);
+}
+
+void
+ddPort::setTxBurst(uint16_t txBurst)
+{
+    rte_eth_tx_buffer_flush(_portId, 0, _txBuffer);
+    // error callback set at initialization is kept
+    rte_eth_tx_buffer_init(_txBuffer, txBurst);
+}
+
+bool
+ddPort::installDropFlow()
+{
+    struct rte_flow_attr attr;
+    struct rte_flow_item pattern[2];
+    struct rte_flow_action actions[3];
+    struct rte_flow_action_count count;
+    struct rte_flow_error error;
+
+    bzero(&attr, sizeof(attr));
+    bzero(pattern, sizeof(pattern));
+    bzero(actions, sizeof(actions));
+    bzero(&count, sizeof(count));
+    attr.ingress = 1;
+    // any Ethernet frame
+    pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+    pattern[1].type = RTE_FLOW_ITEM_TYPE_END;
+
+    actions[0].type = RTE_FLOW_ACTION_TYPE_COUNT;
+    actions[0].conf = &count;
+    actions[1].type = RTE_FLOW_ACTION_TYPE_DROP;
+    actions[2].type = RTE_FLOW_ACTION_TYPE_END;
+    _dropFlow = rte_flow_create(_portId, &attr, pattern, actions, &error);
+    _dropFlowCounted = (NULL != _dropFlow);
+    if (NULL == _dropFlow) {
+        // not every NIC counts per rule, the port counters remain
+        _dropFlow = rte_flow_create(_portId, &attr, pattern, &actions[1], &error);
+    }
+    if (NULL == _dropFlow) {
+        RTE_LOG(INFO, USER1, "Port %u can not drop by flow rule: %s\n", _portId,
+                NULL == error.message ? "unsupported" : error.message);
+        return false;
+    }
+    return true;
+}
+
+const char*
+ddPort::rxModeName() const
+{
+    switch (_rxMode) {
+    case RXMODE_NONE:
+        return "none, no RX queue";
+    case RXMODE_FLOW_DROP:
+        return _dropFlowCounted ? "none, counted flow drop" : "none, flow drop";
+    case RXMODE_DRAIN:
+        return "low priority drain";
+    default:
+        return "poll";
+    }
+}
+
+uint64_t
+ddPort::wrongDirDrops()
+{
+    if (RXMODE_POLL == _rxMode)
+        return 0;
+
+    if (_dropFlowCounted) {
+        struct rte_flow_action_count count;
+        struct rte_flow_action action;
+        struct rte_flow_query_count query;
+        struct rte_flow_error error;
+        bzero(&count, sizeof(count));
+        bzero(&query, sizeof(query));
+        action.type = RTE_FLOW_ACTION_TYPE_COUNT;
+        action.conf = &count;
+        if (0 == rte_flow_query(_portId, _dropFlow, &action, &query, &error) && query.hits_set)
+            return query.hits;
+    }
+    // frames read by the drain or dropped by the NIC for lack of a queue
+    struct rte_eth_stats ethStats;
+    bzero(&ethStats, sizeof(ethStats));
+    rte_eth_stats_get(_portId, &ethStats);
+    return ethStats.ipackets + ethStats.imissed;
+}
+
+// Free a burst of frames nobody looked at, those of a single segment go
+// back to their pool in one put
+static void
+freeBulk(struct rte_mbuf **pkts, uint32_t n)
+{
+    struct rte_mbuf *bulk[MAX_PKT_BURST];
+    struct rte_mempool *pool = NULL;
+    uint32_t nFree = 0;
+
+    for (uint32_t j = 0; j < n; j++) {
+        struct rte_mbuf *pkt = pkts[j];
+        if (1 == pkt->nb_segs && (NULL == pool || pool == pkt->pool)) {
+            pkt = rte_pktmbuf_prefree_seg(pkt);
+            if (NULL != pkt) {
+                pool = pkt->pool;
+                bulk[nFree++] = pkt;
+            }
+        } else {
+            rte_pktmbuf_free(pkt);
+        }
+    }
+    if (nFree)
+        rte_mempool_put_bulk(pool, (void **)bulk, nFree);
+}
+
+uint32_t
+ddPort::drainRx()
+{
+    if (RXMODE_DRAIN != _rxMode)
+        return 0;
+    uint64_t now = rte_rdtsc();
+    if (likely(now < _nextDrainTsc))
+        return 0;
+    _nextDrainTsc = now + _drainTsc;
+
+    // a flood beyond what is drained here overflows the ring, the NIC
+    // counts those as missed
+    struct rte_mbuf *pktsBurst[MAX_PKT_BURST];
+    uint32_t nDrained = 0;
+    for (uint32_t i = 0; i < DD_DRAIN_MAX_BURSTS; i++) {
+        uint32_t nRx = rte_eth_rx_burst(_portId, 0, pktsBurst, MAX_PKT_BURST);
+        freeBulk(pktsBurst, nRx);
+        nDrained += nRx;
+        if (nRx < MAX_PKT_BURST)
+            break;
+    }
+    return nDrained;
+}
+
+void
+ddPort::compact(struct rte_mbuf **pkts, uint32_t n)
+{
+    struct rte_mempool *pool = dataDiodeApp::instance().smallMbufPool();
+    if (NULL == pool || 0 == n)
+        return;
+
+    uint32_t idx[MAX_PKT_BURST];
+    uint32_t nSmall = 0;
+    for (uint32_t j = 0; j < n; j++) {
+        if (pkts[j]->pkt_len <= SMALL_PACKET_SZ && 1 == pkts[j]->nb_segs)
+            idx[nSmall++] = j;
+    }
+    if (0 == nSmall)
+        return;
+
+    // small class exhausted, the frames keep their standard mbufs
+    struct rte_mbuf *small[MAX_PKT_BURST];
+    if (0 != rte_pktmbuf_alloc_bulk(pool, small, nSmall)) {
+        _stats.compactNoMbuf += nSmall;
+        trace(DD_TRACE_NO_MBUF, DD_TRACE_POOL_SMALL, nSmall);
+        return;
+    }
+
+    struct rte_mbuf *standard[MAX_PKT_BURST];
+    for (uint32_t k = 0; k < nSmall; k++) {
+        struct rte_mbuf *pkt = pkts[idx[k]];
+        struct rte_mbuf *copy = small[k];
+        rte_memcpy(rte_pktmbuf_mtod(copy, void *), rte_pktmbuf_mtod(pkt, void *),
+                   pkt->data_len);
+        copy->data_len = pkt->data_len;
+        copy->pkt_len = pkt->pkt_len;
+        copy->port = pkt->port;
+        copy->ol_flags = pkt->ol_flags;
+        copy->packet_type = pkt->packet_type;
+        copy->vlan_tci = pkt->vlan_tci;
+        copy->vlan_tci_outer = pkt->vlan_tci_outer;
+        copy->hash = pkt->hash;
+        copy->timestamp = pkt->timestamp;
+        copy->udata64 = pkt->udata64;
+        standard[k] = pkt;
+        pkts[idx[k]] = copy;
+    }
+    freeBulk(standard, nSmall);
+    _stats.compacted += nSmall;
+}
+
+uint32_t
+ddPort::handleRx()
+{
+    // nothing arrives on ports that only transmit
+    if (unlikely(RXMODE_POLL != _rxMode))
+        return drainRx();
+
+    struct rte_mbuf *pktsBurst[MAX_PKT_BURST];
+    uint32_t nRx = rte_eth_rx_burst(_portId, 0, pktsBurst,
+                                    dataDiodeApp::instance().tuning().rxBurst);
+
+    incRxStats(nRx);
+    if (nRx)
+        trace(DD_TRACE_RX_BURST, 0, nRx);
+    // before any other work on the frames, a burst that is not full
+    // means the ring was drained
+    if (unlikely(_shedding)) {
+        _shedFrom = (nRx == dataDiodeApp::instance().tuning().rxBurst) ?
+                    shedLevel() : DD_SHED_CLASSES;
+        if (_shedFrom < DD_SHED_CLASSES)
+            nRx = shed(pktsBurst, nRx);
+    }
+    compact(pktsBurst, nRx);
+    processBurst(pktsBurst, nRx);
+
+    // all the roles drop here is what arrives the wrong way
+    if (unlikely(_stats.rxDropped != _tracedRxDropped)) {
+        trace(DD_TRACE_DROP, DD_TRACE_DROP_WRONG_DIRECTION, _stats.rxDropped - _tracedRxDropped);
+        _tracedRxDropped = _stats.rxDropped;
+    }
+    return nRx;
+}
+
+void
+ddPort::setShedWatermarks(const uint8_t *pct)
+{
+    // the ring as the PMD set it up, not as asked for
+    struct rte_eth_rxq_info qinfo;
+    bzero(&qinfo, sizeof(qinfo));
+    uint16_t nbRxd = dataDiodeApp::instance().tuning().nbRxd;
+    if (0 == rte_eth_rx_queue_info_get(_portId, 0, &qinfo) && qinfo.nb_desc)
+        nbRxd = qinfo.nb_desc;
+    // descriptor status takes offsets below nbRxd - 1, so 100% is the last valid one
+    for (uint32_t c = 1; c < DD_SHED_CLASSES; c++) {
+        _shedDesc[c] = pct[c] ? RTE_MAX(RTE_MIN(nbRxd * pct[c] / 100, nbRxd - 1), 1) : 0;
+        _shedding = _shedding || pct[c];
+    }
+}
+
+uint8_t
+ddPort::shedLevel()
+{
+    // the highest watermark first, it sheds the most classes
+    int count = -1;
+    for (uint32_t c = 1; c < DD_SHED_CLASSES; c++) {
+        if (0 == _shedDesc[c])
+            continue;
+        if (!_shedByCount) {
+            // the descriptor that many frames behind the next one is done
+            int status = rte_eth_rx_descriptor_status(_portId, 0, _shedDesc[c] - 1);
+            if (RTE_ETH_RX_DESC_DONE == status)
+                return c;
+            if (-ENOTSUP != status)
+                continue;
+            _shedByCount = true;
+        }
+        // counting may walk the ring, once per burst at most
+        if (count < 0)
+            count = rte_eth_rx_queue_count(_portId, 0);
+        if (count >= _shedDesc[c])
+            return c;
+    }
+    return DD_SHED_CLASSES;
+}
+
+uint32_t
+ddPort::shed(struct rte_mbuf **pkts, uint32_t n)
+{
+    const ddConfig *config = diode()->config();
+    uint32_t kept = 0, nShed = 0;
+    for (uint32_t j = 0; j < n; j++) {
+        uint8_t cls = config->shedClass(pkts[j]);
+        if (cls >= _shedFrom) {
+            rte_pktmbuf_free(pkts[j]);
+            _shed[cls]++;
+            nShed++;
+        } else {
+            pkts[kept++] = pkts[j];
+        }
+    }
+    if (nShed)
+        trace(DD_TRACE_DROP, DD_TRACE_DROP_SHED, nShed);
+    return kept;
 }
 
 void
@@ -175,68 +652,384 @@ ddPort::start()
                  ret, _portId);
 }
 
+bool
+ddRxOnlyCorePort::validate(struct rte_mbuf *pkt, const ddConfig *config,
+                           const struct ether_addr *dstAddr, bool known, uint32_t senderIdx)
+{
+    bool errDetect = false;
+    ddCapture::Reason reason = ddCapture::REASON_FORWARDED;
+    struct tunnelHdr_ *tunnelHdr = rte_pktmbuf_mtod(pkt, struct tunnelHdr_ *);
+    const struct ddSender_ *sender = NULL;
+
+    // Verify the encapsulation of the received packet
+    uint32_t ret = memcmp(dstAddr, &(tunnelHdr->dAddr), sizeof(struct ether_addr));
+    if (0 != ret) {
+        errDetect = true;
+        reason = ddCapture::REASON_BAD_DST_ADDR;
+        incErrStatsBadDstAddr();
+    }
+
+    if (errDetect == false && !known) {
+        errDetect = true;
+        reason = ddCapture::REASON_BAD_SRC_ADDR;
+        incErrStatsBadSrcAddr();
+    } else if (errDetect == false) {
+        sender = config->sender(senderIdx);
+    }
+
+    if (errDetect == false &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_TUNNEL_ETHTYPE) &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_COMP_ETHTYPE) &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_FILE_ETHTYPE) &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_HEARTBEAT_ETHTYPE) &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_QUALIFY_ETHTYPE) &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_HC_REFRESH_ETHTYPE) &&
+        tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_HC_ETHTYPE)) {
+        errDetect = true;
+        reason = ddCapture::REASON_BAD_ETH_TYPE;
+        incErrStatsBadEthType();
+    }
+
+    if (errDetect == false && tunnelHdr->sId != sender->sId) {
+        errDetect = true;
+        reason = ddCapture::REASON_BAD_SID;
+        incErrStatsBadSId();
+        diode()->senderStats(sender->slot)->badSId++;
+    }
+
+    if (errDetect) {
+        _burstDrops[reason - 1]++;
+        ddCapture *capture = dataDiodeApp::instance().capture();
+        if (NULL != capture)
+            capture->tap(pkt, portId(), reason);
+        rte_pktmbuf_free(pkt);
+        return false;
+    }
+
+    struct ddSenderStats_ *senderStats = diode()->senderStats(sender->slot);
+    senderStats->rxPkts++;
+    senderStats->rxBytes += rte_pktmbuf_pkt_len(pkt);
+    pkt->udata64 = ddSenderTag(sender);
+    return true;
+}
+
+ddPort*
+ddRxOnlyCorePort::egressPortOf(uint64_t tag) const
+{
+    ddPort *egressPort = NULL;
+    if (likely(tag & DD_SENDER_TAG_VALID) && DD_SENDER_DEFAULT_PORT != ddSenderTagPort(tag))
+        egressPort = diode()->egressPort(ddSenderTagPort(tag));
+    return (NULL == egressPort) ? diode()->accessPort() : egressPort;
+}
+
+ddPort*
+ddRxOnlyCorePort::egress(struct rte_mbuf **pkt)
+{
+    uint64_t tag = (*pkt)->udata64;
+    ddPort *egressPort = egressPortOf(tag);
+    if (likely(tag & DD_SENDER_TAG_VALID)) {
+        if (0 != ddSenderTagVlan(tag)) {
+            (*pkt)->vlan_tci = ddSenderTagVlan(tag);
+            if (0 != rte_vlan_insert(pkt)) {
+                rte_pktmbuf_free(*pkt);
+                egressPort->incTxDropStats(1);
+                return NULL;
+            }
+        }
+        diode()->senderStats(ddSenderTagSlot(tag))->txPkts++;
+    }
+    return egressPort;
+}
+
 void
-ddRxOnlyCorePort::handleRx()
+ddRxOnlyCorePort::rewrite(struct rte_mbuf **pkts, uint32_t n, const ddConfig *config)
 {
-    struct rte_mbuf *pktsBurst[MAX_PKT_BURST];
-    uint32_t nRx = rte_eth_rx_burst(portId(), 0,
-                                    pktsBurst, MAX_PKT_BURST);
+    if (0 == config->nRewrites())
+        return;
 
-    incRxStats(nRx);
+    for (uint32_t base = 0; base < n; base += RTE_HASH_LOOKUP_BULK_MAX) {
+        uint32_t nBulk = RTE_MIN(n - base, (uint32_t)RTE_HASH_LOOKUP_BULK_MAX);
+        struct rewriteHdrs_ hdrs[RTE_HASH_LOOKUP_BULK_MAX];
+        struct ddRewriteKey_ keys[RTE_HASH_LOOKUP_BULK_MAX];
+        const void *keyPtrs[RTE_HASH_LOOKUP_BULK_MAX];
+        void *ruleIdx[RTE_HASH_LOOKUP_BULK_MAX];
+        uint64_t hits = 0;
+
+        for (uint32_t j = 0; j < nBulk; j++) {
+            rewriteKey(pkts[base + j], &hdrs[j], &keys[j]);
+            keyPtrs[j] = &keys[j];
+        }
+        config->lookupRewrites(keyPtrs, nBulk, &hits, ruleIdx);
+
+        // frames without a rule for their port fall back to the one of
+        // their address
+        uint32_t retry[RTE_HASH_LOOKUP_BULK_MAX];
+        uint32_t nRetry = 0;
+        for (uint32_t j = 0; j < nBulk; j++) {
+            if (0 == (hits & (1ULL << j)) && 0 != keys[j].dstPort) {
+                keys[j].dstPort = 0;
+                keyPtrs[nRetry] = &keys[j];
+                retry[nRetry++] = j;
+            }
+        }
+        if (nRetry) {
+            void *retryIdx[RTE_HASH_LOOKUP_BULK_MAX];
+            uint64_t retryHits = 0;
+            config->lookupRewrites(keyPtrs, nRetry, &retryHits, retryIdx);
+            for (uint32_t k = 0; k < nRetry; k++) {
+                if (retryHits & (1ULL << k)) {
+                    hits |= 1ULL << retry[k];
+                    ruleIdx[retry[k]] = retryIdx[k];
+                }
+            }
+        }
+
+        for (uint32_t j = 0; j < nBulk; j++) {
+            if (0 == (hits & (1ULL << j))) {
+                _rewriteMisses++;
+                continue;
+            }
+            const struct ddRewrite_ *rule = config->rewrite((uintptr_t)ruleIdx[j]);
+            struct rewriteHdrs_ *h = &hdrs[j];
+
+            // network B sees the egress port as the previous hop
+            if (rule->setDMac)
+                ether_addr_copy(&rule->dMac, &h->eth->d_addr);
+            ether_addr_copy(rule->setSMac ? &rule->sMac :
+                            egressPortOf(pkts[base + j]->udata64)->ethAddr(), &h->eth->s_addr);
 
+            // checksums are updated, not recomputed, UDP over IPv4 may have none
+            bool l4Csum = (NULL != h->l4Csum) &&
+                          (NULL != h->ip6 || NULL == h->udp || 0 != *h->l4Csum);
+            if (rule->setAddr) {
+                uint8_t *dstAddr = (NULL != h->ip4) ?
+                            reinterpret_cast<uint8_t *>(&h->ip4->dst_addr) : h->ip6->dst_addr;
+                uint32_t len = (NULL != h->ip4) ? 4 : 16;
+                if (NULL != h->ip4)
+                    h->ip4->hdr_checksum = csumUpdate(h->ip4->hdr_checksum, dstAddr,
+                                                      rule->dstAddr, len);
+                if (l4Csum)
+                    *h->l4Csum = csumUpdate(*h->l4Csum, dstAddr, rule->dstAddr, len);
+                memcpy(dstAddr, rule->dstAddr, len);
+            }
+            if (rule->setPort && NULL != h->udp) {
+                if (l4Csum)
+                    *h->l4Csum = csumUpdate(*h->l4Csum, &h->udp->dst_port, &rule->dstPort,
+                                            sizeof(rule->dstPort));
+                h->udp->dst_port = rule->dstPort;
+            }
+            // a UDP checksum of 0 means none
+            if (l4Csum && NULL != h->udp && 0 == *h->l4Csum)
+                *h->l4Csum = 0xFFFF;
+            _rewritten++;
+        }
+    }
+}
+
+void
+ddRxOnlyCorePort::processBurst(struct rte_mbuf **pktsBurst, uint32_t nRx)
+{
 #ifndef _DD_TESTMODE_
-    const struct ether_addr *dstAddr= dataDiodeApp::instance().corePortEthAddr();
+    const struct ether_addr *dstAddr= diode()->corePortEthAddr();
 #else
-    const struct ether_addr *dstAddr= dataDiodeApp::instance().corePortEthAddr(0);
+    const struct ether_addr *dstAddr= diode()->corePortEthAddr(0);
 #endif
     if (NULL == dstAddr) {
         rte_exit(EXIT_FAILURE,
                  "Unable to fetch MAC address of peer core Port. Exiting...\n");
     }
+    const ddConfig *config = diode()->config();
+    ddCrypto *crypto = dataDiodeApp::instance().crypto();
+    ddCapture *capture = dataDiodeApp::instance().capture();
+
+    // look up the senders of the whole burst at once
+    const void *srcAddrs[MAX_PKT_BURST];
+    void *senderIdx[MAX_PKT_BURST];
+    uint64_t senderHits = 0;
     for (uint32_t j = 0; j < nRx; j++) {
-        bool errDetect = false;
-        struct rte_mbuf * pkt = pktsBurst[j];
-        rte_prefetch0(rte_pktmbuf_mtod(pkt, void *));
-        struct tunnelHdr_ *tunnelHdr = rte_pktmbuf_mtod(pkt, struct tunnelHdr_ *);
+        rte_prefetch0(rte_pktmbuf_mtod(pktsBurst[j], void *));
+        srcAddrs[j] = &(rte_pktmbuf_mtod(pktsBurst[j], struct tunnelHdr_ *)->sAddr);
+    }
+    if (nRx)
+        config->lookupSenders(srcAddrs, nRx, &senderHits, senderIdx);
 
-        // Verify the encapsulation of the received packet
-        uint32_t ret = memcmp(dstAddr, &(tunnelHdr->dAddr), sizeof(struct ether_addr));
-        if (0 != ret) {
-            errDetect = true;
-            incErrStatsBadDstAddr();
-        }
+    struct rte_mbuf *validBurst[MAX_PKT_BURST];
+    uint32_t nValid = 0;
+    for (uint32_t j = 0; j < nRx; j++) {
+        if (validate(pktsBurst[j], config, dstAddr, senderHits & (1ULL << j),
+                     (uintptr_t)senderIdx[j]))
+            validBurst[nValid++] = pktsBurst[j];
+    }
+    if (unlikely(nValid != nRx))
+        traceDrops();
 
-#ifndef _DD_TESTMODE_
-        const struct ether_addr* peerCorePortEthAddr = dataDiodeApp::instance().peerCorePortEthAddr();
-#else
-        const struct ether_addr* peerCorePortEthAddr = dataDiodeApp::instance().peerCorePortEthAddr(0);
-#endif
-        ret = memcmp(peerCorePortEthAddr, &(tunnelHdr->sAddr), sizeof(struct ether_addr));
-        if (errDetect == false && 0 != ret) {
-            errDetect = true;
-            incErrStatsBadDstAddr();
-        }
+    if (NULL != crypto) {
+        // hand the burst over to the cryptodev and pick up whatever has
+        // finished in the meantime, never waiting for in-flight ops
+        crypto->enqueueBurst(ddCrypto::DIR_DECRYPT, validBurst, nValid);
+        nValid = crypto->dequeueBurst(ddCrypto::DIR_DECRYPT, validBurst, MAX_PKT_BURST);
+    }
 
-        if (errDetect == false && (tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_TUNNEL_ETHTYPE))) {
-            errDetect = true;
+    // De-capsulate packets, compressed ones go through decompression,
+    // file segments to the file writer, heartbeats and test frames never leave
+    ddCompress *compress = dataDiodeApp::instance().compress();
+    ddFileRx *fileRx = dataDiodeApp::instance().fileRx();
+    ddHeartbeat *heartbeat = dataDiodeApp::instance().heartbeat();
+    ddQualify *qualify = dataDiodeApp::instance().qualify();
+    ddHdrComp *hdrComp = dataDiodeApp::instance().hdrComp();
+    struct rte_mbuf *innerBurst[2 * MAX_PKT_BURST];
+    struct rte_mbuf *compBurst[MAX_PKT_BURST];
+    uint32_t hcIdx[MAX_PKT_BURST];
+    uint64_t hcRefresh = 0;
+    uint32_t nInner = 0, nComp = 0, nHc = 0;
+    for (uint32_t j = 0; j < nValid; j++) {
+        struct rte_mbuf * pkt = validBurst[j];
+        struct tunnelHdr_ *tunnelHdr = rte_pktmbuf_mtod(pkt, struct tunnelHdr_ *);
+        bool compressed = (tunnelHdr->etherType == rte_cpu_to_be_16(DATADIODE_COMP_ETHTYPE));
+        bool file = (tunnelHdr->etherType == rte_cpu_to_be_16(DATADIODE_FILE_ETHTYPE));
+        bool beat = (tunnelHdr->etherType == rte_cpu_to_be_16(DATADIODE_HEARTBEAT_ETHTYPE));
+        bool test = (tunnelHdr->etherType == rte_cpu_to_be_16(DATADIODE_QUALIFY_ETHTYPE));
+        bool hcRefreshed = (tunnelHdr->etherType == rte_cpu_to_be_16(DATADIODE_HC_REFRESH_ETHTYPE));
+        bool hc = hcRefreshed || (tunnelHdr->etherType == rte_cpu_to_be_16(DATADIODE_HC_ETHTYPE));
+
+        rte_pktmbuf_adj(pkt, sizeof(struct tunnelHdr_));
+        if (hc) {
+            // headers are rebuilt for the whole burst, in place
+            if (NULL != hdrComp) {
+                if (hcRefreshed)
+                    hcRefresh |= 1ULL << nHc;
+                hcIdx[nHc++] = nInner;
+                innerBurst[nInner++] = pkt;
+            } else {
+                rte_pktmbuf_free(pkt);
+                incErrStatsBadEthType();
+            }
+        } else if (beat) {
+            if (NULL != heartbeat)
+                heartbeat->receive(pkt);
+            else
+                rte_pktmbuf_free(pkt);
+        } else if (test) {
+            if (NULL != qualify) {
+                qualify->receive(pkt);
+            } else {
+                rte_pktmbuf_free(pkt);
+                incErrStatsBadEthType();
+            }
+        } else if (file) {
+            if (NULL != fileRx) {
+                fileRx->receive(pkt);
+            } else {
+                rte_pktmbuf_free(pkt);
+                incErrStatsBadEthType();
+            }
+        } else if (!compressed) {
+            innerBurst[nInner++] = pkt;
+        } else if (NULL != compress) {
+            compBurst[nComp++] = pkt;
+        } else {
+            // peer compresses but decompression is not enabled here
+            rte_pktmbuf_free(pkt);
             incErrStatsBadEthType();
         }
+    }
 
-        if (errDetect == false && tunnelHdr->sId != rte_cpu_to_be_16(dataDiodeApp::instance().peerSId())) {
-            errDetect = true;
-            incErrStatsBadSId();
+    if (nHc) {
+        hdrComp->decompress(innerBurst, hcIdx, nHc, hcRefresh);
+        uint32_t nKept = 0;
+        for (uint32_t j = 0; j < nInner; j++) {
+            if (NULL != innerBurst[j])
+                innerBurst[nKept++] = innerBurst[j];
         }
+        nInner = nKept;
+    }
 
-        if (errDetect) {
-            rte_pktmbuf_free(pkt);
+    if (NULL != compress) {
+        compress->enqueueBurst(ddCompress::DIR_DECOMPRESS, compBurst, nComp);
+        nInner += compress->dequeueBurst(ddCompress::DIR_DECOMPRESS, &innerBurst[nInner],
+                                         MAX_PKT_BURST);
+    }
+
+    // network B addressing, before the VLAN tag of the sender goes in
+    rewrite(innerBurst, nInner, config);
+
+    // transmit the inner frames on the access port of their sender,
+    // frames of the first access port go through the spill queue
+    // TODO: Add validations to validate inner frame
+    ddPort *accessPort = diode()->accessPort();
+    struct rte_mbuf *defaultBurst[2 * MAX_PKT_BURST];
+    uint32_t nDefault = 0;
+    for (uint32_t j = 0; j < nInner; j++) {
+        struct rte_mbuf *pkt = innerBurst[j];
+        ddPort *egressPort = egress(&pkt);
+        if (NULL == egressPort)
+            continue;
+
+        if (NULL != capture)
+            capture->tap(pkt, egressPort->portId(), ddCapture::REASON_FORWARDED);
+        if (egressPort == accessPort) {
+            defaultBurst[nDefault++] = pkt;
         } else {
-            // De-capsulate packet and transmit it on access port
-            struct ether_hdr* ethHdr = reinterpret_cast<struct ether_hdr*>(rte_pktmbuf_adj(pkt, sizeof(struct tunnelHdr_)));
-            // TODO: Add validations to validate inner frame
-            struct rte_eth_dev_tx_buffer* txBuf = dataDiodeApp::instance().accessPort()->txBuffer();
-            uint16_t sent = rte_eth_tx_buffer(dataDiodeApp::instance().accessPort()->portId(),
-                                              0, txBuf, pkt);
-            dataDiodeApp::instance().accessPort()->incTxStats(sent);
+            egressPort->send(pkt);
+        }
+    }
+
+    ddSpill *spill = dataDiodeApp::instance().spill();
+    if (NULL != spill) {
+        // send straight to the NIC so that nothing overtakes spilled frames,
+        // whatever it does not accept goes behind them into the spill, all
+        // of it while the access link is down
+        uint32_t sent = 0, nSent = 0;
+        if (accessPort->linkUp())
+            sent = spill->drain(accessPort->portId(), diode()->pktMbufPool());
+        if (nDefault && spill->empty() && accessPort->linkUp())
+            nSent = rte_eth_tx_burst(accessPort->portId(), 0, defaultBurst, nDefault);
+        spill->enqueue(&defaultBurst[nSent], nDefault - nSent);
+        accessPort->incTxStats(sent + nSent);
+        return;
+    }
+
+    for (uint32_t j = 0; j < nDefault; j++)
+        accessPort->send(defaultBurst[j]);
+}
+
+ddPort*
+ddRxOnlyCorePort::processEvent(struct rte_mbuf **pkt)
+{
+#ifndef _DD_TESTMODE_
+    const struct ether_addr *dstAddr= diode()->corePortEthAddr();
+#else
+    const struct ether_addr *dstAddr= diode()->corePortEthAddr(0);
+#endif
+    const ddConfig *config = diode()->config();
+    const void *srcAddr = &(rte_pktmbuf_mtod(*pkt, struct tunnelHdr_ *)->sAddr);
+    void *senderIdx = NULL;
+    uint64_t senderHits = 0;
+    config->lookupSenders(&srcAddr, 1, &senderHits, &senderIdx);
+    if (!validate(*pkt, config, dstAddr, senderHits & 1, (uintptr_t)senderIdx)) {
+        traceDrops();
+        return NULL;
+    }
+
+    // the other frame types need stages that do not run on event workers
+    struct tunnelHdr_ *tunnelHdr = rte_pktmbuf_mtod(*pkt, struct tunnelHdr_ *);
+    if (tunnelHdr->etherType != rte_cpu_to_be_16(DATADIODE_TUNNEL_ETHTYPE)) {
+        rte_pktmbuf_free(*pkt);
+        incErrStatsBadEthType();
+        return NULL;
+    }
+    rte_pktmbuf_adj(*pkt, sizeof(struct tunnelHdr_));
+    rewrite(pkt, 1, config);
+    return egress(pkt);
+}
+
+void
+ddRxOnlyCorePort::traceDrops()
+{
+    for (uint32_t r = 0; r < RTE_DIM(_burstDrops); r++) {
+        if (_burstDrops[r]) {
+            trace(DD_TRACE_DROP, r + 1, _burstDrops[r]);
+            _burstDrops[r] = 0;
         }
     }
 }
@@ -247,18 +1040,15 @@ ddRxOnlyCorePort::handleTx()
     // If a packet reaches for Tx on Rx-Only coreport, it may be suspicious
     // Report it and drop the packet
     if (txBuffer()->length) {
+        trace(DD_TRACE_DROP, DD_TRACE_DROP_TX, txBuffer()->length);
         rte_eth_tx_buffer_count_callback(txBuffer()->pkts, txBuffer()->length, &(stats()->txDropped));
+        txBuffer()->length = 0;
     }
 }
 
 void
-ddTxOnlyCorePort::handleRx()
+ddTxOnlyCorePort::processBurst(struct rte_mbuf **pktsBurst, uint32_t nRx)
 {
-    struct rte_mbuf *pktsBurst[MAX_PKT_BURST];
-    uint32_t nRx = rte_eth_rx_burst(portId(), 0,
-                                    pktsBurst, MAX_PKT_BURST);
-
-    incRxStats(nRx);
     // Shouldn't process anything on this port, drop it if anything is received
     for (uint32_t j = 0; j < nRx; j++) {
         bool errDetect = false;
@@ -269,94 +1059,237 @@ ddTxOnlyCorePort::handleRx()
     }
 }
 
-void
-ddTxOnlyCorePort::handleTx()
+ddPort*
+ddTxOnlyCorePort::processEvent(struct rte_mbuf **pkt)
 {
-    uint32_t sent = rte_eth_tx_buffer_flush(portId(), 0, txBuffer());
-    if (sent) {
-        incTxStats(sent);
-    }
+    rte_pktmbuf_free(*pkt);
+    incRxDropStats(1);
+    return NULL;
 }
 
 void
-ddAccessPort::handleRx()
+ddTxOnlyCorePort::handleTx()
 {
-    struct rte_mbuf *pktsBurst[MAX_PKT_BURST];
-    uint32_t nRx = rte_eth_rx_burst(portId(), 0,
-                                    pktsBurst, MAX_PKT_BURST);
-
-    incRxStats(nRx);
+    flushTx();
+}
 
+uint32_t
+ddAccessPort::encapsulate(struct rte_mbuf **pkts, uint32_t nPkts,
+                          uint16_t etherType, struct rte_mbuf **tunnelPkts)
+{
+    const ddConfig *config = diode()->config();
 #ifndef _DD_TESTMODE_
-    const struct ether_addr *dstAddr= dataDiodeApp::instance().peerCorePortEthAddr();
-    const struct ether_addr *srcAddr= dataDiodeApp::instance().corePortEthAddr();
+    const struct ether_addr *dstAddr= config->peerCorePortEthAddr();
+    const struct ether_addr *srcAddr= diode()->corePortEthAddr();
 #else
-    const struct ether_addr *dstAddr= dataDiodeApp::instance().peerCorePortEthAddr(0);
-    const struct ether_addr *srcAddr= dataDiodeApp::instance().corePortEthAddr(1);
+    const struct ether_addr *dstAddr= config->peerCorePortEthAddr(0);
+    const struct ether_addr *srcAddr= diode()->corePortEthAddr(1);
 #endif
     if (NULL == dstAddr) {
         rte_exit(EXIT_FAILURE,
                  "Unable to fetch MAC address of peer core Port. Exiting...\n");
     }
-    for (uint32_t j = 0; j < nRx; j++) {
-        struct rte_mbuf * pkt = pktsBurst[j];
-        rte_prefetch0(rte_pktmbuf_mtod(pkt, void *));
+    ddCrypto *crypto = dataDiodeApp::instance().crypto();
+    uint16_t cryptoHdrLen = (NULL == crypto) ? 0 : crypto->hdrLen();
+    uint16_t sId = rte_cpu_to_be_16(config->sId());
+    uint32_t nTunnel = 0;
+
+    for (uint32_t j = 0; j < nPkts; j++) {
+        struct rte_mbuf * pkt = pkts[j];
 
-        // if corePort is configured for Tx-Only role, forward the packet
         // original packet is tunneled under an l2 encapsulation
-        // <DMAC 6B|SMAC 6B|ETYPE (4004) 4B|SID 4B|ORIGINALPKT|FCS>
+        // <DMAC 6B|SMAC 6B|ETYPE (4004) 2B|SID 2B|ORIGINALPKT|FCS>
         // DMAC: Destination MAC address
         // SMAC: Source MAC address
         // ETYPE : Ethertype set to 0x4004 (Unregistered with IANA)
+        //         0x4005 when the original packet is behind a compression header
+        //         0x4006 for file segments, 0x4007 for heartbeats,
+        //         0x4008 for link qualification test frames,
+        //         0x4009 and 0x400A for header compression refreshes and
+        //         frames with compressed headers
         // SID: Secure ID of the Tx-only device
+        // When payload encryption is enabled a crypto header follows SID
+        // and the original packet is padded and followed by a digest
+        struct tunnelHdr_ *tunnelHdr = reinterpret_cast<struct tunnelHdr_*>(
+                    rte_pktmbuf_prepend(pkt, sizeof(struct tunnelHdr_) + cryptoHdrLen));
+        if (NULL == tunnelHdr) {
+            rte_pktmbuf_free(pkt);
+            incTxDropStats(1);
+            continue;
+        }
+        ether_addr_copy(dstAddr, &tunnelHdr->dAddr);
+        ether_addr_copy(srcAddr, &tunnelHdr->sAddr);
+        tunnelHdr->etherType = rte_be_to_cpu_16(etherType);
+        tunnelHdr->sId = sId;
+        tunnelPkts[nTunnel++] = pkt;
+    }
+    return nTunnel;
+}
+
+void
+ddAccessPort::processBurst(struct rte_mbuf **pktsBurst, uint32_t nRx)
+{
+    const ddConfig *config = diode()->config();
+    ddCompress *compress = dataDiodeApp::instance().compress();
+    ddCapture *capture = dataDiodeApp::instance().capture();
+    ddTopTalkers *topTalkers = dataDiodeApp::instance().topTalkers();
+    if (NULL != topTalkers)
+        topTalkers->update(pktsBurst, nRx);
+
+    struct rte_mbuf *innerBurst[MAX_PKT_BURST];
+    struct rte_mbuf *compBurst[MAX_PKT_BURST];
+    uint32_t nInner = 0, nComp = 0;
+    for (uint32_t j = 0; j < nRx; j++) {
+        struct rte_mbuf * pkt = pktsBurst[j];
+        rte_prefetch0(rte_pktmbuf_mtod(pkt, void *));
+
+        // if corePort is configured for Tx-Only role, forward the packet
 #ifndef _DD_TESTMODE_
-        if (dataDiodeApp::PORTMODE_TX == dataDiodeApp::instance().corePortMode()) {
+        if (dataDiodeApp::PORTMODE_TX == diode()->corePortMode()) {
 #else
-        if (dataDiodeApp::PORTMODE_BIDIR == dataDiodeApp::instance().corePortMode() &&
+        if (dataDiodeApp::PORTMODE_BIDIR == diode()->corePortMode() &&
             portId() == 4) {
 #endif
-            struct tunnelHdr_ *tunnelHdr = reinterpret_cast<struct tunnelHdr_*>(
-                        rte_pktmbuf_prepend(pkt, sizeof(struct tunnelHdr_)));
-            if (NULL == tunnelHdr) {
-                rte_pktmbuf_free(pkt);
-                incTxDropStats(1);
-                continue;
+            if (NULL != capture)
+                capture->tap(pkt, portId(), ddCapture::REASON_FORWARDED);
+            if (NULL != compress && compress->channelEnabled(config, pkt)) {
+                compBurst[nComp++] = pkt;
+            } else {
+                innerBurst[nInner++] = pkt;
             }
-            ether_addr_copy(dstAddr, &tunnelHdr->dAddr);
-            ether_addr_copy(srcAddr, &tunnelHdr->sAddr);
-            tunnelHdr->etherType = rte_be_to_cpu_16(DATADIODE_TUNNEL_ETHTYPE);
-            tunnelHdr->sId = rte_be_to_cpu_16(dataDiodeApp::instance().sId());
-
-            // put the packet into the tx buffer of core port
 #ifndef _DD_TESTMODE_
-            struct rte_eth_dev_tx_buffer* txBuf = dataDiodeApp::instance().corePort()->txBuffer();
-            uint16_t sent = rte_eth_tx_buffer(dataDiodeApp::instance().corePortId(),
-                                              0, txBuf, pkt);
-            dataDiodeApp::instance().corePort()->incTxStats(sent);
+        } else if (dataDiodeApp::PORTMODE_RX == diode()->corePortMode()) {
 #else
-            struct rte_eth_dev_tx_buffer* txBuf = dataDiodeApp::instance().corePort(dataDiodeApp::PORTMODE_TX)->txBuffer();
-            uint16_t sent = rte_eth_tx_buffer(1, 0, txBuf, pkt);
-            dataDiodeApp::instance().corePort(dataDiodeApp::PORTMODE_TX)->incTxStats(sent);
-#endif
-
-#ifndef _DD_TESTMODE_
-        } else if (dataDiodeApp::PORTMODE_RX == dataDiodeApp::instance().corePortMode()) {
-#else
-        } else if (dataDiodeApp::PORTMODE_BIDIR == dataDiodeApp::instance().corePortMode() &&
+        } else if (dataDiodeApp::PORTMODE_BIDIR == diode()->corePortMode() &&
                 portId() == 3) {
 #endif
             // if corePort is configured for Rx-Only role, drop the packet
+            if (NULL != capture)
+                capture->tap(pkt, portId(), ddCapture::REASON_WRONG_DIRECTION);
             rte_pktmbuf_free(pkt);
             incRxDropStats(1);
         }
     }
+
+    struct rte_mbuf *tunnelBurst[4 * MAX_PKT_BURST + 1];
+    uint32_t nTunnel = 0;
+    ddHdrComp *hdrComp = dataDiodeApp::instance().hdrComp();
+    if (NULL != hdrComp) {
+        // runs of frames with the same result keep their order, a refresh
+        // goes before the frames compressed against it
+        static const uint16_t etherTypes[] = {
+            DATADIODE_TUNNEL_ETHTYPE, DATADIODE_HC_REFRESH_ETHTYPE, DATADIODE_HC_ETHTYPE
+        };
+        uint8_t results[MAX_PKT_BURST];
+        hdrComp->compress(portId(), innerBurst, nInner, results);
+        for (uint32_t j = 0, k; j < nInner; j = k) {
+            for (k = j + 1; k < nInner && results[k] == results[j]; k++)
+                ;
+            nTunnel += encapsulate(&innerBurst[j], k - j, etherTypes[results[j]],
+                                   &tunnelBurst[nTunnel]);
+        }
+    } else {
+        nTunnel = encapsulate(innerBurst, nInner, DATADIODE_TUNNEL_ETHTYPE, tunnelBurst);
+    }
+
+    // file segments share the tunnel with the access traffic, at their own rate
+    ddFileTx *fileTx = dataDiodeApp::instance().fileTx();
+    if (NULL != fileTx && this == diode()->accessPort() &&
+#ifndef _DD_TESTMODE_
+        dataDiodeApp::PORTMODE_TX == diode()->corePortMode()) {
+#else
+        portId() == 4) {
+#endif
+        struct rte_mbuf *fileBurst[MAX_PKT_BURST];
+        uint32_t nFile = fileTx->dequeueBurst(fileBurst, MAX_PKT_BURST);
+        nTunnel += encapsulate(fileBurst, nFile, DATADIODE_FILE_ETHTYPE, &tunnelBurst[nTunnel]);
+    }
+
+    // and so do heartbeats, sent even when there is no traffic at all
+    ddHeartbeat *heartbeat = dataDiodeApp::instance().heartbeat();
+    if (NULL != heartbeat && this == diode()->accessPort() &&
+#ifndef _DD_TESTMODE_
+        dataDiodeApp::PORTMODE_TX == diode()->corePortMode()) {
+#else
+        portId() == 4) {
+#endif
+        struct rte_mbuf *beat = heartbeat->poll();
+        if (NULL != beat)
+            nTunnel += encapsulate(&beat, 1, DATADIODE_HEARTBEAT_ETHTYPE, &tunnelBurst[nTunnel]);
+    }
+
+    // qualification test frames at the rate of the current step
+    ddQualify *qualify = dataDiodeApp::instance().qualify();
+    if (NULL != qualify && this == diode()->accessPort() &&
+#ifndef _DD_TESTMODE_
+        dataDiodeApp::PORTMODE_TX == diode()->corePortMode()) {
+#else
+        portId() == 4) {
+#endif
+        struct rte_mbuf *testBurst[MAX_PKT_BURST];
+        uint32_t nTest = qualify->poll(testBurst, MAX_PKT_BURST);
+        nTunnel += encapsulate(testBurst, nTest, DATADIODE_QUALIFY_ETHTYPE, &tunnelBurst[nTunnel]);
+    }
+
+    if (NULL != compress) {
+        // compressed channels are encapsulated once they leave the stage
+        compress->enqueueBurst(ddCompress::DIR_COMPRESS, compBurst, nComp);
+        nComp = compress->dequeueBurst(ddCompress::DIR_COMPRESS, compBurst, MAX_PKT_BURST);
+        nTunnel += encapsulate(compBurst, nComp, DATADIODE_COMP_ETHTYPE, &tunnelBurst[nTunnel]);
+    }
+
+    ddCrypto *crypto = dataDiodeApp::instance().crypto();
+    if (NULL != crypto) {
+        // encryption runs asynchronously, keep polling while ops are in flight
+        crypto->enqueueBurst(ddCrypto::DIR_ENCRYPT, tunnelBurst, nTunnel);
+        nTunnel = crypto->dequeueBurst(ddCrypto::DIR_ENCRYPT, tunnelBurst, RTE_DIM(tunnelBurst));
+    }
+
+    // put the packets into the tx buffer of core port
+#ifndef _DD_TESTMODE_
+    ddPort *corePort = diode()->corePort();
+#else
+    ddPort *corePort = diode()->corePort(dataDiodeApp::PORTMODE_TX);
+#endif
+    for (uint32_t j = 0; j < nTunnel; j++)
+        corePort->send(tunnelBurst[j]);
+}
+
+bool
+ddAccessPort::wrongDirection() const
+{
+#ifndef _DD_TESTMODE_
+    return dataDiodeApp::PORTMODE_RX == diode()->corePortMode();
+#else
+    return portId() == 3;
+#endif
+}
+
+ddPort*
+ddAccessPort::processEvent(struct rte_mbuf **pkt)
+{
+#ifndef _DD_TESTMODE_
+    if (dataDiodeApp::PORTMODE_TX == diode()->corePortMode()) {
+        ddPort *corePort = diode()->corePort();
+#else
+    if (portId() == 4) {
+        ddPort *corePort = diode()->corePort(dataDiodeApp::PORTMODE_TX);
+#endif
+        struct rte_mbuf *tunnelPkt;
+        if (0 == encapsulate(pkt, 1, DATADIODE_TUNNEL_ETHTYPE, &tunnelPkt))
+            return NULL;
+        *pkt = tunnelPkt;
+        return corePort;
+    }
+
+    // nothing enters the diode from the access port of the Rx-Only role
+    rte_pktmbuf_free(*pkt);
+    incRxDropStats(1);
+    return NULL;
 }
 
 void
 ddAccessPort::handleTx()
 {
-    uint32_t sent = rte_eth_tx_buffer_flush(portId(), 0, txBuffer());
-    if (sent) {
-        incTxStats(sent);
-    }
+    flushTx();
 }
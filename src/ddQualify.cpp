@@ -0,0 +1,344 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_atomic.h>
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+#include "ddQualify.h"
+#include "ddPort.h"
+#include "dataDiode.h"
+
+
+// RFC 2544 frame sizes for Ethernet
+const uint16_t ddQualify::frameSizes[DD_QUALIFY_N_SIZES] = {
+    64, 128, 256, 512, 1024, 1280, 1518
+};
+
+// TSC ticks to nanoseconds without overflowing on long uptimes
+static inline uint64_t
+tscToNs(uint64_t tsc, uint64_t hz)
+{
+    return (tsc / hz) * NS_PER_S + (tsc % hz) * NS_PER_S / hz;
+}
+
+ddQualify::ddQualify(uint32_t stepMs) :
+        _stepMs(stepMs ? stepMs : DD_QUALIFY_STEP_MS), _sender(false), _receiver(false),
+        _pool(NULL),
+        _startTsc(0), _stepTsc(0), _slotTsc(0),
+        _step(-1), _pps(0), _stepSent(0), _endSent(false), _finished(false),
+        _sent(0), _noMbuf(0),
+        _rxStep(-1), _nDone(0), _badFrames(0), _late(0)
+{
+    memset(_results, 0, sizeof(_results));
+}
+
+void
+ddQualify::initialize(struct rte_mempool *pool, bool sender, bool receiver)
+{
+    uint64_t hz = rte_get_tsc_hz();
+    _pool = pool;
+    _sender = sender;
+    _receiver = receiver;
+    _stepTsc = hz / 1000 * _stepMs;
+    _slotTsc = hz / 1000 * (_stepMs + DD_QUALIFY_GAP_MS);
+    _startTsc = rte_rdtsc() + hz / 1000 * DD_QUALIFY_START_MS;
+
+    for (uint32_t step = 0; step < DD_QUALIFY_STEPS; step++) {
+        _results[step].frameSize = stepSize(step);
+        _results[step].ratePct = stepRate(step);
+    }
+
+    std::cout << "Initializing link qualification, " << DD_QUALIFY_STEPS << " steps of "
+              << _stepMs << " ms ..." << std::endl;
+}
+
+void
+ddQualify::cleanup()
+{
+    // steps in progress when stopped are reported as they are
+    if (_receiver && _rxStep >= 0 && !_results[_rxStep].done)
+        finish(_rxStep);
+    if (_receiver && _nDone) {
+        std::cout << "=================== Data Diode IN4004 Link Qualification ========================"
+                  << std::endl;
+        report(true);
+        std::cout << "================================================================================="
+                  << std::endl;
+    }
+}
+
+uint32_t
+ddQualify::build(struct rte_mbuf **pkts, uint32_t n, uint8_t type, uint32_t seq)
+{
+    if (0 != rte_pktmbuf_alloc_bulk(_pool, pkts, n)) {
+        _noMbuf += n;
+        return 0;
+    }
+
+    // the core link frame is the tunnel header and this payload, FCS included
+    uint16_t frameSize = stepSize(_step);
+    uint16_t len = frameSize - ETHER_CRC_LEN - sizeof(struct ddPort::tunnelHdr_);
+    uint64_t tsc = rte_rdtsc();
+    for (uint32_t j = 0; j < n; j++) {
+        char *data = rte_pktmbuf_append(pkts[j], len);
+        if (NULL == data) {
+            for (uint32_t k = j; k < n; k++)
+                rte_pktmbuf_free(pkts[k]);
+            _noMbuf += n - j;
+            return j;
+        }
+        memset(data, 0, len);
+        struct ddQualifyHdr_ *hdr = reinterpret_cast<struct ddQualifyHdr_ *>(data);
+        hdr->step = rte_cpu_to_be_16(_step);
+        hdr->frameSize = rte_cpu_to_be_16(frameSize);
+        hdr->ratePct = stepRate(_step);
+        hdr->type = type;
+        hdr->seq = rte_cpu_to_be_32(DD_QUALIFY_TYPE_END == type ? seq : seq + j);
+        hdr->tsc = rte_cpu_to_be_64(tsc);
+        hdr->tscHz = rte_cpu_to_be_64(rte_get_tsc_hz());
+    }
+    return n;
+}
+
+uint32_t
+ddQualify::poll(struct rte_mbuf **pkts, uint32_t max)
+{
+    uint64_t now = rte_rdtsc();
+    if (likely(_finished || now < _startTsc))
+        return 0;
+
+    uint64_t elapsed = now - _startTsc;
+    uint32_t step = elapsed / _slotTsc;
+    uint64_t phase = elapsed % _slotTsc;
+
+    // the step before has ended, tell the Rx-Only side what was sent
+    if ((int32_t)step != _step && _step >= 0 && !_endSent) {
+        _endSent = true;
+        return build(pkts, RTE_MIN((uint32_t)DD_QUALIFY_END_COPIES, max),
+                     DD_QUALIFY_TYPE_END, _stepSent);
+    }
+    if (step >= DD_QUALIFY_STEPS) {
+        _finished = true;
+        RTE_LOG(INFO, USER1, "Link qualification finished, %lu frames sent\n",
+                (unsigned long)_sent);
+        return 0;
+    }
+
+    if ((int32_t)step != _step) {
+#ifndef _DD_TESTMODE_
+        ddPort *corePort = dataDiodeApp::instance().corePort();
+#else
+        ddPort *corePort = dataDiodeApp::instance().corePort(dataDiodeApp::PORTMODE_TX);
+#endif
+        uint64_t mbps = corePort->linkSpeed() ? corePort->linkSpeed() : DD_QUALIFY_DEFAULT_MBPS;
+        // bits on the wire include preamble and inter frame gap
+        _step = step;
+        _pps = mbps * 1000000 / 100 * stepRate(step) / ((stepSize(step) + 20) * 8);
+        _stepSent = 0;
+        _endSent = false;
+    }
+
+    // frames due so far in this step, none once it is over
+    if (phase >= _stepTsc)
+        phase = _stepTsc;
+    uint64_t due = phase * _pps / rte_get_tsc_hz();
+    if (due <= _stepSent)
+        return 0;
+
+    uint32_t n = build(pkts, RTE_MIN(due - _stepSent, (uint64_t)max), DD_QUALIFY_TYPE_DATA,
+                       _stepSent);
+    _stepSent += n;
+    _sent += n;
+    return n;
+}
+
+void
+ddQualify::finish(uint32_t step)
+{
+    rte_smp_wmb();
+    _results[step].done = true;
+    _nDone++;
+}
+
+void
+ddQualify::receive(struct rte_mbuf *pkt)
+{
+    uint64_t now = rte_rdtsc();
+    const struct ddQualifyHdr_ *hdr = rte_pktmbuf_mtod(pkt, const struct ddQualifyHdr_ *);
+    uint32_t step = (rte_pktmbuf_data_len(pkt) < sizeof(struct ddQualifyHdr_)) ?
+                DD_QUALIFY_STEPS : rte_be_to_cpu_16(hdr->step);
+    if (unlikely(step >= DD_QUALIFY_STEPS || 0 == hdr->tscHz || !_receiver)) {
+        _badFrames++;
+        rte_pktmbuf_free(pkt);
+        return;
+    }
+
+    // frames of a step already reported, or the END copies
+    struct result_ *r = &_results[step];
+    if ((int32_t)step < _rxStep || r->done) {
+        if ((int32_t)step < _rxStep && DD_QUALIFY_TYPE_DATA == hdr->type)
+            _late++;
+        rte_pktmbuf_free(pkt);
+        return;
+    }
+
+    // the first frame of the next step closes the current one, its END
+    // frames may all have been lost
+    if ((int32_t)step != _rxStep) {
+        if (_rxStep >= 0 && !_results[_rxStep].done)
+            finish(_rxStep);
+        _rxStep = step;
+    }
+
+    uint32_t seq = rte_be_to_cpu_32(hdr->seq);
+    if (DD_QUALIFY_TYPE_END == hdr->type) {
+        r->sent = seq;
+        r->sentKnown = true;
+        finish(step);
+        rte_pktmbuf_free(pkt);
+        return;
+    }
+
+    // clocks of both sides are not synchronized, the delays have an
+    // unknown offset and only their variation is meaningful
+    int64_t delayNs = (int64_t)tscToNs(now, rte_get_tsc_hz()) -
+                (int64_t)tscToNs(rte_be_to_cpu_64(hdr->tsc), rte_be_to_cpu_64(hdr->tscHz));
+    if (!r->started) {
+        r->started = true;
+        r->firstRxTsc = now;
+        r->firstDelayNs = delayNs;
+        r->minDelayNs = r->maxDelayNs = 0;
+    }
+    delayNs -= r->firstDelayNs;
+    r->minDelayNs = RTE_MIN(r->minDelayNs, delayNs);
+    r->maxDelayNs = RTE_MAX(r->maxDelayNs, delayNs);
+    r->sumDelayNs += delayNs;
+    if (seq < r->nextSeq)
+        r->reordered++;
+    else
+        r->nextSeq = seq + 1;
+    r->lastRxTsc = now;
+    r->received++;
+    rte_pktmbuf_free(pkt);
+}
+
+int32_t
+ddQualify::lossFreeRate(uint32_t size) const
+{
+    int32_t best = -2;
+    for (uint32_t rate = 0; rate < DD_QUALIFY_N_RATES; rate++) {
+        const struct result_ *r = &_results[size * DD_QUALIFY_N_RATES + rate];
+        if (!r->done)
+            continue;
+        if (best < -1)
+            best = -1;
+        if (r->sentKnown && r->sent && r->received >= r->sent)
+            best = r->ratePct;
+    }
+    return best;
+}
+
+void
+ddQualify::printResult(uint32_t step) const
+{
+    const uint32_t colWidth = 10;
+    const struct result_ *r = &_results[step];
+
+    std::cout << std::setw(6) << step
+              << std::setw(6) << r->frameSize
+              << std::setw(6) << (uint32_t)r->ratePct;
+    if (r->sentKnown)
+        std::cout << std::setw(3 + colWidth) << r->sent;
+    else
+        std::cout << std::setw(3 + colWidth) << "-";
+    std::cout << std::setw(3 + colWidth) << r->received;
+    if (r->sentKnown && r->sent)
+        std::cout << std::setw(8) << std::fixed << std::setprecision(3)
+                  << (r->received >= r->sent ? 0.0 :
+                      100.0 * (r->sent - r->received) / r->sent);
+    else
+        std::cout << std::setw(8) << "-";
+
+    // throughput on the wire, over the arrival time of the step
+    double secs = (double)(r->lastRxTsc - r->firstRxTsc) / rte_get_tsc_hz();
+    double mbps = 0.0;
+    if (r->received > 1 && secs > 0.0)
+        mbps = (double)(r->received - 1) * (r->frameSize + 20) * 8 / secs / 1e6;
+    std::cout << std::setw(3 + colWidth) << std::fixed << std::setprecision(1) << mbps;
+
+    // latencies above the lowest one seen in the step
+    if (r->received)
+        std::cout << std::setw(colWidth) << std::setprecision(1)
+                  << ((double)r->sumDelayNs / r->received - r->minDelayNs) / 1000
+                  << std::setw(colWidth) << (double)(r->maxDelayNs - r->minDelayNs) / 1000;
+    else
+        std::cout << std::setw(colWidth) << "-" << std::setw(colWidth) << "-";
+    std::cout << std::setw(colWidth) << r->reordered << std::endl;
+    std::cout << std::resetiosflags(std::ios::fixed) << std::setprecision(6);
+}
+
+void
+ddQualify::report(bool all) const
+{
+    const uint32_t colWidth = 10;
+
+    std::cout << std::setw(6) << "Step"
+              << std::setw(6) << "Size"
+              << std::setw(6) << "Rate%"
+              << std::setw(3 + colWidth) << "Sent"
+              << std::setw(3 + colWidth) << "Received"
+              << std::setw(8) << "Loss%"
+              << std::setw(3 + colWidth) << "Mbps"
+              << std::setw(colWidth) << "Lat us"
+              << std::setw(colWidth) << "Max us"
+              << std::setw(colWidth) << "Reorder" << std::endl;
+    // all steps when done, the periodic statistics just the latest one
+    int32_t last = -1;
+    for (uint32_t step = 0; step < DD_QUALIFY_STEPS; step++) {
+        if (!_results[step].done)
+            continue;
+        rte_smp_rmb();
+        if (all)
+            printResult(step);
+        last = step;
+    }
+    if (!all && last >= 0)
+        printResult(last);
+
+    // RFC 2544 throughput: the highest rate without any loss, per size
+    std::cout << "Loss-free rate:";
+    for (uint32_t size = 0; size < DD_QUALIFY_N_SIZES; size++) {
+        int32_t best = lossFreeRate(size);
+        if (best < -1)
+            continue;
+        std::cout << " " << frameSizes[size] << "B ";
+        if (best < 0)
+            std::cout << "none";
+        else
+            std::cout << best << "%";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,225 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_ethdev.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include "ddSpill.h"
+
+
+// record header in front of every frame, zero marks padding up to the end
+#define DD_SPILL_HDR_SZ             sizeof(uint32_t)
+#define DD_SPILL_REC_SZ(len)        RTE_ALIGN_CEIL(DD_SPILL_HDR_SZ + (len), 8)
+
+// drain bursts per call, keeps the lcore polling RX while the queue is long
+#define DD_SPILL_DRAIN_ROUNDS       4
+
+ddSpill::ddSpill(uint64_t memMb, uint64_t fileMb, const char *filePath) :
+        _memSz(memMb << 20), _fileSz(fileMb << 20), _filePath(filePath), _fd(-1)
+{
+    bzero(&_mem, sizeof(_mem));
+    bzero(&_file, sizeof(_file));
+    bzero(&_stats, sizeof(_stats));
+}
+
+bool
+ddSpill::parseSize(const char *arg, uint64_t *memMb, uint64_t *fileMb)
+{
+    char *end = NULL;
+    *memMb = strtoul(arg, &end, 10);
+    *fileMb = DD_SPILL_FILE_MB;
+    if (end == arg)
+        return false;
+    if (':' == *end) {
+        const char *fileArg = end + 1;
+        *fileMb = strtoul(fileArg, &end, 10);
+        if (end == fileArg)
+            return false;
+    }
+    return '\0' == *end && (*memMb || *fileMb);
+}
+
+void
+ddSpill::initialize()
+{
+    std::cout << "Initializing spill queue of " << (_memSz >> 20) << "MB memory and "
+              << (_fileSz >> 20) << "MB file ..." << std::endl;
+
+    if (_memSz) {
+        _mem.base = (uint8_t *)rte_malloc_socket("dd_spill", _memSz,
+                                                 RTE_CACHE_LINE_SIZE, rte_socket_id());
+        if (NULL == _mem.base)
+            rte_exit(EXIT_FAILURE, "Cannot allocate %luMB spill queue\n",
+                     (unsigned long)(_memSz >> 20));
+        _mem.size = _memSz;
+    }
+
+    if (_fileSz) {
+        // contents do not survive a restart, the file is only overflow space
+        _fd = open(_filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (_fd < 0 || 0 != ftruncate(_fd, _fileSz))
+            rte_exit(EXIT_FAILURE, "Cannot create spill file %s: %s\n",
+                     _filePath.c_str(), strerror(errno));
+        void *addr = mmap(NULL, _fileSz, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (MAP_FAILED == addr)
+            rte_exit(EXIT_FAILURE, "Cannot map spill file %s: %s\n",
+                     _filePath.c_str(), strerror(errno));
+        madvise(addr, _fileSz, MADV_SEQUENTIAL);
+        _file.base = (uint8_t *)addr;
+        _file.size = _fileSz;
+    }
+}
+
+void
+ddSpill::cleanup()
+{
+    if (_memSz) {
+        rte_free(_mem.base);
+    }
+    if (_fileSz) {
+        munmap(_file.base, _fileSz);
+        close(_fd);
+        unlink(_filePath.c_str());
+    }
+}
+
+bool
+ddSpill::put(struct ring_ *ring, const struct rte_mbuf *pkt)
+{
+    if (0 == ring->size)
+        return false;
+
+    uint32_t len = rte_pktmbuf_pkt_len(pkt);
+    uint64_t need = DD_SPILL_REC_SZ(len);
+    uint64_t pos = ring->tail % ring->size;
+    uint64_t toEnd = ring->size - pos;
+    uint64_t pad = (toEnd < need) ? toEnd : 0;
+
+    if (ring->tail + pad + need - ring->head > ring->size)
+        return false;
+
+    // records never wrap, the rest of the buffer is skipped instead
+    if (pad) {
+        *reinterpret_cast<uint32_t *>(ring->base + pos) = 0;
+        ring->tail += pad;
+        pos = 0;
+    }
+    *reinterpret_cast<uint32_t *>(ring->base + pos) = len;
+    uint8_t *data = ring->base + pos + DD_SPILL_HDR_SZ;
+    const uint8_t *src = (const uint8_t *)rte_pktmbuf_read(pkt, 0, len, data);
+    if (src != data)
+        rte_memcpy(data, src, len);
+    ring->tail += need;
+    ring->frames++;
+    return true;
+}
+
+uint32_t
+ddSpill::peek(const struct ring_ *ring, struct rte_mempool *pool,
+              struct rte_mbuf **pkts, uint64_t *heads, uint32_t n)
+{
+    uint64_t head = ring->head;
+    uint32_t i = 0;
+
+    while (i < n && head != ring->tail) {
+        uint64_t pos = head % ring->size;
+        uint32_t len = *reinterpret_cast<uint32_t *>(ring->base + pos);
+        if (0 == len) {
+            head += ring->size - pos;
+            continue;
+        }
+        struct rte_mbuf *pkt = rte_pktmbuf_alloc(pool);
+        if (NULL == pkt)
+            break;
+        rte_memcpy(rte_pktmbuf_append(pkt, len), ring->base + pos + DD_SPILL_HDR_SZ, len);
+        head += DD_SPILL_REC_SZ(len);
+        heads[i] = head;
+        pkts[i++] = pkt;
+    }
+    return i;
+}
+
+uint32_t
+ddSpill::drainRing(struct ring_ *ring, uint16_t portId, struct rte_mempool *pool)
+{
+    struct rte_mbuf *pkts[DD_SPILL_DRAIN_BURST];
+    uint64_t heads[DD_SPILL_DRAIN_BURST];
+
+    uint32_t n = peek(ring, pool, pkts, heads, DD_SPILL_DRAIN_BURST);
+    uint32_t sent = rte_eth_tx_burst(portId, 0, pkts, n);
+
+    // frames not accepted stay queued, their copies are released
+    for (uint32_t i = sent; i < n; i++)
+        rte_pktmbuf_free(pkts[i]);
+    if (sent) {
+        ring->head = heads[sent - 1];
+        ring->frames -= sent;
+        if (0 == ring->frames)
+            ring->head = ring->tail;
+    }
+    return sent;
+}
+
+void
+ddSpill::enqueue(struct rte_mbuf **pkts, uint32_t nPkts)
+{
+    for (uint32_t i = 0; i < nPkts; i++) {
+        // once frames overflowed into the file newer ones have to follow them
+        bool queued = (0 == _file.frames) && put(&_mem, pkts[i]);
+        if (!queued && put(&_file, pkts[i])) {
+            queued = true;
+            _stats.fileSpilled++;
+        }
+        if (queued)
+            _stats.spilled++;
+        else
+            _stats.dropped++;
+        rte_pktmbuf_free(pkts[i]);
+    }
+    _stats.peakBytes = RTE_MAX(_stats.peakBytes, memBytes() + fileBytes());
+}
+
+uint32_t
+ddSpill::drain(uint16_t portId, struct rte_mempool *pool)
+{
+    uint32_t total = 0;
+
+    // memory holds the oldest frames, the file the newer ones
+    for (uint32_t round = 0; round < DD_SPILL_DRAIN_ROUNDS && !empty(); round++) {
+        struct ring_ *ring = _mem.frames ? &_mem : &_file;
+        uint32_t sent = drainRing(ring, portId, pool);
+        total += sent;
+        if (sent < DD_SPILL_DRAIN_BURST)
+            break;
+    }
+    _stats.drained += total;
+    return total;
+}
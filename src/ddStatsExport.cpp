@@ -0,0 +1,525 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_memzone.h>
+#include <rte_mempool.h>
+#include <rte_ethdev.h>
+#include <rte_string_fns.h>
+#include "ddPort.h"
+#include "ddCrypto.h"
+#include "ddCompress.h"
+#include "ddCapture.h"
+#include "ddSpill.h"
+#include "ddFileXfer.h"
+#include "ddHeartbeat.h"
+#include "ddQualify.h"
+#include "ddHandoff.h"
+#include "ddTrace.h"
+#include "ddHdrComp.h"
+#include "ddEventDev.h"
+#include "ddStatsExport.h"
+#include "ddInstance.h"
+#include "dataDiode.h"
+
+
+static uint64_t
+wallClockNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+ddStatsExport::ddStatsExport() :
+        _mz(NULL), _shm(NULL), _lastNs(0), _laidOut(false)
+{
+    bzero(_nXstats, sizeof(_nXstats));
+}
+
+void
+ddStatsExport::initialize()
+{
+    // an instance taking over publishes into the memzone of the running one
+    _mz = rte_memzone_lookup(DD_STATS_MZ_NAME);
+    if (NULL == _mz)
+        _mz = rte_memzone_reserve(DD_STATS_MZ_NAME, sizeof(struct ddStatsShm_),
+                                  rte_socket_id(), 0);
+    if (NULL == _mz)
+        rte_exit(EXIT_FAILURE, "Cannot reserve memzone %s for statistics\n",
+                 DD_STATS_MZ_NAME);
+
+    _shm = reinterpret_cast<struct ddStatsShm_ *>(_mz->addr);
+
+    // the running instance keeps publishing until it handed off its ports
+    if (!dataDiodeApp::instance().handoff()->takeover())
+        layout();
+
+    int ret = rte_ctrl_thread_create(&_thread, "dd-stats", NULL,
+                                     ddStatsExport::exportMain, this);
+    if (ret != 0)
+        rte_exit(EXIT_FAILURE, "Cannot start statistics thread: err = %d\n", ret);
+}
+
+void
+ddStatsExport::layout()
+{
+    // a write section like update(), the sequence of an instance handing
+    // off goes on so readers never see a torn block as complete
+    _shm->seq |= 1;
+    rte_smp_wmb();
+    bzero(&_shm->intervalMs,
+          sizeof(struct ddStatsShm_) - offsetof(struct ddStatsShm_, intervalMs));
+    _shm->magic = DD_STATS_MAGIC;
+    _shm->version = DD_STATS_VERSION;
+    _shm->intervalMs = DD_STATS_INTERVAL_MS;
+    _shm->startNs = _lastNs = wallClockNs();
+
+    dataDiodeApp &app = dataDiodeApp::instance();
+    const ddPortMap &pMap = app.portMap();
+    for (ddPortMap::const_iterator it = pMap.begin();
+         it != pMap.end() && _shm->nPorts < DD_STATS_MAX_PORTS; ++it) {
+        struct ddStatsPort_ *sp = &_shm->ports[_shm->nPorts];
+        uint32_t idx = _shm->nPorts++;
+        ddPort *port = it->second;
+
+        sp->portId = port->portId();
+        sp->nRxQueues = port->nbRxQueues();
+        sp->nTxQueues = port->nbTxQueues();
+        snprintf(sp->name, sizeof(sp->name), "%s", port->devName());
+        snprintf(sp->role, sizeof(sp->role), "%s", port->roleName());
+
+        // xstat names do not change, fetch them once
+        int n = rte_eth_xstats_get_names(sp->portId, NULL, 0);
+        if (n > 0) {
+            struct rte_eth_xstat_name *names = new struct rte_eth_xstat_name[n];
+            n = rte_eth_xstats_get_names(sp->portId, names, n);
+            _nXstats[idx] = RTE_MIN((uint32_t)RTE_MAX(n, 0), (uint32_t)DD_STATS_MAX_XSTATS);
+            for (uint32_t i = 0; i < _nXstats[idx]; i++)
+                snprintf(sp->xstats[i].name, sizeof(sp->xstats[i].name), "%s", names[i].name);
+            delete [] names;
+        }
+        sp->nXstats = _nXstats[idx];
+        rte_eth_stats_get(sp->portId, &sp->eth);
+    }
+
+#ifndef _DD_TESTMODE_
+    if (app.nInstances() > 1)
+        snprintf(_shm->mode, sizeof(_shm->mode), "multi");
+    else
+        snprintf(_shm->mode, sizeof(_shm->mode), "%s",
+                 (dataDiodeApp::PORTMODE_RX == app.corePortMode()) ? "rx-only" : "tx-only");
+#else
+    snprintf(_shm->mode, sizeof(_shm->mode), "test");
+#endif
+
+    rte_smp_wmb();
+    _shm->seq++;
+    _laidOut = true;
+}
+
+void
+ddStatsExport::cleanup()
+{
+    pthread_join(_thread, NULL);
+}
+
+void*
+ddStatsExport::exportMain(void *arg)
+{
+    reinterpret_cast<ddStatsExport *>(arg)->exportLoop();
+    return NULL;
+}
+
+void
+ddStatsExport::exportLoop()
+{
+    while (!dataDiodeApp::instance().forceQuit()) {
+        usleep(DD_STATS_INTERVAL_MS * 1000);
+        // the running instance publishes until it handed off its ports,
+        // the one taking over from when it took them
+        ddHandoff *handoff = dataDiodeApp::instance().handoff();
+        if (handoff->handedOff() || handoff->takeover())
+            continue;
+        if (!_laidOut)
+            layout();
+        update();
+    }
+}
+
+void
+ddStatsExport::updateRate(struct ddStatsRate_ *rate, uint64_t pkts,
+                          uint64_t bytes, uint64_t dtNs)
+{
+    double pps = (double)pkts * 1e9 / dtNs;
+    // count preamble, SFD, IFG and FCS as seen on the wire
+    double bps = (double)(bytes + pkts * 24) * 8 * 1e9 / dtNs;
+
+    rate->pps = DD_STATS_EWMA_ALPHA * pps + (1 - DD_STATS_EWMA_ALPHA) * rate->pps;
+    rate->bps = DD_STATS_EWMA_ALPHA * bps + (1 - DD_STATS_EWMA_ALPHA) * rate->bps;
+    rate->ppsPeak = RTE_MAX(rate->ppsPeak, pps);
+    rate->bpsPeak = RTE_MAX(rate->bpsPeak, bps);
+}
+
+void
+ddStatsExport::updatePort(struct ddStatsPort_ *sp, uint64_t dtNs)
+{
+    ddPort *port = dataDiodeApp::instance().portMap().find(sp->portId)->second;
+
+    // counters of the forwarding lcores are read, never reset or locked
+    sp->rx = port->rxStats();
+    sp->tx = port->txStats();
+    sp->rxDropped = port->rxDropStats() + port->wrongDirDrops();
+    sp->txDropped = port->txDropStats();
+    sp->badSrcAddr = port->errStatsBadSrcAddr();
+    sp->badDstAddr = port->errStatsBadDstAddr();
+    sp->badEthType = port->errStatsBadEthType();
+    sp->badSId = port->errStatsBadSIdr();
+
+    struct rte_eth_stats ethStats;
+    if (0 == rte_eth_stats_get(sp->portId, &ethStats)) {
+        updateRate(&sp->rxRate, ethStats.ipackets - sp->eth.ipackets,
+                   ethStats.ibytes - sp->eth.ibytes, dtNs);
+        updateRate(&sp->txRate, ethStats.opackets - sp->eth.opackets,
+                   ethStats.obytes - sp->eth.obytes, dtNs);
+        sp->eth = ethStats;
+    }
+
+    uint32_t idx = sp - _shm->ports;
+    if (_nXstats[idx]) {
+        struct rte_eth_xstat xstats[DD_STATS_MAX_XSTATS];
+        int n = rte_eth_xstats_get(sp->portId, xstats, _nXstats[idx]);
+        for (int i = 0; i < n && i < (int)_nXstats[idx]; i++)
+            sp->xstats[i].value = xstats[i].value;
+    }
+}
+
+void
+ddStatsExport::addCounter(const char *name, uint64_t value)
+{
+    if (_shm->nCounters >= DD_STATS_MAX_COUNTERS)
+        return;
+    struct ddStatsCounter_ *c = &_shm->counters[_shm->nCounters++];
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->value = value;
+}
+
+void
+ddStatsExport::update()
+{
+    static const char *cryptoDir[] = { "encrypt", "decrypt" };
+    static const char *compressDir[] = { "compress", "decompress" };
+    dataDiodeApp &app = dataDiodeApp::instance();
+    uint64_t now = wallClockNs();
+    uint64_t dtNs = RTE_MAX(now - _lastNs, (uint64_t)1);
+    char name[DD_STATS_NAME_SZ];
+    _lastNs = now;
+
+    // readers retry while the sequence is odd
+    _shm->seq++;
+    rte_smp_wmb();
+
+    for (uint32_t i = 0; i < _shm->nPorts; i++)
+        updatePort(&_shm->ports[i], dtNs);
+
+    _shm->nCounters = 0;
+    addCounter("config_generation", app.configGeneration());
+    addCounter("config_reloads", app.configReloads());
+    addCounter("config_reload_errors", app.configReloadErrors());
+    ddCrypto *crypto = app.crypto();
+    for (int dir = 0; NULL != crypto && dir < ddCrypto::DIR_MAX; dir++) {
+        ddCrypto::Direction d = static_cast<ddCrypto::Direction>(dir);
+        snprintf(name, sizeof(name), "crypto_%s_enqueued", cryptoDir[dir]);
+        addCounter(name, crypto->enqueued(d));
+        snprintf(name, sizeof(name), "crypto_%s_dequeued", cryptoDir[dir]);
+        addCounter(name, crypto->dequeued(d));
+        snprintf(name, sizeof(name), "crypto_%s_enq_dropped", cryptoDir[dir]);
+        addCounter(name, crypto->enqDropped(d));
+        snprintf(name, sizeof(name), "crypto_%s_auth_failed", cryptoDir[dir]);
+        addCounter(name, crypto->authFailed(d));
+        snprintf(name, sizeof(name), "crypto_%s_op_failed", cryptoDir[dir]);
+        addCounter(name, crypto->opFailed(d));
+    }
+    ddCompress *compress = app.compress();
+    for (int dir = 0; NULL != compress && dir < ddCompress::DIR_MAX; dir++) {
+        ddCompress::Direction d = static_cast<ddCompress::Direction>(dir);
+        snprintf(name, sizeof(name), "%s_in", compressDir[dir]);
+        addCounter(name, compress->in(d));
+        snprintf(name, sizeof(name), "%s_processed", compressDir[dir]);
+        addCounter(name, compress->processed(d));
+        snprintf(name, sizeof(name), "%s_bypassed", compressDir[dir]);
+        addCounter(name, compress->bypassed(d));
+        snprintf(name, sizeof(name), "%s_dropped", compressDir[dir]);
+        addCounter(name, compress->dropped(d));
+        snprintf(name, sizeof(name), "%s_errors", compressDir[dir]);
+        addCounter(name, compress->errors(d));
+    }
+    ddCapture *capture = app.capture();
+    if (NULL != capture) {
+        addCounter("capture_captured", capture->captured());
+        addCounter("capture_dropped", capture->dropped());
+        addCounter("capture_written", capture->written());
+        addCounter("capture_write_errors", capture->writeErrors());
+    }
+    ddSpill *spill = app.spill();
+    if (NULL != spill) {
+        addCounter("spill_mem_bytes", spill->memBytes());
+        addCounter("spill_mem_frames", spill->memFrames());
+        addCounter("spill_file_bytes", spill->fileBytes());
+        addCounter("spill_file_frames", spill->fileFrames());
+        addCounter("spill_peak_bytes", spill->peakBytes());
+        addCounter("spill_spilled", spill->spilled());
+        addCounter("spill_file_spilled", spill->fileSpilled());
+        addCounter("spill_drained", spill->drained());
+        addCounter("spill_dropped", spill->dropped());
+    }
+    uint32_t lcoreId;
+    RTE_LCORE_FOREACH(lcoreId) {
+        const struct dataDiodeApp::lcoreCycles *cycles = app.lcoreCycles(lcoreId);
+        snprintf(name, sizeof(name), "lcore%u_rx_cycles", lcoreId);
+        addCounter(name, cycles->rx);
+        snprintf(name, sizeof(name), "lcore%u_tx_cycles", lcoreId);
+        addCounter(name, cycles->tx);
+        snprintf(name, sizeof(name), "lcore%u_stats_cycles", lcoreId);
+        addCounter(name, cycles->stats);
+        snprintf(name, sizeof(name), "lcore%u_idle_cycles", lcoreId);
+        addCounter(name, cycles->idle);
+        snprintf(name, sizeof(name), "lcore%u_pkts", lcoreId);
+        addCounter(name, cycles->pkts);
+        snprintf(name, sizeof(name), "lcore%u_stalls", lcoreId);
+        addCounter(name, app.lcoreStalls(lcoreId));
+        if (app.scale()) {
+            snprintf(name, sizeof(name), "lcore%u_parked", lcoreId);
+            addCounter(name, app.lcoreParked(lcoreId));
+            snprintf(name, sizeof(name), "lcore%u_parks", lcoreId);
+            addCounter(name, app.lcoreParks(lcoreId));
+        }
+    }
+    if (app.scale())
+        addCounter("scale_port_moves", app.portMoves());
+    // counters of the instances are prefixed with their names if there
+    // is more than one
+    bool multi = app.nInstances() > 1;
+    struct rte_mempool *pools[DD_MAX_INSTANCES + 1];
+    const char *classNames[DD_MAX_INSTANCES + 1];
+    uint32_t nPools = 0;
+    for (uint32_t i = 0; i < app.nInstances(); i++) {
+        ddInstance *diode = app.diode(i);
+        classNames[nPools] = multi ? diode->name() : "standard";
+        pools[nPools++] = diode->pktMbufPool();
+        if (!multi)
+            continue;
+        uint64_t rx = 0, tx = 0, dropped = 0;
+        const ddPortMap &ports = app.portMap();
+        for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+            if (it->second->diode() != diode)
+                continue;
+            rx += it->second->rxStats();
+            tx += it->second->txStats();
+            dropped += it->second->rxDropStats() + it->second->wrongDirDrops() +
+                       it->second->txDropStats();
+        }
+        snprintf(name, sizeof(name), "instance_%s_rx", diode->name());
+        addCounter(name, rx);
+        snprintf(name, sizeof(name), "instance_%s_tx", diode->name());
+        addCounter(name, tx);
+        snprintf(name, sizeof(name), "instance_%s_dropped", diode->name());
+        addCounter(name, dropped);
+        snprintf(name, sizeof(name), "instance_%s_mbufs_in_use", diode->name());
+        addCounter(name, rte_mempool_in_use_count(diode->pktMbufPool()));
+    }
+    classNames[nPools] = "small";
+    pools[nPools++] = app.smallMbufPool();
+    for (uint32_t i = 0; i < nPools; i++) {
+        if (NULL == pools[i])
+            continue;
+        snprintf(name, sizeof(name), "mempool_%s_size", classNames[i]);
+        addCounter(name, pools[i]->size);
+        snprintf(name, sizeof(name), "mempool_%s_in_use", classNames[i]);
+        addCounter(name, rte_mempool_in_use_count(pools[i]));
+        snprintf(name, sizeof(name), "mempool_%s_bytes", classNames[i]);
+        addCounter(name, dataDiodeApp::mempoolBytes(pools[i]));
+    }
+    ddEventDev *eventDev = app.eventDev();
+    RTE_LCORE_FOREACH(lcoreId) {
+        if (NULL == eventDev)
+            break;
+        const struct ddEventDev::lcoreStats_ *stats = eventDev->stats(lcoreId);
+        snprintf(name, sizeof(name), "event%u_in", lcoreId);
+        addCounter(name, eventDev->worker(lcoreId) ? stats->worked : stats->rx);
+        snprintf(name, sizeof(name), "event%u_dropped", lcoreId);
+        addCounter(name, stats->rxDropped + stats->txDropped);
+        snprintf(name, sizeof(name), "event%u_tx", lcoreId);
+        addCounter(name, stats->tx);
+        snprintf(name, sizeof(name), "event%u_latency_tsc", lcoreId);
+        addCounter(name, stats->latencyTsc);
+    }
+    ddFileTx *fileTx = app.fileTx();
+    if (NULL != fileTx) {
+        addCounter("file_tx_files", fileTx->filesSent());
+        addCounter("file_tx_segments", fileTx->segments());
+        addCounter("file_tx_bytes", fileTx->bytes());
+        addCounter("file_tx_read_errors", fileTx->readErrors());
+    }
+    ddFileRx *fileRx = app.fileRx();
+    if (NULL != fileRx) {
+        addCounter("file_rx_segments", fileRx->segments());
+        addCounter("file_rx_dropped", fileRx->dropped());
+        addCounter("file_rx_bad_segments", fileRx->badSegments());
+        addCounter("file_rx_committed", fileRx->committed());
+        addCounter("file_rx_crc_errors", fileRx->crcErrors());
+        addCounter("file_rx_expired", fileRx->expired());
+        addCounter("file_rx_write_errors", fileRx->writeErrors());
+        addCounter("file_rx_too_large", fileRx->tooLarge());
+    }
+    ddHeartbeat *heartbeat = app.heartbeat();
+    if (NULL != heartbeat) {
+        addCounter("heartbeat_sent", heartbeat->sent());
+        addCounter("heartbeat_received", heartbeat->received());
+        addCounter("heartbeat_bad", heartbeat->badFrames());
+        addCounter("heartbeat_alarms", heartbeat->alarms());
+    }
+    ddQualify *qualify = app.qualify();
+    if (NULL != qualify) {
+        addCounter("qualify_sent", qualify->sent());
+        addCounter("qualify_no_mbuf", qualify->noMbuf());
+        addCounter("qualify_steps_done", qualify->stepsDone());
+        addCounter("qualify_late", qualify->late());
+        addCounter("qualify_bad", qualify->badFrames());
+        for (uint32_t size = 0; size < DD_QUALIFY_N_SIZES; size++) {
+            int32_t rate = qualify->lossFreeRate(size);
+            if (rate < -1)
+                continue;
+            snprintf(name, sizeof(name), "qualify_%uB_loss_free_pct", ddQualify::frameSizes[size]);
+            addCounter(name, rate < 0 ? 0 : rate);
+        }
+    }
+    ddHdrComp *hdrComp = app.hdrComp();
+    if (NULL != hdrComp) {
+        addCounter("hc_tx_compressed", hdrComp->txCompressed());
+        addCounter("hc_tx_refreshes", hdrComp->txRefreshes());
+        addCounter("hc_tx_plain", hdrComp->txPlain());
+        addCounter("hc_tx_saved_bytes", hdrComp->txSavedBytes());
+        addCounter("hc_rx_rebuilt", hdrComp->rxDecompressed());
+        addCounter("hc_rx_refreshes", hdrComp->rxRefreshes());
+        addCounter("hc_rx_no_context", hdrComp->rxNoContext());
+        addCounter("hc_rx_bad", hdrComp->rxBadFrames());
+    }
+    uint64_t shed[DD_SHED_CLASSES];
+    bzero(shed, sizeof(shed));
+    bool shedding = false;
+    for (uint16_t portId = 0; portId < RTE_MAX_ETHPORTS; portId++) {
+        ddPort *port = app.egressPort(portId);
+        if (NULL == port || !port->shedding())
+            continue;
+        for (uint8_t c = 1; c < DD_SHED_CLASSES; c++)
+            shed[c] += port->shedStats(c);
+        shedding = true;
+    }
+    for (uint8_t c = 1; shedding && c < DD_SHED_CLASSES; c++) {
+        snprintf(name, sizeof(name), "shed_class%u", c);
+        addCounter(name, shed[c]);
+    }
+    ddTrace *trace = app.trace();
+    if (NULL != trace)
+        addCounter("trace_dumps", trace->dumps());
+    ddHandoff *handoff = app.handoff();
+    addCounter("handoff_generation", handoff->generation());
+    addCounter("handoff_max_gap_ns",
+               handoff->maxGapTsc() * NS_PER_S / rte_get_tsc_hz());
+    const ddPortMap &ports = app.portMap();
+    for (ddPortMap::const_iterator it = ports.begin(); it != ports.end(); ++it) {
+        snprintf(name, sizeof(name), "port%u_lsc_events", it->second->portId());
+        addCounter(name, it->second->lscEvents());
+        snprintf(name, sizeof(name), "port%u_link_downs", it->second->portId());
+        addCounter(name, it->second->linkDowns());
+        snprintf(name, sizeof(name), "port%u_tx_link_down", it->second->portId());
+        addCounter(name, it->second->txLinkDownStats());
+        if (NULL != app.smallMbufPool()) {
+            snprintf(name, sizeof(name), "port%u_compacted", it->second->portId());
+            addCounter(name, it->second->compactStats());
+            snprintf(name, sizeof(name), "port%u_compact_no_mbuf", it->second->portId());
+            addCounter(name, it->second->compactNoMbufStats());
+        }
+        const ddRxOnlyCorePort *rxCore = dynamic_cast<const ddRxOnlyCorePort *>(it->second);
+        if (NULL != rxCore && multi) {
+            snprintf(name, sizeof(name), "%s_rewrite_rewritten", rxCore->diode()->name());
+            addCounter(name, rxCore->rewritten());
+            snprintf(name, sizeof(name), "%s_rewrite_unmatched", rxCore->diode()->name());
+            addCounter(name, rxCore->rewriteMisses());
+        } else if (NULL != rxCore) {
+            addCounter("rewrite_rewritten", rxCore->rewritten());
+            addCounter("rewrite_unmatched", rxCore->rewriteMisses());
+        }
+    }
+    // slots with traffic only, the sender table itself is not safe to
+    // read from this thread
+    for (uint32_t i = 0; i < app.nInstances(); i++) {
+        ddInstance *diode = app.diode(i);
+        const char *prefix = multi ? diode->name() : "";
+        const char *sep = multi ? "_" : "";
+        for (uint32_t slot = 0; slot < DD_SENDER_SLOTS; slot++) {
+            const struct ddSenderStats_ *sender = diode->senderStats(slot);
+            if (0 == sender->rxPkts && 0 == sender->badSId)
+                continue;
+            snprintf(name, sizeof(name), "%s%ssender%u_rx_pkts", prefix, sep, slot);
+            addCounter(name, sender->rxPkts);
+            snprintf(name, sizeof(name), "%s%ssender%u_rx_bytes", prefix, sep, slot);
+            addCounter(name, sender->rxBytes);
+            snprintf(name, sizeof(name), "%s%ssender%u_tx_pkts", prefix, sep, slot);
+            addCounter(name, sender->txPkts);
+            snprintf(name, sizeof(name), "%s%ssender%u_bad_sid", prefix, sep, slot);
+            addCounter(name, sender->badSId);
+        }
+    }
+    // the heartbeat serves the first instance only
+    for (uint32_t slot = 0; NULL != heartbeat && heartbeat->monitor() &&
+                            slot < DD_SENDER_SLOTS; slot++) {
+        const struct ddSenderStats_ *sender = app.senderStats(slot);
+        if (0 == sender->rxPkts && 0 == sender->badSId)
+            continue;
+        // as reported by the sender in its heartbeats
+        const struct ddHeartbeat::sender_ *beat = heartbeat->sender(slot);
+        snprintf(name, sizeof(name), "sender%u_uptime_s", slot);
+        addCounter(name, beat->uptimeMs / 1000);
+        snprintf(name, sizeof(name), "sender%u_hb_missing", slot);
+        addCounter(name, beat->missing);
+        snprintf(name, sizeof(name), "sender%u_hb_jitter_ns", slot);
+        addCounter(name, beat->jitterNs);
+        snprintf(name, sizeof(name), "sender%u_access_rx", slot);
+        addCounter(name, beat->accessRx);
+        snprintf(name, sizeof(name), "sender%u_tunnel_tx", slot);
+        addCounter(name, beat->tunnelTx);
+    }
+
+    _shm->updates++;
+    _shm->timestampNs = now;
+
+    rte_smp_wmb();
+    _shm->seq++;
+}
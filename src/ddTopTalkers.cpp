@@ -0,0 +1,279 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <netinet/in.h>
+#include <rte_log.h>
+#include <rte_byteorder.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_malloc.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_atomic.h>
+#include <rte_pause.h>
+#include <rte_lcore.h>
+#include <rte_hash_crc.h>
+#include "ddTopTalkers.h"
+
+
+static bool
+morePkts(const struct ddTopTalkers::flow_ &a, const struct ddTopTalkers::flow_ &b)
+{
+    return a.pkts > b.pkts;
+}
+
+static bool
+moreBytes(const struct ddTopTalkers::flow_ &a, const struct ddTopTalkers::flow_ &b)
+{
+    return a.bytes > b.bytes;
+}
+
+// add the flows of one lcore, flows seen by several lcores are summed
+static void
+merge(std::vector<struct ddTopTalkers::flow_> &flows,
+      const struct ddTopTalkers::flow_ *add, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j;
+        for (j = 0; j < flows.size(); j++) {
+            if (flows[j].hash == add[i].hash &&
+                0 == memcmp(&flows[j].key, &add[i].key, sizeof(add[i].key)))
+                break;
+        }
+        if (j == flows.size()) {
+            flows.push_back(add[i]);
+        } else {
+            flows[j].pkts += add[i].pkts;
+            flows[j].bytes += add[i].bytes;
+        }
+    }
+}
+
+ddTopTalkers::ddTopTalkers(uint32_t topN, uint32_t intervalS) :
+        _topN(RTE_MIN(topN, (uint32_t)DD_TOP_K)),
+        _intervalS(intervalS ? intervalS : DD_TOP_INTERVAL_S), _intervalTsc(0)
+{
+    bzero(_lcore, sizeof(_lcore));
+}
+
+void
+ddTopTalkers::initialize()
+{
+    std::cout << "Initializing top " << _topN << " talkers every "
+              << _intervalS << "s ..." << std::endl;
+
+    _intervalTsc = _intervalS * rte_get_tsc_hz();
+    uint32_t lcoreId;
+    RTE_LCORE_FOREACH(lcoreId) {
+        _lcore[lcoreId] = (struct lcoreState_ *)rte_zmalloc_socket("dd_top",
+                    sizeof(struct lcoreState_), RTE_CACHE_LINE_SIZE,
+                    rte_lcore_to_socket_id(lcoreId));
+        if (NULL == _lcore[lcoreId])
+            rte_exit(EXIT_FAILURE, "Cannot allocate top talkers of lcore %u\n", lcoreId);
+        _lcore[lcoreId]->rollTsc = rte_rdtsc() + _intervalTsc;
+    }
+}
+
+void
+ddTopTalkers::cleanup()
+{
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++) {
+        rte_free(_lcore[i]);
+        _lcore[i] = NULL;
+    }
+}
+
+void
+ddTopTalkers::flowKey(const struct rte_mbuf *pkt, struct flowKey_ *key)
+{
+    const struct ether_hdr *eth = rte_pktmbuf_mtod(pkt, const struct ether_hdr *);
+    uint32_t dataLen = rte_pktmbuf_data_len(pkt);
+
+    memset(key, 0, sizeof(*key));
+    if (eth->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv4) &&
+        dataLen >= sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr)) {
+        const struct ipv4_hdr *ip = reinterpret_cast<const struct ipv4_hdr *>(eth + 1);
+        uint32_t ihl = (ip->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+        key->isIp = 1;
+        key->proto = ip->next_proto_id;
+        key->ip.srcIp = ip->src_addr;
+        key->ip.dstIp = ip->dst_addr;
+
+        // ports only from the first fragment
+        if ((IPPROTO_TCP == key->proto || IPPROTO_UDP == key->proto) &&
+            0 == (ip->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK)) &&
+            dataLen >= sizeof(struct ether_hdr) + ihl + 2 * sizeof(uint16_t)) {
+            const uint16_t *ports = reinterpret_cast<const uint16_t *>(
+                        reinterpret_cast<const uint8_t *>(ip) + ihl);
+            key->ip.srcPort = ports[0];
+            key->ip.dstPort = ports[1];
+        }
+    } else {
+        ether_addr_copy(&eth->s_addr, &key->srcMac);
+    }
+}
+
+void
+ddTopTalkers::updateTop(struct topList_ *top, const struct flowKey_ &key, uint32_t hash,
+                        uint64_t pkts, uint64_t bytes, bool byBytes)
+{
+    uint64_t val = byBytes ? bytes : pkts;
+
+    // most packets stop here, below the smallest heavy hitter
+    if (DD_TOP_K == top->n) {
+        const struct flow_ *min = &top->flows[top->minIdx];
+        if (val <= (byBytes ? min->bytes : min->pkts))
+            return;
+    }
+
+    uint32_t i;
+    for (i = 0; i < top->n; i++) {
+        if (top->flows[i].hash == hash &&
+            0 == memcmp(&top->flows[i].key, &key, sizeof(key)))
+            break;
+    }
+    if (i == top->n) {
+        if (top->n < DD_TOP_K)
+            top->n++;
+        else
+            i = top->minIdx;
+        top->flows[i].key = key;
+        top->flows[i].hash = hash;
+    }
+    top->flows[i].pkts = pkts;
+    top->flows[i].bytes = bytes;
+
+    top->minIdx = 0;
+    for (uint32_t j = 1; j < top->n; j++) {
+        if ((byBytes ? top->flows[j].bytes < top->flows[top->minIdx].bytes :
+                       top->flows[j].pkts < top->flows[top->minIdx].pkts))
+            top->minIdx = j;
+    }
+}
+
+void
+ddTopTalkers::roll(struct lcoreState_ *state, uint64_t now)
+{
+    state->seq++;
+    rte_smp_wmb();
+    state->pubPkts = state->byPkts;
+    state->pubBytes = state->byBytes;
+    rte_smp_wmb();
+    state->seq++;
+
+    memset(state->pkts, 0, sizeof(state->pkts));
+    memset(state->bytes, 0, sizeof(state->bytes));
+    memset(&state->byPkts, 0, sizeof(state->byPkts));
+    memset(&state->byBytes, 0, sizeof(state->byBytes));
+    state->rollTsc = now + _intervalTsc;
+}
+
+void
+ddTopTalkers::update(struct rte_mbuf **pkts, uint32_t nPkts)
+{
+    struct lcoreState_ *state = _lcore[rte_lcore_id()];
+    if (unlikely(NULL == state))
+        return;
+
+    uint64_t now = rte_rdtsc();
+    if (unlikely(now >= state->rollTsc))
+        roll(state, now);
+
+    for (uint32_t i = 0; i < nPkts; i++) {
+        struct flowKey_ key;
+        flowKey(pkts[i], &key);
+
+        // rows are indexed by h1 + d * h2, two hashes for all of them
+        uint32_t h1 = rte_hash_crc(&key, sizeof(key), 0);
+        uint32_t h2 = rte_hash_crc(&key, sizeof(key), h1) | 1;
+        uint32_t len = rte_pktmbuf_pkt_len(pkts[i]);
+        uint64_t estPkts = UINT64_MAX, estBytes = UINT64_MAX;
+        for (uint32_t d = 0; d < DD_TOP_DEPTH; d++) {
+            uint32_t idx = (h1 + d * h2) & (DD_TOP_WIDTH - 1);
+            estPkts = RTE_MIN(estPkts, ++state->pkts[d][idx]);
+            estBytes = RTE_MIN(estBytes, state->bytes[d][idx] += len);
+        }
+        updateTop(&state->byPkts, key, h1, estPkts, estBytes, false);
+        updateTop(&state->byBytes, key, h1, estPkts, estBytes, true);
+    }
+}
+
+void
+ddTopTalkers::report(std::vector<struct flow_> &byPkts, std::vector<struct flow_> &byBytes) const
+{
+    byPkts.clear();
+    byBytes.clear();
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++) {
+        const struct lcoreState_ *state = _lcore[i];
+        if (NULL == state)
+            continue;
+
+        struct topList_ pubPkts, pubBytes;
+        uint32_t seq;
+        do {
+            while ((seq = state->seq) & 1)
+                rte_pause();
+            rte_smp_rmb();
+            pubPkts = state->pubPkts;
+            pubBytes = state->pubBytes;
+            rte_smp_rmb();
+        } while (seq != state->seq);
+
+        merge(byPkts, pubPkts.flows, pubPkts.n);
+        merge(byBytes, pubBytes.flows, pubBytes.n);
+    }
+
+    std::sort(byPkts.begin(), byPkts.end(), morePkts);
+    std::sort(byBytes.begin(), byBytes.end(), moreBytes);
+    if (byPkts.size() > _topN)
+        byPkts.resize(_topN);
+    if (byBytes.size() > _topN)
+        byBytes.resize(_topN);
+}
+
+void
+ddTopTalkers::formatKey(const struct flowKey_ &key, char *buf, uint32_t len)
+{
+    if (!key.isIp) {
+        ether_format_addr(buf, len, &key.srcMac);
+        return;
+    }
+
+    uint32_t src = rte_be_to_cpu_32(key.ip.srcIp);
+    uint32_t dst = rte_be_to_cpu_32(key.ip.dstIp);
+    const char *proto = (IPPROTO_TCP == key.proto) ? "tcp" :
+                        (IPPROTO_UDP == key.proto) ? "udp" : NULL;
+    if (NULL != proto) {
+        snprintf(buf, len, "%u.%u.%u.%u:%u > %u.%u.%u.%u:%u %s",
+                 src >> 24, (src >> 16) & 0xff, (src >> 8) & 0xff, src & 0xff,
+                 rte_be_to_cpu_16(key.ip.srcPort),
+                 dst >> 24, (dst >> 16) & 0xff, (dst >> 8) & 0xff, dst & 0xff,
+                 rte_be_to_cpu_16(key.ip.dstPort), proto);
+    } else {
+        snprintf(buf, len, "%u.%u.%u.%u > %u.%u.%u.%u proto %u",
+                 src >> 24, (src >> 16) & 0xff, (src >> 8) & 0xff, src & 0xff,
+                 dst >> 24, (dst >> 16) & 0xff, (dst >> 8) & 0xff, dst & 0xff,
+                 key.proto);
+    }
+}
@@ -0,0 +1,157 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <rte_log.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_malloc.h>
+#include "ddTrace.h"
+
+
+ddTrace *ddTrace::_tracePtr = NULL;
+
+// signals that end the process, the dump is written before their default action
+static const int crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+ddTrace::ddTrace(const char *path, uint32_t nEvents) :
+        _nEvents(rte_align32pow2(RTE_MAX(nEvents, 2U))), _dumps(0)
+{
+    _mask = _nEvents - 1;
+    snprintf(_path, sizeof(_path), "%s", path);
+    bzero(_rings, sizeof(_rings));
+    bzero(&_ctrlRing, sizeof(_ctrlRing));
+    rte_spinlock_init(&_ctrlLock);
+}
+
+void
+ddTrace::initialize()
+{
+    size_t sz = sizeof(struct ddTraceEvent_) * _nEvents;
+    uint32_t lcoreId;
+
+    // each ring on the socket of the lcore writing it
+    RTE_LCORE_FOREACH(lcoreId) {
+        _rings[lcoreId].events = (struct ddTraceEvent_ *)rte_zmalloc_socket("dd_trace",
+                                         sz, RTE_CACHE_LINE_SIZE,
+                                         rte_lcore_to_socket_id(lcoreId));
+        if (NULL == _rings[lcoreId].events)
+            rte_exit(EXIT_FAILURE, "Cannot allocate trace ring of lcore %u\n", lcoreId);
+    }
+    _ctrlRing.events = (struct ddTraceEvent_ *)rte_zmalloc("dd_trace", sz,
+                                                           RTE_CACHE_LINE_SIZE);
+    if (NULL == _ctrlRing.events)
+        rte_exit(EXIT_FAILURE, "Cannot allocate trace ring of the control threads\n");
+
+    // the dump has to find its directory, nothing can be set up on a crash
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", _path);
+    mkdir(dirname(dir), 0700);
+
+    _tracePtr = this;
+    struct sigaction sa;
+    bzero(&sa, sizeof(sa));
+    sa.sa_sigaction = ddTrace::sigHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    // once only, a crash while dumping takes the default action
+    sa.sa_flags = SA_SIGINFO | SA_RESETHAND;
+    for (uint32_t i = 0; i < RTE_DIM(crashSignals); i++)
+        sigaction(crashSignals[i], &sa, NULL);
+
+    std::cout << "Flight recorder: " << _nEvents << " events per lcore, dumped to "
+              << _path << " on SIGUSR1 or crash" << std::endl;
+}
+
+void
+ddTrace::sigHandler(int sigNumber, __attribute__((unused)) siginfo_t *info,
+                    __attribute__((unused)) void *ctx)
+{
+    if (NULL != _tracePtr)
+        _tracePtr->dump(sigNumber);
+    if (SIGUSR1 != sigNumber)
+        raise(sigNumber);
+}
+
+// write(2) all of buf, nothing else is safe in a signal handler
+static bool
+writeAll(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool
+ddTrace::dump(int sigNumber)
+{
+    // lcores keep recording while SIGUSR1 dumps, their newest events
+    // may be torn
+    int fd = open(_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    struct ddTraceFileHdr_ hdr;
+    struct timespec ts;
+    bzero(&hdr, sizeof(hdr));
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr.magic = DD_TRACE_MAGIC;
+    hdr.version = DD_TRACE_VERSION;
+    hdr.tscHz = rte_get_tsc_hz();
+    hdr.dumpTsc = rte_rdtsc();
+    hdr.dumpNs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    hdr.nEvents = _nEvents;
+    hdr.signal = sigNumber;
+    hdr.pid = getpid();
+    for (uint32_t i = 0; i < RTE_MAX_LCORE; i++)
+        hdr.nRings += (NULL != _rings[i].events);
+    hdr.nRings++;
+
+    size_t sz = sizeof(struct ddTraceEvent_) * _nEvents;
+    bool ok = writeAll(fd, &hdr, sizeof(hdr));
+    for (uint32_t i = 0; ok && i <= RTE_MAX_LCORE; i++) {
+        const struct ring_ *ring = (i < RTE_MAX_LCORE) ? &_rings[i] : &_ctrlRing;
+        if (NULL == ring->events)
+            continue;
+        struct ddTraceRingHdr_ ringHdr;
+        bzero(&ringHdr, sizeof(ringHdr));
+        ringHdr.lcoreId = (i < RTE_MAX_LCORE) ? i : DD_TRACE_CTRL_RING;
+        ringHdr.head = ring->head;
+        ok = writeAll(fd, &ringHdr, sizeof(ringHdr)) && writeAll(fd, ring->events, sz);
+    }
+    close(fd);
+    if (ok)
+        _dumps++;
+    return ok;
+}
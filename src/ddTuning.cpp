@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <rte_mempool.h>
+#include "ddPort.h"
+#include "ddTuning.h"
+#include "dataDiode.h"
+
+
+ddTuning::ddTuning() :
+        rxBurst(PKT_BURST_SZ), txBurst(PKT_BURST_SZ),
+        nbRxd(RTE_TEST_RX_DESC_DEFAULT), nbTxd(RTE_TEST_TX_DESC_DEFAULT),
+        mempoolCache(MEMPOOL_CACHE_SZ), drainUs(BURST_TX_DRAIN_US)
+{
+}
+
+bool
+ddTuning::load(const char *path)
+{
+    std::FILE* inputFile = std::fopen(path, "r");
+    if (!inputFile)
+        return false;
+
+    ddTuning t = *this;
+    bool valid = true;
+    char line[128];
+    while (NULL != fgets(line, sizeof(line), inputFile)) {
+        char key[64];
+        unsigned long val;
+        if ('#' == line[0] || '\n' == line[0])
+            continue;
+        if (2 != sscanf(line, " %63[a-z_] = %lu", key, &val)) {
+            std::cerr << "Invalid tuning line " << line << std::endl;
+            valid = false;
+            continue;
+        }
+        if (0 == strcmp(key, "rx_burst") && val >= 1 && val <= MAX_PKT_BURST) {
+            t.rxBurst = val;
+        } else if (0 == strcmp(key, "tx_burst") && val >= 1 && val <= MAX_PKT_BURST) {
+            t.txBurst = val;
+        } else if (0 == strcmp(key, "rx_desc") && val >= 64 && val <= 16384) {
+            t.nbRxd = val;
+        } else if (0 == strcmp(key, "tx_desc") && val >= 64 && val <= 16384) {
+            t.nbTxd = val;
+        } else if (0 == strcmp(key, "mempool_cache") && val <= RTE_MEMPOOL_CACHE_MAX_SIZE) {
+            t.mempoolCache = val;
+        } else if (0 == strcmp(key, "tx_drain_us") && val >= 1 && val <= 10000) {
+            t.drainUs = val;
+        } else {
+            std::cerr << "Invalid tuning " << key << " = " << val << std::endl;
+            valid = false;
+        }
+    }
+    std::fclose(inputFile);
+
+    if (valid)
+        *this = t;
+    return valid;
+}
+
+bool
+ddTuning::save(const char *path) const
+{
+    std::FILE* outputFile = std::fopen(path, "w");
+    if (!outputFile) {
+        std::cerr << "Unable to write " << path << std::endl;
+        return false;
+    }
+    fprintf(outputFile,
+            "# written by datadiode --autotune\n"
+            "rx_burst = %u\n"
+            "tx_burst = %u\n"
+            "rx_desc = %u\n"
+            "tx_desc = %u\n"
+            "mempool_cache = %u\n"
+            "tx_drain_us = %u\n",
+            rxBurst, txBurst, nbRxd, nbTxd, mempoolCache, drainUs);
+    return 0 == std::fclose(outputFile);
+}
+
+bool
+ddTuning::operator==(const ddTuning &other) const
+{
+    return rxBurst == other.rxBurst && txBurst == other.txBurst &&
+           nbRxd == other.nbRxd && nbTxd == other.nbTxd &&
+           mempoolCache == other.mempoolCache && drainUs == other.drainUs;
+}
+
+std::ostream&
+operator<<(std::ostream &os, const ddTuning &tuning)
+{
+    return os << "rx_burst " << tuning.rxBurst
+              << " tx_burst " << tuning.txBurst
+              << " rx_desc " << tuning.nbRxd
+              << " tx_desc " << tuning.nbTxd
+              << " mempool_cache " << tuning.mempoolCache
+              << " tx_drain_us " << tuning.drainUs;
+}
@@ -17,12 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 
 #include "dataDiode.h"
-#include <vector>
 #include <iostream>
-#include <iterator>
-#include <string>
-#include <fstream>
-#include <rte_ether.h>
 
 
 // Main
@@ -36,72 +31,6 @@ main (int argc, char **argv)
         return 1;
     }
 
-    // open configuration files
-    // configuration file names are hardcoded for security purposes
-    std::FILE* inputFile = std::fopen("/etc/dataDiodeApp/sid.conf", "r");
-    if (!inputFile) {
-        std::cerr << "Unable to open configuration file. Exiting..." << std::endl;
-        return -1;
-    }
-    uint32_t id, ret;
-    ret = fscanf(inputFile, "%u", &id);
-    uint16_t sId = static_cast<uint16_t>(id & 0xFFFF);
-    std::fclose(inputFile);
-
-    inputFile = std::fopen("/etc/dataDiodeApp/peerSid.conf", "r");
-    if (!inputFile) {
-        std::cerr << "Unable to open configuration file. Exiting..." << std::endl;
-        return -1;
-    }
-    ret = fscanf(inputFile, "%u", &id);
-    uint16_t peerSId = static_cast<uint16_t>(id & 0xFFFF);
-    std::fclose(inputFile);
-
-    inputFile = std::fopen("/etc/dataDiodeApp/peerMac.conf", "r");
-    if (!inputFile) {
-        std::cerr << "Unable to open configuration file. Exiting..." << std::endl;
-        return -1;
-    }
-
-    uint32_t pM[6];
-    ret = fscanf(inputFile, "%02x:%02x:%02x:%02x:%02x:%02x",
-           &pM[0], &pM[1], &pM[2], &pM[3], &pM[4], &pM[5]);
-    struct ether_addr peerMac;
-    peerMac.addr_bytes[0] = static_cast<uint8_t>(pM[0] & 0xFF);
-    peerMac.addr_bytes[1] = static_cast<uint8_t>(pM[1] & 0xFF);
-    peerMac.addr_bytes[2] = static_cast<uint8_t>(pM[2] & 0xFF);
-    peerMac.addr_bytes[3] = static_cast<uint8_t>(pM[3] & 0xFF);
-    peerMac.addr_bytes[4] = static_cast<uint8_t>(pM[4] & 0xFF);
-    peerMac.addr_bytes[5] = static_cast<uint8_t>(pM[5] & 0xFF);
-    std::fclose(inputFile);
-
-#ifdef _DD_TESTMODE_
-    inputFile = std::fopen("/etc/dataDiodeApp/peerMac1.conf", "r");
-    if (!inputFile) {
-        std::cerr << "Unable to open configuration file. Exiting..." << std::endl;
-        return -1;
-    }
-
-    pM[6];
-    ret = fscanf(inputFile, "%02x:%02x:%02x:%02x:%02x:%02x",
-           &pM[0], &pM[1], &pM[2], &pM[3], &pM[4], &pM[5]);
-    struct ether_addr peerMac1;
-    peerMac1.addr_bytes[0] = static_cast<uint8_t>(pM[0] & 0xFF);
-    peerMac1.addr_bytes[1] = static_cast<uint8_t>(pM[1] & 0xFF);
-    peerMac1.addr_bytes[2] = static_cast<uint8_t>(pM[2] & 0xFF);
-    peerMac1.addr_bytes[3] = static_cast<uint8_t>(pM[3] & 0xFF);
-    peerMac1.addr_bytes[4] = static_cast<uint8_t>(pM[4] & 0xFF);
-    peerMac1.addr_bytes[5] = static_cast<uint8_t>(pM[5] & 0xFF);
-    std::fclose(inputFile);
-#endif
-
-    // populate config parameters
-#ifndef _DD_TESTMODE_
-    app.configure(&peerMac, peerSId, sId);
-#else
-    app.configure(&peerMac, &peerMac1, peerSId, sId);
-#endif
-
     // initialize application
     app.initialize(argc, argv);
 
@@ -0,0 +1,306 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+// datadiode-stat: attaches to a running data diode application as a DPDK
+// secondary process and prints the statistics it publishes in shared
+// memory. Nothing is asked from the forwarding lcores of the application.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <csignal>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_memzone.h>
+#include <rte_ethdev.h>
+#include "ddStatsShm.h"
+
+
+enum Format {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_PROMETHEUS
+};
+
+static volatile bool forceQuit = false;
+
+static void
+sigHandler(__attribute__((unused)) int sigNumber)
+{
+    forceQuit = true;
+}
+
+static void
+usage(const char *prgName)
+{
+    std::cout << prgName << std::endl <<
+       "[EAL options] --\n"
+       "  -j: print statistics as JSON, one object per line\n"
+       "  -P: print statistics in Prometheus text format\n"
+       "  -i SECONDS: repeat every SECONDS (DEFAULT: print once)\n"
+       "  -x: include extended device statistics\n"
+       "  -h: display this help\n"
+       << std::endl;
+}
+
+static uint16_t
+nbQueues(uint16_t n)
+{
+    return RTE_MIN(n, (uint16_t)RTE_ETHDEV_QUEUE_STAT_CNTRS);
+}
+
+static void
+printText(const struct ddStatsShm_ *s, bool xstats)
+{
+    uint16_t colWidth = 12;
+
+    std::cout << "===================== Data Diode IN4004 Statistics =============================="
+              << std::endl
+              << "Mode: " << s->mode << " Uptime: " << (s->timestampNs - s->startNs) / 1000000000ULL
+              << "s Updates: " << s->updates << std::endl;
+    for (uint32_t p = 0; p < s->nPorts; p++) {
+        const struct ddStatsPort_ *sp = &s->ports[p];
+        std::cout << "---------------------------------------------------------------------------------"
+                  << std::endl
+                  << "Port " << sp->portId << " (" << sp->role << ", " << sp->name << ")"
+                  << std::endl
+                  << std::setw(colWidth) << "rx" << std::setw(colWidth) << "tx"
+                  << std::setw(colWidth) << "rx dropped" << std::setw(colWidth) << "tx dropped"
+                  << std::setw(colWidth) << "bad src" << std::setw(colWidth) << "bad dst"
+                  << std::setw(colWidth) << "bad etype" << std::setw(colWidth) << "bad sid"
+                  << std::endl
+                  << std::setw(colWidth) << sp->rx << std::setw(colWidth) << sp->tx
+                  << std::setw(colWidth) << sp->rxDropped << std::setw(colWidth) << sp->txDropped
+                  << std::setw(colWidth) << sp->badSrcAddr << std::setw(colWidth) << sp->badDstAddr
+                  << std::setw(colWidth) << sp->badEthType << std::setw(colWidth) << sp->badSId
+                  << std::endl
+                  << std::fixed << std::setprecision(0)
+                  << "  rx " << sp->rxRate.pps << " pps " << sp->rxRate.bps / 1e6 << " Mbps"
+                  << " (peak " << sp->rxRate.ppsPeak << " pps " << sp->rxRate.bpsPeak / 1e6 << " Mbps)"
+                  << std::endl
+                  << "  tx " << sp->txRate.pps << " pps " << sp->txRate.bps / 1e6 << " Mbps"
+                  << " (peak " << sp->txRate.ppsPeak << " pps " << sp->txRate.bpsPeak / 1e6 << " Mbps)"
+                  << std::endl
+                  << "  imissed " << sp->eth.imissed << " ierrors " << sp->eth.ierrors
+                  << " oerrors " << sp->eth.oerrors << " rx_nombuf " << sp->eth.rx_nombuf
+                  << std::endl;
+        for (uint16_t q = 0; q < nbQueues(sp->nRxQueues); q++)
+            std::cout << "  rxq " << q << ": packets " << sp->eth.q_ipackets[q]
+                      << " bytes " << sp->eth.q_ibytes[q]
+                      << " errors " << sp->eth.q_errors[q] << std::endl;
+        for (uint16_t q = 0; q < nbQueues(sp->nTxQueues); q++)
+            std::cout << "  txq " << q << ": packets " << sp->eth.q_opackets[q]
+                      << " bytes " << sp->eth.q_obytes[q] << std::endl;
+        for (uint32_t i = 0; xstats && i < sp->nXstats; i++)
+            std::cout << "  " << sp->xstats[i].name << ": " << sp->xstats[i].value << std::endl;
+    }
+    if (s->nCounters)
+        std::cout << "---------------------------------------------------------------------------------"
+                  << std::endl;
+    for (uint32_t i = 0; i < s->nCounters; i++)
+        std::cout << "  " << s->counters[i].name << ": " << s->counters[i].value << std::endl;
+    std::cout << "================================================================================="
+              << std::endl;
+}
+
+static void
+printJson(const struct ddStatsShm_ *s, bool xstats)
+{
+    std::cout << std::fixed << std::setprecision(1)
+              << "{\"timestamp_ns\":" << s->timestampNs
+              << ",\"start_ns\":" << s->startNs
+              << ",\"mode\":\"" << s->mode << "\""
+              << ",\"ports\":[";
+    for (uint32_t p = 0; p < s->nPorts; p++) {
+        const struct ddStatsPort_ *sp = &s->ports[p];
+        std::cout << (p ? "," : "")
+                  << "{\"port\":" << sp->portId
+                  << ",\"name\":\"" << sp->name << "\""
+                  << ",\"role\":\"" << sp->role << "\""
+                  << ",\"rx\":" << sp->rx << ",\"tx\":" << sp->tx
+                  << ",\"rx_dropped\":" << sp->rxDropped << ",\"tx_dropped\":" << sp->txDropped
+                  << ",\"bad_src_addr\":" << sp->badSrcAddr << ",\"bad_dst_addr\":" << sp->badDstAddr
+                  << ",\"bad_eth_type\":" << sp->badEthType << ",\"bad_sid\":" << sp->badSId
+                  << ",\"rx_pps\":" << sp->rxRate.pps << ",\"rx_bps\":" << sp->rxRate.bps
+                  << ",\"rx_pps_peak\":" << sp->rxRate.ppsPeak << ",\"rx_bps_peak\":" << sp->rxRate.bpsPeak
+                  << ",\"tx_pps\":" << sp->txRate.pps << ",\"tx_bps\":" << sp->txRate.bps
+                  << ",\"tx_pps_peak\":" << sp->txRate.ppsPeak << ",\"tx_bps_peak\":" << sp->txRate.bpsPeak
+                  << ",\"ipackets\":" << sp->eth.ipackets << ",\"opackets\":" << sp->eth.opackets
+                  << ",\"ibytes\":" << sp->eth.ibytes << ",\"obytes\":" << sp->eth.obytes
+                  << ",\"imissed\":" << sp->eth.imissed << ",\"ierrors\":" << sp->eth.ierrors
+                  << ",\"oerrors\":" << sp->eth.oerrors << ",\"rx_nombuf\":" << sp->eth.rx_nombuf
+                  << ",\"rx_queues\":[";
+        for (uint16_t q = 0; q < nbQueues(sp->nRxQueues); q++)
+            std::cout << (q ? "," : "") << "{\"packets\":" << sp->eth.q_ipackets[q]
+                      << ",\"bytes\":" << sp->eth.q_ibytes[q]
+                      << ",\"errors\":" << sp->eth.q_errors[q] << "}";
+        std::cout << "],\"tx_queues\":[";
+        for (uint16_t q = 0; q < nbQueues(sp->nTxQueues); q++)
+            std::cout << (q ? "," : "") << "{\"packets\":" << sp->eth.q_opackets[q]
+                      << ",\"bytes\":" << sp->eth.q_obytes[q] << "}";
+        std::cout << "]";
+        if (xstats) {
+            std::cout << ",\"xstats\":{";
+            for (uint32_t i = 0; i < sp->nXstats; i++)
+                std::cout << (i ? "," : "") << "\"" << sp->xstats[i].name << "\":"
+                          << sp->xstats[i].value;
+            std::cout << "}";
+        }
+        std::cout << "}";
+    }
+    std::cout << "],\"counters\":{";
+    for (uint32_t i = 0; i < s->nCounters; i++)
+        std::cout << (i ? "," : "") << "\"" << s->counters[i].name << "\":" << s->counters[i].value;
+    std::cout << "}}" << std::endl;
+}
+
+static void
+printMetric(const char *name, const char *labels, double value)
+{
+    std::cout << "datadiode_" << name << "{" << labels << "} " << value << std::endl;
+}
+
+static void
+printPrometheus(const struct ddStatsShm_ *s, bool xstats)
+{
+    char labels[160];
+    std::cout << std::fixed << std::setprecision(0);
+    for (uint32_t p = 0; p < s->nPorts; p++) {
+        const struct ddStatsPort_ *sp = &s->ports[p];
+        snprintf(labels, sizeof(labels), "port=\"%u\",role=\"%s\"", sp->portId, sp->role);
+        printMetric("rx_packets_total", labels, sp->rx);
+        printMetric("tx_packets_total", labels, sp->tx);
+        printMetric("rx_dropped_total", labels, sp->rxDropped);
+        printMetric("tx_dropped_total", labels, sp->txDropped);
+        printMetric("bad_src_addr_total", labels, sp->badSrcAddr);
+        printMetric("bad_dst_addr_total", labels, sp->badDstAddr);
+        printMetric("bad_eth_type_total", labels, sp->badEthType);
+        printMetric("bad_sid_total", labels, sp->badSId);
+        printMetric("rx_pps", labels, sp->rxRate.pps);
+        printMetric("rx_bps", labels, sp->rxRate.bps);
+        printMetric("rx_pps_peak", labels, sp->rxRate.ppsPeak);
+        printMetric("rx_bps_peak", labels, sp->rxRate.bpsPeak);
+        printMetric("tx_pps", labels, sp->txRate.pps);
+        printMetric("tx_bps", labels, sp->txRate.bps);
+        printMetric("tx_pps_peak", labels, sp->txRate.ppsPeak);
+        printMetric("tx_bps_peak", labels, sp->txRate.bpsPeak);
+        printMetric("eth_imissed_total", labels, sp->eth.imissed);
+        printMetric("eth_ierrors_total", labels, sp->eth.ierrors);
+        printMetric("eth_oerrors_total", labels, sp->eth.oerrors);
+        printMetric("eth_rx_nombuf_total", labels, sp->eth.rx_nombuf);
+        for (uint16_t q = 0; q < nbQueues(sp->nRxQueues); q++) {
+            snprintf(labels, sizeof(labels), "port=\"%u\",role=\"%s\",queue=\"%u\"",
+                     sp->portId, sp->role, q);
+            printMetric("eth_rxq_packets_total", labels, sp->eth.q_ipackets[q]);
+            printMetric("eth_rxq_bytes_total", labels, sp->eth.q_ibytes[q]);
+            printMetric("eth_rxq_errors_total", labels, sp->eth.q_errors[q]);
+        }
+        for (uint16_t q = 0; q < nbQueues(sp->nTxQueues); q++) {
+            snprintf(labels, sizeof(labels), "port=\"%u\",role=\"%s\",queue=\"%u\"",
+                     sp->portId, sp->role, q);
+            printMetric("eth_txq_packets_total", labels, sp->eth.q_opackets[q]);
+            printMetric("eth_txq_bytes_total", labels, sp->eth.q_obytes[q]);
+        }
+        for (uint32_t i = 0; xstats && i < sp->nXstats; i++) {
+            snprintf(labels, sizeof(labels), "port=\"%u\",role=\"%s\",name=\"%s\"",
+                     sp->portId, sp->role, sp->xstats[i].name);
+            printMetric("eth_xstat", labels, sp->xstats[i].value);
+        }
+    }
+    for (uint32_t i = 0; i < s->nCounters; i++) {
+        snprintf(labels, sizeof(labels), "name=\"%s\"", s->counters[i].name);
+        printMetric("counter", labels, s->counters[i].value);
+    }
+    std::cout << std::endl;
+}
+
+int
+main(int argc, char **argv)
+{
+    // always attach to the running application as secondary process
+    std::vector<char *> ealArgs(argv, argv + argc);
+    char procType[] = "--proc-type=secondary";
+    ealArgs.insert(ealArgs.begin() + 1, procType);
+    ealArgs.push_back(NULL);
+
+    int ret = rte_eal_init(argc + 1, &ealArgs[0]);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Cannot attach to the data diode application\n");
+    argc = argc + 1 - ret;
+    argv = &ealArgs[ret];
+
+    Format format = FORMAT_TEXT;
+    uint32_t interval = 0;
+    bool xstats = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "jPi:xh")) != EOF) {
+        switch (opt) {
+        case 'j':
+            format = FORMAT_JSON;
+            break;
+        case 'P':
+            format = FORMAT_PROMETHEUS;
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 10);
+            break;
+        case 'x':
+            xstats = true;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            rte_exit(EXIT_SUCCESS, "Exiting...\n");
+        }
+    }
+
+    const struct rte_memzone *mz = rte_memzone_lookup(DD_STATS_MZ_NAME);
+    if (NULL == mz)
+        rte_exit(EXIT_FAILURE, "No statistics published, is the application running?\n");
+
+    const volatile struct ddStatsShm_ *shm =
+                reinterpret_cast<const volatile struct ddStatsShm_ *>(mz->addr);
+    if (DD_STATS_MAGIC != shm->magic || DD_STATS_VERSION != shm->version)
+        rte_exit(EXIT_FAILURE, "Statistics version %u not supported, expected %u\n",
+                 shm->version, DD_STATS_VERSION);
+
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+
+    struct ddStatsShm_ *copy = new struct ddStatsShm_;
+    do {
+        if (!ddStatsShmRead(shm, copy)) {
+            std::cerr << "Statistics kept changing while reading, retrying" << std::endl;
+        } else if (FORMAT_JSON == format) {
+            printJson(copy, xstats);
+        } else if (FORMAT_PROMETHEUS == format) {
+            printPrometheus(copy, xstats);
+        } else {
+            printText(copy, xstats);
+        }
+        std::cout.flush();
+        for (uint32_t i = 0; i < interval * 10 && !forceQuit; i++)
+            usleep(100000);
+    } while (interval && !forceQuit);
+
+    delete copy;
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+Copyright (C) 2020 Pankaj Malviya
+
+This file is part of data diode application "IN4004"
+
+This is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+// datadiode-trace: turns a flight recorder dump of the data diode
+// application into a timeline, the events of all lcores merged by time.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <time.h>
+#include "ddTraceDump.h"
+
+
+struct event_ {
+    uint16_t  lcoreId;
+    struct ddTraceEvent_ ev;
+};
+
+static bool
+olderThan(const struct event_ &a, const struct event_ &b)
+{
+    return a.ev.tsc < b.ev.tsc;
+}
+
+static void
+usage(const char *prgName)
+{
+    std::cout << prgName << " [options] FILE" << std::endl <<
+       "  -l LCORE: events of lcore LCORE only (ctrl for the control threads)\n"
+       "  -p PORT: events of port PORT only\n"
+       "  -n N: the last N events only\n"
+       "  -e: leave out the RX and TX bursts\n"
+       "  -h: display this help\n"
+       << std::endl;
+}
+
+// wall clock of an event, from the TSC and wall clock of the dump
+static void
+printTime(const struct ddTraceFileHdr_ *hdr, uint64_t tsc)
+{
+    int64_t agoNs = (int64_t)((double)(int64_t)(hdr->dumpTsc - tsc) * 1e9 / hdr->tscHz);
+    uint64_t ns = hdr->dumpNs - agoNs;
+    time_t sec = ns / 1000000000ULL;
+    struct tm tm;
+    char buf[32];
+    localtime_r(&sec, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%06lu %12.3fms", buf, (unsigned long)(ns % 1000000000ULL / 1000),
+           -agoNs / 1e6);
+}
+
+static void
+printEvent(const struct ddTraceFileHdr_ *hdr, const struct event_ *e)
+{
+    const struct ddTraceEvent_ *ev = &e->ev;
+    printTime(hdr, ev->tsc);
+    if (DD_TRACE_CTRL_RING == e->lcoreId)
+        printf("  %-6s", "ctrl");
+    else
+        printf("  %-6u", e->lcoreId);
+    if (DD_TRACE_CONFIG_SWAP == ev->type)
+        printf(" %-5s", "-");
+    else
+        printf(" %-5u", ev->portId);
+    printf(" %-8s", ddTraceTypeName(ev->type));
+
+    switch (ev->type) {
+    case DD_TRACE_DROP:
+        printf(" %u %s\n", ev->value, ddTraceDropName(ev->reason));
+        break;
+    case DD_TRACE_NO_MBUF:
+        printf(" %u from the %s pool\n", ev->value, ddTracePoolName(ev->reason));
+        break;
+    case DD_TRACE_CONFIG_SWAP:
+        printf(" generation %u\n", ev->value);
+        break;
+    case DD_TRACE_LINK:
+        printf(" %s\n", ev->value ? "up" : "down");
+        break;
+    default:
+        printf(" %u\n", ev->value);
+        break;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int32_t lcoreFilter = -1;
+    int32_t portFilter = -1;
+    uint64_t last = 0;
+    bool noBursts = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:p:n:eh")) != EOF) {
+        switch (opt) {
+        case 'l':
+            lcoreFilter = (0 == strcmp(optarg, "ctrl")) ? DD_TRACE_CTRL_RING : atoi(optarg);
+            break;
+        case 'p':
+            portFilter = atoi(optarg);
+            break;
+        case 'n':
+            last = strtoull(optarg, NULL, 10);
+            break;
+        case 'e':
+            noBursts = true;
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[optind], std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[optind] << std::endl;
+        return EXIT_FAILURE;
+    }
+    struct ddTraceFileHdr_ hdr;
+    if (!in.read((char *)&hdr, sizeof(hdr)) || DD_TRACE_MAGIC != hdr.magic) {
+        std::cerr << argv[optind] << " is not a flight recorder dump" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (DD_TRACE_VERSION != hdr.version || 0 == hdr.tscHz ||
+        0 == hdr.nEvents || (hdr.nEvents & (hdr.nEvents - 1))) {
+        std::cerr << "Dump version " << hdr.version << " not supported, expected "
+                  << DD_TRACE_VERSION << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "=== Data Diode IN4004 Flight Recorder ===" << std::endl
+              << "Process " << hdr.pid << " dumped on " << strsignal(hdr.signal) << " at ";
+    std::cout.flush();
+    printTime(&hdr, hdr.dumpTsc);
+    printf("\nTSC %lu Hz, %u rings of %u events\n\n", (unsigned long)hdr.tscHz,
+           hdr.nRings, hdr.nEvents);
+
+    // the ring holds the newest nEvents, the oldest one where head points
+    std::vector<struct event_> events;
+    std::vector<struct ddTraceEvent_> ring(hdr.nEvents);
+    printf("%-6s %10s %10s %14s\n", "Lcore", "Recorded", "Kept", "Covers ms");
+    for (uint32_t r = 0; r < hdr.nRings; r++) {
+        struct ddTraceRingHdr_ ringHdr;
+        if (!in.read((char *)&ringHdr, sizeof(ringHdr)) ||
+            !in.read((char *)&ring[0], sizeof(struct ddTraceEvent_) * hdr.nEvents)) {
+            std::cerr << "Dump is truncated in ring " << r << std::endl;
+            return EXIT_FAILURE;
+        }
+        uint64_t kept = std::min(ringHdr.head, (uint64_t)hdr.nEvents);
+        uint64_t first = ringHdr.head - kept;
+        for (uint64_t i = first; i < ringHdr.head; i++) {
+            struct event_ e;
+            e.lcoreId = ringHdr.lcoreId;
+            e.ev = ring[i & (hdr.nEvents - 1)];
+            events.push_back(e);
+        }
+        double coversMs = 0;
+        if (kept)
+            coversMs = (double)(hdr.dumpTsc - ring[first & (hdr.nEvents - 1)].tsc) * 1e3 / hdr.tscHz;
+        if (DD_TRACE_CTRL_RING == ringHdr.lcoreId)
+            printf("%-6s", "ctrl");
+        else
+            printf("%-6u", ringHdr.lcoreId);
+        printf(" %10lu %10lu %14.3f\n", (unsigned long)ringHdr.head,
+               (unsigned long)kept, coversMs);
+    }
+    std::cout << std::endl;
+
+    // lcores that were quiet cover a longer time, the merged timeline
+    // is complete only from the latest first event of the busy ones
+    std::stable_sort(events.begin(), events.end(), olderThan);
+
+    std::vector<const struct event_ *> shown;
+    for (size_t i = 0; i < events.size(); i++) {
+        const struct event_ *e = &events[i];
+        if (lcoreFilter >= 0 && e->lcoreId != lcoreFilter)
+            continue;
+        if (portFilter >= 0 && (DD_TRACE_CONFIG_SWAP == e->ev.type || e->ev.portId != portFilter))
+            continue;
+        if (noBursts && (DD_TRACE_RX_BURST == e->ev.type || DD_TRACE_TX_FLUSH == e->ev.type))
+            continue;
+        shown.push_back(e);
+    }
+    size_t from = (last && last < shown.size()) ? shown.size() - last : 0;
+
+    printf("%-26s %14s  %-6s %-5s %-8s %s\n", "Time", "To dump", "Lcore", "Port", "Event", "Detail");
+    for (size_t i = from; i < shown.size(); i++)
+        printEvent(&hdr, shown[i]);
+    return EXIT_SUCCESS;
+}